@@ -0,0 +1,130 @@
+// backpressure_bench.cc: producing into a small librdkafka queue with each
+// BackpressurePolicy, compared with retrying poll(1000) on QUEUE_FULL like
+// examples/producer.cc used to do.
+#include "bench_util.hpp"
+
+#include <stdlib.h>
+
+using namespace rdkafka;
+
+static ClientMetrics* metrics = nullptr;
+
+static void dr_msg_cb(rd_kafka_t*, const rd_kafka_message_t* rkmessage,
+                      void*) {
+  metrics->recordDelivery(rkmessage);
+}
+
+enum class Mode { kPollRetry, kFail, kBlock, kSpinThenPark, kPurgeQueue };
+
+static void runCase(const char* name, Mode mode, const char* bootstraps,
+                    long num_message, int queue_size) {
+  GlobalConf conf;
+  conf.put("bootstrap.servers", bootstraps);
+  conf.put("queue.buffering.max.messages", std::to_string(queue_size).data());
+  conf.put("linger.ms", "5");
+  conf.setDeliveryReportCallback(dr_msg_cb);
+
+  char errstr[512];
+  Producer producer(std::move(conf), errstr);
+  if (producer.isNull())
+    error::Exit("[ERROR] Create producer failed: %s\n", errstr);
+  Topic topic(producer.get(), "backpressure_bench");
+  metrics = &producer.metrics();
+
+  BackpressureOptions options;
+  switch (mode) {
+    case Mode::kPollRetry:
+      break;
+    case Mode::kFail:
+      options.policy = BackpressurePolicy::kFail;
+      break;
+    case Mode::kBlock:
+      options.policy = BackpressurePolicy::kBlock;
+      break;
+    case Mode::kSpinThenPark:
+      options.policy = BackpressurePolicy::kSpinThenPark;
+      break;
+    case Mode::kPurgeQueue:
+      options.policy = BackpressurePolicy::kPurgeQueue;
+      break;
+  }
+  if (mode != Mode::kPollRetry) producer.setBackpressure(options);
+
+  // stalls of the poll(1000) loop, policies record their own in metrics
+  Histogram poll_retry_stalls;
+
+  char payload[100] = {};
+  auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < num_message; i++) {
+    if (producer.produce(topic, payload, sizeof(payload))) {
+      producer.poll(0);
+      continue;
+    }
+    if (rd_kafka_last_error() != RD_KAFKA_RESP_ERR__QUEUE_FULL)
+      error::Exit("[ERROR] produce failed: %s\n",
+                  rd_kafka_err2str(rd_kafka_last_error()));
+
+    auto stall_start = std::chrono::steady_clock::now();
+    do {
+      if (mode == Mode::kFail) {
+        producer.poll(0);
+        producer.retryToken().wait();
+      } else {
+        producer.poll(1000);
+      }
+    } while (!producer.produce(topic, payload, sizeof(payload)));
+    auto stall = std::chrono::steady_clock::now() - stall_start;
+    poll_retry_stalls.record(
+        std::chrono::duration_cast<std::chrono::microseconds>(stall).count());
+  }
+  while (!producer.flush(1000)) {
+  }
+  double seconds = bench::secondsSince(start);
+
+  auto snapshot = metrics->snapshot();
+  auto stalls = snapshot.get(ClientMetrics::HistogramType::kBackpressureWaitUs);
+  if (mode == Mode::kPollRetry || mode == Mode::kFail)
+    stalls = poll_retry_stalls;
+  printf(
+      "%-14s %9.0f msgs/s, %6llu stalls p50 %6llu us p99 %6llu us "
+      "max %7llu us, %6llu dropped\n",
+      name, num_message / seconds,
+      static_cast<unsigned long long>(stalls.count()),
+      static_cast<unsigned long long>(stalls.percentile(0.5)),
+      static_cast<unsigned long long>(stalls.percentile(0.99)),
+      static_cast<unsigned long long>(stalls.max()),
+      static_cast<unsigned long long>(
+          snapshot.get(ClientMetrics::Counter::kDeliveryErrors)));
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 &&
+      (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+    fprintf(stderr,
+            "Usage: %s [message-count] [queue-size]\n"
+            "  default: 200000 1000\n",
+            argv[0]);
+    exit(1);
+  }
+  long num_message = (argc > 1) ? atol(argv[1]) : 200000;
+  int queue_size = (argc > 2) ? atoi(argv[2]) : 1000;
+  if (num_message <= 0 || queue_size <= 0)
+    error::Exit("[ERROR] invalid arguments\n");
+
+  bench::MockClusterProducer cluster;
+  cluster.createTopic("backpressure_bench", 4);
+  std::string bootstraps = cluster.bootstraps();
+
+  printf("%ld messages, queue.buffering.max.messages=%d\n", num_message,
+         queue_size);
+  runCase("poll(1000)", Mode::kPollRetry, bootstraps.data(), num_message,
+          queue_size);
+  runCase("kFail+token", Mode::kFail, bootstraps.data(), num_message,
+          queue_size);
+  runCase("kBlock", Mode::kBlock, bootstraps.data(), num_message, queue_size);
+  runCase("kSpinThenPark", Mode::kSpinThenPark, bootstraps.data(),
+          num_message, queue_size);
+  runCase("kPurgeQueue", Mode::kPurgeQueue, bootstraps.data(), num_message,
+          queue_size);
+  return 0;
+}
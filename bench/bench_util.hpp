@@ -0,0 +1,86 @@
+// bench_util.hpp: shared helpers of benchmarks on librdkafka's mock cluster
+#pragma once
+
+#include "rdkafka_classes.hpp"
+#include "rdkafka_mock.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+using namespace rdkafka;
+
+inline double secondsSince(std::chrono::steady_clock::time_point start) {
+  auto now = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(now - start).count();
+}
+
+// Producer with its own mock cluster, consumers join it with bootstraps()
+class MockClusterProducer {
+ public:
+  MockClusterProducer(int num_brokers = 1) {
+    GlobalConf conf;
+    conf.put("test.mock.num.brokers", std::to_string(num_brokers).data());
+    conf.put("queue.buffering.max.messages", "1000000");
+
+    char errstr[512];
+    producer_.reset(new Producer(std::move(conf), errstr));
+    if (producer_->isNull())
+      error::Exit("[ERROR] Create producer failed: %s\n", errstr);
+    mcluster_ = rd_kafka_handle_mock_cluster(producer_->get());
+  }
+
+  const Producer& producer() const noexcept { return *producer_; }
+
+  const char* bootstraps() const noexcept {
+    return rd_kafka_mock_cluster_bootstraps(mcluster_);
+  }
+
+  rd_kafka_mock_cluster_t* mockCluster() const noexcept { return mcluster_; }
+
+  void createTopic(const char* topic_name, int partition_count) const {
+    error::checkRespError(
+        rd_kafka_mock_topic_create(mcluster_, topic_name, partition_count, 1),
+        "rd_kafka_mock_topic_create");
+  }
+
+  // produce num_message messages of payload_size bytes and wait for delivery
+  void fillTopic(const char* topic_name, long num_message,
+                 size_t payload_size) const {
+    Topic topic(producer_->get(), topic_name);
+    std::vector<char> payload(payload_size, 'x');
+
+    constexpr int kBatchSize = 1000;
+    ProduceBatch batch(kBatchSize);
+    long num_left = num_message;
+    while (num_left > 0) {
+      batch.clear();
+      for (int i = 0; i < kBatchSize && i < num_left; i++)
+        batch.add(payload.data(), payload.size());
+
+      num_left -=
+          producer_->produceBatch(topic, batch, PayloadOwnership::kBorrow);
+      producer_->poll(1);
+    }
+    while (!producer_->flush(1000)) {
+    }
+  }
+
+ private:
+  std::unique_ptr<Producer> producer_;
+  rd_kafka_mock_cluster_t* mcluster_;
+};
+
+// consumer config reading topic from the beginning in its own group
+inline GlobalConf consumerConf(const char* bootstraps, const char* group) {
+  GlobalConf conf;
+  conf.put("bootstrap.servers", bootstraps);
+  conf.put("group.id", group);
+  conf.put("auto.offset.reset", "earliest");
+  conf.put("enable.auto.commit", "false");
+  return conf;
+}
+
+}  // namespace bench
@@ -0,0 +1,121 @@
+// commit_bench.cc: commit requests of a ParallelConsumer committing every
+// message asynchronously with rd_kafka_commit_message() compared with
+// OffsetTracker's coalesced commits. Both must end with every partition
+// committed at its high watermark.
+#include "bench_util.hpp"
+#include "rdkafka_offset_tracker.hpp"
+#include "rdkafka_parallel_consumer.hpp"
+
+#include <stdlib.h>
+
+#include <atomic>
+
+using namespace rdkafka;
+
+static const char* kTopicName = "commit_bench";
+
+// partitions committed at their high watermark
+static int countCommitted(const char* bootstraps, const char* group,
+                          int partition_count) {
+  char errstr[512];
+  Consumer consumer(bench::consumerConf(bootstraps, group), errstr);
+  if (consumer.isNull())
+    error::Exit("[ERROR] Create consumer failed: %s\n", errstr);
+  PointerHolder<rd_kafka_topic_partition_list_t> list(
+      rd_kafka_topic_partition_list_new(partition_count));
+  for (int32_t p = 0; p < partition_count; p++)
+    rd_kafka_topic_partition_list_add(list.get(), kTopicName, p);
+  error::checkRespError(rd_kafka_committed(consumer.get(), list.get(), 10000),
+                        "rd_kafka_committed");
+  int num_committed = 0;
+  for (int i = 0; i < list.get()->cnt; i++) {
+    const auto& elem = list.get()->elems[i];
+    int64_t low, high;
+    error::checkRespError(
+        rd_kafka_query_watermark_offsets(consumer.get(), kTopicName,
+                                         elem.partition, &low, &high, 10000),
+        "rd_kafka_query_watermark_offsets");
+    if (elem.offset == high) ++num_committed;
+  }
+  return num_committed;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 &&
+      (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+    fprintf(stderr,
+            "Usage: %s [message-count] [partition-count] [workers]\n"
+            "  default: 100000 8 4\n",
+            argv[0]);
+    exit(1);
+  }
+  long num_message = (argc > 1) ? atol(argv[1]) : 100000;
+  int partition_count = (argc > 2) ? atoi(argv[2]) : 8;
+  size_t num_workers = (argc > 3) ? atol(argv[3]) : 4;
+  if (num_message <= 0 || partition_count <= 0)
+    error::Exit("[ERROR] invalid arguments\n");
+
+  bench::MockClusterProducer producer;
+  producer.createTopic(kTopicName, partition_count);
+  producer.fillTopic(kTopicName, num_message, 100);
+  std::string bootstraps = producer.bootstraps();
+
+  printf("%ld messages, %d partitions, %zu workers\n", num_message,
+         partition_count, num_workers);
+  for (bool use_tracker : {false, true}) {
+    std::atomic<long> num_consumed(0);
+    std::atomic<long> num_commits(0);
+    std::unique_ptr<OffsetTracker> tracker;
+    rd_kafka_t* rk = nullptr;
+
+    auto handler = [&](const MessageView& message) {
+      if (message.hasError()) return;
+      if (use_tracker) {
+        tracker->track(message);
+        tracker->complete(message);
+      } else {
+        rd_kafka_commit_message(rk, message.get(), 1);
+        ++num_commits;
+      }
+      ++num_consumed;
+    };
+
+    std::string group = use_tracker ? "commit-bench-tracker"
+                                    : "commit-bench-message";
+    char errstr[512];
+    ParallelConsumer consumer(
+        bench::consumerConf(bootstraps.data(), group.data()), num_workers,
+        handler, errstr);
+    if (consumer.isNull())
+      error::Exit("[ERROR] Create consumer failed: %s\n", errstr);
+    rk = consumer.get();
+    tracker.reset(new OffsetTracker(rk));
+    consumer.setAssignHandler(
+        [&](rd_kafka_t*, rd_kafka_topic_partition_list_t* partitions) {
+          tracker->assign(partitions);
+        });
+    consumer.setRevokeHandler(
+        [&](rd_kafka_t*, rd_kafka_topic_partition_list_t* partitions) {
+          if (use_tracker) tracker->revoke(partitions);
+        });
+    error::checkRespError(consumer.subscribe({kTopicName}), "subscribe");
+
+    auto start = std::chrono::steady_clock::now();
+    while (num_consumed < num_message) {
+      consumer.poll(10);
+      if (use_tracker) tracker->poll();
+    }
+    double secs = bench::secondsSince(start);
+    consumer.close();
+    if (use_tracker) num_commits = tracker->counts().commits;
+
+    int num_committed =
+        countCommitted(bootstraps.data(), group.data(), partition_count);
+    printf("%-12s %10.0f msgs/s %8ld commit requests, %d/%d partitions "
+           "committed\n",
+           use_tracker ? "tracker" : "per message", num_message / secs,
+           num_commits.load(), num_committed, partition_count);
+    tracker.reset();
+  }
+  return 0;
+}
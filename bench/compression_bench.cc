@@ -0,0 +1,106 @@
+// compression_bench.cc: produce compressible JSON-like payloads to the mock
+// cluster until they're delivered, with librdkafka's compression.codec=gzip,
+// which compresses message sets on the broker thread, and with
+// CompressingProducer compressing each payload on 1 to max-workers threads.
+#include "bench_util.hpp"
+#include "rdkafka_compression.hpp"
+
+#include <stdlib.h>
+
+using namespace rdkafka;
+
+static const char* kTopic = "compression_bench";
+
+static Producer* newProducer(const char* bootstraps, const char* codec) {
+  GlobalConf conf;
+  conf.put("bootstrap.servers", bootstraps);
+  conf.put("queue.buffering.max.messages", "100000");
+  conf.put("compression.codec", codec);
+  char errstr[512];
+  auto producer = new Producer(std::move(conf), errstr);
+  if (producer->isNull())
+    error::Exit("[ERROR] Create producer failed: %s\n", errstr);
+  return producer;
+}
+
+// a few distinct records repeated up to size bytes
+static std::vector<std::string> newPayloads(size_t size) {
+  std::vector<std::string> payloads(64);
+  for (size_t i = 0; i < payloads.size(); i++) {
+    auto& s = payloads[i];
+    while (s.size() < size)
+      s += "{\"id\": " + std::to_string(s.size() * 31 + i) +
+           ", \"name\": \"user-" + std::to_string(i) +
+           "\", \"active\": true, \"score\": " + std::to_string(s.size() % 97) +
+           "}";
+    s.resize(size);
+  }
+  return payloads;
+}
+
+static void report(const char* mode, long num_message, size_t payload_size,
+                   double secs) {
+  printf("%-10s %12.0f %10.1f\n", mode, num_message / secs,
+         num_message * payload_size / secs / 1e6);
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 &&
+      (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+    fprintf(stderr,
+            "Usage: %s [message-count] [payload-size] [max-workers]\n"
+            "  default: 20000 8192 4\n",
+            argv[0]);
+    exit(1);
+  }
+  long num_message = (argc > 1) ? atol(argv[1]) : 20000;
+  size_t payload_size = (argc > 2) ? atol(argv[2]) : 8192;
+  int max_workers = (argc > 3) ? atoi(argv[3]) : 4;
+  if (num_message <= 0 || payload_size == 0 || max_workers <= 0)
+    error::Exit("[ERROR] invalid arguments\n");
+
+  bench::MockClusterProducer cluster;
+  cluster.createTopic(kTopic, 1);
+  auto payloads = newPayloads(payload_size);
+  printf("%ld messages of %zu bytes\n", num_message, payload_size);
+  printf("%-10s %12s %10s\n", "mode", "msg/s", "MB/s");
+
+  {
+    std::unique_ptr<Producer> producer(
+        newProducer(cluster.bootstraps(), "gzip"));
+    Topic topic(producer->get(), kTopic);
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < num_message; i++) {
+      const auto& payload = payloads[i % payloads.size()];
+      while (!producer->produceCopy(topic, payload)) producer->poll(1);
+      producer->poll(0);
+    }
+    while (!producer->flush(1000)) {
+    }
+    report("gzip", num_message, payload_size, bench::secondsSince(start));
+  }
+
+  for (int num_workers = 1; num_workers <= max_workers; num_workers *= 2) {
+    std::unique_ptr<Producer> producer(
+        newProducer(cluster.bootstraps(), "none"));
+    Topic topic(producer->get(), kTopic);
+    CompressionOptions options;
+    options.num_workers = num_workers;
+    CompressingProducer compressing(*producer, options);
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < num_message; i++) {
+      compressing.produce(topic, payloads[i % payloads.size()]);
+      producer->poll(0);
+    }
+    compressing.drain();
+    while (!producer->flush(1000)) {
+    }
+    double secs = bench::secondsSince(start);
+    auto counts = compressing.counts();
+    std::string mode = "workers=" + std::to_string(num_workers);
+    report(mode.data(), num_message, payload_size, secs);
+    printf("%-10s ratio %.3f\n", "",
+           static_cast<double>(counts.bytes_out) / counts.bytes_in);
+  }
+  return 0;
+}
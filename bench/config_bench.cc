@@ -0,0 +1,227 @@
+// config_bench.cc: time to build the configs of many clients from a large
+// config file, ConfigSet compared with the std::getline() based reader that
+// readConfig() used before, and the allocations it takes per client. Then
+// kafka_client::ConfigSnapshot compared with validating every key again, and
+// typed Set()/Get() of kafka_client::keys compared with strings.
+#include "bench_util.hpp"
+#include "kafka_client/config.h"
+#include "rdkafka_readconfig.hpp"
+
+#include <stdlib.h>
+
+#include <fstream>
+#include <new>
+
+using namespace rdkafka;
+
+static long num_allocations = 0;
+
+void* operator new(size_t size) {
+  ++num_allocations;
+  void* p = malloc(size);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+
+// readConfig() before ConfigSet, without printing
+static std::string strip(const std::string& s) {
+  size_t pos_begin = 0;
+  while (pos_begin < s.size() && isblank(s[pos_begin])) ++pos_begin;
+  if (pos_begin == s.size() || s[pos_begin] == '#') return "";
+
+  size_t pos_end = s.size();
+  while (pos_end > pos_begin && isblank(s[pos_end - 1])) --pos_end;
+
+  size_t pos_comment = s.rfind('#', pos_end - 1);
+  if (pos_comment != std::string::npos) pos_end = pos_comment;
+  return s.substr(pos_begin, pos_end - pos_begin);
+}
+
+static void legacyReadConfig(const std::string& filename, GlobalConf& global,
+                             TopicConf& topic) {
+  std::ifstream fin(filename);
+  std::string line;
+  enum { GLOBAL, TOPIC, NONE } type = NONE;
+  while (std::getline(fin, line)) {
+    line = strip(line);
+    if (line.empty()) continue;
+    if (line[0] == '[') {
+      auto header = line.substr(1, line.length() - 2);
+      type = (header == "topic") ? TOPIC : GLOBAL;
+      continue;
+    }
+    size_t pos = line.find('=');
+    line[pos] = '\0';
+    if (type == GLOBAL)
+      global.put(line.data(), line.data() + pos + 1);
+    else
+      topic.put(line.data(), line.data() + pos + 1);
+  }
+}
+
+// [global] and num_topics sections of overrides, [topic:<name>] sections
+// or [topic] sections the legacy reader understands
+static void writeConfig(const char* filename, int num_topics,
+                        bool topic_names) {
+  static const char* kGlobal[] = {
+      "client.id=config_bench",       "bootstrap.servers=localhost:9092",
+      "message.max.bytes=1000000",    "socket.timeout.ms=60000",
+      "socket.keepalive.enable=true", "reconnect.backoff.ms=100",
+      "statistics.interval.ms=0",     "queue.buffering.max.messages=100000",
+      "linger.ms=5",                  "batch.num.messages=10000",
+      "compression.codec=lz4",        "api.version.request=true"};
+  static const char* kTopic[] = {"acks=all", "request.timeout.ms=30000",
+                                 "message.timeout.ms=300000",
+                                 "partitioner=murmur2_random"};
+
+  FILE* fp = fopen(filename, "w");
+  if (!fp) error::Exit("[ERROR] open %s failed\n", filename);
+  fprintf(fp, "# generated by config_bench\n[global]\n");
+  for (auto line : kGlobal) fprintf(fp, "%s\n", line);
+  for (int i = 0; i < num_topics; i++) {
+    if (topic_names)
+      fprintf(fp, "\n# overrides of topic-%d\n[topic:topic-%d]\n", i, i);
+    else
+      fprintf(fp, "\n# overrides of topic-%d\n[topic]\n", i);
+    for (auto line : kTopic) fprintf(fp, "%s\n", line);
+  }
+  fclose(fp);
+}
+
+template <typename Function>
+static void run(const char* name, int num_clients, Function f) {
+  long allocations = num_allocations;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < num_clients; i++) f();
+  double seconds = bench::secondsSince(start);
+  printf("%-38s %9.1f us/client %9.1f allocations/client\n", name,
+         seconds * 1e6 / num_clients,
+         static_cast<double>(num_allocations - allocations) / num_clients);
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 &&
+      (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+    fprintf(stderr,
+            "Usage: %s [topic-count] [client-count]\n"
+            "  default: 500 200\n",
+            argv[0]);
+    exit(1);
+  }
+  int num_topics = (argc > 1) ? atoi(argv[1]) : 500;
+  int num_clients = (argc > 2) ? atoi(argv[2]) : 200;
+  if (num_topics <= 0 || num_clients <= 0)
+    error::Exit("[ERROR] invalid arguments\n");
+
+  char legacy_file[] = "/tmp/config_bench_legacy_XXXXXX";
+  char topics_file[] = "/tmp/config_bench_topics_XXXXXX";
+  close(mkstemp(legacy_file));
+  close(mkstemp(topics_file));
+  writeConfig(legacy_file, num_topics, false);
+  writeConfig(topics_file, num_topics, true);
+  printf("%d topic sections, %d clients\n", num_topics, num_clients);
+
+  ConfigSet config_set;
+  ConfigError error;
+  auto check = [&error](bool ok) {
+    if (!ok) error::Exit("[ERROR] %s\n", error.toString().data());
+  };
+
+  // parsing only
+  run("legacy getline parse", num_clients, [&] {
+    std::ifstream fin(legacy_file);
+    std::string line;
+    size_t n = 0;
+    while (std::getline(fin, line)) n += strip(line).size();
+    if (n == 0) error::Exit("[ERROR] empty file\n");
+  });
+  run("ConfigSet load", num_clients,
+      [&] { check(config_set.load(topics_file, error)); });
+
+  // every line applied to the client's GlobalConf and TopicConf
+  run("legacy readConfig", num_clients, [&] {
+    GlobalConf global;
+    TopicConf topic;
+    legacyReadConfig(legacy_file, global, topic);
+  });
+  run("ConfigSet load + confs", num_clients, [&] {
+    GlobalConf global;
+    TopicConf topic;
+    check(config_set.load(legacy_file, error));
+    check(config_set.toGlobalConf(global, error));
+    check(config_set.toTopicConf(topic, "", error));
+  });
+
+  // the file loaded once at startup, each client applies the [global]
+  // section and the overrides of its own topic
+  check(config_set.load(topics_file, error));
+  int i = 0;
+  run("ConfigSet loaded once, [topic:<name>]", num_clients, [&] {
+    GlobalConf global;
+    TopicConf topic;
+    std::string topic_name = "topic-" + std::to_string(i++ % num_topics);
+    check(config_set.toGlobalConf(global, error));
+    check(config_set.toTopicConf(topic, topic_name, error));
+  });
+
+  // the same GlobalConfig of each client, validated key by key or cloned
+  static const char* kProducerConfig[][2] = {
+      {"bootstrap.servers", "localhost:9092"},
+      {"message.max.bytes", "1000000"},
+      {"socket.timeout.ms", "60000"},
+      {"socket.keepalive.enable", "true"},
+      {"queue.buffering.max.messages", "100000"},
+      {"linger.ms", "5"},
+      {"batch.num.messages", "10000"},
+      {"compression.codec", "lz4"},
+      {"enable.idempotence", "true"},
+      {"message.timeout.ms", "300000"},
+      {"retries", "10"},
+      {"retry.backoff.ms", "100"}};
+  run("GlobalConfig Put() per key", num_clients, [&] {
+    kafka_client::GlobalConfig config;
+    for (auto& key_value : kProducerConfig)
+      config.Put(key_value[0], key_value[1]);
+    config.Put("client.id", "config_bench");
+  });
+  kafka_client::GlobalConfig base;
+  for (auto& key_value : kProducerConfig) base.Put(key_value[0], key_value[1]);
+  kafka_client::ConfigSnapshot<kafka_client::GlobalConfig> snapshot(base);
+  run("ConfigSnapshot Clone() + override", num_clients, [&] {
+    auto config = snapshot.Clone();
+    config.Put("client.id", "config_bench");
+  });
+
+  // numbers formatted by the caller or by Set(), read back as strings or typed
+  kafka_client::GlobalConfig config;
+  int n = 0;
+  run("GlobalConfig Put(to_string()) numbers", num_clients, [&] {
+    config.Put("linger.ms", std::to_string(n % 100).data());
+    config.Put("batch.num.messages", std::to_string(10000 + n).data());
+    config.Put("message.max.bytes", std::to_string(1000000 + n++).data());
+  });
+  run("GlobalConfig Set(keys::...) numbers", num_clients, [&] {
+    config.Set(kafka_client::keys::linger_ms, n % 100);
+    config.Set(kafka_client::keys::batch_num_messages, 10000 + n);
+    config.Set(kafka_client::keys::message_max_bytes, 1000000 + n++);
+  });
+  long sum = 0;
+  run("GlobalConfig Get() + atoi()", num_clients, [&] {
+    sum += atoi(config.Get("batch.num.messages").data());
+    sum += atoi(config.Get("message.max.bytes").data());
+    sum += config.Get("compression.codec") == "lz4";
+  });
+  run("GlobalConfig Get(keys::...)", num_clients, [&] {
+    sum += config.Get(kafka_client::keys::batch_num_messages);
+    sum += config.Get(kafka_client::keys::message_max_bytes);
+    sum += config.Get(kafka_client::keys::compression_codec) ==
+           kafka_client::CompressionCodec::kLz4;
+  });
+  if (sum == 0) error::Exit("[ERROR] nothing read\n");
+
+  unlink(legacy_file);
+  unlink(topics_file);
+  return 0;
+}
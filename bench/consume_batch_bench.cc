@@ -0,0 +1,88 @@
+// consume_batch_bench.cc: Consumer::consume() loop vs Consumer::consumeBatch()
+// Runs against librdkafka's mock cluster, so no broker is needed.
+#include "bench_util.hpp"
+
+#include <stdlib.h>
+
+using namespace rdkafka;
+
+static const char* kTopicName = "consume_batch_bench";
+
+static Consumer createConsumer(const char* bootstraps, const char* group) {
+  char errstr[512];
+  Consumer consumer(bench::consumerConf(bootstraps, group), errstr);
+  if (consumer.isNull())
+    error::Exit("[ERROR] Create consumer failed: %s\n", errstr);
+  error::checkRespError(consumer.subscribe({kTopicName}), "subscribe");
+  return consumer;
+}
+
+// the same loop as examples/consumer.cc: one consume() per message
+static double runLoop(const Consumer& consumer, long num_message) {
+  long num_consumed = 0;
+  std::chrono::steady_clock::time_point start;
+  while (num_consumed < num_message) {
+    auto message = consumer.consume(100);
+    if (message.isNull() || message.hasError()) continue;
+    if (num_consumed++ == 0) start = std::chrono::steady_clock::now();
+  }
+  return bench::secondsSince(start);
+}
+
+static double runBatch(const Consumer& consumer, long num_message,
+                       size_t batch_size) {
+  MessageBatch batch(batch_size);
+
+  long num_consumed = 0;
+  std::chrono::steady_clock::time_point start;
+  while (num_consumed < num_message) {
+    auto err = consumer.consumeBatch(batch, batch_size, 100);
+    error::checkRespError(err, "consumeBatch");
+
+    for (size_t i = 0; i < batch.size(); i++) {
+      if (batch[i].hasError()) continue;
+      if (num_consumed++ == 0) start = std::chrono::steady_clock::now();
+    }
+  }
+  return bench::secondsSince(start);
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 &&
+      (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+    fprintf(stderr,
+            "Usage: %s [message-count] [payload-size] [batch-size] "
+            "[partition-count]\n"
+            "  default: 1000000 100 1000 16\n",
+            argv[0]);
+    exit(1);
+  }
+  long num_message = (argc > 1) ? atol(argv[1]) : 1000000;
+  size_t payload_size = (argc > 2) ? atol(argv[2]) : 100;
+  size_t batch_size = (argc > 3) ? atol(argv[3]) : 1000;
+  int partition_count = (argc > 4) ? atoi(argv[4]) : 16;
+
+  bench::MockClusterProducer producer;
+  producer.createTopic(kTopicName, partition_count);
+  producer.fillTopic(kTopicName, num_message, payload_size);
+  std::string bootstraps = producer.bootstraps();
+
+  printf("%ld messages, payload %zu bytes, batch size %zu, %d partitions\n",
+         num_message, payload_size, batch_size, partition_count);
+
+  // each case uses its own group, so both start from the earliest offset
+  {
+    auto consumer = createConsumer(bootstraps.data(), "bench-loop");
+    double secs = runLoop(consumer, num_message);
+    printf("%-16s %10.0f msgs/s\n", "consume() loop", num_message / secs);
+    consumer.waitUntilRebalanceRevoke();
+  }
+  {
+    auto consumer = createConsumer(bootstraps.data(), "bench-batch");
+    double secs = runBatch(consumer, num_message, batch_size);
+    printf("%-16s %10.0f msgs/s\n", "consumeBatch()", num_message / secs);
+    consumer.waitUntilRebalanceRevoke();
+  }
+
+  return 0;
+}
@@ -0,0 +1,138 @@
+// event_loop_bench.cc: delivery latency and CPU cost of the ways to serve
+// delivery reports: spinning poll(0), poll(100) and EventLoop's IO events.
+// Messages are produced at a fixed rate, then the client idles.
+#include "bench_util.hpp"
+#include "rdkafka_event_loop.hpp"
+
+#include <stdlib.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+using namespace rdkafka;
+
+static std::vector<int64_t> latencies_us;
+
+static int64_t nowUs() {
+  auto now = std::chrono::steady_clock::now().time_since_epoch();
+  return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+}
+
+// latency from produce() to the delivery report callback, the payload holds
+// the enqueue time
+static void dr_msg_cb(rd_kafka_t*, const rd_kafka_message_t* rkmessage,
+                      void*) {
+  int64_t enqueue_us;
+  memcpy(&enqueue_us, rkmessage->payload, sizeof(enqueue_us));
+  latencies_us.push_back(nowUs() - enqueue_us);
+}
+
+static double cpuSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int64_t percentile(std::vector<int64_t>& values, double p) {
+  if (values.empty()) return -1;
+  auto n = static_cast<size_t>(p * (values.size() - 1));
+  std::nth_element(values.begin(), values.begin() + n, values.end());
+  return values[n];
+}
+
+enum class Mode { kSpinPoll, kTimedPoll, kEventLoop };
+
+static void runCase(const char* name, Mode mode, const char* bootstraps,
+                    int rate, int seconds) {
+  GlobalConf conf;
+  conf.put("bootstrap.servers", bootstraps);
+  conf.put("linger.ms", "0");
+  conf.setDeliveryReportCallback(dr_msg_cb);
+
+  char errstr[512];
+  Producer producer(std::move(conf), errstr);
+  if (producer.isNull())
+    error::Exit("[ERROR] Create producer failed: %s\n", errstr);
+  Topic topic(producer.get(), "event_loop_bench");
+
+  std::atomic<bool> running(true);
+  std::thread poller;
+  EventLoop loop;
+  if (mode == Mode::kEventLoop) {
+    if (loop.isNull() || !loop.addPoll(producer))
+      error::Exit("[ERROR] EventLoop failed: %s\n", strerror(errno));
+    loop.start();
+  } else {
+    int timeout_ms = (mode == Mode::kSpinPoll) ? 0 : 100;
+    poller = std::thread([&producer, &running, timeout_ms] {
+      while (running) producer.poll(timeout_ms);
+    });
+  }
+
+  latencies_us.clear();
+  latencies_us.reserve(rate * seconds);
+  char payload[100] = {};
+
+  // busy phase: produce at a fixed rate
+  double cpu_start = cpuSeconds();
+  auto interval = std::chrono::microseconds(1000000 / rate);
+  auto next = std::chrono::steady_clock::now();
+  for (int i = 0; i < rate * seconds; i++) {
+    std::this_thread::sleep_until(next);
+    next += interval;
+    int64_t enqueue_us = nowUs();
+    memcpy(payload, &enqueue_us, sizeof(enqueue_us));
+    producer.produce(topic, payload, sizeof(payload));
+  }
+  producer.flush(5000);
+  double busy_cpu = cpuSeconds() - cpu_start;
+
+  // idle phase: nothing to do, the poller should cost nothing
+  cpu_start = cpuSeconds();
+  std::this_thread::sleep_for(std::chrono::seconds(seconds));
+  double idle_cpu = cpuSeconds() - cpu_start;
+
+  if (mode == Mode::kEventLoop) {
+    loop.stop();
+  } else {
+    running = false;
+    poller.join();
+  }
+
+  size_t num_delivered = latencies_us.size();
+  printf(
+      "%-12s %7zu delivered, latency p50 %6lld us p99 %6lld us, "
+      "CPU busy %5.1f%% idle %5.1f%%\n",
+      name, num_delivered,
+      static_cast<long long>(percentile(latencies_us, 0.5)),
+      static_cast<long long>(percentile(latencies_us, 0.99)),
+      busy_cpu / seconds * 100, idle_cpu / seconds * 100);
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 &&
+      (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+    fprintf(stderr,
+            "Usage: %s [messages-per-second] [seconds]\n"
+            "  default: 1000 3\n",
+            argv[0]);
+    exit(1);
+  }
+  int rate = (argc > 1) ? atoi(argv[1]) : 1000;
+  int seconds = (argc > 2) ? atoi(argv[2]) : 3;
+  if (rate <= 0 || seconds <= 0) error::Exit("[ERROR] invalid arguments\n");
+
+  // the mock cluster lives in another client, so its threads aren't counted
+  // differently between cases
+  bench::MockClusterProducer cluster;
+  std::string bootstraps = cluster.bootstraps();
+
+  printf("%d messages/s for %d seconds, then idle for %d seconds\n", rate,
+         seconds, seconds);
+  runCase("poll(0)", Mode::kSpinPoll, bootstraps.data(), rate, seconds);
+  runCase("poll(100)", Mode::kTimedPoll, bootstraps.data(), rate, seconds);
+  runCase("EventLoop", Mode::kEventLoop, bootstraps.data(), rate, seconds);
+  return 0;
+}
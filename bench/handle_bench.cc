@@ -0,0 +1,88 @@
+// handle_bench.cc: size and destruction cost of PointerHolder's compile-time
+// deleter vs the function pointer deleter it replaced.
+// A fake handle with a trivial destroy function is used, so the wrapper's
+// cost isn't hidden by rd_kafka_message_destroy().
+#include "rdkafka_classes.hpp"
+
+#include <stdlib.h>
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+struct FakeHandle {
+  int value;
+};
+
+static long num_destroyed = 0;
+
+// not inlined, like a call into librdkafka
+__attribute__((noinline)) static void fake_destroy(FakeHandle* handle) {
+  num_destroyed += handle->value;
+}
+
+namespace rdkafka {
+template <>
+struct HandleTraits<FakeHandle> {
+  static void destroy(FakeHandle* handle) noexcept { fake_destroy(handle); }
+};
+}  // namespace rdkafka
+
+using FunctionPointerHolder =
+    std::unique_ptr<FakeHandle, void (*)(FakeHandle*)>;
+using TraitsHolder = rdkafka::PointerHolder<FakeHandle>;
+
+template <typename Holder, typename MakeHolder>
+static double destroyNanos(std::vector<FakeHandle>& handles, int rounds,
+                           MakeHolder make_holder) {
+  std::vector<Holder> holders;
+  holders.reserve(handles.size());
+
+  double total_secs = 0;
+  for (int r = 0; r < rounds; r++) {
+    for (auto& handle : handles) holders.emplace_back(make_holder(&handle));
+
+    auto start = std::chrono::steady_clock::now();
+    holders.clear();
+    auto end = std::chrono::steady_clock::now();
+    total_secs += std::chrono::duration<double>(end - start).count();
+  }
+  return total_secs * 1e9 / (static_cast<double>(handles.size()) * rounds);
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 &&
+      (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+    fprintf(stderr,
+            "Usage: %s [handle-count] [rounds]\n"
+            "  default: 1000000 20\n",
+            argv[0]);
+    exit(1);
+  }
+  size_t num_handles = (argc > 1) ? atol(argv[1]) : 1000000;
+  int rounds = (argc > 2) ? atoi(argv[2]) : 20;
+
+  std::vector<FakeHandle> handles(num_handles, FakeHandle{1});
+
+  printf("sizeof: function pointer deleter %zu, traits deleter %zu, "
+         "Message %zu\n",
+         sizeof(FunctionPointerHolder), sizeof(TraitsHolder),
+         sizeof(rdkafka::Message));
+
+  double fp_nanos = destroyNanos<FunctionPointerHolder>(
+      handles, rounds, [](FakeHandle* handle) {
+        return FunctionPointerHolder(handle, fake_destroy);
+      });
+  double traits_nanos = destroyNanos<TraitsHolder>(
+      handles, rounds, [](FakeHandle* handle) { return TraitsHolder(handle); });
+
+  printf("destroy: function pointer deleter %.2f ns, traits deleter %.2f ns\n",
+         fp_nanos, traits_nanos);
+
+  // every handle is destroyed once per round by each holder
+  if (num_destroyed != static_cast<long>(num_handles) * rounds * 2) {
+    fprintf(stderr, "unexpected destroy count %ld\n", num_destroyed);
+    return 1;
+  }
+  return 0;
+}
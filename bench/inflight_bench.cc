@@ -0,0 +1,102 @@
+// inflight_bench.cc: produce throughput to a mock broker with a round trip
+// time, keeping order with 1 request in flight compared with an idempotent
+// producer, which keeps order with 5. The last row has 5 in flight without
+// idempotence, a retry may reorder its messages.
+// In these runs the idempotent producer still sent one request per
+// partition at a time, so its gain grows with the partition count.
+#include "bench_util.hpp"
+
+#include <stdlib.h>
+
+using namespace rdkafka;
+
+static const char* kTopic = "inflight_bench";
+
+static double messagesPerSecond(const char* bootstraps, bool idempotent,
+                                int max_in_flight, long num_message,
+                                size_t payload_size, int batch_size) {
+  GlobalConf conf;
+  conf.put("bootstrap.servers", bootstraps);
+  conf.put("queue.buffering.max.messages", "1000000");
+  conf.put("queue.buffering.max.ms", "1");
+  conf.put("batch.num.messages", std::to_string(batch_size).data());
+  if (idempotent) {
+    conf.enableIdempotence(max_in_flight);
+    auto error = conf.checkIdempotence();
+    if (!error.empty()) error::Exit("[ERROR] %s\n", error.data());
+  } else {
+    conf.put("max.in.flight", std::to_string(max_in_flight).data());
+  }
+  char errstr[512];
+  Producer producer(std::move(conf), errstr);
+  if (producer.isNull())
+    error::Exit("[ERROR] Create producer failed: %s\n", errstr);
+  Topic topic(producer.get(), kTopic);
+  std::vector<char> payload(payload_size, 'x');
+
+  // connect first, so only producing is measured
+  while (!producer.produceCopy(topic, Slice(payload.data(), payload.size())))
+    producer.poll(1);
+  while (!producer.flush(1000)) {
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  constexpr int kBatchSize = 1000;
+  ProduceBatch batch(kBatchSize);
+  long num_left = num_message;
+  while (num_left > 0) {
+    batch.clear();
+    for (int i = 0; i < kBatchSize && i < num_left; i++)
+      batch.add(payload.data(), payload.size());
+    num_left -= producer.produceBatch(topic, batch, PayloadOwnership::kBorrow);
+    producer.poll(0);
+  }
+  while (!producer.flush(1000)) {
+  }
+  return num_message / bench::secondsSince(start);
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 &&
+      (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+    fprintf(stderr,
+            "Usage: %s [message-count] [partition-count] [rtt-ms] "
+            "[batch-size] [payload-size]\n"
+            "  default: 100000 8 10 100 100\n",
+            argv[0]);
+    exit(1);
+  }
+  long num_message = (argc > 1) ? atol(argv[1]) : 100000;
+  int num_partitions = (argc > 2) ? atoi(argv[2]) : 8;
+  int rtt_ms = (argc > 3) ? atoi(argv[3]) : 10;
+  int batch_size = (argc > 4) ? atoi(argv[4]) : 100;
+  size_t payload_size = (argc > 5) ? atol(argv[5]) : 100;
+  if (num_message <= 0 || num_partitions <= 0 || rtt_ms < 0 ||
+      batch_size <= 0)
+    error::Exit("[ERROR] invalid arguments\n");
+
+  bench::MockClusterProducer cluster;
+  cluster.createTopic(kTopic, num_partitions);
+  error::checkRespError(
+      rd_kafka_mock_broker_set_rtt(cluster.mockCluster(), 1, rtt_ms),
+      "rd_kafka_mock_broker_set_rtt");
+
+  printf("%ld messages of %zu bytes to %d partitions, %d per request, "
+         "rtt %d ms\n",
+         num_message, payload_size, num_partitions, batch_size, rtt_ms);
+  printf("%-28s %14s\n", "mode", "messages/s");
+  struct Mode {
+    const char* name;
+    bool idempotent;
+    int max_in_flight;
+  };
+  for (const auto& mode : {Mode{"ordered, 1 in flight", false, 1},
+                           Mode{"idempotent, 5 in flight", true, 5},
+                           Mode{"unordered, 5 in flight", false, 5}}) {
+    printf("%-28s %14.0f\n", mode.name,
+           messagesPerSecond(cluster.bootstraps(), mode.idempotent,
+                             mode.max_in_flight, num_message, payload_size,
+                             batch_size));
+  }
+  return 0;
+}
@@ -0,0 +1,111 @@
+// lag_bench.cc: lag of every partition of many groups, one blocking
+// rd_kafka_committed() and rd_kafka_query_watermark_offsets() per partition
+// (what examples/offset_manager.cc does, with a consumer per group) compared
+// with LagMonitor's batched requests. The per-partition way is timed on the
+// first group only and extrapolated, it takes minutes for all of them.
+#include "bench_util.hpp"
+#include "rdkafka_lag.hpp"
+
+#include <stdlib.h>
+
+using namespace rdkafka;
+
+static Consumer* newConsumer(const char* bootstraps, const char* group) {
+  GlobalConf conf;
+  conf.put("bootstrap.servers", bootstraps);
+  conf.put("group.id", group);
+  char errstr[512];
+  auto consumer = new Consumer(std::move(conf), errstr);
+  if (consumer->isNull())
+    error::Exit("[ERROR] Create consumer failed: %s\n", errstr);
+  return consumer;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 &&
+      (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+    fprintf(stderr,
+            "Usage: %s [group-count] [topic-count] [partition-count]\n"
+            "  default: 20 10 50\n",
+            argv[0]);
+    exit(1);
+  }
+  int num_groups = (argc > 1) ? atoi(argv[1]) : 20;
+  int num_topics = (argc > 2) ? atoi(argv[2]) : 10;
+  int num_partitions = (argc > 3) ? atoi(argv[3]) : 50;
+  if (num_groups <= 0 || num_topics <= 0 || num_partitions <= 0)
+    error::Exit("[ERROR] invalid arguments\n");
+  long total = static_cast<long>(num_groups) * num_topics * num_partitions;
+  printf("%d groups x %d topics x %d partitions = %ld group partitions\n",
+         num_groups, num_topics, num_partitions, total);
+
+  bench::MockClusterProducer cluster(3);
+  std::vector<std::string> topics;
+  for (int i = 0; i < num_topics; i++) {
+    topics.push_back("lag-bench-" + std::to_string(i));
+    cluster.createTopic(topics.back().data(), num_partitions);
+    cluster.fillTopic(topics.back().data(), num_partitions * 10, 10);
+  }
+
+  // every group committed offset 5 of every partition
+  std::vector<std::string> groups;
+  for (int i = 0; i < num_groups; i++) {
+    groups.push_back("lag-bench-group-" + std::to_string(i));
+    std::unique_ptr<Consumer> consumer(
+        newConsumer(cluster.bootstraps(), groups.back().data()));
+    PointerHolder<rd_kafka_topic_partition_list_t> offsets(
+        rd_kafka_topic_partition_list_new(0));
+    for (const auto& topic : topics) {
+      for (int32_t p = 0; p < num_partitions; p++)
+        rd_kafka_topic_partition_list_add(offsets.get(), topic.data(), p)
+            ->offset = 5;
+    }
+    error::checkRespError(rd_kafka_commit(consumer->get(), offsets.get(), 0),
+                          "rd_kafka_commit");
+  }
+
+  // one blocking call per partition, first group only
+  {
+    auto start = std::chrono::steady_clock::now();
+    std::unique_ptr<Consumer> consumer(
+        newConsumer(cluster.bootstraps(), groups[0].data()));
+    long num_wrong = 0;
+    for (const auto& topic : topics) {
+      for (int32_t p = 0; p < num_partitions; p++) {
+        PointerHolder<rd_kafka_topic_partition_list_t> offsets(
+            rd_kafka_topic_partition_list_new(1));
+        rd_kafka_topic_partition_list_add(offsets.get(), topic.data(), p);
+        int64_t low, high;
+        if (rd_kafka_committed(consumer->get(), offsets.get(), 10000) ||
+            rd_kafka_query_watermark_offsets(consumer->get(), topic.data(), p,
+                                             &low, &high, 10000) ||
+            offsets.get()->elems[0].offset != 5 || high < 0)
+          ++num_wrong;
+      }
+    }
+    double seconds = bench::secondsSince(start);
+    printf("%-34s %9.3f s (%.3f s measured for 1 group) wrong=%ld\n",
+           "per-partition blocking calls", seconds * num_groups, seconds,
+           num_wrong);
+  }
+
+  LagMonitor monitor(cluster.producer());
+  for (const auto& group : groups) monitor.watch(group, topics);
+  std::vector<PartitionLag> lags;
+  for (const char* name : {"LagMonitor cold (metadata, watermarks)",
+                           "LagMonitor watermarks cached"}) {
+    auto start = std::chrono::steady_clock::now();
+    auto err = monitor.poll(lags);
+    double seconds = bench::secondsSince(start);
+    long num_wrong = 0;
+    for (const auto& lag : lags)
+      num_wrong += (lag.committed != 5 ||
+                    lag.lag != std::max<int64_t>(lag.high - 5, 0));
+    printf("%-34s %9.3f s lags=%zu wrong=%ld err=%s\n", name, seconds,
+           lags.size(), num_wrong, rd_kafka_err2str(err));
+  }
+  const auto& counts = monitor.requestCounts();
+  printf("requests: metadata=%ld committed=%ld watermarks=%ld\n",
+         counts.metadata, counts.committed, counts.watermarks);
+  return 0;
+}
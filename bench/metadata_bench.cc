@@ -0,0 +1,158 @@
+// metadata_bench.cc: partition leader lookups from many threads through
+// MetadataCache's lock-free snapshots compared with a mutex-guarded
+// std::unordered_map, while the cache keeps being refreshed.
+#include "bench_util.hpp"
+#include "rdkafka_metadata.hpp"
+
+#include <stdlib.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+using namespace rdkafka;
+
+// what a cache is usually written as
+class MutexMetadata {
+ public:
+  void update(const rd_kafka_metadata_t& metadata) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    leaders_.clear();
+    for (int i = 0; i < metadata.topic_cnt; i++) {
+      const auto& topic = metadata.topics[i];
+      auto& leaders = leaders_[topic.topic];
+      leaders.assign(topic.partition_cnt, -1);
+      for (int j = 0; j < topic.partition_cnt; j++) {
+        const auto& partition = topic.partitions[j];
+        if (partition.id >= 0 && partition.id < topic.partition_cnt)
+          leaders[partition.id] = partition.leader;
+      }
+    }
+  }
+
+  int32_t leader(const char* topic, int32_t partition) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = leaders_.find(topic);
+    if (it == leaders_.end() || partition < 0 ||
+        static_cast<size_t>(partition) >= it->second.size())
+      return -1;
+    return it->second[partition];
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, std::vector<int32_t>> leaders_;
+};
+
+template <typename Lookup>
+static double lookupsPerSecond(int num_threads, long num_lookups,
+                               const std::vector<std::string>& topics,
+                               int num_partitions, Lookup lookup,
+                               long* num_missing) {
+  std::atomic<long> missing(0);
+  std::vector<std::thread> threads;
+  auto start = std::chrono::steady_clock::now();
+  for (int t = 0; t < num_threads; t++) {
+    threads.emplace_back([&, t] {
+      long local_missing = 0;
+      uint32_t x = 2463534242u + t;
+      for (long i = 0; i < num_lookups; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        const auto& topic = topics[x % topics.size()];
+        if (lookup(topic.data(), static_cast<int32_t>(x % num_partitions)) < 0)
+          ++local_missing;
+      }
+      missing += local_missing;
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  *num_missing = missing;
+  return num_threads * num_lookups / bench::secondsSince(start);
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 &&
+      (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+    fprintf(stderr,
+            "Usage: %s [topic-count] [partition-count] [lookups-per-thread] "
+            "[max-threads]\n"
+            "  default: 200 16 2000000 <hardware concurrency>\n",
+            argv[0]);
+    exit(1);
+  }
+  int num_topics = (argc > 1) ? atoi(argv[1]) : 200;
+  int num_partitions = (argc > 2) ? atoi(argv[2]) : 16;
+  long num_lookups = (argc > 3) ? atol(argv[3]) : 2000000;
+  int max_threads = (argc > 4)
+                        ? atoi(argv[4])
+                        : static_cast<int>(std::thread::hardware_concurrency());
+  if (num_topics <= 0 || num_partitions <= 0 || num_lookups <= 0)
+    error::Exit("[ERROR] invalid arguments\n");
+  if (max_threads <= 0) max_threads = 1;
+
+  bench::MockClusterProducer cluster(3);
+  std::vector<std::string> topics;
+  for (int i = 0; i < num_topics; i++) {
+    topics.push_back("metadata-bench-topic-" + std::to_string(i));
+    cluster.createTopic(topics.back().data(), num_partitions);
+  }
+
+  MetadataCache cache(cluster.producer());
+  error::checkRespError(cache.refresh(), "refresh");
+  MutexMetadata mutex_metadata;
+  const rd_kafka_metadata_t* metadata;
+  error::checkRespError(rd_kafka_metadata(cluster.producer().get(), 1, nullptr,
+                                          &metadata, 10000),
+                        "rd_kafka_metadata");
+  mutex_metadata.update(*metadata);
+
+  auto start = std::chrono::steady_clock::now();
+  constexpr int kRounds = 100;
+  for (int i = 0; i < kRounds; i++) MetadataSnapshot snapshot(*metadata, 0);
+  printf("%d topics x %d partitions, snapshot built in %.1f us\n", num_topics,
+         num_partitions, bench::secondsSince(start) * 1e6 / kRounds);
+
+  // refreshed every 10ms meanwhile, the cache only publishes a snapshot if
+  // something changed, the mutex map is rebuilt each time
+  std::atomic<bool> running(true);
+  std::thread refresher([&] {
+    while (running) {
+      cache.refresh();
+      mutex_metadata.update(*metadata);
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  });
+
+  printf("%-8s %16s %16s\n", "threads", "mutex map/s", "cache/s");
+  for (int num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+    long missing_mutex, missing_cache;
+    double mutex_rate = lookupsPerSecond(
+        num_threads, num_lookups, topics, num_partitions,
+        [&](const char* topic, int32_t partition) {
+          return mutex_metadata.leader(topic, partition);
+        },
+        &missing_mutex);
+    double cache_rate = lookupsPerSecond(
+        num_threads, num_lookups, topics, num_partitions,
+        [&](const char* topic, int32_t partition) {
+          MetadataCache::Reader reader(cache);
+          return reader->leader(topic, partition);
+        },
+        &missing_cache);
+    printf("%-8d %16.0f %16.0f", num_threads, mutex_rate, cache_rate);
+    if (missing_mutex + missing_cache > 0)
+      printf("  (%ld, %ld missing)", missing_mutex, missing_cache);
+    printf("\n");
+  }
+
+  running = false;
+  refresher.join();
+  rd_kafka_metadata_destroy(metadata);
+  printf("%ld metadata requests, %llu snapshots published\n",
+         cache.numRequests(),
+         static_cast<unsigned long long>(cache.version()));
+  return 0;
+}
@@ -0,0 +1,80 @@
+// metrics_bench.cc: cost of recording into ClientMetrics from many threads,
+// compared with every thread incrementing one shared atomic counter.
+#include "rdkafka_metrics.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using rdkafka::ClientMetrics;
+
+template <typename Function>
+static double nanosPerOp(int num_threads, long ops_per_thread, Function f) {
+  std::vector<std::thread> threads;
+  std::atomic<bool> go(false);
+  for (int i = 0; i < num_threads; i++) {
+    threads.emplace_back([&go, ops_per_thread, f] {
+      while (!go) std::this_thread::yield();
+      for (long j = 0; j < ops_per_thread; j++) f(j);
+    });
+  }
+  auto start = std::chrono::steady_clock::now();
+  go = true;
+  for (auto& t : threads) t.join();
+  auto end = std::chrono::steady_clock::now();
+  double seconds = std::chrono::duration<double>(end - start).count();
+  return seconds * 1e9 / (static_cast<double>(num_threads) * ops_per_thread);
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 &&
+      (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+    fprintf(stderr,
+            "Usage: %s [ops-per-thread] [max-threads]\n"
+            "  default: 10000000 8\n",
+            argv[0]);
+    exit(1);
+  }
+  long ops_per_thread = (argc > 1) ? atol(argv[1]) : 10000000;
+  int max_threads = (argc > 2) ? atoi(argv[2]) : 8;
+  if (ops_per_thread <= 0 || max_threads <= 0) {
+    fprintf(stderr, "invalid arguments\n");
+    exit(1);
+  }
+
+  ClientMetrics metrics;
+  std::atomic<uint64_t> shared_counter(0);
+
+  printf("%8s %16s %16s %16s\n", "threads", "shared atomic", "metrics add",
+         "metrics record");
+  for (int num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+    double shared_nanos = nanosPerOp(num_threads, ops_per_thread, [&](long) {
+      shared_counter.fetch_add(1, std::memory_order_relaxed);
+    });
+    double add_nanos = nanosPerOp(num_threads, ops_per_thread, [&](long) {
+      metrics.add(ClientMetrics::Counter::kProduceCalls);
+    });
+    double record_nanos =
+        nanosPerOp(num_threads, ops_per_thread, [&](long j) {
+          metrics.record(ClientMetrics::HistogramType::kDeliveryLatencyUs,
+                         static_cast<uint64_t>(j & 0xffff));
+        });
+    printf("%8d %13.2f ns %13.2f ns %13.2f ns\n", num_threads, shared_nanos,
+           add_nanos, record_nanos);
+  }
+
+  auto snapshot = metrics.snapshot();
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < 100; i++) snapshot = metrics.snapshot();
+  auto end = std::chrono::steady_clock::now();
+  printf("snapshot: %.1f us, %llu adds merged\n",
+         std::chrono::duration<double>(end - start).count() * 1e6 / 100,
+         static_cast<unsigned long long>(
+             snapshot.get(ClientMetrics::Counter::kProduceCalls)));
+  return 0;
+}
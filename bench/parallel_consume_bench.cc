@@ -0,0 +1,90 @@
+// parallel_consume_bench.cc: ParallelConsumer throughput by worker count
+// Each message costs some CPU work, so the throughput should scale with the
+// workers until it's bound by cores or partitions. Per-partition ordering is
+// checked on the way.
+#include "bench_util.hpp"
+#include "rdkafka_parallel_consumer.hpp"
+
+#include <stdlib.h>
+
+#include <atomic>
+#include <thread>
+
+using namespace rdkafka;
+
+static const char* kTopicName = "parallel_consume_bench";
+
+// simulated per-message processing, returns a value to keep it not optimized
+static uint32_t process(const MessageView& message, int rounds) {
+  uint32_t hash = 2166136261u;
+  for (int r = 0; r < rounds; r++) {
+    for (size_t i = 0; i < message.payloadLen(); i++) {
+      hash = (hash ^ static_cast<uint8_t>(message.payload()[i])) * 16777619u;
+    }
+  }
+  return hash;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 &&
+      (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+    fprintf(stderr,
+            "Usage: %s [message-count] [partition-count] [work-rounds] "
+            "[max-workers]\n"
+            "  default: 200000 16 20 <hardware concurrency>\n",
+            argv[0]);
+    exit(1);
+  }
+  long num_message = (argc > 1) ? atol(argv[1]) : 200000;
+  int partition_count = (argc > 2) ? atoi(argv[2]) : 16;
+  int rounds = (argc > 3) ? atoi(argv[3]) : 20;
+  size_t max_workers = (argc > 4) ? atol(argv[4])
+                                  : std::thread::hardware_concurrency();
+  if (max_workers == 0) max_workers = 1;
+
+  bench::MockClusterProducer producer;
+  producer.createTopic(kTopicName, partition_count);
+  producer.fillTopic(kTopicName, num_message, 100);
+  std::string bootstraps = producer.bootstraps();
+
+  printf("%ld messages, %d partitions, %d work rounds\n", num_message,
+         partition_count, rounds);
+  for (size_t num_workers = 1; num_workers <= max_workers; num_workers *= 2) {
+    std::atomic<long> num_consumed(0);
+    std::atomic<long> num_out_of_order(0);
+    std::atomic<uint32_t> checksum(0);
+    std::vector<int64_t> last_offsets(partition_count, -1);
+
+    auto handler = [&](const MessageView& message) {
+      if (message.hasError()) return;
+      // a partition is handled by one worker at a time
+      auto& last_offset = last_offsets[message.partition()];
+      if (message.offset() <= last_offset) ++num_out_of_order;
+      last_offset = message.offset();
+
+      checksum += process(message, rounds);
+      ++num_consumed;
+    };
+
+    std::string group = "bench-" + std::to_string(num_workers);
+    char errstr[512];
+    ParallelConsumer consumer(
+        bench::consumerConf(bootstraps.data(), group.data()), num_workers,
+        handler, errstr);
+    if (consumer.isNull())
+      error::Exit("[ERROR] Create consumer failed: %s\n", errstr);
+    error::checkRespError(consumer.subscribe({kTopicName}), "subscribe");
+
+    // wait for the assignment, then time the consumption
+    while (num_consumed == 0) consumer.poll(10);
+    auto start = std::chrono::steady_clock::now();
+    while (num_consumed < num_message) consumer.poll(10);
+    double secs = bench::secondsSince(start);
+
+    consumer.close();
+    printf("%2zu workers %10.0f msgs/s (%ld out of order)\n", num_workers,
+           num_message / secs, num_out_of_order.load());
+  }
+
+  return 0;
+}
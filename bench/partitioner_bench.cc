@@ -0,0 +1,157 @@
+// partitioner_bench.cc: cost per message of the partitioners in
+// rdkafka_partitioner.hpp compared with librdkafka's, and the batches formed
+// by keyless messages with StickyPartitioner compared with librdkafka's
+// random and sticky partitioning.
+#include "bench_util.hpp"
+#include "rdkafka_stats.hpp"
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+using namespace rdkafka;
+
+template <typename Function>
+static double nanosPerCall(const std::vector<std::string>& keys, long rounds,
+                           Function f) {
+  int32_t sum = 0;  // keeps the calls from being optimized out
+  auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < rounds; i++) {
+    const std::string& key = keys[i % keys.size()];
+    sum += f(key.data(), key.size());
+  }
+  double seconds = bench::secondsSince(start);
+  if (sum < 0) printf("%d\n", sum);
+  return seconds * 1e9 / rounds;
+}
+
+static void benchKeyed(size_t key_size, long rounds) {
+  constexpr int32_t kNumPartitions = 64;
+  std::vector<std::string> keys(1024);
+  for (size_t i = 0; i < keys.size(); i++) {
+    keys[i] = std::to_string(i);
+    keys[i].resize(key_size, 'k');
+  }
+
+  Murmur2Partitioner murmur2;
+  ConsistentHashPartitioner consistent;
+  double librdkafka_murmur2 = nanosPerCall(keys, rounds, [](const char* key,
+                                                            size_t len) {
+    return rd_kafka_msg_partitioner_murmur2(nullptr, key, len, kNumPartitions,
+                                            nullptr, nullptr);
+  });
+  double wrapper_murmur2 =
+      nanosPerCall(keys, rounds, [&](const char* key, size_t len) {
+        return murmur2.partition(nullptr, key, len, kNumPartitions);
+      });
+  double librdkafka_consistent = nanosPerCall(keys, rounds, [](const char* key,
+                                                               size_t len) {
+    return rd_kafka_msg_partitioner_consistent(nullptr, key, len,
+                                               kNumPartitions, nullptr,
+                                               nullptr);
+  });
+  double wrapper_consistent =
+      nanosPerCall(keys, rounds, [&](const char* key, size_t len) {
+        return consistent.partition(nullptr, key, len, kNumPartitions);
+      });
+  printf("%8zu %12.1f ns %12.1f ns %12.1f ns %12.1f ns\n", key_size,
+         librdkafka_murmur2, wrapper_murmur2, librdkafka_consistent,
+         wrapper_consistent);
+}
+
+static std::string stats_json;
+
+static int stats_cb(rd_kafka_t*, char* json, size_t json_len, void*) {
+  stats_json.assign(json, json_len);
+  return 0;
+}
+
+enum class Keyless { kRandom, kLibrdkafkaSticky, kStickyPartitioner };
+
+static void benchKeyless(const char* name, Keyless keyless,
+                         const char* bootstraps, long num_message) {
+  GlobalConf conf;
+  conf.put("bootstrap.servers", bootstraps);
+  conf.put("compression.codec", "lz4");
+  conf.put("linger.ms", "5");
+  conf.put("queue.buffering.max.messages", "1000000");
+  conf.put("statistics.interval.ms", "100");
+  conf.put("sticky.partitioning.linger.ms",
+           keyless == Keyless::kLibrdkafkaSticky ? "10" : "0");
+  conf.setStatsCallback(stats_cb);
+
+  char errstr[512];
+  Producer producer(std::move(conf), errstr);
+  if (producer.isNull())
+    error::Exit("[ERROR] Create producer failed: %s\n", errstr);
+
+  StickyPartitioner<> partitioner(1000);
+  TopicConf topic_conf;
+  if (keyless == Keyless::kStickyPartitioner)
+    topic_conf.setPartitioner(&partitioner);
+  else
+    topic_conf.put("partitioner", "random");
+  Topic topic(producer.get(), "partitioner_bench", std::move(topic_conf));
+
+  // compressible records, like JSON events
+  char payload[128];
+  auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < num_message; i++) {
+    int len = snprintf(payload, sizeof(payload),
+                       "{\"id\":%ld,\"type\":\"click\",\"page\":\"/home\"}", i);
+    while (!producer.produce(topic, payload, static_cast<size_t>(len)))
+      producer.poll(100);
+    producer.poll(0);
+  }
+  while (!producer.flush(1000)) {
+  }
+  double seconds = bench::secondsSince(start);
+
+  // the next report has every request
+  stats_json.clear();
+  producer.poll(300);
+  StatsSnapshot snapshot;
+  if (!snapshot.parse(stats_json.data(), stats_json.size()))
+    error::Exit("[ERROR] no statistics\n");
+  int64_t num_requests = 0;
+  int64_t num_bytes = 0;
+  for (auto& broker : snapshot.brokers) {
+    if (broker.nodeid < 0) continue;  // bootstrap and internal brokers
+    num_requests += broker.tx;
+    num_bytes += broker.txbytes;
+  }
+  printf("%-20s %9.0f msgs/s %8" PRId64 " requests %6.1f bytes/msg\n", name,
+         num_message / seconds, num_requests,
+         static_cast<double>(num_bytes) / num_message);
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 &&
+      (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+    fprintf(stderr,
+            "Usage: %s [message-count] [partition-count] [rounds]\n"
+            "  default: 500000 64 10000000\n",
+            argv[0]);
+    exit(1);
+  }
+  long num_message = (argc > 1) ? atol(argv[1]) : 500000;
+  int num_partitions = (argc > 2) ? atoi(argv[2]) : 64;
+  long rounds = (argc > 3) ? atol(argv[3]) : 10000000;
+  if (num_message <= 0 || num_partitions <= 0 || rounds <= 0)
+    error::Exit("[ERROR] invalid arguments\n");
+
+  printf("%8s %15s %15s %15s %15s\n", "key size", "rdk murmur2",
+         "Murmur2", "rdk consistent", "ConsistentHash");
+  for (size_t key_size : {8, 32, 128}) benchKeyed(key_size, rounds);
+
+  bench::MockClusterProducer cluster;
+  cluster.createTopic("partitioner_bench", num_partitions);
+  std::string bootstraps = cluster.bootstraps();
+  printf("\n%ld keyless messages, %d partitions, lz4\n", num_message,
+         num_partitions);
+  benchKeyless("random", Keyless::kRandom, bootstraps.data(), num_message);
+  benchKeyless("librdkafka sticky", Keyless::kLibrdkafkaSticky,
+               bootstraps.data(), num_message);
+  benchKeyless("StickyPartitioner", Keyless::kStickyPartitioner,
+               bootstraps.data(), num_message);
+  return 0;
+}
@@ -0,0 +1,353 @@
+// perf_suite.cc: producer/consumer throughput and end-to-end latency matrix
+//
+// Every combination of api, payload size, batch size, compression codec and
+// linger.ms is run against librdkafka's mock cluster. Results are written to
+// stdout as a JSON array, progress goes to stderr, e.g.
+//   ./perf_suite.out --codec=none,lz4 > perf_suite.json
+//
+// api "wrapper" uses Producer::produce()/produceBatch() and
+// Consumer::consumeBatch(), api "raw" calls the same librdkafka functions
+// directly, so the difference is the wrapper's overhead.
+// Batch size 1 means one produce() per message.
+#include "bench_util.hpp"
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <sstream>
+#include <thread>
+
+using namespace rdkafka;
+
+struct Options {
+  long num_message = 50000;
+  int num_partitions = 4;
+  std::vector<std::string> apis = {"wrapper", "raw"};
+  std::vector<std::string> payload_sizes = {"100", "1000"};
+  std::vector<std::string> batch_sizes = {"1", "1000"};
+  std::vector<std::string> codecs = {"none", "lz4", "zstd"};
+  std::vector<std::string> linger_ms = {"0", "5"};
+};
+
+struct Case {
+  bool raw;
+  size_t payload_size;
+  size_t batch_size;
+  std::string codec;
+  std::string linger_ms;
+};
+
+struct Result {
+  double produce_secs = 0;
+  double e2e_secs = 0;
+  long num_consumed = 0;
+  long num_failed = 0;
+  std::vector<int64_t> latencies_us;
+};
+
+static constexpr long kWarmupMessages = 100;
+static constexpr int kTimeoutSecs = 60;
+// the mock cluster only keeps the last 5MB of a partition, a consumer that
+// falls behind would lose messages, so a case's topic gets enough partitions
+// and messages are spread over all of them (no sticky partitioning)
+static constexpr size_t kBytesPerPartition = 2 * 1024 * 1024;
+
+static std::atomic<long> num_failed(0);
+
+static void dr_msg_cb(rd_kafka_t*, const rd_kafka_message_t* rkmessage,
+                      void*) {
+  if (rkmessage->err != RD_KAFKA_RESP_ERR_NO_ERROR) ++num_failed;
+}
+
+static int64_t nowUs() {
+  auto now = std::chrono::steady_clock::now().time_since_epoch();
+  return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+}
+
+// payload starts with the enqueue time, 0 for warmup messages
+static void stamp(char* payload, int64_t enqueue_us) {
+  memcpy(payload, &enqueue_us, sizeof(enqueue_us));
+}
+
+static int64_t enqueueTime(const void* payload) {
+  int64_t enqueue_us;
+  memcpy(&enqueue_us, payload, sizeof(enqueue_us));
+  return enqueue_us;
+}
+
+static std::vector<std::string> split(const std::string& s) {
+  std::vector<std::string> values;
+  std::istringstream stream(s);
+  std::string value;
+  while (std::getline(stream, value, ',')) {
+    if (!value.empty()) values.push_back(value);
+  }
+  return values;
+}
+
+static Options parseOptions(int argc, char* argv[]) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    auto pos = arg.find('=');
+    if (arg.compare(0, 2, "--") != 0 || pos == std::string::npos) {
+      fprintf(stderr,
+              "Usage: %s [--messages=N] [--partitions=N] [--api=wrapper,raw]\n"
+              "       [--payload=100,1000] [--batch=1,1000]\n"
+              "       [--codec=none,lz4,zstd] [--linger=0,5]\n",
+              argv[0]);
+      exit(1);
+    }
+    auto name = arg.substr(2, pos - 2);
+    auto value = arg.substr(pos + 1);
+    if (name == "messages") {
+      options.num_message = atol(value.data());
+    } else if (name == "partitions") {
+      options.num_partitions = atoi(value.data());
+    } else if (name == "api") {
+      options.apis = split(value);
+    } else if (name == "payload") {
+      options.payload_sizes = split(value);
+    } else if (name == "batch") {
+      options.batch_sizes = split(value);
+    } else if (name == "codec") {
+      options.codecs = split(value);
+    } else if (name == "linger") {
+      options.linger_ms = split(value);
+    } else {
+      error::Exit("[ERROR] unknown option --%s\n", name.data());
+    }
+  }
+  return options;
+}
+
+// consume until num_message stamped messages arrived, records the latencies
+static void consumeLoop(const Consumer& consumer, bool raw, long num_message,
+                        std::atomic<long>& num_warmup, Result& result) {
+  constexpr size_t kBatchSize = 1000;
+  MessageBatch batch(kBatchSize);
+  std::vector<rd_kafka_message_t*> raw_batch(kBatchSize);
+  auto rkqu = rd_kafka_queue_get_consumer(consumer.get());
+
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::seconds(kTimeoutSecs);
+  while (result.num_consumed < num_message &&
+         std::chrono::steady_clock::now() < deadline) {
+    ssize_t n;
+    if (raw) {
+      n = rd_kafka_consume_batch_queue(rkqu, 100, raw_batch.data(),
+                                       kBatchSize);
+    } else {
+      consumer.consumeBatch(batch, kBatchSize, 100);
+      n = batch.size();
+    }
+
+    int64_t now_us = nowUs();
+    for (ssize_t i = 0; i < n; i++) {
+      const rd_kafka_message_t* rkmessage =
+          raw ? raw_batch[i] : batch[i].get();
+      if (rkmessage->err != RD_KAFKA_RESP_ERR_NO_ERROR) continue;
+
+      int64_t enqueue_us = enqueueTime(rkmessage->payload);
+      if (enqueue_us == 0) {
+        ++num_warmup;
+      } else {
+        result.latencies_us.push_back(now_us - enqueue_us);
+        ++result.num_consumed;
+      }
+    }
+    if (raw) {
+      for (ssize_t i = 0; i < n; i++) rd_kafka_message_destroy(raw_batch[i]);
+    }
+  }
+  rd_kafka_queue_destroy(rkqu);
+}
+
+// produce num_message stamped messages, batch_size == 1 means produce()
+static void produceLoop(const Producer& producer, const Topic& topic,
+                        const Case& c, long num_message, bool warmup) {
+  std::vector<char> payloads(c.payload_size * c.batch_size, 'x');
+  ProduceBatch batch(c.batch_size);
+  std::vector<rd_kafka_message_t> raw_batch;
+
+  long num_left = num_message;
+  while (num_left > 0) {
+    size_t n = std::min<long>(num_left, c.batch_size);
+    for (size_t i = 0; i < n; i++) {
+      stamp(&payloads[i * c.payload_size], warmup ? 0 : nowUs());
+    }
+
+    if (c.batch_size == 1) {
+      bool ok = c.raw ? rd_kafka_produce(topic.get(), RD_KAFKA_PARTITION_UA,
+                                         RD_KAFKA_MSG_F_COPY, payloads.data(),
+                                         c.payload_size, nullptr, 0,
+                                         nullptr) == 0
+                      : producer.produce(topic, payloads.data(),
+                                         c.payload_size);
+      if (ok) --num_left;
+    } else {
+      int num_enqueued = 0;
+      if (c.raw) {
+        raw_batch.assign(n, rd_kafka_message_t());
+        for (size_t i = 0; i < n; i++) {
+          raw_batch[i].payload = &payloads[i * c.payload_size];
+          raw_batch[i].len = c.payload_size;
+        }
+        num_enqueued = rd_kafka_produce_batch(
+            topic.get(), RD_KAFKA_PARTITION_UA, RD_KAFKA_MSG_F_COPY,
+            raw_batch.data(), static_cast<int>(n));
+      } else {
+        batch.clear();
+        for (size_t i = 0; i < n; i++)
+          batch.add(&payloads[i * c.payload_size], c.payload_size);
+        num_enqueued = producer.produceBatch(topic, batch);
+      }
+      // failed messages (queue full) are produced again with a new stamp
+      num_left -= num_enqueued;
+      if (num_enqueued < static_cast<int>(n)) producer.poll(1);
+    }
+    producer.poll(0);
+  }
+}
+
+static Result runCase(const char* bootstraps, const std::string& topic_name,
+                      int num_partitions, const Case& c, long num_message) {
+  Result result;
+  result.latencies_us.reserve(num_message);
+
+  // consumer is assigned all partitions directly, no group rebalance
+  std::string group = topic_name + "-group";
+  char errstr[512];
+  auto consumer_conf = bench::consumerConf(bootstraps, group.data());
+  // the default 500ms fetch wait would dominate the latency on the mock cluster
+  consumer_conf.put("fetch.wait.max.ms", "10");
+  // the mock cluster doesn't return a record batch larger than this, which
+  // linger.ms and 1KB payloads can produce
+  consumer_conf.put("max.partition.fetch.bytes", "10485760");
+  Consumer consumer(std::move(consumer_conf), errstr);
+  if (consumer.isNull())
+    error::Exit("[ERROR] Create consumer failed: %s\n", errstr);
+  auto partitions = rd_kafka_topic_partition_list_new(num_partitions);
+  rd_kafka_topic_partition_list_add_range(partitions, topic_name.data(), 0,
+                                          num_partitions - 1);
+  for (int i = 0; i < partitions->cnt; i++)
+    partitions->elems[i].offset = RD_KAFKA_OFFSET_BEGINNING;
+  error::checkRespError(rd_kafka_assign(consumer.get(), partitions),
+                        "rd_kafka_assign");
+  rd_kafka_topic_partition_list_destroy(partitions);
+
+  GlobalConf conf;
+  conf.put("bootstrap.servers", bootstraps);
+  conf.put("queue.buffering.max.messages", "1000000");
+  conf.put("linger.ms", c.linger_ms.data());
+  conf.put("compression.codec", c.codec.data());
+  conf.put("sticky.partitioning.linger.ms", "0");
+  conf.setDeliveryReportCallback(dr_msg_cb);
+  Producer producer(std::move(conf), errstr);
+  if (producer.isNull())
+    error::Exit("[ERROR] Create producer failed: %s\n", errstr);
+  Topic topic(producer.get(), topic_name.data());
+
+  std::atomic<long> num_warmup(0);
+  int64_t last_consumed_us = 0;
+  std::thread consumer_thread([&] {
+    consumeLoop(consumer, c.raw, num_message, num_warmup, result);
+    last_consumed_us = nowUs();
+  });
+
+  // warmup: wait until the consumer is fetching
+  produceLoop(producer, topic, c, kWarmupMessages, true);
+  producer.flush(kTimeoutSecs * 1000);
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::seconds(kTimeoutSecs);
+  while (num_warmup < kWarmupMessages &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  num_failed = 0;
+  int64_t start_us = nowUs();
+  produceLoop(producer, topic, c, num_message, false);
+  producer.flush(kTimeoutSecs * 1000);
+  result.produce_secs = (nowUs() - start_us) / 1e6;
+
+  consumer_thread.join();
+  result.e2e_secs = (last_consumed_us - start_us) / 1e6;
+  result.num_failed = num_failed;
+  consumer.waitUntilRebalanceRevoke();
+  return result;
+}
+
+static int64_t percentile(std::vector<int64_t>& values, double p) {
+  if (values.empty()) return -1;
+  auto n = static_cast<size_t>(p * (values.size() - 1));
+  std::nth_element(values.begin(), values.begin() + n, values.end());
+  return values[n];
+}
+
+static void printResult(const Case& c, int num_partitions, long num_message,
+                        Result& result, bool first) {
+  double mb = static_cast<double>(num_message) * c.payload_size / 1e6;
+  printf("%s  {\"api\": \"%s\", \"payload_size\": %zu, \"batch_size\": %zu, "
+         "\"codec\": \"%s\", \"linger_ms\": %s, \"partitions\": %d, "
+         "\"messages\": %ld, \"consumed\": %ld, \"delivery_errors\": %ld,\n"
+         "   \"produce_msgs_per_sec\": %.0f, \"produce_mb_per_sec\": %.2f, "
+         "\"e2e_msgs_per_sec\": %.0f, \"e2e_mb_per_sec\": %.2f,\n"
+         "   \"latency_us\": {\"p50\": %lld, \"p99\": %lld, \"p999\": %lld}}",
+         first ? "" : ",\n", c.raw ? "raw" : "wrapper", c.payload_size,
+         c.batch_size, c.codec.data(), c.linger_ms.data(), num_partitions,
+         num_message, result.num_consumed, result.num_failed,
+         num_message / result.produce_secs, mb / result.produce_secs,
+         result.num_consumed / result.e2e_secs, mb / result.e2e_secs,
+         static_cast<long long>(percentile(result.latencies_us, 0.5)),
+         static_cast<long long>(percentile(result.latencies_us, 0.99)),
+         static_cast<long long>(percentile(result.latencies_us, 0.999)));
+  fflush(stdout);
+}
+
+int main(int argc, char* argv[]) {
+  auto options = parseOptions(argc, argv);
+
+  std::vector<Case> cases;
+  for (auto const& api : options.apis)
+    for (auto const& payload_size : options.payload_sizes)
+      for (auto const& batch_size : options.batch_sizes)
+        for (auto const& codec : options.codecs)
+          for (auto const& linger_ms : options.linger_ms) {
+            Case c{api == "raw", static_cast<size_t>(atol(payload_size.data())),
+                   static_cast<size_t>(atol(batch_size.data())), codec,
+                   linger_ms};
+            // the payload holds the enqueue time
+            if (c.payload_size < sizeof(int64_t)) c.payload_size = 8;
+            if (c.batch_size == 0) c.batch_size = 1;
+            cases.push_back(c);
+          }
+
+  bench::MockClusterProducer cluster;
+  std::string bootstraps = cluster.bootstraps();
+
+  printf("[\n");
+  for (size_t i = 0; i < cases.size(); i++) {
+    auto const& c = cases[i];
+    fprintf(stderr, "[%zu/%zu] api=%s payload=%zu batch=%zu codec=%s "
+            "linger.ms=%s\n", i + 1, cases.size(), c.raw ? "raw" : "wrapper",
+            c.payload_size, c.batch_size, c.codec.data(), c.linger_ms.data());
+
+    // a topic per case, so no case reads another's messages
+    std::string topic_name = "perf_suite_" + std::to_string(i);
+    size_t num_bytes = options.num_message * c.payload_size;
+    int num_partitions = std::max<int>(options.num_partitions,
+                                       num_bytes / kBytesPerPartition + 1);
+    cluster.createTopic(topic_name.data(), num_partitions);
+
+    auto result = runCase(bootstraps.data(), topic_name, num_partitions, c,
+                          options.num_message);
+    if (result.num_consumed < options.num_message)
+      fprintf(stderr, "[WARN] only %ld messages consumed in %d seconds\n",
+              result.num_consumed, kTimeoutSecs);
+    printResult(c, num_partitions, options.num_message, result, i == 0);
+  }
+  printf("\n]\n");
+  return 0;
+}
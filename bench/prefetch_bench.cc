@@ -0,0 +1,125 @@
+// prefetch_bench.cc: a slow consumer reads a backlog while librdkafka
+// prefetches it. With the plain consumer all partitions share the consumer
+// queue (queued.max.messages.kbytes), PartitionPrefetcher gives each
+// partition its own queue plus a read-ahead limit. The peak prefetched bytes
+// (from statistics, every 100 ms) and the consume rate are reported.
+#include "bench_util.hpp"
+#include "rdkafka_prefetch.hpp"
+#include "rdkafka_stats.hpp"
+
+#include <stdlib.h>
+
+using namespace rdkafka;
+
+static const char* kTopic = "prefetch_bench";
+
+static PartitionPrefetcher* prefetcher;  // null for the plain consumer
+static StatsSnapshot stats;
+static int64_t peak_prefetched = 0;
+
+static int statsCallback(rd_kafka_t*, char* json, size_t json_len, void*) {
+  if (!stats.parse(json, json_len)) return 0;
+  int64_t prefetched = 0;
+  for (const auto& topic : stats.topics) {
+    for (const auto& partition : topic.partitions) {
+      if (partition.partition < 0) continue;
+      if (prefetcher) {
+        // each partition's own queue and buffer
+        prefetched += partition.fetchq_size +
+                      prefetcher->bufferedBytes(
+                          topic.name,
+                          static_cast<int32_t>(partition.partition));
+      } else {
+        // the consumer queue's size, whichever partition
+        prefetched = std::max(prefetched, partition.fetchq_size);
+      }
+    }
+  }
+  peak_prefetched = std::max(peak_prefetched, prefetched);
+  return 0;
+}
+
+static void spin(int work_us) {
+  auto start = std::chrono::steady_clock::now();
+  while (bench::secondsSince(start) * 1e6 < work_us) {
+  }
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 &&
+      (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+    fprintf(stderr,
+            "Usage: %s [message-count] [partition-count] [payload-size] "
+            "[work-us]\n"
+            "  default: 50000 4 1000 20\n",
+            argv[0]);
+    exit(1);
+  }
+  long num_message = (argc > 1) ? atol(argv[1]) : 50000;
+  int num_partitions = (argc > 2) ? atoi(argv[2]) : 4;
+  size_t payload_size = (argc > 3) ? atol(argv[3]) : 1000;
+  int work_us = (argc > 4) ? atoi(argv[4]) : 20;
+  if (num_message <= 0 || num_partitions <= 0 || work_us < 0)
+    error::Exit("[ERROR] invalid arguments\n");
+
+  bench::MockClusterProducer cluster;
+  cluster.createTopic(kTopic, num_partitions);
+  cluster.fillTopic(kTopic, num_message, payload_size);
+  printf("%ld messages of %zu bytes in %d partitions, %d us per message\n",
+         num_message, payload_size, num_partitions, work_us);
+  printf("%-24s %12s %18s\n", "consumer", "msg/s", "peak prefetch MB");
+
+  // queued.max.messages.kbytes is 1024 in all runs, -1: the plain consumer
+  for (long limit_kb : {-1L, 0L, 256L, 1024L}) {
+    auto conf = bench::consumerConf(cluster.bootstraps(), "prefetch-bench");
+    conf.put("statistics.interval.ms", "100");
+    conf.put("queued.max.messages.kbytes", "1024");
+    conf.put("max.partition.fetch.bytes", "262144");
+    conf.setStatsCallback(statsCallback);
+    char errstr[512];
+    Consumer consumer(std::move(conf), errstr);
+    if (consumer.isNull())
+      error::Exit("[ERROR] Create consumer failed: %s\n", errstr);
+    std::unique_ptr<PartitionPrefetcher> partition_prefetcher;
+    if (limit_kb >= 0)
+      partition_prefetcher.reset(
+          new PartitionPrefetcher(consumer, limit_kb * 1024));
+    prefetcher = partition_prefetcher.get();
+    peak_prefetched = 0;
+
+    PointerHolder<rd_kafka_topic_partition_list_t> partitions(
+        rd_kafka_topic_partition_list_new(num_partitions));
+    for (int32_t p = 0; p < num_partitions; p++)
+      rd_kafka_topic_partition_list_add(partitions.get(), kTopic, p)->offset =
+          RD_KAFKA_OFFSET_BEGINNING;
+    if (prefetcher) prefetcher->assign(partitions.get());
+    error::checkRespError(rd_kafka_assign(consumer.get(), partitions.get()),
+                          "rd_kafka_assign");
+
+    // until nothing arrives for a second
+    long num_consumed = 0;
+    auto start = std::chrono::steady_clock::now();
+    double secs = 0;
+    while (num_consumed < num_message) {
+      auto message = prefetcher ? prefetcher->consume(1000)
+                                : consumer.consume(1000);
+      if (message.isNull()) break;
+      if (message.hasError()) continue;
+      ++num_consumed;
+      spin(work_us);
+      secs = bench::secondsSince(start);
+    }
+    std::string name =
+        prefetcher ? "per partition, " + std::to_string(limit_kb) + " KB"
+                   : "shared queue";
+    printf("%-24s %12.0f %18.1f\n", name.data(), num_consumed / secs,
+           peak_prefetched / 1e6);
+
+    if (prefetcher) prefetcher->revoke();
+    rd_kafka_assign(consumer.get(), nullptr);
+    partition_prefetcher.reset();
+    prefetcher = nullptr;
+    consumer.waitUntilRebalanceRevoke();
+  }
+  return 0;
+}
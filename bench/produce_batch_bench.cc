@@ -0,0 +1,143 @@
+// produce_batch_bench.cc: Producer::produce() loop vs Producer::produceBatch()
+// Runs against librdkafka's mock cluster, so no broker is needed.
+#include "rdkafka_classes.hpp"
+
+#include <stdlib.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace rdkafka;
+
+static long num_delivered = 0;
+static long num_failed = 0;
+
+static void dr_msg_cb(rd_kafka_t*, const rd_kafka_message_t* rkmessage,
+                      void*) {
+  if (rkmessage->err == RD_KAFKA_RESP_ERR_NO_ERROR)
+    ++num_delivered;
+  else
+    ++num_failed;
+}
+
+static void waitDelivered(const Producer& producer, long num_message) {
+  while (num_delivered + num_failed < num_message) producer.flush(100);
+}
+
+// the same loop as examples/producer.cc: one produce() per message and retry
+// after polling when the queue is full
+static void runLoop(const Producer& producer, const Topic& topic,
+                    std::vector<char>& payload, long num_message) {
+  for (long i = 0; i < num_message; i++) {
+    while (!producer.produce(topic, payload.data(), payload.size())) {
+      if (rd_kafka_last_error() != RD_KAFKA_RESP_ERR__QUEUE_FULL) {
+        error::Exit("produce failed: %s\n",
+                    rd_kafka_err2str(rd_kafka_last_error()));
+      }
+      producer.poll(1);
+    }
+    producer.poll(0);
+  }
+}
+
+static void runBatch(const Producer& producer, const Topic& topic,
+                     std::vector<char>& payload, long num_message,
+                     int batch_size, PayloadOwnership ownership) {
+  ProduceBatch batch(batch_size);
+  ProduceBatch retry(batch_size);
+
+  long num_added = 0;
+  while (num_added < num_message || !retry.empty()) {
+    batch.clear();
+    // messages failed with QUEUE_FULL are produced first
+    for (size_t i = 0; i < retry.size(); i++) {
+      batch.add(retry[i].payload, retry[i].len);
+    }
+    while (batch.size() < static_cast<size_t>(batch_size) &&
+           num_added < num_message) {
+      batch.add(payload.data(), payload.size());
+      ++num_added;
+    }
+
+    retry.clear();
+    int n = producer.produceBatch(topic, batch, ownership);
+    if (n < static_cast<int>(batch.size())) {
+      for (size_t i = 0; i < batch.size(); i++) {
+        ErrorCode err = batch.error(i);
+        if (err == RD_KAFKA_RESP_ERR_NO_ERROR) continue;
+        if (err != RD_KAFKA_RESP_ERR__QUEUE_FULL)
+          error::Exit("produceBatch failed: %s\n", rd_kafka_err2str(err));
+        retry.add(batch[i].payload, batch[i].len);
+      }
+      producer.poll(1);
+    }
+    producer.poll(0);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 &&
+      (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+    fprintf(stderr,
+            "Usage: %s [message-count] [payload-size] [batch-size]\n"
+            "  default: 1000000 100 1000\n",
+            argv[0]);
+    exit(1);
+  }
+  long num_message = (argc > 1) ? atol(argv[1]) : 1000000;
+  size_t payload_size = (argc > 2) ? atol(argv[2]) : 100;
+  int batch_size = (argc > 3) ? atoi(argv[3]) : 1000;
+
+  GlobalConf conf;
+  conf.put("test.mock.num.brokers", "1");
+  conf.put("queue.buffering.max.messages", "1000000");
+  conf.put("linger.ms", "5");
+  conf.setDeliveryReportCallback(dr_msg_cb);
+
+  char errstr[512];
+  Producer producer(std::move(conf), errstr);
+  if (producer.isNull())
+    error::Exit("[ERROR] Create producer failed: %s\n", errstr);
+  Topic topic(producer.get(), "produce_batch_bench");
+
+  // payload lives until the end, so PayloadOwnership::kBorrow is safe here
+  std::vector<char> payload(payload_size, 'x');
+
+  struct Case {
+    const char* name;
+    bool batch;
+    PayloadOwnership ownership;
+  } cases[] = {
+      {"produce() loop (copy)", false, PayloadOwnership::kCopy},
+      {"produceBatch() (copy)", true, PayloadOwnership::kCopy},
+      {"produceBatch() (borrow)", true, PayloadOwnership::kBorrow},
+  };
+
+  printf("%ld messages, payload %zu bytes, batch size %d\n", num_message,
+         payload_size, batch_size);
+  for (auto const& c : cases) {
+    num_delivered = num_failed = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    if (c.batch) {
+      runBatch(producer, topic, payload, num_message, batch_size, c.ownership);
+    } else {
+      runLoop(producer, topic, payload, num_message);
+    }
+    auto enqueued = std::chrono::steady_clock::now();
+    waitDelivered(producer, num_message);
+    auto delivered = std::chrono::steady_clock::now();
+
+    double enqueue_secs =
+        std::chrono::duration<double>(enqueued - start).count();
+    double total_secs =
+        std::chrono::duration<double>(delivered - start).count();
+    printf(
+        "%-24s enqueue %10.0f msgs/s, delivered %10.0f msgs/s (%ld failed)\n",
+        c.name, num_message / enqueue_secs, num_message / total_secs,
+        num_failed);
+  }
+
+  return 0;
+}
@@ -0,0 +1,106 @@
+// serde_bench.cc: producing int64_t keys and length-prefixed string values
+// encoded by hand into std::string, like services did before TypedProducer,
+// compared with TypedProducer's thread-local arena. Then decoding them from
+// messages into std::string or zero-copy Slice. Allocations are counted by
+// operator new, librdkafka's own mallocs aren't.
+#include "bench_util.hpp"
+#include "rdkafka_serde.hpp"
+
+#include <arpa/inet.h>
+#include <stdlib.h>
+
+#include <new>
+
+using namespace rdkafka;
+
+static long num_allocations = 0;
+
+void* operator new(size_t size) {
+  ++num_allocations;
+  void* p = malloc(size);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  ++num_allocations;
+  return malloc(size);
+}
+
+void operator delete(void* p) noexcept { free(p); }
+
+using KeySerde = BigEndianSerde<int64_t>;
+using ValueSerde = LengthPrefixedSerde<int32_t>;
+
+template <typename Function>
+static void run(const char* name, long num_message, Function f) {
+  long allocations = num_allocations;
+  auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < num_message; i++) f(i);
+  double seconds = bench::secondsSince(start);
+  printf("%-30s %10.0f msg/s %6.2f allocations/msg\n", name,
+         num_message / seconds,
+         static_cast<double>(num_allocations - allocations) / num_message);
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 &&
+      (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+    fprintf(stderr,
+            "Usage: %s [message-count] [payload-size]\n"
+            "  default: 200000 100\n",
+            argv[0]);
+    exit(1);
+  }
+  long num_message = (argc > 1) ? atol(argv[1]) : 200000;
+  int payload_size = (argc > 2) ? atoi(argv[2]) : 100;
+  if (num_message <= 0 || payload_size <= 0)
+    error::Exit("[ERROR] invalid arguments\n");
+  printf("%ld messages, %d bytes payload\n", num_message, payload_size);
+
+  bench::MockClusterProducer cluster;
+  cluster.createTopic("serde_bench", 1);
+  const Producer& producer = cluster.producer();
+  Topic topic(producer.get(), "serde_bench");
+  std::string payload(payload_size, 'x');
+
+  auto drain = [&producer] {
+    while (!producer.flush(1000)) {
+    }
+  };
+
+  run("hand-rolled std::string", num_message, [&](long i) {
+    std::string key(8, '\0');
+    for (int j = 7; j >= 0; j--, i >>= 8) key[j] = static_cast<char>(i & 0xff);
+    std::string value(4, '\0');
+    uint32_t length = htonl(static_cast<uint32_t>(payload.size()));
+    memcpy(&value[0], &length, 4);
+    value += payload;
+    producer.produce(topic, &value[0], value.size(), key.data(), key.size());
+    producer.poll(0);
+  });
+  drain();
+
+  TypedProducer<int64_t, Slice, KeySerde, ValueSerde> typed_producer(producer);
+  run("TypedProducer", num_message, [&](long i) {
+    typed_producer.produce(topic, i, payload);
+    producer.poll(0);
+  });
+  drain();
+
+  // decoding values, without the consumer's cost
+  std::vector<char> message(4 + payload.size());
+  ValueSerde::encode(payload, message.data());
+  Slice bytes(message.data(), message.size());
+  size_t total = 0;
+  run("decode to std::string", num_message, [&](long) {
+    std::string value;
+    if (ValueSerde::decode(bytes, &value)) total += value.size();
+  });
+  run("decode to Slice", num_message, [&](long) {
+    Slice value;
+    if (ValueSerde::decode(bytes, &value)) total += value.size();
+  });
+  if (total == 0) error::Exit("[ERROR] nothing decoded\n");
+  return 0;
+}
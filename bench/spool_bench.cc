@@ -0,0 +1,107 @@
+// spool_bench.cc: produce while the mock broker is down, with a plain
+// producer whose queue fills up and then rejects messages, and with
+// SpoolingProducer, which spills them to disk. Then the broker is brought up
+// and the time to replay and deliver the spooled messages is measured.
+#include "bench_util.hpp"
+#include "rdkafka_spool.hpp"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace rdkafka;
+
+static const char* kTopic = "spool_bench";
+
+static Producer* newProducer(const char* bootstraps, long queue_size) {
+  GlobalConf conf;
+  conf.put("bootstrap.servers", bootstraps);
+  conf.put("queue.buffering.max.messages",
+           std::to_string(queue_size).data());
+  char errstr[512];
+  auto producer = new Producer(std::move(conf), errstr);
+  if (producer->isNull())
+    error::Exit("[ERROR] Create producer failed: %s\n", errstr);
+  return producer;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 &&
+      (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+    fprintf(stderr,
+            "Usage: %s [message-count] [queue-size] [payload-size] "
+            "[spool-dir]\n"
+            "  default: 500000 10000 100 /tmp\n",
+            argv[0]);
+    exit(1);
+  }
+  long num_message = (argc > 1) ? atol(argv[1]) : 500000;
+  long queue_size = (argc > 2) ? atol(argv[2]) : 10000;
+  size_t payload_size = (argc > 3) ? atol(argv[3]) : 100;
+  std::string parent = (argc > 4) ? argv[4] : "/tmp";
+  if (num_message <= 0 || queue_size <= 0)
+    error::Exit("[ERROR] invalid arguments\n");
+
+  bench::MockClusterProducer cluster;
+  cluster.createTopic(kTopic, 1);
+  auto mcluster = cluster.mockCluster();
+  std::vector<char> payload(payload_size, 'x');
+  Slice value(payload.data(), payload.size());
+  printf("%ld messages of %zu bytes, queue of %ld messages, broker down\n",
+         num_message, payload_size, queue_size);
+  printf("%-10s %10s %10s %14s %14s\n", "mode", "accepted", "rejected",
+         "produce/s", "replay msg/s");
+
+  // plain producer: the queue fills up, then every message is rejected
+  {
+    rd_kafka_mock_broker_set_down(mcluster, 1);
+    std::unique_ptr<Producer> producer(
+        newProducer(cluster.bootstraps(), queue_size));
+    Topic topic(producer->get(), kTopic);
+    long num_accepted = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < num_message; i++) {
+      if (producer->produceCopy(topic, value)) ++num_accepted;
+    }
+    double secs = bench::secondsSince(start);
+    printf("%-10s %10ld %10ld %14.0f %14s\n", "queue", num_accepted,
+           num_message - num_accepted, num_message / secs, "-");
+    rd_kafka_mock_broker_set_up(mcluster, 1);
+    while (!producer->flush(1000)) {
+    }
+  }
+
+  // spool: everything is accepted, then replayed in order
+  {
+    std::string directory = parent + "/spool_bench.XXXXXX";
+    if (!mkdtemp(&directory[0]))
+      error::Exit("[ERROR] mkdtemp failed: %s\n", strerror(errno));
+    rd_kafka_mock_broker_set_down(mcluster, 1);
+    std::unique_ptr<Producer> producer(
+        newProducer(cluster.bootstraps(), queue_size));
+    std::unique_ptr<SpoolingProducer> spooling(
+        new SpoolingProducer(*producer));
+    std::string error;
+    if (!spooling->open(directory, error))
+      error::Exit("[ERROR] %s\n", error.data());
+    Topic topic(producer->get(), kTopic);
+    long num_accepted = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < num_message; i++) {
+      if (spooling->produce(topic, value) == RD_KAFKA_RESP_ERR_NO_ERROR)
+        ++num_accepted;
+    }
+    double secs = bench::secondsSince(start);
+
+    rd_kafka_mock_broker_set_up(mcluster, 1);
+    start = std::chrono::steady_clock::now();
+    while (!spooling->flush(1000)) {
+    }
+    double replay_secs = bench::secondsSince(start);
+    printf("%-10s %10ld %10ld %14.0f %14.0f\n", "spool", num_accepted,
+           num_message - num_accepted, num_message / secs,
+           num_accepted / replay_secs);
+    spooling.reset();  // deletes the replayed segments
+    rmdir(directory.data());
+  }
+  return 0;
+}
@@ -0,0 +1,120 @@
+// stats_bench.cc: StatsSnapshot::parse() cost on the statistics JSON of a
+// producer writing to many partitions, and the allocations per parse when a
+// snapshot is reused between callbacks.
+#include "bench_util.hpp"
+#include "rdkafka_stats.hpp"
+
+#include <stdlib.h>
+
+#include <new>
+
+using namespace rdkafka;
+
+static long num_allocations = 0;
+
+void* operator new(size_t size) {
+  ++num_allocations;
+  void* p = malloc(size);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  ++num_allocations;
+  return malloc(size);
+}
+
+void operator delete(void* p) noexcept { free(p); }
+
+static std::string stats_json;
+
+static int stats_cb(rd_kafka_t*, char* json, size_t json_len, void*) {
+  stats_json.assign(json, json_len);
+  return 0;
+}
+
+// statistics of a producer that has written to every partition
+static void collectStats(int num_topics, int num_partitions) {
+  bench::MockClusterProducer cluster;
+
+  GlobalConf conf;
+  conf.put("bootstrap.servers", cluster.bootstraps());
+  conf.put("statistics.interval.ms", "100");
+  conf.setStatsCallback(stats_cb);
+
+  char errstr[512];
+  Producer producer(std::move(conf), errstr);
+  if (producer.isNull())
+    error::Exit("[ERROR] Create producer failed: %s\n", errstr);
+
+  char payload[] = "stats";
+  for (int i = 0; i < num_topics; i++) {
+    std::string topic_name = "stats_bench_" + std::to_string(i);
+    cluster.createTopic(topic_name.data(), num_partitions);
+    Topic topic(producer.get(), topic_name.data());
+    for (int partition = 0; partition < num_partitions; partition++) {
+      producer.setPartition(partition);
+      producer.produce(topic, payload, sizeof(payload));
+    }
+  }
+  producer.flush(10 * 1000);
+
+  // wait for a report that has all the topics
+  stats_json.clear();
+  auto start = std::chrono::steady_clock::now();
+  StatsSnapshot snapshot;
+  while (bench::secondsSince(start) < 10) {
+    producer.poll(100);
+    if (snapshot.parse(stats_json.data(), stats_json.size()) &&
+        snapshot.topics.size() == static_cast<size_t>(num_topics))
+      return;
+  }
+  error::Exit("[ERROR] no statistics of %d topics\n", num_topics);
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 &&
+      (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+    fprintf(stderr,
+            "Usage: %s [topic-count] [partition-count] [rounds]\n"
+            "  default: 10 100 200\n",
+            argv[0]);
+    exit(1);
+  }
+  int num_topics = (argc > 1) ? atoi(argv[1]) : 10;
+  int num_partitions = (argc > 2) ? atoi(argv[2]) : 100;
+  int rounds = (argc > 3) ? atoi(argv[3]) : 200;
+  if (num_topics <= 0 || num_partitions <= 0 || rounds <= 0)
+    error::Exit("[ERROR] invalid arguments\n");
+
+  collectStats(num_topics, num_partitions);
+  printf("statistics JSON: %zu bytes, %d topics x %d partitions\n",
+         stats_json.size(), num_topics, num_partitions);
+
+  StatsSnapshot snapshot;
+  long allocations = num_allocations;
+  snapshot.parse(stats_json.data(), stats_json.size());
+  printf("first parse: %ld allocations\n", num_allocations - allocations);
+
+  allocations = num_allocations;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < rounds; i++)
+    snapshot.parse(stats_json.data(), stats_json.size());
+  double seconds = bench::secondsSince(start);
+  printf("reused snapshot: %.1f us/parse, %.1f MB/s, %.1f allocations/parse\n",
+         seconds * 1e6 / rounds, stats_json.size() * rounds / seconds / 1e6,
+         static_cast<double>(num_allocations - allocations) / rounds);
+
+  StatsSnapshot prev = snapshot;
+  prev.ts -= 1000000;  // one second earlier
+  StatsRates rates;
+  rates.compute(prev, snapshot);
+  allocations = num_allocations;
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < rounds; i++) rates.compute(prev, snapshot);
+  seconds = bench::secondsSince(start);
+  printf("rates of %zu partitions: %.1f us/compute, %.1f allocations/compute\n",
+         rates.partitions.size(), seconds * 1e6 / rounds,
+         static_cast<double>(num_allocations - allocations) / rounds);
+  return 0;
+}
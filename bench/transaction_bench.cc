@@ -0,0 +1,140 @@
+// transaction_bench.cc: consume-transform-produce through
+// TransactionalProducer by records per transaction, transactions/s and
+// records/s show how batching amortizes the per-transaction round trips.
+// The first row produces the same records without a transaction.
+#include "bench_util.hpp"
+#include "rdkafka_transaction.hpp"
+
+#include <stdlib.h>
+
+using namespace rdkafka;
+
+static const char* kInputTopic = "transaction_bench_in";
+static const char* kOutputTopic = "transaction_bench_out";
+
+struct Result {
+  long records = 0;
+  long transactions = 0;
+  double secs = 0;
+};
+
+// transform up to num_records inputs, committing every records_per_txn
+// records, or produce them without transaction if records_per_txn is 0
+static Result run(const char* bootstraps, long num_records,
+                  long records_per_txn, const std::string& id) {
+  GlobalConf conf;
+  conf.put("bootstrap.servers", bootstraps);
+  conf.put("queue.buffering.max.messages", "1000000");
+  if (records_per_txn > 0) conf.put("transactional.id", id.data());
+  char errstr[512];
+  Producer producer(std::move(conf), errstr);
+  if (producer.isNull())
+    error::Exit("[ERROR] Create producer failed: %s\n", errstr);
+
+  Consumer consumer(bench::consumerConf(bootstraps, id.data()), errstr);
+  if (consumer.isNull())
+    error::Exit("[ERROR] Create consumer failed: %s\n", errstr);
+  PointerHolder<rd_kafka_topic_partition_list_t> partitions(
+      rd_kafka_topic_partition_list_new(1));
+  rd_kafka_topic_partition_list_add(partitions.get(), kInputTopic, 0)->offset =
+      RD_KAFKA_OFFSET_BEGINNING;
+  error::checkRespError(rd_kafka_assign(consumer.get(), partitions.get()),
+                        "rd_kafka_assign");
+
+  TransactionOptions options;
+  options.max_records = records_per_txn;
+  options.max_duration = std::chrono::milliseconds(60 * 1000);
+  TransactionalProducer txn(producer, consumer.get(), options);
+  if (records_per_txn > 0) {
+    auto error = txn.init();
+    if (!error.isNull())
+      error::Exit("[ERROR] init transactions failed: %s\n", error.str());
+  }
+
+  Topic output(producer.get(), kOutputTopic);
+  MessageBatch batch(1000);
+  char payload[256];
+  Result result;
+  auto start = std::chrono::steady_clock::now();
+  while (result.records < num_records) {
+    consumer.consumeBatch(batch, batch.capacity(), 1000);
+    for (size_t i = 0; i < batch.size() && result.records < num_records;
+         i++) {
+      auto message = batch[i];
+      if (message.hasError()) continue;
+      size_t len = std::min(message.payloadLen(), sizeof(payload));
+      for (size_t j = 0; j < len; j++)
+        payload[j] = static_cast<char>(toupper(message.payload()[j]));
+
+      Slice value(payload, len);
+      if (records_per_txn == 0) {
+        while (!producer.produceCopy(output, value)) producer.poll(1);
+      } else {
+        auto error_code = txn.produce(output, value);
+        if (error_code != RD_KAFKA_RESP_ERR_NO_ERROR)
+          error::Exit("[ERROR] produce failed: %s\n",
+                      rd_kafka_err2str(error_code));
+        auto error = txn.consumed(message);
+        if (!error.isNull())
+          error::Exit("[ERROR] commit failed: %s\n", error.str());
+      }
+      ++result.records;
+    }
+  }
+  if (records_per_txn == 0) {
+    while (!producer.flush(1000)) {
+    }
+  } else {
+    auto error = txn.commit();
+    if (!error.isNull())
+      error::Exit("[ERROR] commit failed: %s\n", error.str());
+  }
+  result.secs = bench::secondsSince(start);
+  result.transactions = txn.counts().committed;
+  consumer.waitUntilRebalanceRevoke();
+  return result;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 &&
+      (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+    fprintf(stderr,
+            "Usage: %s [message-count] [max-transactions] [payload-size]\n"
+            "  default: 20000 100 100\n",
+            argv[0]);
+    exit(1);
+  }
+  long num_message = (argc > 1) ? atol(argv[1]) : 20000;
+  long max_transactions = (argc > 2) ? atol(argv[2]) : 100;
+  size_t payload_size = (argc > 3) ? atol(argv[3]) : 100;
+  if (num_message <= 0 || max_transactions <= 0)
+    error::Exit("[ERROR] invalid arguments\n");
+
+  bench::MockClusterProducer cluster(3);
+  cluster.createTopic(kInputTopic, 1);
+  cluster.createTopic(kOutputTopic, 1);
+  cluster.fillTopic(kInputTopic, num_message, payload_size);
+
+  printf("%ld input messages of %zu bytes, at most %ld transactions a row\n",
+         num_message, payload_size, max_transactions);
+  printf("%-16s %10s %12s %14s %14s\n", "records/txn", "records",
+         "transactions", "txn/s", "records/s");
+  for (long records_per_txn : {0L, 1L, 10L, 100L, 1000L, 10000L}) {
+    // small transactions are slow, limit their count
+    long num_records = num_message;
+    if (records_per_txn > 0)
+      num_records = std::min(num_records, records_per_txn * max_transactions);
+    auto result =
+        run(cluster.bootstraps(), num_records, records_per_txn,
+            "transaction-bench-" + std::to_string(records_per_txn));
+    char label[32];
+    if (records_per_txn == 0)
+      snprintf(label, sizeof(label), "no transaction");
+    else
+      snprintf(label, sizeof(label), "%ld", records_per_txn);
+    printf("%-16s %10ld %12ld %14.1f %14.0f\n", label, result.records,
+           result.transactions, result.transactions / result.secs,
+           result.records / result.secs);
+  }
+  return 0;
+}
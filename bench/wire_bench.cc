@@ -0,0 +1,144 @@
+// wire_bench.cc: decoding consumer protocol assignments like group lag
+// tooling does for every member of thousands of groups, the ByteBuffer of
+// examples/group_metadata.cc before rdkafka_wire.hpp (a std::string per topic
+// and a std::vector per partition list) compared with WireReader decoding
+// views into a reused WireArena.
+#include "bench_util.hpp"
+#include "rdkafka_wire.hpp"
+
+#include <arpa/inet.h>
+#include <stdlib.h>
+
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace rdkafka;
+
+static long num_allocations = 0;
+
+void* operator new(size_t size) {
+  ++num_allocations;
+  void* p = malloc(size);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+
+// examples/group_metadata.cc before rdkafka_wire.hpp, without printing
+struct ByteBuffer {
+  const void* data;
+  int size;
+
+  const char* char_ptr(int pos = 0) const noexcept {
+    return static_cast<const char*>(data) + pos;
+  }
+
+  void checkRange(int pos, int n) const {
+    if (pos + n > size) {
+      fprintf(stderr, "checkRange error: pos=%d n=%d size=%d\n", pos, n, size);
+      abort();
+    }
+  }
+
+  int16_t getInt16(int pos) const noexcept {
+    checkRange(pos, 2);
+    return ntohs(*reinterpret_cast<const uint16_t*>(char_ptr(pos)));
+  }
+
+  int32_t getInt32(int pos) const noexcept {
+    checkRange(pos, 4);
+    return ntohl(*reinterpret_cast<const uint32_t*>(char_ptr(pos)));
+  }
+
+  std::string getString(int pos) const noexcept {
+    int16_t length = getInt16(pos);
+    checkRange(pos + 2, length);
+    return {char_ptr(pos + 2), static_cast<size_t>(length)};
+  }
+};
+
+static size_t legacyDecode(const std::string& data) {
+  ByteBuffer buffer{data.data(), static_cast<int>(data.size())};
+  int assign_cnt = buffer.getInt32(2);
+  size_t num_partitions = 0;
+  int pos = 6;
+  for (int i = 0; i < assign_cnt; i++) {
+    auto topic = buffer.getString(pos);
+    pos += (2 + topic.size());
+
+    std::vector<int32_t> partitions;
+    int partition_cnt = buffer.getInt32(pos);
+    pos += 4;
+    for (int j = 0; j < partition_cnt; j++) {
+      partitions.emplace_back(buffer.getInt32(pos));
+      pos += 4;
+    }
+    num_partitions += partitions.size();
+  }
+  return num_partitions;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 &&
+      (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+    fprintf(stderr,
+            "Usage: %s [member-count] [topic-count] [partition-count]\n"
+            "  default: 100000 20 32\n",
+            argv[0]);
+    exit(1);
+  }
+  long num_members = (argc > 1) ? atol(argv[1]) : 100000;
+  int num_topics = (argc > 2) ? atoi(argv[2]) : 20;
+  int num_partitions = (argc > 3) ? atoi(argv[3]) : 32;
+  if (num_members <= 0 || num_topics <= 0 || num_partitions <= 0)
+    error::Exit("[ERROR] invalid arguments\n");
+
+  // topic names longer than std::string's small string buffer
+  std::vector<std::string> topic_names;
+  for (int i = 0; i < num_topics; i++)
+    topic_names.push_back("wire-bench-topic-" + std::to_string(i));
+  std::vector<int32_t> partitions(num_partitions);
+  for (int i = 0; i < num_partitions; i++) partitions[i] = i;
+  std::vector<TopicPartitions> assigned;
+  for (auto& name : topic_names)
+    assigned.push_back({name, ArrayView<int32_t>(partitions.data(),
+                                                 partitions.size())});
+  ConsumerProtocolAssignment assignment;
+  assignment.assigned_partitions =
+      ArrayView<TopicPartitions>(assigned.data(), assigned.size());
+  std::string data;
+  WireWriter writer(data);
+  encodeAssignment(assignment, writer);
+  printf("%ld members, assignment of %d topics x %d partitions, %zu bytes\n",
+         num_members, num_topics, num_partitions, data.size());
+
+  size_t expected = static_cast<size_t>(num_topics) * num_partitions;
+  auto run = [&](const char* name, std::function<size_t()> decode) {
+    long allocations = num_allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < num_members; i++) {
+      if (decode() != expected) error::Exit("[ERROR] %s decoded wrong\n", name);
+    }
+    double seconds = bench::secondsSince(start);
+    printf("%-26s %8.0f ns/member %7.1f MB/s %6.2f allocations/member\n", name,
+           seconds * 1e9 / num_members,
+           data.size() * num_members / seconds / 1e6,
+           static_cast<double>(num_allocations - allocations) / num_members);
+  };
+
+  run("ByteBuffer (legacy)", [&] { return legacyDecode(data); });
+  WireArena arena;
+  run("WireReader + WireArena", [&] {
+    arena.reset();
+    ConsumerProtocolAssignment decoded;
+    if (!decodeAssignment(data, arena, &decoded)) return size_t(0);
+    size_t n = 0;
+    for (const auto& topic : decoded.assigned_partitions)
+      n += topic.partitions.size();
+    return n;
+  });
+  return 0;
+}
@@ -3,11 +3,15 @@ set -o errexit
 cd `dirname $0`
 
 INSTALL_DIR=`pwd`
+# rdkafka_lag.hpp needs rd_kafka_ListOffsets() of 2.3
+LIBRDKAFKA_VERSION=v2.3.0
 
 git submodule init
 git submodule update
 
 cd ./third_party/librdkafka
+git fetch --tags origin
+git checkout $LIBRDKAFKA_VERSION
 ./configure --prefix=$INSTALL_DIR
 make
 make install
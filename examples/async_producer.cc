@@ -0,0 +1,91 @@
+// async_producer.cc
+#include <signal.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include "rdkafka.hpp"
+using namespace rdkafka;
+
+static bool run = true;
+
+int main(int argc, char* argv[]) {
+  // command line config
+  if (argc < 2 ||
+      (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+    fprintf(stderr, "Usage: %s <topic-name> [config-path] [max-in-flight]\n",
+            argv[0]);
+    exit(1);
+  }
+
+  const char* topic_name = argv[1];
+  std::string configpath = (argc > 2) ? argv[2] : "config/producer.conf";
+  size_t max_in_flight = (argc > 3) ? atoi(argv[3]) : 10000;
+
+  bool is_terminal = isatty(STDIN_FILENO) == 1;
+
+  // file config, no delivery report callback is needed
+  error::Print("[INFO] Read configuration from %s\n", configpath.data());
+  auto configs = readConfig(configpath, topic_name);
+
+  char errstr[512];
+  AsyncProducer producer(std::move(configs.first), max_in_flight, errstr);
+  if (producer.isNull())
+    error::Exit("[ERROR] Create producer failed: %s\n", errstr);
+  error::Print("[INFO] Create producer: %s\n", rd_kafka_name(producer.get()));
+
+  Topic topic(producer.get(), topic_name, std::move(configs.second));
+
+  signal(SIGINT, [](int) {
+    if (!run) exit(1);  // already break the loop, force to exit
+    run = false;
+    close(STDIN_FILENO);
+  });
+  if (is_terminal)
+    error::Print("[INFO] Enter line to send (Press Ctrl+C to safe exit)\n");
+
+  // counted on the poller thread, captured by one reference so that the
+  // callback fits in std::function without allocating
+  struct {
+    std::atomic<long> delivered{0};
+    std::atomic<long> failed{0};
+  } counts;
+
+  // loop: read line from stdin to produce, send() only blocks when
+  // max_in_flight messages are not delivered yet
+  long num_message = 0;
+  char buf[512];
+  while (run && fgets(buf, sizeof(buf), stdin)) {
+    size_t len = strlen(buf);
+    if (len > 0 && buf[len - 1] == '\n') buf[--len] = '\0';
+    if (len == 0) continue;
+
+    auto id = ++num_message;
+    auto error_code = producer.send(
+        topic, buf, len, nullptr, 0,
+        [&counts, id](const DeliveryResult& result) {
+          if (result.error == RD_KAFKA_RESP_ERR_NO_ERROR) {
+            ++counts.delivered;
+            error::Print("[INFO] Message %ld delivered (partition %d)\n", id,
+                         result.partition);
+          } else {
+            ++counts.failed;
+            error::Print("[ERROR] Message %ld delivery failed: %s\n", id,
+                         rd_kafka_err2str(result.error));
+          }
+        });
+    if (error_code != RD_KAFKA_RESP_ERR_NO_ERROR) {
+      error::Print("[ERROR] Failed to produce to topic %s: %s\n", topic_name,
+                   rd_kafka_err2str(error_code));
+    }
+  }
+
+  // wait for message delivery
+  while (!producer.close(1000)) {
+    error::Print("[INFO] Flushing %zu final messages...\n",
+                 producer.numInFlight());
+  }
+  error::Print("[INFO] DONE! %ld messages delivered, %ld failed\n",
+               counts.delivered.load(), counts.failed.load());
+  return 0;
+}
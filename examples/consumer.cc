@@ -11,6 +11,11 @@ static void rebalance_cb(rd_kafka_t* rk, rd_kafka_resp_err_t err,
 
 void msg_consume(const Message& message);
 
+// Where assigned partitions start, the committed offsets by default. Set
+// others before subscribing, e.g. start_offsets.set(topic,
+// StartOffset::latest(100)) or StartOffset::timestamp(ms).
+static StartOffsetPolicy start_offsets;
+
 int main(int argc, char* argv[]) {
   // command line config
   if (argc < 2 ||
@@ -82,8 +87,10 @@ static void rebalance_cb(rd_kafka_t* rk, rd_kafka_resp_err_t err,
     case RD_KAFKA_RESP_ERR__ASSIGN_PARTITIONS:
       error::Print("%d partitions assigned\n", partitions->cnt);
 
-      // TODO: You can manual setting the consumer start offset here, eg.
-      // partitions->elems[0].offset = 0;
+      error_code = start_offsets.apply(rk, partitions, 5000);
+      if (error_code != RD_KAFKA_RESP_ERR_NO_ERROR)
+        error::Print("[WARN] Start offsets: %s\n",
+                     rd_kafka_err2str(error_code));
 
       util::printPartitionList(partitions, stderr);
 
@@ -123,5 +130,9 @@ void msg_consume(const Message& message) {
            message.topicName(), message.partition(),
            static_cast<long long>(message.offset()),
            static_cast<int>(message.payloadLen()), message.payload());
+    for (auto header : message.headers()) {
+      printf("  header %s: %.*s\n", header.name,
+             static_cast<int>(header.value.size()), header.value.data());
+    }
   }
 }
@@ -1,4 +1,3 @@
-#include <arpa/inet.h>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -61,73 +60,45 @@ int main(int argc, char* argv[]) {
   return 0;
 }
 
-struct ByteBuffer {
-  const void* data;
-  int size;
-
-  const char* char_ptr(int pos = 0) const noexcept {
-    return static_cast<const char*>(data) + pos;
-  }
-
-  void dump() const {
-    constexpr int kBytesPerLine = 8;
-    for (int i = 0; i < size; i++) {
-      printf("%02X", static_cast<uint8_t>(getInt8(i)));
-      if ((i % kBytesPerLine < (kBytesPerLine - 1)) && i != (size - 1)) {
-        printf(" ");
-      } else {
-        printf("\n");
-      }
-    }
-  }
-
-  void checkRange(int pos, int n) const {
-    if (pos + n > size) {
-      fprintf(stderr, "checkRange error: pos=%d n=%d size=%d\n", pos, n, size);
-      abort();
+// hex dump, 8 bytes per line
+static void dump(Slice data) {
+  constexpr size_t kBytesPerLine = 8;
+  for (size_t i = 0; i < data.size(); i++) {
+    printf("%02X", static_cast<uint8_t>(data[i]));
+    if ((i % kBytesPerLine < (kBytesPerLine - 1)) && i != (data.size() - 1)) {
+      printf(" ");
+    } else {
+      printf("\n");
     }
   }
+}
 
-  int8_t getInt8(int pos) const noexcept {
-    checkRange(pos, 1);
-    return *char_ptr(pos);
-  }
-
-  int16_t getInt16(int pos) const noexcept {
-    checkRange(pos, 2);
-    return ntohs(*reinterpret_cast<const uint16_t*>(char_ptr(pos)));
-  }
-
-  int32_t getInt32(int pos) const noexcept {
-    checkRange(pos, 4);
-    return ntohl(*reinterpret_cast<const uint32_t*>(char_ptr(pos)));
-  }
-
-  std::string getString(int pos) const noexcept {
-    int16_t length = getInt16(pos);
-    checkRange(pos + 2, length);
-    return {char_ptr(pos + 2), static_cast<size_t>(length)};
-  }
-};
+// decoded metadata and assignments point into the arena, which is reused by
+// every member
+static WireArena arena;
 
 static void parseMetadata(const void* data, int size) {
   printf("metadata:\n");
-  ByteBuffer buffer{data, size};
-  buffer.dump();
-
-  int version = buffer.getInt16(0);
-  int topic_cnt = buffer.getInt32(2);
-  printf("version: %d\ntopic count: %d\n", version, topic_cnt);
-
-  int pos = 6;
-  for (int i = 0; i < topic_cnt; i++) {
-    auto topic = buffer.getString(pos);
-    printf("topic[%d] = %s\n", i, topic.c_str());
-    pos += (2 + topic.size());
+  Slice bytes(data, static_cast<size_t>(size));
+  dump(bytes);
+
+  arena.reset();
+  ConsumerProtocolSubscription subscription;
+  if (!decodeSubscription(bytes, arena, &subscription)) {
+    fprintf(stderr, "malformed metadata of %d bytes\n", size);
+    return;
+  }
+  printf("version: %d\ntopic count: %zu\n", subscription.version,
+         subscription.topics.size());
+
+  for (size_t i = 0; i < subscription.topics.size(); i++) {
+    Slice topic = subscription.topics[i];
+    printf("topic[%zu] = %.*s\n", i, static_cast<int>(topic.size()),
+           topic.data());
   }
 }
 
-inline std::string to_string(const std::vector<int32_t>& partitions) {
+inline std::string to_string(ArrayView<int32_t> partitions) {
   std::ostringstream stream;
   for (size_t i = 0; i < partitions.size(); i++) {
     if (i > 0) stream << ",";
@@ -138,27 +109,22 @@ inline std::string to_string(const std::vector<int32_t>& partitions) {
 
 static void parseAssignment(const void* data, int size) {
   printf("assignment:\n");
-  ByteBuffer buffer{data, size};
-  buffer.dump();
-
-  int version = buffer.getInt16(0);
-  int assign_cnt = buffer.getInt32(2);
-  printf("version: %d\nassign count: %d\n", version, assign_cnt);
-
-  int pos = 6;
-  for (int i = 0; i < assign_cnt; i++) {
-    auto topic = buffer.getString(pos);
-    pos += (2 + topic.size());
-
-    std::vector<int32_t> partitions;
-    int partition_cnt = buffer.getInt32(pos);
-    pos += 4;
-    for (int j = 0; j < partition_cnt; j++) {
-      partitions.emplace_back(buffer.getInt32(pos));
-      pos += 4;
-    }
-
-    printf("Assign [%d]: topic=\"%s\" partitions=[%s]\n", i, topic.c_str(),
-           to_string(partitions).c_str());
+  Slice bytes(data, static_cast<size_t>(size));
+  dump(bytes);
+
+  arena.reset();
+  ConsumerProtocolAssignment assignment;
+  if (!decodeAssignment(bytes, arena, &assignment)) {
+    fprintf(stderr, "malformed assignment of %d bytes\n", size);
+    return;
+  }
+  printf("version: %d\nassign count: %zu\n", assignment.version,
+         assignment.assigned_partitions.size());
+
+  for (size_t i = 0; i < assignment.assigned_partitions.size(); i++) {
+    const TopicPartitions& assigned = assignment.assigned_partitions[i];
+    printf("Assign [%zu]: topic=\"%.*s\" partitions=[%s]\n", i,
+           static_cast<int>(assigned.topic.size()), assigned.topic.data(),
+           to_string(assigned.partitions).c_str());
   }
 }
@@ -29,12 +29,24 @@ int main(int argc, char* argv[]) {
   if (consumer.isNull())
     error::Exit("[INFO] Create consumer failed: %s\n", errstr);
 
-  auto offsets = rd_kafka_topic_partition_list_new(1);
-  PartitionListGuard offsets_guard(offsets);
+  // partition count from metadata
+  MetadataCache metadata(consumer);
+  auto err = metadata.refreshTopic(topic_name);
+  if (err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+    fprintf(stderr, "rd_kafka_metadata failed: %s\n", rd_kafka_err2str(err));
+    exit(1);
+  }
+  int partition_count = MetadataCache::Reader(metadata)->partitionCount(
+      topic_name);
+  if (partition_count <= 0) {
+    fprintf(stderr, "topic %s not found\n", topic_name);
+    exit(1);
+  }
 
-  constexpr int kPartitionCount = 3;
+  auto offsets = rd_kafka_topic_partition_list_new(partition_count);
+  PartitionListGuard offsets_guard(offsets);
   rd_kafka_topic_partition_list_add_range(offsets, topic_name, 0,
-                                          kPartitionCount - 1);
+                                          partition_count - 1);
 
   // get commited offsets
   {
@@ -49,7 +61,7 @@ int main(int argc, char* argv[]) {
 
   // commit a large offset which is out of range
 
-  for (int i = 0; i < kPartitionCount; i++)
+  for (int i = 0; i < partition_count; i++)
     offsets->elems[i].offset = offset;
 
   {
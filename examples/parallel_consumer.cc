@@ -0,0 +1,108 @@
+// parallel_consumer.cc
+#include <signal.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+
+#include "rdkafka.hpp"
+using namespace rdkafka;
+
+static bool run = true;
+
+int main(int argc, char* argv[]) {
+  // command line config
+  if (argc < 2 ||
+      (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+    fprintf(stderr, "Usage: %s <topic-name> [config-path] [worker-count]\n",
+            argv[0]);
+    exit(1);
+  }
+  const char* topic_name = argv[1];
+  std::string configpath = (argc > 2) ? argv[2] : "config/consumer.conf";
+  size_t num_workers =
+      (argc > 3) ? atoi(argv[3]) : std::thread::hardware_concurrency();
+
+  // file config
+  error::Print("[INFO] Read configuration from %s\n", configpath.data());
+  auto configs = readConfig(configpath);
+  configs.first.setDefaultTopicConf(std::move(configs.second));
+  // offsets of handled messages are committed by the tracker
+  configs.first.put("enable.auto.commit", "false");
+
+  std::atomic<size_t> num_msg(0);
+  std::unique_ptr<OffsetTracker> tracker;
+  auto handler = [&num_msg, &tracker](const MessageView& message) {
+    if (message.hasError()) {
+      error::Print("[ERROR] Consume error for topic \"%s\" [%d]: %s\n",
+                   message.topicName(), message.partition(),
+                   message.errorStr());
+      return;
+    }
+    // called on worker threads, messages of a partition arrive in order
+    tracker->track(message);
+    printf("[Message %zu] \"%s\"[%d]: %lld\n  %.*s\n", ++num_msg,
+           message.topicName(), message.partition(),
+           static_cast<long long>(message.offset()),
+           static_cast<int>(message.payloadLen()), message.payload());
+    tracker->complete(message);
+  };
+
+  char errstr[512];
+  ParallelConsumer consumer(std::move(configs.first), num_workers, handler,
+                            errstr);
+  if (consumer.isNull())
+    error::Exit("[INFO] Create consumer failed: %s\n", errstr);
+  error::Print("[INFO] Create consumer with %zu workers\n",
+               consumer.numWorkers());
+  tracker.reset(new OffsetTracker(consumer.get()));
+
+  consumer.setAssignHandler(
+      [&tracker](rd_kafka_t*, rd_kafka_topic_partition_list_t* partitions) {
+        error::Print("[INFO] %d partitions assigned\n", partitions->cnt);
+        util::printPartitionList(partitions, stderr);
+        tracker->assign(partitions);
+      });
+  consumer.setRevokeHandler(
+      [&tracker](rd_kafka_t*, rd_kafka_topic_partition_list_t* partitions) {
+        error::Print("[INFO] %d partitions revoked\n", partitions->cnt);
+        auto error_code = tracker->revoke(partitions);
+        if (error_code != RD_KAFKA_RESP_ERR_NO_ERROR) {
+          error::Print("[ERROR] Commit revoked partitions failed: %s\n",
+                       rd_kafka_err2str(error_code));
+        }
+      });
+
+  auto error_code = consumer.subscribe({topic_name});
+  error::checkRespError(error_code, "[INFO] Consumer subscribe");
+
+  signal(SIGINT, [](int) {
+    if (!run) exit(1);  // already break the loop, force to exit
+    run = false;        // break the loop
+  });
+
+  // loop: serve rebalance events, messages are handled by workers
+  while (run) {
+    auto rkmessage = consumer.poll(1000);
+    if (!rkmessage.isNull() && rkmessage.hasError()) {
+      error::Print("[ERROR] Consumer error: %s\n", rkmessage.errorStr());
+    }
+    error_code = tracker->poll();
+    if (error_code != RD_KAFKA_RESP_ERR_NO_ERROR) {
+      error::Print("[ERROR] Commit failed: %s\n",
+                   rd_kafka_err2str(error_code));
+    }
+  }
+
+  // the final revoke commits the handled messages
+  error_code = consumer.close();
+  if (error_code != RD_KAFKA_RESP_ERR_NO_ERROR) {
+    error::Print("[INFO] Failed to close consumer: %s\n",
+                 rd_kafka_err2str(error_code));
+  } else {
+    error::Print("[INFO] Consumer closed, %zu messages, %ld commits\n",
+                 num_msg.load(), tracker->counts().commits);
+  }
+  tracker.reset();  // its queue must be destroyed before the consumer
+  return 0;
+}
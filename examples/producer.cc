@@ -5,11 +5,12 @@
 using namespace rdkafka;
 
 static bool run = true;
-static long num_message = 0;
-static long num_message_left = 0;
+static ClientMetrics* metrics = nullptr;  // producer's, for dr_msg_cb()
 
 static void dr_msg_cb(rd_kafka_t* rk, const rd_kafka_message_t* rkmessage,
                       void* opaque);
+static int stats_cb(rd_kafka_t* rk, char* json, size_t json_len,
+                    void* opaque);
 
 int main(int argc, char* argv[]) {
   // command line config
@@ -28,8 +29,10 @@ int main(int argc, char* argv[]) {
 
   // file config
   error::Print("[INFO] Read configuration from %s\n", configpath.data());
-  auto configs = readConfig(configpath);
+  auto configs = readConfig(configpath, topic_name);
   configs.first.setDeliveryReportCallback(dr_msg_cb);  // global conf
+  // only called if statistics.interval.ms is configured
+  configs.first.setStatsCallback(stats_cb);
 
   // shared error message
   char errstr[512];
@@ -40,6 +43,14 @@ int main(int argc, char* argv[]) {
   if (producer.isNull())
     error::Exit("[ERROR] Create producer failed: %s\n", errstr);
   error::Print("[INFO] Create producer: %s\n", producer.name());
+  metrics = &producer.metrics();
+
+  // when the queue is full, produce() polls until a delivery report makes
+  // room, queue's size is determined by queue.buffering.max.messages
+  BackpressureOptions backpressure;
+  backpressure.policy = BackpressurePolicy::kBlock;
+  backpressure.max_wait_ms = 10 * 1000;
+  producer.setBackpressure(backpressure);
 
   // create topic from topic config, Producer::produce() method need it
   Topic topic(producer.get(), topic_name, std::move(configs.second));
@@ -61,24 +72,13 @@ int main(int argc, char* argv[]) {
       buf[--len] = '\0';
 
     if (len > 0) {
-      ++num_message;
-      ++num_message_left;
       error::Print("[INFO] Produce %zd bytes...\n", len);
-      bool success = false;
-      while (!(success = producer.produce(topic, buf, len))) {
+      bool success = producer.produce(topic, buf, len);
+      if (!success) {
         // check producer() error reason
         error_code = rd_kafka_last_error();
         error::Print("[INFO] Failed to produce to topic %s: %s\n", topic_name,
                      rd_kafka_err2str(error_code));
-
-        // queue is full, wait for 1000ms, trigger dr_msg_cb()
-        // queue's size is determined by queue.buffering.max.messages
-        if (error_code == RD_KAFKA_RESP_ERR__QUEUE_FULL) {
-          error::Print("[INFO] Queue is full!\n");
-          producer.poll(1000);
-        } else {
-          break;
-        }
       }
 
       if (success) {
@@ -91,11 +91,26 @@ int main(int argc, char* argv[]) {
   }
 
   // wait for message delivery success
-  while (num_message_left > 0) {
+  using Counter = ClientMetrics::Counter;
+  auto snapshot = metrics->snapshot();
+  while (snapshot.get(Counter::kProducedMessages) >
+         snapshot.get(Counter::kDelivered) +
+             snapshot.get(Counter::kDeliveryErrors)) {
     error::Print("[INFO] Flushing final messages...\n");
     producer.flush(1 * 1000);
+    snapshot = metrics->snapshot();
   }
-  error::Print("[INFO] DONE! %zd messages committed!\n", num_message);
+
+  auto const& latency =
+      snapshot.get(ClientMetrics::HistogramType::kDeliveryLatencyUs);
+  error::Print(
+      "[INFO] DONE! %llu messages committed! %llu failed, %llu queue full, "
+      "delivery latency p50 %llu us p99 %llu us\n",
+      (unsigned long long)snapshot.get(Counter::kDelivered),
+      (unsigned long long)snapshot.get(Counter::kDeliveryErrors),
+      (unsigned long long)snapshot.get(Counter::kQueueFull),
+      (unsigned long long)latency.percentile(0.5),
+      (unsigned long long)latency.percentile(0.99));
   return 0;
 }
 
@@ -108,5 +123,31 @@ static void dr_msg_cb(rd_kafka_t* rk, const rd_kafka_message_t* rkmessage,
     error::Print("[ERROR] Message delivery failed: %s\n",
                  rd_kafka_err2str(rkmessage->err));
   }
-  --num_message_left;
+  metrics->recordDelivery(rkmessage);
+}
+
+static int stats_cb(rd_kafka_t* rk, char* json, size_t json_len,
+                    void* opaque) {
+  static StatsSnapshot snapshots[2];
+  static int index = 0;
+
+  auto& prev = snapshots[index];
+  auto& cur = snapshots[index ^ 1];
+  if (!cur.parse(json, json_len)) {
+    error::Print("[ERROR] Malformed statistics\n");
+    return 0;
+  }
+  index ^= 1;
+
+  StatsRates rates;
+  if (rates.compute(prev, cur)) {
+    error::Print("[INFO] Statistics: %.1f msgs/s, %.1f bytes/s, %ld queued\n",
+                 rates.txmsgs, rates.txmsg_bytes, (long)cur.msg_cnt);
+    for (auto const& broker : cur.brokers) {
+      if (broker.rtt.cnt > 0)
+        error::Print("[INFO]   broker %s rtt p99 %ld us\n", broker.name.data(),
+                     (long)broker.rtt.p99);
+    }
+  }
+  return 0;  // let librdkafka free json
 }
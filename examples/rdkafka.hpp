@@ -1,8 +1,26 @@
 // rdkafka.hpp
 #pragma once
 
+#include "include/rdkafka_async_producer.hpp"
+#include "include/rdkafka_backpressure.hpp"
 #include "include/rdkafka_classes.hpp"
+#include "include/rdkafka_compression.hpp"
 #include "include/rdkafka_error.hpp"
+#include "include/rdkafka_event_loop.hpp"
+#include "include/rdkafka_hash.hpp"
+#include "include/rdkafka_lag.hpp"
+#include "include/rdkafka_metadata.hpp"
+#include "include/rdkafka_metrics.hpp"
+#include "include/rdkafka_offset_tracker.hpp"
+#include "include/rdkafka_parallel_consumer.hpp"
+#include "include/rdkafka_partitioner.hpp"
+#include "include/rdkafka_prefetch.hpp"
 #include "include/rdkafka_readconfig.hpp"
+#include "include/rdkafka_serde.hpp"
+#include "include/rdkafka_spool.hpp"
+#include "include/rdkafka_start_offset.hpp"
+#include "include/rdkafka_stats.hpp"
+#include "include/rdkafka_transaction.hpp"
 #include "include/rdkafka_util.hpp"
+#include "include/rdkafka_wire.hpp"
 #include "include/helper/timestamp.h"
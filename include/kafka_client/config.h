@@ -20,6 +20,14 @@ class TopicConfig : public ConfigBase<rd_kafka_topic_conf_t> {
                                      size_t* dest_size) const override;
 
   const char* name() const { return "TopicConfig"; }
+
+  rd_kafka_topic_conf_t* RdKafkaConfDup() const override;
+
+  friend class ConfigSnapshot<TopicConfig>;
+
+  // takes ownership of conf
+  explicit TopicConfig(rd_kafka_topic_conf_t* conf)
+      : Base(conf, &rd_kafka_topic_conf_destroy) {}
 };
 
 class GlobalConfig : public ConfigBase<rd_kafka_conf_t> {
@@ -36,6 +44,14 @@ class GlobalConfig : public ConfigBase<rd_kafka_conf_t> {
                                      size_t* dest_size) const override;
 
   const char* name() const { return "GlobalConfig"; }
+
+  rd_kafka_conf_t* RdKafkaConfDup() const override;
+
+  friend class ConfigSnapshot<GlobalConfig>;
+
+  // takes ownership of conf
+  explicit GlobalConfig(rd_kafka_conf_t* conf)
+      : Base(conf, &rd_kafka_conf_destroy) {}
 };
 
 inline rd_kafka_conf_res_t TopicConfig::RdKafkaConfSet(const char* name,
@@ -50,6 +66,10 @@ inline rd_kafka_conf_res_t TopicConfig::RdKafkaConfGet(
   return rd_kafka_topic_conf_get(handle(), name, dest, dest_size);
 }
 
+inline rd_kafka_topic_conf_t* TopicConfig::RdKafkaConfDup() const {
+  return rd_kafka_topic_conf_dup(handle());
+}
+
 inline rd_kafka_conf_res_t GlobalConfig::RdKafkaConfSet(const char* name,
                                                         const char* value,
                                                         char* errstr,
@@ -62,6 +82,10 @@ inline rd_kafka_conf_res_t GlobalConfig::RdKafkaConfGet(
   return rd_kafka_conf_get(handle(), name, dest, dest_size);
 }
 
+inline rd_kafka_conf_t* GlobalConfig::RdKafkaConfDup() const {
+  return rd_kafka_conf_dup(handle());
+}
+
 }  // namespace kafka_client
 
 #endif  // KAFKA_CLIENT_CONFIG_H
@@ -1,16 +1,24 @@
 #ifndef KAFKA_CLIENT_CONFIG_BASE_H
 #define KAFKA_CLIENT_CONFIG_BASE_H
 
+#include "kafka_client/config_keys.h"
 #include "kafka_client/error_message.h"
 
+#include <initializer_list>
 #include <memory>
+#include <utility>
 #include "librdkafka/rdkafka.h"
 
 namespace kafka_client {
 
+template <typename ConfigT>
+class ConfigSnapshot;
+
 template <typename ConfT>
 class ConfigBase {
  public:
+  using ConfType = ConfT;
+
   /**
    * @brief Put a key-value pair to config
    * @returns true or false on error
@@ -23,6 +31,40 @@ class ConfigBase {
    */
   std::string Get(const char* key) const;
 
+  /**
+   * @brief Put a typed value of a key from \c keys or \c topic_keys.
+   *
+   * A key of the other config type or a value of the wrong type doesn't
+   * compile, numbers are formatted without allocations. I.e.:
+   * @code
+   *   config.Set(keys::linger_ms, 5);
+   *   config.Set(keys::compression_codec, CompressionCodec::kLz4);
+   *   config.Set(keys::bootstrap_servers, {"host1:9092", "host2:9092"});
+   * @endcode
+   * @returns true or false on error
+   */
+  template <typename Key>
+  bool Set(detail::SetType<Key> value);
+
+  template <typename Key>
+  bool Set(Key, detail::SetType<Key> value) {
+    return Set<Key>(value);
+  }
+
+  /**
+   * @brief Get the typed value of a key from \c keys or \c topic_keys.
+   *
+   * Values that fit a stack buffer are read without allocations.
+   * @returns The value or a value-initialized one on error
+   */
+  template <typename Key>
+  detail::GetType<Key> Get() const;
+
+  template <typename Key>
+  detail::GetType<Key> Get(Key) const {
+    return Get<Key>();
+  }
+
   /**
    * @brief Returns internal error message.
    *
@@ -54,9 +96,15 @@ class ConfigBase {
 
   virtual const char* name() const = 0;
 
+  // a copy of handle() that the caller owns
+  virtual ConfT* RdKafkaConfDup() const = 0;
+
   ConfT* handle() const noexcept { return conf_.get(); }
 
  private:
+  template <typename ConfigT>
+  friend class ConfigSnapshot;
+
   std::unique_ptr<ConfT, ConfDeleter> conf_;
   mutable ErrorMessage error_;
 };
@@ -101,6 +149,107 @@ inline std::string ConfigBase<ConfT>::Get(const char* key) const {
   return value;
 }
 
+template <typename ConfT>
+template <typename Key>
+inline bool ConfigBase<ConfT>::Set(detail::SetType<Key> value) {
+  static_assert(std::is_same<typename Key::ConfType, ConfT>::value,
+                "the key belongs to the other config type");
+  using Traits = detail::ValueTraits<typename Key::ValueType>;
+  detail::ValueBuffer buffer;
+  return Put(Key::Name(), Traits::Format(value, buffer));
+}
+
+template <typename ConfT>
+template <typename Key>
+inline detail::GetType<Key> ConfigBase<ConfT>::Get() const {
+  static_assert(std::is_same<typename Key::ConfType, ConfT>::value,
+                "the key belongs to the other config type");
+  using Traits = detail::ValueTraits<typename Key::ValueType>;
+  detail::GetType<Key> value{};
+
+  char buffer[256];
+  size_t value_size = sizeof(buffer);
+  if (RdKafkaConfGet(Key::Name(), buffer, &value_size) != RD_KAFKA_CONF_OK) {
+    error_.Format("%s Get(\"%s\") failed", name(), Key::Name());
+    return value;
+  }
+
+  bool ok;
+  if (value_size <= sizeof(buffer)) {
+    ok = Traits::Parse(buffer, &value);
+  } else {
+    // long strings or lists, value_size is the size they need
+    std::string long_value(value_size, '\0');
+    RdKafkaConfGet(Key::Name(), &long_value[0], &value_size);
+    ok = Traits::Parse(long_value.data(), &value);
+  }
+  if (!ok) {
+    error_.Format("%s Get(\"%s\"): unexpected value", name(), Key::Name());
+    value = detail::GetType<Key>{};
+  }
+  return value;
+}
+
+/**
+ * @brief Immutable copy of a config, to create many clients from.
+ *
+ * Every key of a config is validated once by \c Put(), then \c Clone() copies
+ * the validated values with \c rd_kafka_conf_dup() and only validates the
+ * overrides of each instance. A snapshot is never modified, so \c Clone() can
+ * be called from many threads at once, and copying a snapshot shares it.
+ * I.e.:
+ * @code
+ *   GlobalConfig config;
+ *   config.Put("bootstrap.servers", "localhost:9092");
+ *   ConfigSnapshot<GlobalConfig> snapshot(config);
+ *
+ *   GlobalConfig producer_config = snapshot.Clone();
+ *   if (!producer_config.Put("client.id", "producer-1"))
+ *     fprintf(stderr, "Put failed: %s\n", producer_config.Error());
+ * @endcode
+ */
+template <typename ConfigT>
+class ConfigSnapshot {
+ public:
+  using Override = std::pair<const char*, const char*>;
+
+  /**
+   * @brief Copies \p config's current values.
+   *
+   * \p config can still be modified, the snapshot doesn't change.
+   */
+  explicit ConfigSnapshot(const ConfigT& config)
+      : config_(std::make_shared<ConfigT>(ConfigT(Dup(config)))) {}
+
+  /**
+   * @brief Returns a copy of the snapshot, to \c Put() overrides into.
+   */
+  ConfigT Clone() const { return ConfigT(Dup(*config_)); }
+
+  /**
+   * @brief Makes \p config a copy of the snapshot with \p overrides applied
+   *        in order.
+   * @returns true or false if an override is invalid, \p config's \c Error()
+   *          tells why
+   */
+  bool Clone(ConfigT* config,
+             std::initializer_list<Override> overrides = {}) const {
+    *config = Clone();
+    for (const auto& key_value : overrides) {
+      if (!config->Put(key_value.first, key_value.second)) return false;
+    }
+    return true;
+  }
+
+ private:
+  std::shared_ptr<const ConfigT> config_;
+
+  static typename ConfigT::ConfType* Dup(const ConfigT& config) {
+    return static_cast<const typename ConfigT::Base&>(config)
+        .RdKafkaConfDup();
+  }
+};
+
 }  // namespace kafka_client
 
 #endif  // CONFIG_BASE_H
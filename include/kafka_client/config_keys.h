@@ -0,0 +1,326 @@
+#ifndef KAFKA_CLIENT_CONFIG_KEYS_H
+#define KAFKA_CLIENT_CONFIG_KEYS_H
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <initializer_list>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "librdkafka/rdkafka.h"
+
+namespace kafka_client {
+
+/**
+ * @brief Values of enum configuration properties.
+ *
+ * The enumerators are in the order of \c EnumNames<T>::Name(), which are the
+ * names librdkafka returns from \c rd_kafka_conf_get().
+ */
+enum class CompressionCodec { kNone, kGzip, kSnappy, kLz4, kZstd, kInherit };
+enum class SecurityProtocol { kPlaintext, kSsl, kSaslPlaintext, kSaslSsl };
+enum class IsolationLevel { kReadUncommitted, kReadCommitted };
+enum class AutoOffsetReset { kEarliest, kLatest, kError };
+enum class Partitioner {
+  kRandom,
+  kConsistent,
+  kConsistentRandom,
+  kMurmur2,
+  kMurmur2Random,
+  kFnv1a,
+  kFnv1aRandom
+};
+
+template <typename T>
+struct EnumNames;
+
+#define KAFKA_CLIENT_ENUM_NAMES(T, ...)                           \
+  template <>                                                     \
+  struct EnumNames<T> {                                           \
+    static const char* Name(size_t i) noexcept {                  \
+      static const char* const kNames[] = {__VA_ARGS__};          \
+      return i < sizeof(kNames) / sizeof(kNames[0]) ? kNames[i]   \
+                                                    : nullptr;    \
+    }                                                             \
+  }
+
+// "inherit" is only valid for topic configs
+KAFKA_CLIENT_ENUM_NAMES(CompressionCodec, "none", "gzip", "snappy", "lz4",
+                        "zstd", "inherit");
+KAFKA_CLIENT_ENUM_NAMES(SecurityProtocol, "plaintext", "ssl", "sasl_plaintext",
+                        "sasl_ssl");
+KAFKA_CLIENT_ENUM_NAMES(IsolationLevel, "read_uncommitted", "read_committed");
+KAFKA_CLIENT_ENUM_NAMES(AutoOffsetReset, "smallest", "largest", "error");
+KAFKA_CLIENT_ENUM_NAMES(Partitioner, "random", "consistent",
+                        "consistent_random", "murmur2", "murmur2_random",
+                        "fnv1a", "fnv1a_random");
+
+#undef KAFKA_CLIENT_ENUM_NAMES
+
+// value type of comma separated lists, e.g. "bootstrap.servers"
+struct List {};
+
+namespace detail {
+
+// storage of a formatted value, only lists use the string
+struct ValueBuffer {
+  char data[32];
+  std::string storage;
+};
+
+/**
+ * How a value type is passed to \c Set(), returned by \c Get(), formatted to
+ * a property's string and parsed from it.
+ */
+template <typename T, typename Enable = void>
+struct ValueTraits;
+
+template <>
+struct ValueTraits<int> {
+  using SetType = int;
+  using GetType = int;
+
+  static const char* Format(int value, ValueBuffer& buffer) noexcept {
+    char* end = buffer.data + sizeof(buffer.data);
+    char* p = end;
+    *--p = '\0';
+    // negative values are formatted from their absolute value as unsigned
+    unsigned int n = (value < 0) ? 0u - static_cast<unsigned int>(value)
+                                 : static_cast<unsigned int>(value);
+    do {
+      *--p = static_cast<char>('0' + n % 10);
+      n /= 10;
+    } while (n > 0);
+    if (value < 0) *--p = '-';
+    return p;
+  }
+
+  static bool Parse(const char* s, int* value) noexcept {
+    char* end;
+    errno = 0;
+    long n = strtol(s, &end, 10);
+    if (errno != 0 || end == s || *end != '\0') return false;
+    *value = static_cast<int>(n);
+    return true;
+  }
+};
+
+template <>
+struct ValueTraits<double> {
+  using SetType = double;
+  using GetType = double;
+
+  static const char* Format(double value, ValueBuffer& buffer) noexcept {
+    snprintf(buffer.data, sizeof(buffer.data), "%.17g", value);
+    return buffer.data;
+  }
+
+  static bool Parse(const char* s, double* value) noexcept {
+    char* end;
+    *value = strtod(s, &end);
+    return end != s && *end == '\0';
+  }
+};
+
+template <>
+struct ValueTraits<bool> {
+  using SetType = bool;
+  using GetType = bool;
+
+  static const char* Format(bool value, ValueBuffer&) noexcept {
+    return value ? "true" : "false";
+  }
+
+  static bool Parse(const char* s, bool* value) noexcept {
+    *value = (strcmp(s, "true") == 0);
+    return *value || strcmp(s, "false") == 0;
+  }
+};
+
+template <typename T>
+struct ValueTraits<T, typename std::enable_if<std::is_enum<T>::value>::type> {
+  using SetType = T;
+  using GetType = T;
+
+  static const char* Format(T value, ValueBuffer&) noexcept {
+    return EnumNames<T>::Name(static_cast<size_t>(value));
+  }
+
+  static bool Parse(const char* s, T* value) noexcept {
+    for (size_t i = 0; EnumNames<T>::Name(i); i++) {
+      if (strcmp(s, EnumNames<T>::Name(i)) == 0) {
+        *value = static_cast<T>(i);
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+template <>
+struct ValueTraits<std::string> {
+  using SetType = const char*;
+  using GetType = std::string;
+
+  static const char* Format(const char* value, ValueBuffer&) noexcept {
+    return value;
+  }
+
+  static bool Parse(const char* s, std::string* value) {
+    *value = s;
+    return true;
+  }
+};
+
+template <>
+struct ValueTraits<List> {
+  using SetType = std::initializer_list<const char*>;
+  using GetType = std::vector<std::string>;
+
+  static const char* Format(SetType values, ValueBuffer& buffer) {
+    buffer.storage.clear();
+    for (const char* value : values) {
+      if (!buffer.storage.empty()) buffer.storage += ',';
+      buffer.storage += value;
+    }
+    return buffer.storage.data();
+  }
+
+  static bool Parse(const char* s, GetType* values) {
+    values->clear();
+    while (*s) {
+      const char* comma = strchr(s, ',');
+      size_t size = comma ? static_cast<size_t>(comma - s) : strlen(s);
+      values->emplace_back(s, size);
+      s += size + (comma ? 1 : 0);
+    }
+    return true;
+  }
+};
+
+template <typename Key>
+using SetType = typename ValueTraits<typename Key::ValueType>::SetType;
+
+template <typename Key>
+using GetType = typename ValueTraits<typename Key::ValueType>::GetType;
+
+}  // namespace detail
+
+/**
+ * @brief A configuration property known at compile time.
+ *
+ * \c ConfType is the config it belongs to, \c ValueType how its value is
+ * typed, see \c ConfigBase::Set() and \c ConfigBase::Get().
+ */
+#define KAFKA_CLIENT_CONFIG_KEY(Type, object, conf_type, value_type, key) \
+  struct Type {                                                           \
+    using ConfType = conf_type;                                           \
+    using ValueType = value_type;                                         \
+    static constexpr const char* Name() { return key; }                   \
+  };                                                                      \
+  constexpr Type object {}
+
+#define KAFKA_CLIENT_GLOBAL_KEY(Type, object, value_type, key) \
+  KAFKA_CLIENT_CONFIG_KEY(Type, object, rd_kafka_conf_t, value_type, key)
+
+#define KAFKA_CLIENT_TOPIC_KEY(Type, object, value_type, key) \
+  KAFKA_CLIENT_CONFIG_KEY(Type, object, rd_kafka_topic_conf_t, value_type, key)
+
+// keys of GlobalConfig, see librdkafka's CONFIGURATION.md for their meaning
+namespace keys {
+
+KAFKA_CLIENT_GLOBAL_KEY(BootstrapServers, bootstrap_servers, List,
+                        "bootstrap.servers");
+KAFKA_CLIENT_GLOBAL_KEY(ClientId, client_id, std::string, "client.id");
+KAFKA_CLIENT_GLOBAL_KEY(Debug, debug, List, "debug");
+KAFKA_CLIENT_GLOBAL_KEY(SecurityProtocolKey, security_protocol,
+                        SecurityProtocol, "security.protocol");
+KAFKA_CLIENT_GLOBAL_KEY(MessageMaxBytes, message_max_bytes, int,
+                        "message.max.bytes");
+KAFKA_CLIENT_GLOBAL_KEY(SocketTimeoutMs, socket_timeout_ms, int,
+                        "socket.timeout.ms");
+KAFKA_CLIENT_GLOBAL_KEY(SocketKeepaliveEnable, socket_keepalive_enable, bool,
+                        "socket.keepalive.enable");
+KAFKA_CLIENT_GLOBAL_KEY(StatisticsIntervalMs, statistics_interval_ms, int,
+                        "statistics.interval.ms");
+KAFKA_CLIENT_GLOBAL_KEY(ApiVersionRequest, api_version_request, bool,
+                        "api.version.request");
+
+// producer
+KAFKA_CLIENT_GLOBAL_KEY(LingerMs, linger_ms, double, "linger.ms");
+KAFKA_CLIENT_GLOBAL_KEY(BatchNumMessages, batch_num_messages, int,
+                        "batch.num.messages");
+KAFKA_CLIENT_GLOBAL_KEY(BatchSize, batch_size, int, "batch.size");
+KAFKA_CLIENT_GLOBAL_KEY(QueueBufferingMaxMessages,
+                        queue_buffering_max_messages, int,
+                        "queue.buffering.max.messages");
+KAFKA_CLIENT_GLOBAL_KEY(QueueBufferingMaxKbytes, queue_buffering_max_kbytes,
+                        int, "queue.buffering.max.kbytes");
+KAFKA_CLIENT_GLOBAL_KEY(CompressionCodecKey, compression_codec,
+                        CompressionCodec, "compression.codec");
+KAFKA_CLIENT_GLOBAL_KEY(EnableIdempotence, enable_idempotence, bool,
+                        "enable.idempotence");
+KAFKA_CLIENT_GLOBAL_KEY(Retries, retries, int, "retries");
+KAFKA_CLIENT_GLOBAL_KEY(RetryBackoffMs, retry_backoff_ms, int,
+                        "retry.backoff.ms");
+KAFKA_CLIENT_GLOBAL_KEY(StickyPartitioningLingerMs,
+                        sticky_partitioning_linger_ms, int,
+                        "sticky.partitioning.linger.ms");
+KAFKA_CLIENT_GLOBAL_KEY(TransactionalId, transactional_id, std::string,
+                        "transactional.id");
+KAFKA_CLIENT_GLOBAL_KEY(TransactionTimeoutMs, transaction_timeout_ms, int,
+                        "transaction.timeout.ms");
+
+// consumer
+KAFKA_CLIENT_GLOBAL_KEY(GroupId, group_id, std::string, "group.id");
+KAFKA_CLIENT_GLOBAL_KEY(EnableAutoCommit, enable_auto_commit, bool,
+                        "enable.auto.commit");
+KAFKA_CLIENT_GLOBAL_KEY(AutoCommitIntervalMs, auto_commit_interval_ms, int,
+                        "auto.commit.interval.ms");
+KAFKA_CLIENT_GLOBAL_KEY(EnableAutoOffsetStore, enable_auto_offset_store, bool,
+                        "enable.auto.offset.store");
+KAFKA_CLIENT_GLOBAL_KEY(SessionTimeoutMs, session_timeout_ms, int,
+                        "session.timeout.ms");
+KAFKA_CLIENT_GLOBAL_KEY(MaxPollIntervalMs, max_poll_interval_ms, int,
+                        "max.poll.interval.ms");
+KAFKA_CLIENT_GLOBAL_KEY(FetchWaitMaxMs, fetch_wait_max_ms, int,
+                        "fetch.wait.max.ms");
+KAFKA_CLIENT_GLOBAL_KEY(FetchMinBytes, fetch_min_bytes, int,
+                        "fetch.min.bytes");
+KAFKA_CLIENT_GLOBAL_KEY(MaxPartitionFetchBytes, max_partition_fetch_bytes, int,
+                        "max.partition.fetch.bytes");
+KAFKA_CLIENT_GLOBAL_KEY(QueuedMinMessages, queued_min_messages, int,
+                        "queued.min.messages");
+KAFKA_CLIENT_GLOBAL_KEY(IsolationLevelKey, isolation_level, IsolationLevel,
+                        "isolation.level");
+
+}  // namespace keys
+
+// keys of TopicConfig
+namespace topic_keys {
+
+KAFKA_CLIENT_TOPIC_KEY(Acks, acks, int, "acks");  // -1 is "all"
+KAFKA_CLIENT_TOPIC_KEY(RequestTimeoutMs, request_timeout_ms, int,
+                       "request.timeout.ms");
+KAFKA_CLIENT_TOPIC_KEY(MessageTimeoutMs, message_timeout_ms, int,
+                       "message.timeout.ms");
+KAFKA_CLIENT_TOPIC_KEY(PartitionerKey, partitioner, Partitioner,
+                       "partitioner");
+KAFKA_CLIENT_TOPIC_KEY(CompressionCodecKey, compression_codec,
+                       CompressionCodec, "compression.codec");
+KAFKA_CLIENT_TOPIC_KEY(CompressionLevel, compression_level, int,
+                       "compression.level");
+KAFKA_CLIENT_TOPIC_KEY(AutoOffsetResetKey, auto_offset_reset, AutoOffsetReset,
+                       "auto.offset.reset");
+
+}  // namespace topic_keys
+
+#undef KAFKA_CLIENT_GLOBAL_KEY
+#undef KAFKA_CLIENT_TOPIC_KEY
+
+}  // namespace kafka_client
+
+#endif  // KAFKA_CLIENT_CONFIG_KEYS_H
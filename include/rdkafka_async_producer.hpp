@@ -0,0 +1,224 @@
+// rdkafka_async_producer.hpp: producer with per-message delivery callbacks
+//
+// Each message takes a completion slot from a fixed pool, the slot is passed
+// as msg_opaque and released in the delivery report callback, which is run by
+// an internal poller thread. The pool size bounds the number of in-flight
+// messages: send() waits for a free slot instead of failing or spinning,
+// except in a callback, where waiting would block the only thread freeing
+// slots. The destructor blocks until every message is delivered or failed,
+// which takes up to message.timeout.ms, call close() first to bound it.
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "rdkafka_classes.hpp"
+
+namespace rdkafka {
+
+struct DeliveryResult {
+  ErrorCode error;
+  int32_t partition;
+  int64_t offset;
+};
+
+class AsyncProducer final {
+ public:
+  // Called on the poller thread. libstdc++'s std::function stores trivially
+  // copyable captures of up to 16 bytes (two pointers) inline, so such
+  // callbacks don't allocate, larger ones allocate once per send().
+  using DeliveryCallback = std::function<void(const DeliveryResult&)>;
+
+  template <size_t N>
+  AsyncProducer(GlobalConf conf, size_t max_in_flight, char (&errstr)[N])
+      : slots_(max_in_flight > 0 ? max_in_flight : 1),
+        producer_(prepareConf(std::move(conf), this), errstr) {
+    free_slots_.reserve(slots_.size());
+    for (size_t i = slots_.size(); i > 0; i--) free_slots_.push_back(i - 1);
+    if (!producer_.isNull()) poller_ = std::thread(&AsyncProducer::run, this);
+  }
+
+  AsyncProducer(const AsyncProducer&) = delete;
+  AsyncProducer& operator=(const AsyncProducer&) = delete;
+
+  // waits for every message, see close()
+  ~AsyncProducer() { close(-1); }
+
+  bool isNull() const noexcept { return producer_.isNull(); }
+
+  rd_kafka_t* get() const noexcept { return producer_.get(); }
+
+  ClientMetrics& metrics() const noexcept { return producer_.metrics(); }
+
+  size_t maxInFlight() const noexcept { return slots_.size(); }
+
+  // Enqueue a copy of payload, callback is invoked once with the delivery
+  // result. Blocks while all slots are in flight or librdkafka's queue is
+  // full, but returns RD_KAFKA_RESP_ERR__QUEUE_FULL instead when called by a
+  // callback. Returns the enqueue error, callback is not invoked on error.
+  ErrorCode send(const Topic& topic, const char* payload, size_t len,
+                 const char* key, size_t keylen, DeliveryCallback callback,
+                 int32_t partition = RD_KAFKA_PARTITION_UA) {
+    // only the poller thread frees slots and librdkafka's queue
+    bool can_wait = std::this_thread::get_id() != poller_.get_id();
+    while (true) {
+      size_t index;
+      uint64_t num_delivered;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!can_wait && free_slots_.empty() && !closed_)
+          return RD_KAFKA_RESP_ERR__QUEUE_FULL;
+        cond_.wait(lock, [this] { return !free_slots_.empty() || closed_; });
+        if (closed_) return RD_KAFKA_RESP_ERR__DESTROY;
+        index = free_slots_.back();
+        free_slots_.pop_back();
+        num_delivered = num_delivered_;
+      }
+
+      // the delivery report may come as soon as the message is enqueued
+      auto& slot = slots_[index];
+      slot.callback = std::move(callback);
+      metrics().add(ClientMetrics::Counter::kProduceCalls);
+      if (rd_kafka_produce(topic.get(), partition, RD_KAFKA_MSG_F_COPY,
+                           const_cast<char*>(payload), len, key, keylen,
+                           &slot) == 0) {
+        metrics().recordProduce(RD_KAFKA_RESP_ERR_NO_ERROR);
+        return RD_KAFKA_RESP_ERR_NO_ERROR;
+      }
+
+      auto error_code = rd_kafka_last_error();
+      metrics().recordProduce(error_code);
+      callback = std::move(slot.callback);
+      slot.callback = nullptr;
+
+      std::unique_lock<std::mutex> lock(mutex_);
+      free_slots_.push_back(index);
+      if (error_code != RD_KAFKA_RESP_ERR__QUEUE_FULL || !can_wait) {
+        lock.unlock();
+        cond_.notify_all();
+        return error_code;
+      }
+      // wait for the next delivery report to free librdkafka's queue
+      cond_.wait(lock, [this, num_delivered] {
+        return num_delivered_ != num_delivered || closed_;
+      });
+    }
+  }
+
+  // Same as send(), but the result is returned by a future. The future's
+  // shared state is allocated per message, use send() on hot paths.
+  std::future<DeliveryResult> sendAsync(
+      const Topic& topic, const char* payload, size_t len,
+      const char* key = nullptr, size_t keylen = 0,
+      int32_t partition = RD_KAFKA_PARTITION_UA) {
+    auto promise = std::make_shared<std::promise<DeliveryResult>>();
+    auto future = promise->get_future();
+
+    auto error_code = send(topic, payload, len, key, keylen,
+                           [promise](const DeliveryResult& result) {
+                             promise->set_value(result);
+                           },
+                           partition);
+    if (error_code != RD_KAFKA_RESP_ERR_NO_ERROR) {
+      promise->set_value({error_code, partition, RD_KAFKA_OFFSET_INVALID});
+    }
+    return future;
+  }
+
+  size_t numInFlight() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return slots_.size() - free_slots_.size();
+  }
+
+  // wait until all in-flight messages are delivered or timeout_ms expires,
+  // timeout_ms < 0 waits forever
+  bool flush(int timeout_ms) const {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto all_free = [this] { return free_slots_.size() == slots_.size(); };
+    if (timeout_ms < 0) {
+      cond_.wait(lock, all_free);
+      return true;
+    }
+    return cond_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                          all_free);
+  }
+
+  // Flush then stop the poller thread, send() fails after it.
+  // Returns false and keeps running if messages are still in flight.
+  bool close(int timeout_ms) {
+    if (producer_.isNull() || !poller_.joinable()) return true;
+    if (!flush(timeout_ms)) return false;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closed_ = true;
+    }
+    cond_.notify_all();
+    poller_.join();
+    return true;
+  }
+
+ private:
+  struct Slot {
+    DeliveryCallback callback;
+  };
+
+  static constexpr int kPollTimeoutMs = 100;
+
+  std::vector<Slot> slots_;
+  std::vector<size_t> free_slots_;
+  Producer producer_;
+  std::thread poller_;
+
+  mutable std::mutex mutex_;
+  mutable std::condition_variable cond_;
+  bool closed_ = false;
+  uint64_t num_delivered_ = 0;
+
+  static GlobalConf prepareConf(GlobalConf conf, AsyncProducer* self) {
+    conf.setOpaque(self);
+    conf.setDeliveryReportCallback(deliveryReportCallback);
+    return conf;
+  }
+
+  static void deliveryReportCallback(rd_kafka_t*,
+                                     const rd_kafka_message_t* rkmessage,
+                                     void* opaque) {
+    auto self = static_cast<AsyncProducer*>(opaque);
+    auto slot = static_cast<Slot*>(rkmessage->_private);
+    self->producer_.metrics().recordDelivery(rkmessage);
+
+    DeliveryResult result{rkmessage->err, rkmessage->partition,
+                          rkmessage->offset};
+    // the slot isn't in the free list yet, so it's only touched here
+    if (slot->callback) slot->callback(result);
+    slot->callback = nullptr;
+
+    {
+      std::lock_guard<std::mutex> lock(self->mutex_);
+      auto index = static_cast<size_t>(slot - self->slots_.data());
+      self->free_slots_.push_back(index);
+      ++self->num_delivered_;
+    }
+    self->cond_.notify_all();
+  }
+
+  void run() {
+    while (true) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_) break;
+      }
+      producer_.poll(kPollTimeoutMs);
+    }
+    // serve the remaining delivery reports
+    producer_.poll(0);
+  }
+};
+
+}  // namespace rdkafka
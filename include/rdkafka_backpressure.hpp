@@ -0,0 +1,188 @@
+// rdkafka_backpressure.hpp: what Producer::produce() does on QUEUE_FULL
+//
+// librdkafka rejects a message with QUEUE_FULL when
+// queue.buffering.max.messages or queue.buffering.max.kbytes is reached, and
+// only makes room when poll() serves delivery reports. How long a producer
+// thread has to stall depends on the delivery report rate, which Backpressure
+// estimates from rd_kafka_outq_len() and the number of enqueued messages each
+// time the queue is full. See Producer::setBackpressure().
+#pragma once
+
+#include "rdkafka.h"
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include "rdkafka_metrics.hpp"
+
+namespace rdkafka {
+
+enum class BackpressurePolicy {
+  // return QUEUE_FULL at once, Producer::retryToken() tells when to retry
+  kFail,
+  // poll() until a delivery report makes room, at most max_wait_ms
+  kBlock,
+  // poll(0) and yield while room is expected within max_spin_us, then kBlock
+  kSpinThenPark,
+  // Purge ALL unsent messages of every partition, not just the oldest one,
+  // their delivery reports fail with _PURGE_QUEUE, then kBlock if the queue
+  // is still full. Only for data that may be lost, e.g. the latest readings
+  // superseding older ones.
+  kPurgeQueue,
+};
+
+struct BackpressureOptions {
+  BackpressurePolicy policy = BackpressurePolicy::kBlock;
+  int max_wait_ms = 1000;
+  int max_spin_us = 100;
+};
+
+// when a message rejected with QUEUE_FULL is expected to fit
+struct RetryToken {
+  std::chrono::steady_clock::time_point retry_at;
+
+  bool ready() const noexcept {
+    return std::chrono::steady_clock::now() >= retry_at;
+  }
+
+  void wait() const { std::this_thread::sleep_until(retry_at); }
+};
+
+class Backpressure {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit Backpressure(const BackpressureOptions& options) noexcept
+      : options_(options) {}
+
+  const BackpressureOptions& options() const noexcept { return options_; }
+
+  // Called after produce_once() returned QUEUE_FULL, retries it according to
+  // the policy and returns the last error. produce_once() must record its
+  // result in metrics, the enqueued count is used to estimate the rate.
+  template <typename ProduceOnce>
+  rd_kafka_resp_err_t handle(rd_kafka_t* rk, ClientMetrics& metrics,
+                             ProduceOnce&& produce_once) {
+    auto start = Clock::now();
+    auto deadline = start + std::chrono::milliseconds(options_.max_wait_ms);
+    sample(rk, metrics, start);
+
+    auto error_code = RD_KAFKA_RESP_ERR__QUEUE_FULL;
+    switch (options_.policy) {
+      case BackpressurePolicy::kFail:
+        return error_code;
+      case BackpressurePolicy::kBlock:
+        break;
+      case BackpressurePolicy::kSpinThenPark:
+        if (expectedWaitUs() <= options_.max_spin_us) {
+          auto spin_time = std::chrono::microseconds(options_.max_spin_us);
+          auto spin_deadline = std::min(deadline, start + spin_time);
+          while (Clock::now() < spin_deadline) {
+            rd_kafka_poll(rk, 0);
+            error_code = produce_once();
+            if (error_code != RD_KAFKA_RESP_ERR__QUEUE_FULL) break;
+            std::this_thread::yield();
+          }
+        }
+        break;
+      case BackpressurePolicy::kPurgeQueue:
+        rd_kafka_purge(rk,
+                       RD_KAFKA_PURGE_F_QUEUE | RD_KAFKA_PURGE_F_NON_BLOCKING);
+        // room is made when the purged messages' reports are served
+        rd_kafka_poll(rk, 0);
+        error_code = produce_once();
+        break;
+    }
+
+    // park in poll(), which returns as soon as a delivery report is served,
+    // the timeout only matters if another thread serves them
+    while (error_code == RD_KAFKA_RESP_ERR__QUEUE_FULL) {
+      auto now = Clock::now();
+      if (now >= deadline) break;
+      rd_kafka_poll(rk, parkTimeoutMs(deadline - now));
+      error_code = produce_once();
+      if (error_code == RD_KAFKA_RESP_ERR__QUEUE_FULL)
+        sample(rk, metrics, Clock::now());
+    }
+
+    auto waited = Clock::now() - start;
+    metrics.record(
+        ClientMetrics::HistogramType::kBackpressureWaitUs,
+        std::chrono::duration_cast<std::chrono::microseconds>(waited).count());
+    return error_code;
+  }
+
+  // expected time until one message fits, -1 if the rate isn't known yet
+  int64_t expectedWaitUs() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return (drain_rate_ > 0) ? static_cast<int64_t>(1 / drain_rate_) : -1;
+  }
+
+  RetryToken retryToken() const {
+    int64_t wait_us = expectedWaitUs();
+    if (wait_us < 0) wait_us = kUnknownWaitUs;
+    return RetryToken{Clock::now() + std::chrono::microseconds(wait_us)};
+  }
+
+ private:
+  // samples closer than this are merged, older ones are stale
+  static constexpr int64_t kMinSampleUs = 100;
+  static constexpr int64_t kMaxSampleUs = 1000 * 1000;
+  static constexpr int64_t kUnknownWaitUs = 1000;
+  static constexpr double kSmoothing = 0.3;
+
+  const BackpressureOptions options_;
+
+  mutable std::mutex mutex_;
+  double drain_rate_ = 0;  // messages per microsecond
+  bool has_sample_ = false;
+  Clock::time_point last_time_;
+  int64_t last_outq_ = 0;
+  uint64_t last_enqueued_ = 0;
+
+  // messages drained = queued before + enqueued since - queued now
+  void sample(rd_kafka_t* rk, ClientMetrics& metrics, Clock::time_point now) {
+    int64_t outq = rd_kafka_outq_len(rk);
+    uint64_t enqueued =
+        metrics.count(ClientMetrics::Counter::kProducedMessages);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto elapsed_us =
+        std::chrono::duration_cast<std::chrono::microseconds>(now - last_time_)
+            .count();
+    if (has_sample_ && elapsed_us < kMinSampleUs) return;
+
+    if (has_sample_ && elapsed_us <= kMaxSampleUs) {
+      int64_t drained = last_outq_ +
+                        static_cast<int64_t>(enqueued - last_enqueued_) - outq;
+      if (drained >= 0) {
+        double rate = static_cast<double>(drained) / elapsed_us;
+        drain_rate_ = (drain_rate_ > 0)
+                          ? kSmoothing * rate + (1 - kSmoothing) * drain_rate_
+                          : rate;
+      }
+    }
+    has_sample_ = true;
+    last_time_ = now;
+    last_outq_ = outq;
+    last_enqueued_ = enqueued;
+  }
+
+  // twice the expected wait, so a report served by another thread is seen
+  // soon after it makes room
+  int parkTimeoutMs(Clock::duration remaining) const {
+    auto remaining_ms =
+        std::chrono::duration_cast<std::chrono::milliseconds>(remaining)
+            .count() + 1;
+    int64_t wait_us = expectedWaitUs();
+    if (wait_us < 0) return static_cast<int>(remaining_ms);
+    int64_t timeout_ms = std::max<int64_t>(1, 2 * wait_us / 1000);
+    return static_cast<int>(std::min<int64_t>(timeout_ms, remaining_ms));
+  }
+};
+
+}  // namespace rdkafka
@@ -5,11 +5,16 @@
 
 #include <string.h>
 
+#include <chrono>
 #include <memory>
 #include <string>
 #include <vector>
 
+#include "rdkafka_backpressure.hpp"
 #include "rdkafka_error.hpp"
+#include "rdkafka_metrics.hpp"
+#include "rdkafka_partitioner.hpp"
+#include "rdkafka_slice.hpp"
 #include "rdkafka_util.hpp"
 
 namespace rdkafka {
@@ -20,17 +25,54 @@ class Topic;
 class KafkaBase;
 class Consumer;
 class Producer;
+class PartitionPrefetcher;
 class Message;
+class MessageView;
+class MessageBatch;
+class MessageHeaders;
+class HeadersView;
+
+// How to destroy a librdkafka handle, resolved at compile time so the
+// deleter is stateless and PointerHolder<T> is a single pointer.
+template <typename T>
+struct HandleTraits;
+
+#define RDKAFKA_HANDLE_TRAITS(type, destroy_func)                    \
+  template <>                                                        \
+  struct HandleTraits<type> {                                        \
+    static void destroy(type* ptr) noexcept { destroy_func(ptr); }   \
+  }
+
+RDKAFKA_HANDLE_TRAITS(rd_kafka_t, rd_kafka_destroy);
+RDKAFKA_HANDLE_TRAITS(rd_kafka_conf_t, rd_kafka_conf_destroy);
+RDKAFKA_HANDLE_TRAITS(rd_kafka_topic_conf_t, rd_kafka_topic_conf_destroy);
+RDKAFKA_HANDLE_TRAITS(rd_kafka_topic_t, rd_kafka_topic_destroy);
+RDKAFKA_HANDLE_TRAITS(rd_kafka_message_t, rd_kafka_message_destroy);
+RDKAFKA_HANDLE_TRAITS(rd_kafka_queue_t, rd_kafka_queue_destroy);
+RDKAFKA_HANDLE_TRAITS(rd_kafka_headers_t, rd_kafka_headers_destroy);
+RDKAFKA_HANDLE_TRAITS(rd_kafka_topic_partition_list_t,
+                      rd_kafka_topic_partition_list_destroy);
+RDKAFKA_HANDLE_TRAITS(rd_kafka_event_t, rd_kafka_event_destroy);
+RDKAFKA_HANDLE_TRAITS(rd_kafka_AdminOptions_t, rd_kafka_AdminOptions_destroy);
+RDKAFKA_HANDLE_TRAITS(rd_kafka_error_t, rd_kafka_error_destroy);
+RDKAFKA_HANDLE_TRAITS(rd_kafka_consumer_group_metadata_t,
+                      rd_kafka_consumer_group_metadata_destroy);
+
+#undef RDKAFKA_HANDLE_TRAITS
+
+template <typename T>
+struct HandleDeleter {
+  void operator()(T* ptr) const noexcept { HandleTraits<T>::destroy(ptr); }
+};
 
 template <typename T>
 class PointerHolder {
  public:
   using element_type = T;
   using pointer = T*;
-  using deleter_type = void (*)(pointer);
+  using deleter_type = HandleDeleter<T>;
 
-  PointerHolder(pointer ptr, deleter_type deleter) noexcept
-      : ptr_(ptr, deleter) {}
+  explicit PointerHolder(pointer ptr = nullptr) noexcept : ptr_(ptr) {}
 
   // automatic following member:
   // 1. deleted copy constructor/assignment operator
@@ -40,33 +82,53 @@ class PointerHolder {
   pointer get() const noexcept { return ptr_.get(); }
   pointer release() noexcept { return ptr_.release(); }
 
+  // destroy the holding pointer (if any) and hold ptr
+  void reset(pointer ptr = nullptr) noexcept { ptr_.reset(ptr); }
+
   bool isNull() const noexcept { return ptr_ == nullptr; }
 
  private:
   std::unique_ptr<T, deleter_type> ptr_;
 };
 
+static_assert(sizeof(PointerHolder<rd_kafka_t>) == sizeof(rd_kafka_t*),
+              "PointerHolder must be a single pointer");
+
 template <typename T>
 class Conf : public PointerHolder<T> {
  public:
   using Base = PointerHolder<T>;
   using Base::Base;
-  using typename Base::deleter_type;
   using typename Base::element_type;
   using typename Base::pointer;
 
-  Conf(pointer ptr, deleter_type deleter) : Base(ptr, deleter) {}
+  explicit Conf(pointer ptr) noexcept : Base(ptr) {}
 
   void put(const char* name, const char* value) const noexcept {
     util::putNameValue(this->get(), name, value);
   }
+
+  // empty if name is unknown or unset
+  std::string value(const char* name) const {
+    return util::getValue(this->get(), name);
+  }
 };
 
 class TopicConf : public Conf<rd_kafka_topic_conf_t> {
  public:
   using Base = Conf<rd_kafka_topic_conf_t>;
   TopicConf() noexcept
-      : Base(rd_kafka_topic_conf_new(), rd_kafka_topic_conf_destroy) {}
+      : Base(rd_kafka_topic_conf_new()) {}
+
+  // Partition messages with partitioner, which must outlive the topics created
+  // from this config, see rdkafka_partitioner.hpp. The call is resolved at
+  // compile time, no virtual call per message.
+  template <typename Partitioner>
+  void setPartitioner(Partitioner* partitioner) const noexcept {
+    rd_kafka_topic_conf_set_partitioner_cb(
+        get(), &detail::partitionerCallback<Partitioner>);
+    rd_kafka_topic_conf_set_opaque(get(), partitioner);
+  }
 };
 
 class GlobalConf : public Conf<rd_kafka_conf_t> {
@@ -76,8 +138,14 @@ class GlobalConf : public Conf<rd_kafka_conf_t> {
                                      rd_kafka_topic_partition_list_t*, void*);
   using DeliveryReportCallback = void (*)(rd_kafka_t*,
                                           const rd_kafka_message_t*, void*);
+  // return 0 to let librdkafka free json, see rdkafka_stats.hpp
+  using StatsCallback = int (*)(rd_kafka_t*, char* json, size_t json_len,
+                                void*);
+
+  GlobalConf() noexcept : Base(rd_kafka_conf_new()) {}
 
-  GlobalConf() noexcept : Base(rd_kafka_conf_new(), rd_kafka_conf_destroy) {}
+  // take conf's ownership
+  explicit GlobalConf(rd_kafka_conf_t* conf) noexcept : Base(conf) {}
 
   void setDefaultTopicConf(TopicConf&& topicconf) const noexcept {
     // take rd_kafka_topic_conf_t's ownership
@@ -92,6 +160,52 @@ class GlobalConf : public Conf<rd_kafka_conf_t> {
       noexcept {
     rd_kafka_conf_set_dr_msg_cb(get(), callback);
   }
+
+  // called every statistics.interval.ms from poll()
+  void setStatsCallback(StatsCallback callback) const noexcept {
+    rd_kafka_conf_set_stats_cb(get(), callback);
+  }
+
+  // opaque is passed to all callbacks as the last argument
+  void setOpaque(void* opaque) const noexcept {
+    rd_kafka_conf_set_opaque(get(), opaque);
+  }
+
+  // Idempotent producer: the broker drops duplicates of retried requests by
+  // their sequence numbers, so messages are written once and in order with
+  // up to 5 requests in flight per connection, instead of 1 without it.
+  void enableIdempotence(int max_in_flight = 5) const noexcept {
+    put("enable.idempotence", "true");
+    put("max.in.flight", std::to_string(max_in_flight).data());
+  }
+
+  // Empty if this is a valid idempotent (or transactional) producer config,
+  // otherwise why it isn't. rd_kafka_new() rejects only part of these, an old
+  // broker.version.fallback fails later.
+  std::string checkIdempotence() const {
+    if (value("enable.idempotence") != "true" &&
+        value("transactional.id").empty())
+      return "enable.idempotence is not true";
+    // librdkafka lowers the default to 5 itself
+    auto max_in_flight = value("max.in.flight");
+    if (max_in_flight != GlobalConf().value("max.in.flight") &&
+        (atoi(max_in_flight.data()) < 1 || atoi(max_in_flight.data()) > 5))
+      return "max.in.flight must be 1 to 5, not " + max_in_flight;
+    auto acks = value("acks");  // unset means all
+    if (!acks.empty() && acks != "all" && acks != "-1")
+      return "acks must be all, not " + acks;
+    if (atoi(value("retries").data()) < 1)
+      return "retries must be at least 1";
+    if (value("api.version.request") == "false") {
+      int major = 0, minor = 0;
+      auto fallback = value("broker.version.fallback");
+      sscanf(fallback.data(), "%d.%d", &major, &minor);
+      if (major == 0 && minor < 11)
+        return "broker.version.fallback " + fallback +
+               " has no idempotence, which requires 0.11+";
+    }
+    return std::string();
+  }
 };
 
 class KafkaBase : public PointerHolder<rd_kafka_t> {
@@ -99,7 +213,10 @@ class KafkaBase : public PointerHolder<rd_kafka_t> {
   using Base = PointerHolder<rd_kafka_t>;
 
   int poll(int timeout_ms) const noexcept {
-    return rd_kafka_poll(get(), timeout_ms);
+    auto start = std::chrono::steady_clock::now();
+    int num_events = rd_kafka_poll(get(), timeout_ms);
+    metrics_.recordPollWait(start);
+    return num_events;
   }
 
   bool flush(int timeout_ms) const noexcept {
@@ -110,11 +227,27 @@ class KafkaBase : public PointerHolder<rd_kafka_t> {
 
   const char* name() const noexcept { return rd_kafka_name(get()); }
 
+  // The error that made the client unusable, RD_KAFKA_RESP_ERR_NO_ERROR if
+  // none. Only idempotent producers (e.g. a broker lost their sequence) and
+  // consumers with group.instance.id (fenced) raise them.
+  ErrorCode fatalError(std::string* reason = nullptr) const {
+    char errstr[512];
+    auto error_code = rd_kafka_fatal_error(get(), errstr, sizeof(errstr));
+    if (reason && error_code != RD_KAFKA_RESP_ERR_NO_ERROR) *reason = errstr;
+    return error_code;
+  }
+
+  // wrapper's own counters and histograms, see rdkafka_metrics.hpp
+  ClientMetrics& metrics() const noexcept { return metrics_; }
+
  protected:
   // store error in errstr
   template <size_t N>
   KafkaBase(rd_kafka_type_t type, GlobalConf conf, char (&errstr)[N]) noexcept
-      : Base(rd_kafka_new(type, conf.release(), errstr, N), rd_kafka_destroy) {}
+      : Base(rd_kafka_new(type, conf.release(), errstr, N)) {}
+
+ private:
+  mutable ClientMetrics metrics_;  // allocates on the first record
 };
 
 class Topic : public PointerHolder<rd_kafka_topic_t> {
@@ -122,77 +255,415 @@ class Topic : public PointerHolder<rd_kafka_topic_t> {
   using Base = PointerHolder<rd_kafka_topic_t>;
 
   Topic(rd_kafka_t* rk, const char* name) noexcept
-      : Base(rd_kafka_topic_new(rk, name, nullptr), rd_kafka_topic_destroy) {}
+      : Base(rd_kafka_topic_new(rk, name, nullptr)) {}
 
   Topic(rd_kafka_t* rk, const char* name, TopicConf conf) noexcept
-      : Base(rd_kafka_topic_new(rk, name, conf.release()),
-             rd_kafka_topic_destroy) {}
+      : Base(rd_kafka_topic_new(rk, name, conf.release())) {}
+};
+
+// Error object returned by the newer APIs (transactions, seek_partitions),
+// null means success. Unlike ErrorCode it tells whether the error is fatal
+// (the client must be recreated), retriable or requires a transaction abort.
+class KafkaError : public PointerHolder<rd_kafka_error_t> {
+ public:
+  using Base = PointerHolder<rd_kafka_error_t>;
+
+  KafkaError() noexcept : Base(nullptr) {}
+
+  explicit KafkaError(rd_kafka_error_t* error) noexcept : Base(error) {}
+
+  ErrorCode code() const noexcept {
+    return isNull() ? RD_KAFKA_RESP_ERR_NO_ERROR : rd_kafka_error_code(get());
+  }
+
+  const char* str() const noexcept {
+    return isNull() ? "Success" : rd_kafka_error_string(get());
+  }
+
+  bool isFatal() const noexcept {
+    return !isNull() && rd_kafka_error_is_fatal(get());
+  }
+
+  bool isRetriable() const noexcept {
+    return !isNull() && rd_kafka_error_is_retriable(get());
+  }
+
+  bool txnRequiresAbort() const noexcept {
+    return !isNull() && rd_kafka_error_txn_requires_abort(get());
+  }
+};
+
+// Headers to attach to a produced message, see Producer::produceWithHeaders()
+class MessageHeaders : public PointerHolder<rd_kafka_headers_t> {
+ public:
+  using Base = PointerHolder<rd_kafka_headers_t>;
+
+  explicit MessageHeaders(size_t initial_count = 4) noexcept
+      : Base(rd_kafka_headers_new(initial_count)) {}
+
+  // name and value are copied
+  ErrorCode add(const char* name, Slice value) const noexcept {
+    return rd_kafka_header_add(get(), name, -1, value.data(),
+                               static_cast<ssize_t>(value.size()));
+  }
+
+  size_t size() const noexcept { return rd_kafka_header_cnt(get()); }
+};
+
+// Read-only view of a message's headers, names and values point into the
+// message's buffer, so they are valid as long as the message.
+class HeadersView {
+ public:
+  struct Header {
+    const char* name;
+    Slice value;  // null value is an empty slice with nullptr data
+  };
+
+  class Iterator {
+   public:
+    Iterator(const HeadersView* view, size_t i) noexcept
+        : view_(view), i_(i) {}
+
+    Header operator*() const noexcept { return (*view_)[i_]; }
+
+    Iterator& operator++() noexcept {
+      ++i_;
+      return *this;
+    }
+
+    bool operator!=(const Iterator& rhs) const noexcept { return i_ != rhs.i_; }
+
+   private:
+    const HeadersView* view_;
+    size_t i_;
+  };
+
+  explicit HeadersView(const rd_kafka_headers_t* hdrs) noexcept
+      : hdrs_(hdrs) {}
+
+  size_t size() const noexcept {
+    return hdrs_ ? rd_kafka_header_cnt(hdrs_) : 0;
+  }
+
+  bool empty() const noexcept { return size() == 0; }
+
+  Header operator[](size_t i) const noexcept {
+    Header header{nullptr, Slice()};
+    if (!hdrs_) return header;
+
+    const void* value = nullptr;
+    size_t value_size = 0;
+    auto error_code =
+        rd_kafka_header_get_all(hdrs_, i, &header.name, &value, &value_size);
+    if (error_code == RD_KAFKA_RESP_ERR_NO_ERROR) {
+      header.value = Slice(value, value_size);
+    }
+    return header;
+  }
+
+  // Find the last header named name, returns false if not found.
+  bool get(const char* name, Slice& value) const noexcept {
+    if (!hdrs_) return false;
+
+    const void* data = nullptr;
+    size_t size = 0;
+    if (rd_kafka_header_get_last(hdrs_, name, &data, &size) !=
+        RD_KAFKA_RESP_ERR_NO_ERROR) {
+      return false;
+    }
+    value = Slice(data, size);
+    return true;
+  }
+
+  Iterator begin() const noexcept { return Iterator(this, 0); }
+
+  Iterator end() const noexcept { return Iterator(this, size()); }
+
+ private:
+  const rd_kafka_headers_t* hdrs_;
+};
+
+// Payload ownership of messages produced by Producer::produceBatch()
+enum class PayloadOwnership : int {
+  // librdkafka copies the payload, the buffer can be reused after the call
+  kCopy = RD_KAFKA_MSG_F_COPY,
+  // librdkafka free()s the payload after delivery, it must come from malloc(),
+  // payloads of messages that failed to enqueue are still owned by caller
+  kFree = RD_KAFKA_MSG_F_FREE,
+  // no copy, caller keeps the payload alive until its delivery report
+  kBorrow = 0
+};
+
+// Reusable message container for Producer::produceBatch(), the messages are
+// stored as rd_kafka_message_t so the batch is passed to librdkafka as is.
+// After produceBatch() each message holds its own error code.
+class ProduceBatch {
+ public:
+  ProduceBatch() = default;
+  explicit ProduceBatch(size_t capacity) { messages_.reserve(capacity); }
+
+  void add(void* payload, size_t len, const void* key = nullptr,
+           size_t keylen = 0, void* msg_opaque = nullptr,
+           int32_t partition = RD_KAFKA_PARTITION_UA) {
+    rd_kafka_message_t message;
+    memset(&message, 0, sizeof(message));
+    message.partition = partition;
+    message.payload = payload;
+    message.len = len;
+    message.key = const_cast<void*>(key);
+    message.key_len = keylen;
+    message._private = msg_opaque;  // rd_kafka_produce_batch()'s msg_opaque
+    messages_.push_back(message);
+
+    if (partition != RD_KAFKA_PARTITION_UA) has_partition_ = true;
+  }
+
+  // keep the capacity, so a reused batch won't allocate again
+  void clear() noexcept {
+    messages_.clear();
+    has_partition_ = false;
+  }
+
+  size_t size() const noexcept { return messages_.size(); }
+
+  bool empty() const noexcept { return messages_.empty(); }
+
+  // true if any message was added with an explicit partition
+  bool hasPartition() const noexcept { return has_partition_; }
+
+  ErrorCode error(size_t i) const noexcept { return messages_[i].err; }
+
+  const rd_kafka_message_t& operator[](size_t i) const noexcept {
+    return messages_[i];
+  }
+
+  rd_kafka_message_t* data() noexcept { return messages_.data(); }
+
+ private:
+  std::vector<rd_kafka_message_t> messages_;
+  bool has_partition_ = false;
 };
 
 class Producer final : public KafkaBase {
  public:
   template <size_t N>
   Producer(GlobalConf conf, char (&errstr)[N]) noexcept
-      : KafkaBase(RD_KAFKA_PRODUCER, std::move(conf), errstr) {}
+      : Producer(idempotentConf(conf), std::move(conf), errstr) {}
+
+  // whether enable.idempotence (or transactional.id) is set
+  bool isIdempotent() const noexcept { return !idempotent_conf_.isNull(); }
+
+  // After a fatal error, replace the handle with a new one created from the
+  // same config, which gets a new producer id. Messages not delivered yet are
+  // purged first and their failed delivery reports served. Those failed with
+  // __PURGE_QUEUE were never sent and can be produced again in order, those
+  // failed with __PURGE_INFLIGHT were sent and may have been written, so
+  // producing them again may duplicate them. Topics of the old handle must be
+  // destroyed before and created again after. Returns false, keeping the old
+  // handle, if the producer isn't idempotent or rd_kafka_new() failed (see
+  // errstr).
+  template <size_t N>
+  bool recreate(char (&errstr)[N]) noexcept {
+    if (!isIdempotent()) {
+      snprintf(errstr, N, "only an idempotent producer can be recreated");
+      return false;
+    }
+    auto conf = rd_kafka_conf_dup(idempotent_conf_.get());
+    auto rk = rd_kafka_new(RD_KAFKA_PRODUCER, conf, errstr, N);
+    if (!rk) {
+      rd_kafka_conf_destroy(conf);
+      return false;
+    }
+    rd_kafka_purge(get(), RD_KAFKA_PURGE_F_QUEUE | RD_KAFKA_PURGE_F_INFLIGHT);
+    poll(0);
+    reset(rk);
+    metrics().add(ClientMetrics::Counter::kRecreations);
+    return true;
+  }
 
+  // on QUEUE_FULL the backpressure policy is applied, see setBackpressure()
   bool produce(const Topic& topic, char* payload, size_t len,
                const char* key = nullptr, size_t keylen = 0,
                void* msg_opaque = nullptr) const noexcept {
-    return rd_kafka_produce(
-               topic.get(), partition_, msgflags_, static_cast<void*>(payload),
-               len, static_cast<const void*>(key), keylen, msg_opaque) == 0;
+    return produceWithFlags(topic, msgflags_, payload, len, key, keylen,
+                            msg_opaque);
+  }
+
+  // Same as produce() but payload and key are always copied whatever
+  // setMsgflags() set, so the caller can reuse their memory at once.
+  bool produceCopy(const Topic& topic, Slice payload, Slice key = Slice(),
+                   void* msg_opaque = nullptr) const noexcept {
+    int msgflags = (msgflags_ & ~RD_KAFKA_MSG_F_FREE) | RD_KAFKA_MSG_F_COPY;
+    return produceWithFlags(topic, msgflags, const_cast<char*>(payload.data()),
+                            payload.size(), key.data(), key.size(),
+                            msg_opaque);
+  }
+
+  // Same as produce() with headers attached. On success headers' ownership
+  // moves to librdkafka and headers becomes null, on failure it's kept so
+  // the same headers can be used to retry.
+  ErrorCode produceWithHeaders(const Topic& topic, char* payload, size_t len,
+                               MessageHeaders& headers,
+                               const char* key = nullptr, size_t keylen = 0,
+                               void* msg_opaque = nullptr) const noexcept {
+    auto produce_once = [&]() noexcept {
+      auto error_code = rd_kafka_producev(
+          get(), RD_KAFKA_V_RKT(topic.get()), RD_KAFKA_V_PARTITION(partition_),
+          RD_KAFKA_V_MSGFLAGS(msgflags_), RD_KAFKA_V_VALUE(payload, len),
+          RD_KAFKA_V_KEY(key, keylen), RD_KAFKA_V_OPAQUE(msg_opaque),
+          RD_KAFKA_V_HEADERS(headers.get()), RD_KAFKA_V_END);
+      metrics().recordProduce(error_code);
+      return error_code;
+    };
+    metrics().add(ClientMetrics::Counter::kProduceCalls);
+    auto error_code = produceWithBackpressure(produce_once);
+    if (error_code == RD_KAFKA_RESP_ERR_NO_ERROR) headers.release();
+    return error_code;
+  }
+
+  // Enqueue all messages of batch with a single librdkafka call.
+  // Returns the number of messages enqueued, messages that failed have their
+  // error code set, see ProduceBatch::error(). The backpressure policy isn't
+  // applied, retryToken() tells when to retry QUEUE_FULL messages.
+  int produceBatch(
+      const Topic& topic, ProduceBatch& batch,
+      PayloadOwnership ownership = PayloadOwnership::kCopy) const noexcept {
+    return produceBatch(topic, batch.data(), static_cast<int>(batch.size()),
+                        ownership, batch.hasPartition());
+  }
+
+  // Same as above but on a caller's array, if per_message_partition is true,
+  // each message's partition field is used instead of setPartition()'s value.
+  int produceBatch(const Topic& topic, rd_kafka_message_t* messages, int count,
+                   PayloadOwnership ownership,
+                   bool per_message_partition = false) const noexcept {
+    int msgflags = static_cast<int>(ownership);
+    if (per_message_partition) msgflags |= RD_KAFKA_MSG_F_PARTITION;
+    int num_enqueued = rd_kafka_produce_batch(topic.get(), partition_,
+                                              msgflags, messages, count);
+
+    metrics().add(ClientMetrics::Counter::kProduceCalls);
+    metrics().add(ClientMetrics::Counter::kProducedMessages, num_enqueued);
+    if (num_enqueued < count) {
+      for (int i = 0; i < count; i++) {
+        if (messages[i].err != RD_KAFKA_RESP_ERR_NO_ERROR)
+          metrics().recordProduce(messages[i].err);
+      }
+    }
+    return num_enqueued;
   }
 
   void setPartition(int32_t partition) noexcept { partition_ = partition; }
 
   void setMsgflags(int msgflags) noexcept { msgflags_ = msgflags; }
 
+  // What produce() and produceWithHeaders() do on QUEUE_FULL, by default they
+  // return it at once. See rdkafka_backpressure.hpp.
+  void setBackpressure(const BackpressureOptions& options) {
+    backpressure_.reset(new Backpressure(options));
+  }
+
+  // when to retry a message rejected with QUEUE_FULL, estimated from the
+  // delivery report rate if a backpressure policy is set
+  RetryToken retryToken() const {
+    if (backpressure_) return backpressure_->retryToken();
+    return RetryToken{std::chrono::steady_clock::now()};
+  }
+
  private:
   int32_t partition_ = RD_KAFKA_PARTITION_UA;
   int msgflags_ = RD_KAFKA_MSG_F_COPY;
-};
+  std::unique_ptr<Backpressure> backpressure_;
+  // copy of an idempotent producer's config for recreate(), null otherwise
+  GlobalConf idempotent_conf_;
 
-class Message final : public PointerHolder<rd_kafka_message_t> {
-  friend class Consumer;
+  // conf is moved only after idempotent_conf is copied from it
+  template <size_t N>
+  Producer(GlobalConf&& idempotent_conf, GlobalConf&& conf,
+           char (&errstr)[N]) noexcept
+      : KafkaBase(RD_KAFKA_PRODUCER, std::move(conf), errstr),
+        idempotent_conf_(std::move(idempotent_conf)) {}
+
+  // reads the properties into stack buffers, the constructors are noexcept
+  static GlobalConf idempotentConf(const GlobalConf& conf) noexcept {
+    char idempotence[8];
+    size_t size = sizeof(idempotence);
+    bool enabled = rd_kafka_conf_get(conf.get(), "enable.idempotence",
+                                     idempotence, &size) == RD_KAFKA_CONF_OK &&
+                   strcmp(idempotence, "true") == 0;
+    // the size of the value including its '\0'
+    size_t id_size = 0;
+    bool transactional = rd_kafka_conf_get(conf.get(), "transactional.id",
+                                           nullptr, &id_size) ==
+                             RD_KAFKA_CONF_OK &&
+                         id_size > 1;
+    if (!enabled && !transactional) return GlobalConf(nullptr);
+    return GlobalConf(rd_kafka_conf_dup(conf.get()));
+  }
 
- public:
-  using Base = PointerHolder<rd_kafka_message_t>;
-  using typename Base::element_type;
-  using typename Base::pointer;
+  bool produceWithFlags(const Topic& topic, int msgflags, char* payload,
+                        size_t len, const char* key, size_t keylen,
+                        void* msg_opaque) const noexcept {
+    auto produce_once = [&]() noexcept {
+      auto error_code =
+          rd_kafka_produce(topic.get(), partition_, msgflags,
+                           static_cast<void*>(payload), len,
+                           static_cast<const void*>(key), keylen,
+                           msg_opaque) == 0
+              ? RD_KAFKA_RESP_ERR_NO_ERROR
+              : rd_kafka_last_error();
+      metrics().recordProduce(error_code);
+      return error_code;
+    };
+    metrics().add(ClientMetrics::Counter::kProduceCalls);
+    return produceWithBackpressure(produce_once) == RD_KAFKA_RESP_ERR_NO_ERROR;
+  }
 
-  //    pointer operator->() const noexcept { return get(); }
+  template <typename ProduceOnce>
+  ErrorCode produceWithBackpressure(ProduceOnce& produce_once) const noexcept {
+    auto error_code = produce_once();
+    if (error_code == RD_KAFKA_RESP_ERR__QUEUE_FULL && backpressure_)
+      error_code = backpressure_->handle(get(), metrics(), produce_once);
+    return error_code;
+  }
+};
 
+// Read-only accessors shared by Message and MessageView,
+// Derived must provide `rd_kafka_message_t* get() const`.
+template <typename Derived>
+class MessageAccessor {
+ public:
   const char* payload() const noexcept {
-    return const_cast<const char*>(static_cast<char*>(get()->payload));
+    return const_cast<const char*>(static_cast<char*>(message()->payload));
   }
 
-  size_t payloadLen() const noexcept { return get()->len; }
+  size_t payloadLen() const noexcept { return message()->len; }
 
   const char* key() const noexcept {
-    return const_cast<const char*>(static_cast<char*>(get()->key));
+    return const_cast<const char*>(static_cast<char*>(message()->key));
   }
 
-  size_t keyLen() const noexcept { return get()->key_len; }
+  size_t keyLen() const noexcept { return message()->key_len; }
 
   bool hasError() const noexcept {
-    return get()->err != RD_KAFKA_RESP_ERR_NO_ERROR;
+    return message()->err != RD_KAFKA_RESP_ERR_NO_ERROR;
   }
 
   const char* errorStr() const noexcept {
-    return rd_kafka_message_errstr(get());
+    return rd_kafka_message_errstr(message());
   }
 
-  int32_t partition() const noexcept { return get()->partition; }
+  int32_t partition() const noexcept { return message()->partition; }
 
-  int64_t offset() const noexcept { return get()->offset; }
+  int64_t offset() const noexcept { return message()->offset; }
 
   // return -1 if failed.
   int64_t timestamp() const noexcept {
-    return rd_kafka_message_timestamp(get(), nullptr);
+    return rd_kafka_message_timestamp(message(), nullptr);
   }
 
   const char* topicName() const noexcept {
-    auto p = get();
+    auto p = message();
     if (p->rkt) {
       return rd_kafka_topic_name(p->rkt);
     } else {
@@ -201,15 +672,107 @@ class Message final : public PointerHolder<rd_kafka_message_t> {
   }
 
   bool isTopicInvalid() const noexcept {
-    return get()->err == RD_KAFKA_RESP_ERR__UNKNOWN_TOPIC;
+    return message()->err == RD_KAFKA_RESP_ERR__UNKNOWN_TOPIC;
   }
 
   bool isPartitionInvalid() const noexcept {
-    return get()->err == RD_KAFKA_RESP_ERR__UNKNOWN_PARTITION;
+    return message()->err == RD_KAFKA_RESP_ERR__UNKNOWN_PARTITION;
+  }
+
+  // headers are parsed by librdkafka on the first call, the view doesn't copy
+  HeadersView headers() const noexcept {
+    rd_kafka_headers_t* hdrs = nullptr;
+    if (rd_kafka_message_headers(message(), &hdrs) !=
+        RD_KAFKA_RESP_ERR_NO_ERROR) {
+      hdrs = nullptr;
+    }
+    return HeadersView(hdrs);
   }
 
  private:
-  Message(pointer ptr) noexcept : Base(ptr, rd_kafka_message_destroy) {}
+  const rd_kafka_message_t* message() const noexcept {
+    return static_cast<const Derived*>(this)->get();
+  }
+};
+
+class Message final : public PointerHolder<rd_kafka_message_t>,
+                      public MessageAccessor<Message> {
+  friend class Consumer;
+  friend class PartitionPrefetcher;
+
+ public:
+  using Base = PointerHolder<rd_kafka_message_t>;
+  using typename Base::element_type;
+  using typename Base::pointer;
+
+  //    pointer operator->() const noexcept { return get(); }
+
+ private:
+  Message(pointer ptr) noexcept : Base(ptr) {}
+};
+
+static_assert(sizeof(Message) == sizeof(rd_kafka_message_t*),
+              "Message must be a single pointer");
+
+// Non-owning view of a message in MessageBatch, it's valid until the batch is
+// cleared or refilled.
+class MessageView final : public MessageAccessor<MessageView> {
+ public:
+  using pointer = rd_kafka_message_t*;
+
+  explicit MessageView(pointer ptr) noexcept : ptr_(ptr) {}
+
+  pointer get() const noexcept { return ptr_; }
+
+ private:
+  pointer ptr_;
+};
+
+// Caller-owned container filled by Consumer::consumeBatch(). The slots are
+// allocated once in constructor, so refilling a batch doesn't allocate.
+class MessageBatch {
+ public:
+  explicit MessageBatch(size_t capacity) : messages_(capacity, nullptr) {}
+
+  MessageBatch(const MessageBatch&) = delete;
+  MessageBatch& operator=(const MessageBatch&) = delete;
+
+  ~MessageBatch() { clear(); }
+
+  size_t size() const noexcept { return size_; }
+
+  size_t capacity() const noexcept { return messages_.size(); }
+
+  bool empty() const noexcept { return size_ == 0; }
+
+  MessageView operator[](size_t i) const noexcept {
+    return MessageView(messages_[i]);
+  }
+
+  // destroy the messages but keep the slots
+  void clear() noexcept {
+    for (size_t i = 0; i < size_; i++) rd_kafka_message_destroy(messages_[i]);
+    size_ = 0;
+  }
+
+  // Refill the batch with up to max_messages (at most capacity()) messages
+  // from rkqu with a single librdkafka call, waiting at most timeout_ms.
+  ErrorCode consume(rd_kafka_queue_t* rkqu, size_t max_messages,
+                    int timeout_ms) noexcept {
+    clear();
+    if (max_messages > capacity()) max_messages = capacity();
+
+    auto n = rd_kafka_consume_batch_queue(rkqu, timeout_ms, messages_.data(),
+                                          max_messages);
+    if (n < 0) return rd_kafka_last_error();
+
+    size_ = static_cast<size_t>(n);
+    return RD_KAFKA_RESP_ERR_NO_ERROR;
+  }
+
+ private:
+  std::vector<rd_kafka_message_t*> messages_;
+  size_t size_ = 0;
 };
 
 class Consumer final : public KafkaBase {
@@ -217,11 +780,21 @@ class Consumer final : public KafkaBase {
   template <size_t N>
   Consumer(GlobalConf conf, char (&errstr)[N]) noexcept
       : KafkaBase(RD_KAFKA_CONSUMER, std::move(conf), errstr) {
+    if (isNull()) return;
+
     auto error_code = rd_kafka_poll_set_consumer(get());
     if (error_code != RD_KAFKA_RESP_ERR_NO_ERROR) {
       const char* errmsg = rd_kafka_err2str(rd_kafka_last_error());
-      strncpy(errstr, errmsg, N);
+      strncpy(errstr, errmsg, N - 1);
+      errstr[N - 1] = '\0';
     }
+    queue_.reset(rd_kafka_queue_get_consumer(get()));
+  }
+
+  // consumer queue must be destroyed before rd_kafka_t
+  pointer release() noexcept {
+    queue_.reset();
+    return Base::release();
   }
 
   ErrorCode subscribe(const std::vector<std::string>& topics) const noexcept {
@@ -240,12 +813,66 @@ class Consumer final : public KafkaBase {
   }
 
   Message consume(int timeout_ms) const noexcept {
-    return rd_kafka_consumer_poll(get(), timeout_ms);
+    auto start = std::chrono::steady_clock::now();
+    Message message(rd_kafka_consumer_poll(get(), timeout_ms));
+    metrics().recordPollWait(start);
+    if (!message.isNull())
+      metrics().add(ClientMetrics::Counter::kConsumedMessages);
+    return message;
+  }
+
+  // Consume up to max_messages (at most batch.capacity()) messages from the
+  // consumer queue, previous messages of batch are destroyed first.
+  // Returns error code, the number of consumed messages is batch.size().
+  ErrorCode consumeBatch(MessageBatch& batch, size_t max_messages,
+                         int timeout_ms) const noexcept {
+    auto start = std::chrono::steady_clock::now();
+    auto error_code = batch.consume(queue_.get(), max_messages, timeout_ms);
+    metrics().recordPollWait(start);
+    metrics().record(ClientMetrics::HistogramType::kConsumeBatchSize,
+                     batch.size());
+    metrics().add(ClientMetrics::Counter::kConsumedMessages, batch.size());
+    return error_code;
+  }
+
+  // Move the fetch positions of assigned partitions to their offsets (or
+  // logical offsets like RD_KAFKA_OFFSET_TAIL(n)), waiting at most timeout_ms
+  // for the seeks to finish, 0 doesn't wait. Messages already fetched for
+  // these partitions are dropped. Per-partition errors are set in partitions.
+  ErrorCode seek(rd_kafka_topic_partition_list_t* partitions,
+                 int timeout_ms) const noexcept {
+    return KafkaError(rd_kafka_seek_partitions(get(), partitions, timeout_ms))
+        .code();
+  }
+
+  ErrorCode seek(const char* topic, int32_t partition, int64_t offset,
+                 int timeout_ms) const noexcept {
+    PointerHolder<rd_kafka_topic_partition_list_t> partitions(
+        rd_kafka_topic_partition_list_new(1));
+    rd_kafka_topic_partition_list_add(partitions.get(), topic, partition)
+        ->offset = offset;
+    auto error_code = seek(partitions.get(), timeout_ms);
+    if (error_code != RD_KAFKA_RESP_ERR_NO_ERROR) return error_code;
+    return partitions.get()->elems[0].err;
+  }
+
+  // Stop fetching the partitions, their prefetched messages are dropped and
+  // fetched again from the consumed position after resume().
+  // Per-partition errors are set in partitions.
+  ErrorCode pause(rd_kafka_topic_partition_list_t* partitions) const noexcept {
+    return rd_kafka_pause_partitions(get(), partitions);
+  }
+
+  ErrorCode resume(rd_kafka_topic_partition_list_t* partitions) const noexcept {
+    return rd_kafka_resume_partitions(get(), partitions);
   }
 
   ErrorCode waitUntilRebalanceRevoke() const noexcept {
     return rd_kafka_consumer_close(get());
   }
+
+ private:
+  PointerHolder<rd_kafka_queue_t> queue_;
 };
 
 }  // namespace rdkafka
@@ -0,0 +1,385 @@
+// rdkafka_compression.hpp: compress payloads on a worker pool
+//
+// librdkafka compresses whole message sets (compression.codec) on the broker
+// threads, one per broker, so compression doesn't scale with cores.
+// CompressingProducer compresses each large payload with zlib on its own
+// worker threads instead and tags the message with a header naming the
+// codec, the consumer inflates it with PayloadDecompressor. Messages are
+// enqueued to librdkafka in produce() order whichever worker finishes first.
+//
+// A compressed payload is the uncompressed size (4 bytes, big endian) then a
+// zlib stream. A preset dictionary of strings common in payloads (e.g. JSON
+// field names) makes small payloads compress well, consumers need the same
+// dictionary. Payloads below min_bytes or that don't shrink are sent as is,
+// without header.
+#pragma once
+
+#include "rdkafka.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "rdkafka_classes.hpp"
+#include "rdkafka_slice.hpp"
+
+namespace rdkafka {
+
+struct CompressionOptions {
+  // zlib level, 1 (fastest) to 9 (smallest)
+  int level = 6;
+  // smaller payloads aren't compressed
+  size_t min_bytes = 1024;
+  // 0: std::thread::hardware_concurrency()
+  int num_workers = 0;
+  // produce() blocks while this many messages aren't enqueued yet
+  size_t max_pending = 1024;
+  // preset dictionary, the consumers' PayloadDecompressor needs the same
+  std::string dictionary;
+  // header whose value names the codec of a compressed payload
+  std::string header = "x-payload-codec";
+  // PayloadDecompressor rejects larger uncompressed sizes as corrupted
+  size_t max_uncompressed_bytes = 256 * 1024 * 1024;
+};
+
+namespace detail {
+
+constexpr const char* kZlibCodec = "zlib";
+constexpr size_t kSizePrefix = 4;
+
+}  // namespace detail
+
+// Compress on worker threads, enqueue in produce() order, thread safe.
+// librdkafka's QUEUE_FULL is waited out with poll(), so delivery reports may
+// be served on a worker thread.
+class CompressingProducer final {
+ public:
+  struct Counts {
+    long compressed = 0;    // messages sent compressed
+    long uncompressed = 0;  // too small or didn't shrink
+    long errors = 0;        // rejected by librdkafka, see metrics()
+    uint64_t bytes_in = 0;  // payload bytes of compressed messages
+    uint64_t bytes_out = 0;
+  };
+
+  // producer isn't owned, it must outlive the CompressingProducer
+  CompressingProducer(const Producer& producer,
+                      const CompressionOptions& options = CompressionOptions())
+      : producer_(producer),
+        options_(options),
+        jobs_(std::max<size_t>(options.max_pending, 1)) {
+    int num_workers = options.num_workers;
+    if (num_workers <= 0)
+      num_workers = static_cast<int>(std::thread::hardware_concurrency());
+    for (int i = 0; i < std::max(num_workers, 1); i++)
+      workers_.emplace_back(&CompressingProducer::run, this);
+  }
+
+  CompressingProducer(const CompressingProducer&) = delete;
+  CompressingProducer& operator=(const CompressingProducer&) = delete;
+
+  // pending messages are enqueued first
+  ~CompressingProducer() {
+    drain();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    work_cond_.notify_all();
+    for (auto& worker : workers_) worker.join();
+  }
+
+  // Copy the message to be compressed by a worker. A small one is enqueued
+  // at once if nothing is pending, which keeps the order too, and its error
+  // is returned. A worker's error is counted and kept for lastError() since
+  // produce() has returned already. msg_opaque is passed to the delivery
+  // report. topic must outlive drain(), workers enqueue to it later.
+  ErrorCode produce(const Topic& topic, Slice payload, Slice key = Slice(),
+                    int32_t partition = RD_KAFKA_PARTITION_UA,
+                    void* msg_opaque = nullptr) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (payload.size() < options_.min_bytes && next_emit_ == next_seq_)
+      return produceNow(lock, topic.get(), partition, payload, key,
+                        msg_opaque);
+    space_cond_.wait(lock, [this] { return next_seq_ - next_emit_ < size(); });
+    auto& job = jobs_[next_seq_ % size()];
+    job.topic = topic.get();
+    job.partition = partition;
+    job.payload.assign(payload.data(), payload.size());
+    job.has_key = key.data() != nullptr;
+    job.key.assign(key.data(), key.size());
+    job.msg_opaque = msg_opaque;
+    job.done = false;
+    ++next_seq_;
+    work_cond_.notify_one();
+    return RD_KAFKA_RESP_ERR_NO_ERROR;
+  }
+
+  // wait until every message passed to produce() is enqueued to librdkafka
+  void drain() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    space_cond_.wait(lock, [this] { return next_emit_ == next_seq_; });
+  }
+
+  Counts counts() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return counts_;
+  }
+
+  // the last error of a message enqueued by a worker
+  ErrorCode lastError() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return last_error_;
+  }
+
+  const Producer& producer() const noexcept { return producer_; }
+
+ private:
+  struct Job {
+    rd_kafka_topic_t* topic = nullptr;
+    int32_t partition = RD_KAFKA_PARTITION_UA;
+    // buffers keep their capacity when the slot is reused
+    std::string payload;
+    std::string key;
+    bool has_key = false;
+    void* msg_opaque = nullptr;
+    std::string output;  // the compressed payload if compressed
+    bool compressed = false;
+    bool done = false;
+  };
+
+  const Producer& producer_;
+  const CompressionOptions options_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable work_cond_;   // a job to compress, or stopping_
+  std::condition_variable space_cond_;  // next_emit_ advanced
+  // ring of the jobs from next_emit_ to next_seq_
+  std::vector<Job> jobs_;
+  uint64_t next_seq_ = 0;   // of the next produce()
+  uint64_t next_take_ = 0;  // next job to compress
+  uint64_t next_emit_ = 0;  // next job to enqueue
+  bool emitting_ = false;   // a worker is enqueuing done jobs in order
+  bool stopping_ = false;
+  Counts counts_;
+  ErrorCode last_error_ = RD_KAFKA_RESP_ERR_NO_ERROR;
+  std::vector<std::thread> workers_;
+
+  size_t size() const noexcept { return jobs_.size(); }
+
+  // Enqueue a small message without the lock, enqueue() may wait out
+  // QUEUE_FULL in poll(), whose callbacks may call produce(). Its sequence
+  // number is taken first and emitting_ set, so later messages queue up
+  // behind it and are emitted after it.
+  ErrorCode produceNow(std::unique_lock<std::mutex>& lock,
+                       rd_kafka_topic_t* topic, int32_t partition,
+                       Slice payload, Slice key, void* msg_opaque) {
+    ++next_seq_;
+    ++next_take_;
+    emitting_ = true;
+    lock.unlock();
+    auto error_code =
+        enqueue(topic, partition, payload, key, msg_opaque, false);
+    lock.lock();
+    if (error_code == RD_KAFKA_RESP_ERR_NO_ERROR) {
+      ++counts_.uncompressed;
+    } else {
+      ++counts_.errors;
+    }
+    ++next_emit_;
+    // jobs done meanwhile weren't emitted by their workers
+    emit(lock);
+    space_cond_.notify_all();
+    return error_code;
+  }
+
+  void run() {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    bool ok = deflateInit(&stream, options_.level) == Z_OK;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      work_cond_.wait(lock,
+                      [this] { return stopping_ || next_take_ < next_seq_; });
+      if (next_take_ == next_seq_) break;  // stopping
+      auto& job = jobs_[next_take_++ % size()];
+      lock.unlock();
+      job.compressed = ok && compress(stream, job);
+      lock.lock();
+      job.done = true;
+      if (!emitting_) emit(lock);
+    }
+    if (ok) deflateEnd(&stream);
+  }
+
+  // Enqueue the done jobs from next_emit_ in order, the lock is released
+  // while enqueuing, emitting_ keeps other workers from doing the same.
+  void emit(std::unique_lock<std::mutex>& lock) {
+    emitting_ = true;
+    while (next_emit_ < next_take_ && jobs_[next_emit_ % size()].done) {
+      auto& job = jobs_[next_emit_ % size()];
+      lock.unlock();
+      Slice payload = job.compressed ? Slice(job.output) : Slice(job.payload);
+      Slice key = job.has_key ? Slice(job.key) : Slice();
+      auto error_code = enqueue(job.topic, job.partition, payload, key,
+                                job.msg_opaque, job.compressed);
+      lock.lock();
+      if (error_code != RD_KAFKA_RESP_ERR_NO_ERROR) {
+        ++counts_.errors;
+        last_error_ = error_code;
+      } else if (job.compressed) {
+        ++counts_.compressed;
+        counts_.bytes_in += job.payload.size();
+        counts_.bytes_out += job.output.size();
+      } else {
+        ++counts_.uncompressed;
+      }
+      job.done = false;
+      ++next_emit_;
+      space_cond_.notify_all();
+    }
+    emitting_ = false;
+  }
+
+  // false if the payload doesn't shrink
+  bool compress(z_stream& stream, Job& job) {
+    if (job.payload.size() < options_.min_bytes) return false;
+    if (deflateReset(&stream) != Z_OK) return false;
+    if (!options_.dictionary.empty())
+      deflateSetDictionary(
+          &stream, reinterpret_cast<const Bytef*>(options_.dictionary.data()),
+          static_cast<uInt>(options_.dictionary.size()));
+
+    size_t bound = deflateBound(&stream, job.payload.size());
+    job.output.resize(detail::kSizePrefix + bound);
+    auto size = static_cast<uint32_t>(job.payload.size());
+    for (size_t i = 0; i < detail::kSizePrefix; i++)
+      job.output[i] = static_cast<char>(size >> (8 * (3 - i)));
+
+    stream.next_in =
+        reinterpret_cast<Bytef*>(const_cast<char*>(job.payload.data()));
+    stream.avail_in = static_cast<uInt>(job.payload.size());
+    stream.next_out = reinterpret_cast<Bytef*>(&job.output[0]) +
+                      detail::kSizePrefix;
+    stream.avail_out = static_cast<uInt>(bound);
+    if (deflate(&stream, Z_FINISH) != Z_STREAM_END) return false;
+    job.output.resize(detail::kSizePrefix + stream.total_out);
+    return job.output.size() < job.payload.size();
+  }
+
+  // waits out QUEUE_FULL, returns other errors
+  ErrorCode enqueue(rd_kafka_topic_t* topic, int32_t partition, Slice payload,
+                    Slice key, void* msg_opaque, bool compressed) {
+    auto& metrics = producer_.metrics();
+    while (true) {
+      rd_kafka_headers_t* headers = nullptr;
+      if (compressed) {
+        headers = rd_kafka_headers_new(1);
+        rd_kafka_header_add(headers, options_.header.data(),
+                            static_cast<ssize_t>(options_.header.size()),
+                            detail::kZlibCodec, -1);
+      }
+      auto error_code = rd_kafka_producev(
+          producer_.get(), RD_KAFKA_V_RKT(topic),
+          RD_KAFKA_V_PARTITION(partition),
+          RD_KAFKA_V_MSGFLAGS(RD_KAFKA_MSG_F_COPY),
+          RD_KAFKA_V_VALUE(const_cast<char*>(payload.data()), payload.size()),
+          RD_KAFKA_V_KEY(key.data(), key.size()),
+          RD_KAFKA_V_OPAQUE(msg_opaque), RD_KAFKA_V_HEADERS(headers),
+          RD_KAFKA_V_END);
+      metrics.add(ClientMetrics::Counter::kProduceCalls);
+      metrics.recordProduce(error_code);
+      if (error_code == RD_KAFKA_RESP_ERR_NO_ERROR) return error_code;
+      // librdkafka owns the headers only on success
+      if (headers) rd_kafka_headers_destroy(headers);
+      if (error_code != RD_KAFKA_RESP_ERR__QUEUE_FULL) return error_code;
+      producer_.poll(1);
+    }
+  }
+};
+
+// Inflate payloads compressed by CompressingProducer into a reusable buffer,
+// one per consumer thread.
+class PayloadDecompressor final {
+ public:
+  explicit PayloadDecompressor(
+      const CompressionOptions& options = CompressionOptions())
+      : options_(options) {
+    memset(&stream_, 0, sizeof(stream_));
+    ok_ = inflateInit(&stream_) == Z_OK;
+  }
+
+  ~PayloadDecompressor() {
+    if (ok_) inflateEnd(&stream_);
+  }
+
+  PayloadDecompressor(const PayloadDecompressor&) = delete;
+  PayloadDecompressor& operator=(const PayloadDecompressor&) = delete;
+
+  // The message's payload, inflated if its header names a codec. It's valid
+  // until the next call or while the message lives if not compressed.
+  // Returns RD_KAFKA_RESP_ERR__BAD_COMPRESSION if the payload is corrupted
+  // or needs another dictionary, RD_KAFKA_RESP_ERR__NOT_IMPLEMENTED for an
+  // unknown codec.
+  template <typename T>
+  ErrorCode payload(const MessageAccessor<T>& message, Slice& payload) {
+    payload = Slice(message.payload(), message.payloadLen());
+    Slice codec;
+    if (!message.headers().get(options_.header.data(), codec))
+      return RD_KAFKA_RESP_ERR_NO_ERROR;
+    if (codec != detail::kZlibCodec) return RD_KAFKA_RESP_ERR__NOT_IMPLEMENTED;
+    return inflate(payload);
+  }
+
+  // inflate a compressed payload (size prefix and zlib stream)
+  ErrorCode inflate(Slice& payload) {
+    if (!ok_ || payload.size() < detail::kSizePrefix)
+      return RD_KAFKA_RESP_ERR__BAD_COMPRESSION;
+    uint32_t size = 0;
+    for (size_t i = 0; i < detail::kSizePrefix; i++)
+      size = (size << 8) | static_cast<uint8_t>(payload[i]);
+    if (size > options_.max_uncompressed_bytes)
+      return RD_KAFKA_RESP_ERR__BAD_COMPRESSION;
+
+    buffer_.resize(std::max<size_t>(size, 1));
+    if (::inflateReset(&stream_) != Z_OK)
+      return RD_KAFKA_RESP_ERR__BAD_COMPRESSION;
+    stream_.next_in = reinterpret_cast<Bytef*>(
+        const_cast<char*>(payload.data() + detail::kSizePrefix));
+    stream_.avail_in =
+        static_cast<uInt>(payload.size() - detail::kSizePrefix);
+    stream_.next_out = reinterpret_cast<Bytef*>(&buffer_[0]);
+    stream_.avail_out = size;
+
+    int result = ::inflate(&stream_, Z_FINISH);
+    if (result == Z_NEED_DICT) {
+      if (options_.dictionary.empty() ||
+          inflateSetDictionary(
+              &stream_,
+              reinterpret_cast<const Bytef*>(options_.dictionary.data()),
+              static_cast<uInt>(options_.dictionary.size())) != Z_OK)
+        return RD_KAFKA_RESP_ERR__BAD_COMPRESSION;
+      result = ::inflate(&stream_, Z_FINISH);
+    }
+    if (result != Z_STREAM_END || stream_.total_out != size)
+      return RD_KAFKA_RESP_ERR__BAD_COMPRESSION;
+    payload = Slice(buffer_.data(), size);
+    return RD_KAFKA_RESP_ERR_NO_ERROR;
+  }
+
+ private:
+  const CompressionOptions options_;
+  z_stream stream_;
+  bool ok_;
+  std::vector<char> buffer_;  // keeps its capacity
+};
+
+}  // namespace rdkafka
@@ -0,0 +1,174 @@
+// rdkafka_event_loop.hpp: epoll reactor driven by librdkafka queue IO events
+//
+// librdkafka writes to an eventfd when a queue becomes non-empty (see
+// rd_kafka_queue_io_event_enable()), so the loop sleeps in epoll_wait() until
+// delivery reports, errors or messages are ready instead of calling poll() with
+// a timeout. The write only happens on the empty to non-empty transition, so
+// a handler must drain its queue each time it's called.
+//
+// NOTE: IO events must be enabled on the queue events finally arrive at. For a
+//       Consumer, the main queue is forwarded to the consumer queue, so the
+//       consumer queue must be added instead of using addPoll().
+#pragma once
+
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "rdkafka_classes.hpp"
+
+namespace rdkafka {
+
+class EventLoop final {
+ public:
+  // called on the loop thread, must drain the queue
+  using Handler = std::function<void()>;
+
+  EventLoop() noexcept
+      : epoll_fd_(epoll_create1(EPOLL_CLOEXEC)),
+        wakeup_fd_(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) {
+    if (epoll_fd_ != -1 && wakeup_fd_ != -1) {
+      struct epoll_event event;
+      event.events = EPOLLIN;
+      event.data.ptr = nullptr;  // nullptr means the wakeup fd
+      if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wakeup_fd_, &event) == 0)
+        return;
+    }
+    // without the wakeup fd stop() couldn't wake the loop, so neither is kept
+    if (epoll_fd_ != -1) close(epoll_fd_);
+    if (wakeup_fd_ != -1) close(wakeup_fd_);
+    epoll_fd_ = -1;
+    wakeup_fd_ = -1;
+  }
+
+  EventLoop(const EventLoop&) = delete;
+  EventLoop& operator=(const EventLoop&) = delete;
+
+  // must be destroyed before the clients of the added queues
+  ~EventLoop() {
+    stop();
+    for (auto& entry : entries_) {
+      rd_kafka_queue_io_event_enable(entry->queue.get(), -1, nullptr, 0);
+      close(entry->fd);
+    }
+    if (wakeup_fd_ != -1) close(wakeup_fd_);
+    if (epoll_fd_ != -1) close(epoll_fd_);
+  }
+
+  bool isNull() const noexcept {
+    return epoll_fd_ == -1 || wakeup_fd_ == -1;
+  }
+
+  // epoll fd, it can be added to another reactor to call runOnce(0)
+  // when it's readable
+  int fd() const noexcept { return epoll_fd_; }
+
+  // Take ownership of rkqu (e.g. from rd_kafka_queue_get_consumer()) and call
+  // handler whenever it has events. Must not be called while the loop runs.
+  // Returns false on system error, errno is set.
+  bool add(rd_kafka_queue_t* rkqu, Handler handler) {
+    std::unique_ptr<Entry> entry(new Entry(rkqu, std::move(handler)));
+    entry->fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (entry->fd == -1) return false;
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = entry.get();
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, entry->fd, &event) == -1) {
+      close(entry->fd);
+      return false;
+    }
+
+    // eventfd only accepts 8 bytes writes
+    const uint64_t one = 1;
+    rd_kafka_queue_io_event_enable(rkqu, entry->fd, &one, sizeof(one));
+    // events queued before enabling don't trigger a write, drain them first
+    notify(entry->fd);
+
+    entries_.emplace_back(std::move(entry));
+    return true;
+  }
+
+  // serve client's rd_kafka_poll() callbacks (delivery reports, errors, ...)
+  bool addPoll(const KafkaBase& client) {
+    rd_kafka_t* rk = client.get();
+    return add(rd_kafka_queue_get_main(rk), [rk] { rd_kafka_poll(rk, 0); });
+  }
+
+  // Wait up to timeout_ms (-1 means infinite) and call handlers of ready
+  // queues. Returns the number of handlers called or -1 on error.
+  int runOnce(int timeout_ms) {
+    constexpr int kMaxEvents = 16;
+    struct epoll_event events[kMaxEvents];
+
+    int n = epoll_wait(epoll_fd_, events, kMaxEvents, timeout_ms);
+    if (n == -1) return (errno == EINTR) ? 0 : -1;
+
+    int num_handled = 0;
+    for (int i = 0; i < n; i++) {
+      auto entry = static_cast<Entry*>(events[i].data.ptr);
+      if (!entry) {
+        drain(wakeup_fd_);
+        continue;
+      }
+      drain(entry->fd);
+      entry->handler();
+      ++num_handled;
+    }
+    return num_handled;
+  }
+
+  // run the loop on a background thread until stop()
+  void start() {
+    if (thread_.joinable()) return;
+    running_ = true;
+    thread_ = std::thread([this] {
+      while (running_) runOnce(-1);
+    });
+  }
+
+  void stop() {
+    if (!thread_.joinable()) return;
+    running_ = false;
+    notify(wakeup_fd_);
+    thread_.join();
+  }
+
+ private:
+  struct Entry {
+    Entry(rd_kafka_queue_t* rkqu, Handler handler_)
+        : queue(rkqu), handler(std::move(handler_)) {}
+
+    PointerHolder<rd_kafka_queue_t> queue;
+    Handler handler;
+    int fd = -1;
+  };
+
+  int epoll_fd_;
+  int wakeup_fd_;
+  std::vector<std::unique_ptr<Entry>> entries_;
+  std::thread thread_;
+  std::atomic<bool> running_{false};
+
+  static void notify(int fd) noexcept {
+    const uint64_t one = 1;
+    auto ret = write(fd, &one, sizeof(one));
+    (void)ret;  // only fails if the counter overflows, it's still readable
+  }
+
+  static void drain(int fd) noexcept {
+    uint64_t value;
+    auto ret = read(fd, &value, sizeof(value));
+    (void)ret;  // EAGAIN if another wakeup drained it
+  }
+};
+
+}  // namespace rdkafka
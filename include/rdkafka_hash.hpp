@@ -0,0 +1,50 @@
+// rdkafka_hash.hpp: hash functions shared by partitioners and lookup tables
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+namespace rdkafka {
+
+// Same hash as Java client's Utils.murmur2() and librdkafka's murmur2
+// partitioners. The hash chain is serial, the speed comes from loading 4 bytes
+// per block instead of assembling them byte by byte.
+inline uint32_t murmur2(const void* key, size_t len) noexcept {
+  constexpr uint32_t kSeed = 0x9747b28c;
+  constexpr uint32_t m = 0x5bd1e995;
+  constexpr int r = 24;
+
+  auto data = static_cast<const unsigned char*>(key);
+  uint32_t h = kSeed ^ static_cast<uint32_t>(len);
+  for (size_t i = len / 4; i > 0; i--, data += 4) {
+    uint32_t k;
+    memcpy(&k, data, sizeof(k));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    k = __builtin_bswap32(k);  // blocks are little endian
+#endif
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+    h *= m;
+    h ^= k;
+  }
+
+  switch (len & 3) {
+    case 3:
+      h ^= static_cast<uint32_t>(data[2]) << 16;
+      // fallthrough
+    case 2:
+      h ^= static_cast<uint32_t>(data[1]) << 8;
+      // fallthrough
+    case 1:
+      h ^= data[0];
+      h *= m;
+  }
+
+  h ^= h >> 13;
+  h *= m;
+  h ^= h >> 15;
+  return h;
+}
+
+}  // namespace rdkafka
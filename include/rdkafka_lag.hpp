@@ -0,0 +1,511 @@
+// rdkafka_lag.hpp: lag of many consumer groups over many partitions at once
+//
+// LagMonitor::poll() computes the lag of every partition of the watched
+// groups' topics in one pass, without a blocking call per partition:
+//
+// 1. partition counts come from one metadata request, cached for
+//    metadata_ttl or until a group watches a new topic
+// 2. committed offsets come from one ListConsumerGroupOffsets request per
+//    group (librdkafka takes a single group per request), max_in_flight of
+//    them at once
+// 3. watermarks come from one ListOffsets request for the earliest and one
+//    for the latest offsets of all partitions whose cached watermarks are
+//    older than watermark_ttl
+//
+// The requests of 2 and 3 share one queue and run concurrently, librdkafka
+// sends them to the brokers that own them. It needs librdkafka 2.3+ for
+// ListOffsets. Unlike rd_kafka_committed(), the client doesn't need group.id
+// and any producer or consumer can query any group.
+//
+// With LagMonitorOptions::metadata set, partition counts are read from that
+// shared MetadataCache instead of 1.
+#pragma once
+
+#include "rdkafka.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "rdkafka_classes.hpp"
+#include "rdkafka_error.hpp"
+#include "rdkafka_metadata.hpp"
+
+namespace rdkafka {
+
+struct LagMonitorOptions {
+  std::chrono::milliseconds watermark_ttl{5000};
+  std::chrono::milliseconds metadata_ttl{60000};
+  // of each poll(), requests not done by then fail with _TIMED_OUT
+  int timeout_ms = 10000;
+  // ListConsumerGroupOffsets requests in flight at once
+  int max_in_flight = 100;
+  // shared cache of partition counts, not owned, metadata_ttl is unused then
+  MetadataCache* metadata = nullptr;
+};
+
+// Lag of a group on a partition, group and topic point into the LagMonitor
+// and are valid until the group is unwatched.
+struct PartitionLag {
+  const char* group;
+  const char* topic;
+  int32_t partition;
+  int64_t committed;  // RD_KAFKA_OFFSET_INVALID if the group never committed
+  int64_t low;        // watermarks, -1 if unknown
+  int64_t high;
+  int64_t lag;        // high - committed, -1 if either is unknown
+  ErrorCode err;      // why the committed offset or watermarks are unknown
+};
+
+class LagMonitor {
+ public:
+  // number of requests poll() has sent
+  struct RequestCounts {
+    long metadata = 0;
+    long committed = 0;
+    long watermarks = 0;
+  };
+
+  // client is used to send requests, it's not owned
+  explicit LagMonitor(const KafkaBase& client,
+                      LagMonitorOptions options = LagMonitorOptions())
+      : client_(client),
+        options_(options),
+        queue_(rd_kafka_queue_new(client.get())) {}
+
+  // Watch group's committed offsets on every partition of topics, a watched
+  // group's topics are replaced.
+  void watch(const std::string& group, const std::vector<std::string>& topics) {
+    auto it = findGroup(group);
+    if (it == groups_.end()) {
+      groups_.emplace_back(new Group);
+      it = groups_.end() - 1;
+      (*it)->name = group;
+    }
+    (*it)->topics = topics;
+    for (const auto& topic : topics) {
+      if (partition_counts_.count(topic) == 0) metadata_stale_ = true;
+    }
+  }
+
+  void unwatch(const std::string& group) {
+    auto it = findGroup(group);
+    if (it != groups_.end()) groups_.erase(it);
+  }
+
+  // Refill lags with every partition of every watched group. Returns the
+  // first error of the metadata, committed offsets or watermarks requests,
+  // partitions they failed for have their err set.
+  ErrorCode poll(std::vector<PartitionLag>& lags);
+
+  const RequestCounts& requestCounts() const noexcept { return counts_; }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Group {
+    std::string name;
+    std::vector<std::string> topics;
+    // per partition of the topics in order, topic_base[i] is the index of
+    // topics[i]'s partition 0
+    std::vector<int64_t> committed;
+    std::vector<size_t> topic_base;
+    ErrorCode err = RD_KAFKA_RESP_ERR_NO_ERROR;
+  };
+
+  struct Watermarks {
+    std::vector<int64_t> low;
+    std::vector<int64_t> high;
+    Clock::time_point fetched_at;
+    bool valid = false;
+    bool pending = false;
+    ErrorCode err = RD_KAFKA_RESP_ERR_NO_ERROR;
+  };
+
+  // opaque of a request is (poll_id_ << kRequestBits) | request, so that
+  // responses arriving after their poll() timed out are dropped
+  static constexpr int kRequestBits = 24;
+  static constexpr uintptr_t kEarliest = 0;
+  static constexpr uintptr_t kLatest = 1;
+  static constexpr uintptr_t kFirstGroup = 2;
+
+  const KafkaBase& client_;
+  const LagMonitorOptions options_;
+  PointerHolder<rd_kafka_queue_t> queue_;
+  std::vector<std::unique_ptr<Group>> groups_;
+  std::unordered_map<std::string, int32_t> partition_counts_;
+  std::unordered_map<std::string, Watermarks> watermarks_;
+  Clock::time_point metadata_fetched_at_;
+  bool metadata_stale_ = true;
+  uintptr_t poll_id_ = 0;
+  RequestCounts counts_;
+
+  std::vector<std::unique_ptr<Group>>::iterator findGroup(
+      const std::string& name) {
+    return std::find_if(
+        groups_.begin(), groups_.end(),
+        [&name](const std::unique_ptr<Group>& group) {
+          return group->name == name;
+        });
+  }
+
+  void* opaque(uintptr_t request) const noexcept {
+    return reinterpret_cast<void*>((poll_id_ << kRequestBits) | request);
+  }
+
+  ErrorCode refreshMetadata();
+
+  ErrorCode readMetadata(MetadataCache& cache);
+
+  // partition counts of the watched topics
+  ErrorCode applyMetadata(const MetadataSnapshot& snapshot);
+
+  // false if there's nothing to send
+  bool sendWatermarks(rd_kafka_AdminOptions_t* admin_options,
+                      Clock::time_point now);
+
+  bool sendCommitted(rd_kafka_AdminOptions_t* admin_options, size_t index);
+
+  void handleWatermarks(rd_kafka_event_t* event, bool earliest,
+                        Clock::time_point now);
+
+  void handleCommitted(rd_kafka_event_t* event, Group& group);
+
+  void fillLags(std::vector<PartitionLag>& lags) const;
+};
+
+inline ErrorCode LagMonitor::poll(std::vector<PartitionLag>& lags) {
+  ErrorCode first_error = RD_KAFKA_RESP_ERR_NO_ERROR;
+  auto setError = [&first_error](ErrorCode err) {
+    if (first_error == RD_KAFKA_RESP_ERR_NO_ERROR) first_error = err;
+  };
+
+  auto now = Clock::now();
+  auto deadline = now + std::chrono::milliseconds(options_.timeout_ms);
+  if (options_.metadata)
+    setError(readMetadata(*options_.metadata));
+  else if (metadata_stale_ ||
+           now - metadata_fetched_at_ >= options_.metadata_ttl)
+    setError(refreshMetadata());
+
+  ++poll_id_;
+  PointerHolder<rd_kafka_AdminOptions_t> admin_options(
+      rd_kafka_AdminOptions_new(client_.get(), RD_KAFKA_ADMIN_OP_ANY));
+  char errstr[512];
+  rd_kafka_AdminOptions_set_request_timeout(
+      admin_options.get(), options_.timeout_ms, errstr, sizeof(errstr));
+
+  int num_pending = sendWatermarks(admin_options.get(), now) ? 2 : 0;
+
+  size_t next_group = 0;
+  int in_flight = 0;
+  auto sendGroups = [&] {
+    while (next_group < groups_.size() && in_flight < options_.max_in_flight) {
+      if (sendCommitted(admin_options.get(), next_group++)) {
+        ++in_flight;
+        ++num_pending;
+      }
+    }
+  };
+  // groups not sent before the deadline have their err left
+  for (auto& group : groups_) {
+    group->err = RD_KAFKA_RESP_ERR__TIMED_OUT;
+    group->committed.clear();
+    group->topic_base.clear();
+  }
+  sendGroups();
+
+  while (num_pending > 0) {
+    auto timeout_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          deadline - Clock::now())
+                          .count();
+    if (timeout_ms <= 0) break;
+    PointerHolder<rd_kafka_event_t> event(
+        rd_kafka_queue_poll(queue_.get(), static_cast<int>(timeout_ms)));
+    if (event.isNull()) continue;
+
+    auto id = reinterpret_cast<uintptr_t>(rd_kafka_event_opaque(event.get()));
+    if ((id >> kRequestBits) !=
+        (poll_id_ & (UINTPTR_MAX >> kRequestBits)))
+      continue;  // of a previous poll()
+    auto request = id & ((uintptr_t(1) << kRequestBits) - 1);
+    --num_pending;
+    if (request == kEarliest || request == kLatest) {
+      handleWatermarks(event.get(), request == kEarliest, now);
+    } else {
+      handleCommitted(event.get(), *groups_[request - kFirstGroup]);
+      --in_flight;
+      sendGroups();
+    }
+  }
+
+  for (auto& kv : watermarks_) {
+    auto& watermarks = kv.second;
+    if (watermarks.pending) {
+      watermarks.pending = false;
+      watermarks.err = RD_KAFKA_RESP_ERR__TIMED_OUT;
+    }
+    if (watermarks.err != RD_KAFKA_RESP_ERR_NO_ERROR) setError(watermarks.err);
+  }
+  for (const auto& group : groups_) {
+    if (group->err != RD_KAFKA_RESP_ERR_NO_ERROR) setError(group->err);
+  }
+
+  fillLags(lags);
+  return first_error;
+}
+
+inline ErrorCode LagMonitor::refreshMetadata() {
+  ++counts_.metadata;
+  const rd_kafka_metadata_t* metadata;
+  auto err = rd_kafka_metadata(client_.get(), 1, nullptr, &metadata,
+                               options_.timeout_ms);
+  if (err != RD_KAFKA_RESP_ERR_NO_ERROR) return err;
+  MetadataSnapshot snapshot(*metadata, 0);
+  rd_kafka_metadata_destroy(metadata);
+
+  metadata_fetched_at_ = Clock::now();
+  metadata_stale_ = false;
+  return applyMetadata(snapshot);
+}
+
+inline ErrorCode LagMonitor::readMetadata(MetadataCache& cache) {
+  if (cache.version() == 0) {
+    auto err = cache.refresh();
+    if (err != RD_KAFKA_RESP_ERR_NO_ERROR) return err;
+  }
+  MetadataCache::Reader reader(cache);
+  auto err = applyMetadata(*reader.get());
+  if (err != RD_KAFKA_RESP_ERR_NO_ERROR) cache.requestRefresh();
+  return err;
+}
+
+inline ErrorCode LagMonitor::applyMetadata(const MetadataSnapshot& snapshot) {
+  std::unordered_set<std::string> watched;
+  for (const auto& group : groups_)
+    watched.insert(group->topics.begin(), group->topics.end());
+
+  partition_counts_.clear();
+  for (const auto& topic : watched) {
+    int32_t partition_cnt = snapshot.partitionCount(topic.data());
+    if (partition_cnt < 0) continue;
+    partition_counts_[topic] = partition_cnt;
+    auto& watermarks = watermarks_[topic];
+    if (watermarks.high.size() != static_cast<size_t>(partition_cnt)) {
+      watermarks.low.assign(partition_cnt, -1);
+      watermarks.high.assign(partition_cnt, -1);
+      watermarks.valid = false;
+    }
+  }
+
+  // watermarks of topics no longer watched
+  for (auto it = watermarks_.begin(); it != watermarks_.end();) {
+    if (partition_counts_.count(it->first) == 0)
+      it = watermarks_.erase(it);
+    else
+      ++it;
+  }
+
+  if (partition_counts_.size() < watched.size())
+    return RD_KAFKA_RESP_ERR_UNKNOWN_TOPIC_OR_PART;
+  return RD_KAFKA_RESP_ERR_NO_ERROR;
+}
+
+inline bool LagMonitor::sendWatermarks(rd_kafka_AdminOptions_t* admin_options,
+                                       Clock::time_point now) {
+  PointerHolder<rd_kafka_topic_partition_list_t> earliest(
+      rd_kafka_topic_partition_list_new(0));
+  PointerHolder<rd_kafka_topic_partition_list_t> latest(
+      rd_kafka_topic_partition_list_new(0));
+  for (auto& kv : watermarks_) {
+    auto& watermarks = kv.second;
+    if (watermarks.valid &&
+        now - watermarks.fetched_at < options_.watermark_ttl)
+      continue;
+    watermarks.pending = true;
+    watermarks.err = RD_KAFKA_RESP_ERR_NO_ERROR;
+    for (size_t i = 0; i < watermarks.high.size(); i++) {
+      auto partition = static_cast<int32_t>(i);
+      rd_kafka_topic_partition_list_add(earliest.get(), kv.first.data(),
+                                        partition)
+          ->offset = RD_KAFKA_OFFSET_SPEC_EARLIEST;
+      rd_kafka_topic_partition_list_add(latest.get(), kv.first.data(),
+                                        partition)
+          ->offset = RD_KAFKA_OFFSET_SPEC_LATEST;
+    }
+  }
+  if (latest.get()->cnt == 0) return false;
+
+  rd_kafka_AdminOptions_set_opaque(admin_options, opaque(kEarliest));
+  rd_kafka_ListOffsets(client_.get(), earliest.get(), admin_options,
+                       queue_.get());
+  rd_kafka_AdminOptions_set_opaque(admin_options, opaque(kLatest));
+  rd_kafka_ListOffsets(client_.get(), latest.get(), admin_options,
+                       queue_.get());
+  counts_.watermarks += 2;
+  return true;
+}
+
+inline bool LagMonitor::sendCommitted(rd_kafka_AdminOptions_t* admin_options,
+                                      size_t index) {
+  Group& group = *groups_[index];
+  PointerHolder<rd_kafka_topic_partition_list_t> partitions(
+      rd_kafka_topic_partition_list_new(0));
+  group.topic_base.clear();
+  for (const auto& topic : group.topics) {
+    group.topic_base.push_back(static_cast<size_t>(partitions.get()->cnt));
+    auto it = partition_counts_.find(topic);
+    if (it == partition_counts_.end()) continue;
+    rd_kafka_topic_partition_list_add_range(partitions.get(), topic.data(), 0,
+                                            it->second - 1);
+  }
+  group.committed.assign(partitions.get()->cnt, RD_KAFKA_OFFSET_INVALID);
+  if (partitions.get()->cnt == 0) {
+    group.err = RD_KAFKA_RESP_ERR_UNKNOWN_TOPIC_OR_PART;
+    return false;
+  }
+
+  auto request = rd_kafka_ListConsumerGroupOffsets_new(group.name.data(),
+                                                       partitions.get());
+  rd_kafka_AdminOptions_set_opaque(admin_options, opaque(kFirstGroup + index));
+  rd_kafka_ListConsumerGroupOffsets(client_.get(), &request, 1, admin_options,
+                                    queue_.get());
+  rd_kafka_ListConsumerGroupOffsets_destroy(request);
+  ++counts_.committed;
+  return true;
+}
+
+inline void LagMonitor::handleWatermarks(rd_kafka_event_t* event,
+                                         bool earliest, Clock::time_point now) {
+  auto err = rd_kafka_event_error(event);
+  auto result = rd_kafka_event_ListOffsets_result(event);
+  if (err != RD_KAFKA_RESP_ERR_NO_ERROR || !result) {
+    for (auto& kv : watermarks_) {
+      if (!kv.second.pending) continue;
+      kv.second.pending = false;
+      kv.second.err = err ? err : RD_KAFKA_RESP_ERR__BAD_MSG;
+    }
+    return;
+  }
+
+  size_t num_infos;
+  auto infos = rd_kafka_ListOffsets_result_infos(result, &num_infos);
+  // results are grouped by topic, so the last topic is looked up first
+  Watermarks* watermarks = nullptr;
+  const char* topic = nullptr;
+  for (size_t i = 0; i < num_infos; i++) {
+    auto tp = rd_kafka_ListOffsetsResultInfo_topic_partition(infos[i]);
+    if (!topic || strcmp(topic, tp->topic) != 0) {
+      auto it = watermarks_.find(tp->topic);
+      if (it == watermarks_.end()) continue;
+      watermarks = &it->second;
+      topic = it->first.data();
+    }
+    if (tp->partition < 0 ||
+        static_cast<size_t>(tp->partition) >= watermarks->high.size())
+      continue;
+    int64_t offset = tp->offset;
+    if (tp->err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+      watermarks->err = tp->err;
+      offset = -1;
+    }
+    (earliest ? watermarks->low : watermarks->high)[tp->partition] = offset;
+  }
+
+  // both requests are sent together, the latest offsets finish them
+  if (earliest) return;
+  for (auto& kv : watermarks_) {
+    auto& topic_watermarks = kv.second;
+    if (!topic_watermarks.pending) continue;
+    topic_watermarks.pending = false;
+    if (topic_watermarks.err == RD_KAFKA_RESP_ERR_NO_ERROR) {
+      topic_watermarks.valid = true;
+      topic_watermarks.fetched_at = now;
+    }
+  }
+}
+
+inline void LagMonitor::handleCommitted(rd_kafka_event_t* event,
+                                        Group& group) {
+  group.err = rd_kafka_event_error(event);
+  auto result = rd_kafka_event_ListConsumerGroupOffsets_result(event);
+  if (group.err != RD_KAFKA_RESP_ERR_NO_ERROR) return;
+  if (!result) {
+    group.err = RD_KAFKA_RESP_ERR__BAD_MSG;
+    return;
+  }
+
+  size_t num_groups;
+  auto group_results =
+      rd_kafka_ListConsumerGroupOffsets_result_groups(result, &num_groups);
+  for (size_t i = 0; i < num_groups; i++) {
+    if (auto error = rd_kafka_group_result_error(group_results[i])) {
+      group.err = rd_kafka_error_code(error);
+      continue;
+    }
+    auto partitions = rd_kafka_group_result_partitions(group_results[i]);
+    if (!partitions) continue;
+
+    size_t topic_index = 0;
+    for (int j = 0; j < partitions->cnt; j++) {
+      const auto& elem = partitions->elems[j];
+      // in the requested order, so the current topic is checked first
+      if (group.topics[topic_index] != elem.topic) {
+        auto it = std::find(group.topics.begin(), group.topics.end(),
+                            elem.topic);
+        if (it == group.topics.end()) continue;
+        topic_index = static_cast<size_t>(it - group.topics.begin());
+      }
+      size_t index = group.topic_base[topic_index] +
+                     static_cast<size_t>(elem.partition);
+      if (elem.partition < 0 || index >= group.committed.size()) continue;
+      if (elem.err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+        group.err = elem.err;
+        continue;
+      }
+      group.committed[index] = elem.offset;
+    }
+  }
+}
+
+inline void LagMonitor::fillLags(std::vector<PartitionLag>& lags) const {
+  lags.clear();
+  for (const auto& group : groups_) {
+    for (size_t i = 0; i < group->topics.size(); i++) {
+      const auto& topic = group->topics[i];
+      auto it = watermarks_.find(topic);
+      if (it == watermarks_.end()) continue;
+      const Watermarks& watermarks = it->second;
+      for (size_t partition = 0; partition < watermarks.high.size();
+           partition++) {
+        PartitionLag lag;
+        lag.group = group->name.data();
+        lag.topic = topic.data();
+        lag.partition = static_cast<int32_t>(partition);
+        size_t index = (i < group->topic_base.size())
+                           ? group->topic_base[i] + partition
+                           : group->committed.size();
+        lag.committed = (index < group->committed.size())
+                            ? group->committed[index]
+                            : RD_KAFKA_OFFSET_INVALID;
+        lag.low = watermarks.low[partition];
+        lag.high = watermarks.high[partition];
+        lag.lag = (lag.committed >= 0 && lag.high >= 0)
+                      ? std::max<int64_t>(lag.high - lag.committed, 0)
+                      : -1;
+        lag.err = (group->err != RD_KAFKA_RESP_ERR_NO_ERROR) ? group->err
+                                                             : watermarks.err;
+        lags.push_back(lag);
+      }
+    }
+  }
+}
+
+}  // namespace rdkafka
@@ -0,0 +1,501 @@
+// rdkafka_metadata.hpp: cluster metadata indexed for lock-free lookups
+//
+// MetadataSnapshot is an immutable copy of rd_kafka_metadata() in flat
+// arrays: topics (found through an open-addressing hash of their names),
+// then every topic's partitions indexed by partition id, then the replica and
+// ISR broker ids of all partitions. A lookup is a hash probe and two array
+// indexings, it doesn't allocate or lock.
+//
+// MetadataCache publishes snapshots RCU style: a refresh builds a new snapshot
+// aside, swaps it in with an atomic pointer exchange (only if it changed),
+// waits until no reader can still see the old one and deletes it. Readers
+// pin the current snapshot with a Reader, which increments a counter of
+// their thread's shard (on its own cache line) instead of taking a lock, so
+// partitioners and monitors can look partitions up on every message.
+//
+// NOTE: a Reader delays the deletion of its snapshot, so it must not be held
+//       across blocking calls.
+#pragma once
+
+#include "rdkafka.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "rdkafka_classes.hpp"
+#include "rdkafka_wire.hpp"
+
+namespace rdkafka {
+
+class MetadataSnapshot {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  struct BrokerInfo {
+    int32_t id;
+    int32_t port;
+    const char* host;
+  };
+
+  struct TopicInfo {
+    const char* name;
+    ErrorCode err;
+    int32_t partition_cnt;
+    uint32_t first_partition;  // index in the partition array
+    uint32_t hash;
+  };
+
+  struct PartitionInfo {
+    int32_t id;
+    int32_t leader;  // -1 if unknown
+    ErrorCode err;   // _UNKNOWN_PARTITION if the broker didn't return it
+    uint32_t first_replica;  // indexes in the broker id array
+    uint32_t first_isr;
+    int32_t replica_cnt;
+    int32_t isr_cnt;
+  };
+
+  MetadataSnapshot(const MetadataSnapshot&) = delete;
+  MetadataSnapshot& operator=(const MetadataSnapshot&) = delete;
+
+  // index every topic of metadata
+  MetadataSnapshot(const rd_kafka_metadata_t& metadata, uint64_t version)
+      : MetadataSnapshot(nullptr, metadata, version) {}
+
+  // Topics of metadata replace those of base, the other topics of base are
+  // copied. This way refreshing a single topic doesn't lose the others.
+  MetadataSnapshot(const MetadataSnapshot* base,
+                   const rd_kafka_metadata_t& metadata, uint64_t version)
+      : version_(version), fetched_at_(Clock::now()) {
+    for (int i = 0; i < metadata.broker_cnt; i++) {
+      const auto& broker = metadata.brokers[i];
+      brokers_.push_back({broker.id, broker.port, nullptr});
+      broker_hosts_.push_back(addString(broker.host));
+    }
+    if (base) {
+      for (const auto& topic : base->topics()) {
+        if (!findTopic(metadata, topic.name)) addTopic(*base, topic);
+      }
+    }
+    for (int i = 0; i < metadata.topic_cnt; i++) addTopic(metadata.topics[i]);
+    finish();
+  }
+
+  ArrayView<BrokerInfo> brokers() const noexcept {
+    return ArrayView<BrokerInfo>(brokers_.data(), brokers_.size());
+  }
+
+  ArrayView<TopicInfo> topics() const noexcept {
+    return ArrayView<TopicInfo>(topics_.data(), topics_.size());
+  }
+
+  // partitions[i] has id i
+  ArrayView<PartitionInfo> partitions(const TopicInfo& topic) const noexcept {
+    return ArrayView<PartitionInfo>(partitions_.data() + topic.first_partition,
+                                    static_cast<size_t>(topic.partition_cnt));
+  }
+
+  ArrayView<int32_t> replicas(const PartitionInfo& partition) const noexcept {
+    return ArrayView<int32_t>(broker_ids_.data() + partition.first_replica,
+                              static_cast<size_t>(partition.replica_cnt));
+  }
+
+  ArrayView<int32_t> isrs(const PartitionInfo& partition) const noexcept {
+    return ArrayView<int32_t>(broker_ids_.data() + partition.first_isr,
+                              static_cast<size_t>(partition.isr_cnt));
+  }
+
+  // nullptr if the topic isn't in the snapshot
+  const TopicInfo* findTopic(const char* name) const noexcept {
+    if (slots_.empty()) return nullptr;
+    uint32_t hash = hashOf(name);
+    size_t mask = slots_.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+      uint32_t slot = slots_[i];
+      if (slot == 0) return nullptr;
+      const auto& topic = topics_[slot - 1];
+      if (topic.hash == hash && strcmp(topic.name, name) == 0) return &topic;
+    }
+  }
+
+  // -1 if the topic isn't in the snapshot or has an error
+  int32_t partitionCount(const char* topic) const noexcept {
+    auto info = findTopic(topic);
+    if (!info || info->err != RD_KAFKA_RESP_ERR_NO_ERROR) return -1;
+    return info->partition_cnt;
+  }
+
+  const PartitionInfo* findPartition(const char* topic,
+                                     int32_t partition) const noexcept {
+    auto info = findTopic(topic);
+    if (!info || partition < 0 || partition >= info->partition_cnt)
+      return nullptr;
+    return &partitions_[info->first_partition + partition];
+  }
+
+  // -1 if the partition or its leader is unknown
+  int32_t leader(const char* topic, int32_t partition) const noexcept {
+    auto info = findPartition(topic, partition);
+    return info ? info->leader : -1;
+  }
+
+  const BrokerInfo* findBroker(int32_t id) const noexcept {
+    for (const auto& broker : brokers_) {
+      if (broker.id == id) return &broker;
+    }
+    return nullptr;
+  }
+
+  // increased by every snapshot MetadataCache publishes
+  uint64_t version() const noexcept { return version_; }
+
+  Clock::time_point fetchedAt() const noexcept { return fetched_at_; }
+
+  // same brokers, topics, leaders and replicas, whatever the versions
+  bool sameAs(const MetadataSnapshot& other) const noexcept {
+    if (brokers_.size() != other.brokers_.size() ||
+        topics_.size() != other.topics_.size() ||
+        partitions_.size() != other.partitions_.size() ||
+        broker_ids_ != other.broker_ids_)
+      return false;
+    for (size_t i = 0; i < brokers_.size(); i++) {
+      const auto& a = brokers_[i];
+      const auto& b = other.brokers_[i];
+      if (a.id != b.id || a.port != b.port || strcmp(a.host, b.host) != 0)
+        return false;
+    }
+    for (size_t i = 0; i < topics_.size(); i++) {
+      const auto& a = topics_[i];
+      const auto& b = other.topics_[i];
+      if (a.err != b.err || a.partition_cnt != b.partition_cnt ||
+          strcmp(a.name, b.name) != 0)
+        return false;
+    }
+    for (size_t i = 0; i < partitions_.size(); i++) {
+      const auto& a = partitions_[i];
+      const auto& b = other.partitions_[i];
+      if (a.leader != b.leader || a.err != b.err ||
+          a.replica_cnt != b.replica_cnt || a.isr_cnt != b.isr_cnt)
+        return false;
+    }
+    return true;
+  }
+
+ private:
+  uint64_t version_;
+  Clock::time_point fetched_at_;
+  std::vector<BrokerInfo> brokers_;
+  std::vector<TopicInfo> topics_;
+  std::vector<PartitionInfo> partitions_;
+  std::vector<int32_t> broker_ids_;
+  std::vector<uint32_t> slots_;  // topic index + 1, 0 if empty
+  // names and hosts separated by '\0', the pointers are set by finish()
+  // because the buffer moves while it grows
+  std::vector<char> strings_;
+  std::vector<size_t> topic_names_;
+  std::vector<size_t> broker_hosts_;
+
+  // FNV-1a
+  static uint32_t hashOf(const char* s) noexcept {
+    uint32_t hash = 2166136261u;
+    for (; *s; s++) hash = (hash ^ static_cast<uint8_t>(*s)) * 16777619u;
+    return hash;
+  }
+
+  static const rd_kafka_metadata_topic_t* findTopic(
+      const rd_kafka_metadata_t& metadata, const char* name) noexcept {
+    for (int i = 0; i < metadata.topic_cnt; i++) {
+      if (strcmp(metadata.topics[i].topic, name) == 0)
+        return &metadata.topics[i];
+    }
+    return nullptr;
+  }
+
+  size_t addString(const char* s) {
+    size_t offset = strings_.size();
+    strings_.insert(strings_.end(), s, s + strlen(s) + 1);
+    return offset;
+  }
+
+  uint32_t addBrokerIds(const int32_t* ids, int32_t cnt) {
+    auto first = static_cast<uint32_t>(broker_ids_.size());
+    broker_ids_.insert(broker_ids_.end(), ids, ids + cnt);
+    return first;
+  }
+
+  TopicInfo& newTopic(const char* name, ErrorCode err, int32_t partition_cnt) {
+    topic_names_.push_back(addString(name));
+    topics_.push_back({nullptr, err, partition_cnt,
+                       static_cast<uint32_t>(partitions_.size()),
+                       hashOf(name)});
+    for (int32_t i = 0; i < partition_cnt; i++) {
+      partitions_.push_back({i, -1, RD_KAFKA_RESP_ERR__UNKNOWN_PARTITION,
+                             static_cast<uint32_t>(broker_ids_.size()),
+                             static_cast<uint32_t>(broker_ids_.size()), 0, 0});
+    }
+    return topics_.back();
+  }
+
+  void addTopic(const rd_kafka_metadata_topic_t& topic) {
+    int32_t partition_cnt = topic.partition_cnt;
+    for (int i = 0; i < topic.partition_cnt; i++) {
+      partition_cnt = std::max(partition_cnt, topic.partitions[i].id + 1);
+    }
+    auto& info = newTopic(topic.topic, topic.err, partition_cnt);
+    for (int i = 0; i < topic.partition_cnt; i++) {
+      const auto& partition = topic.partitions[i];
+      if (partition.id < 0) continue;
+      auto& to = partitions_[info.first_partition + partition.id];
+      to.leader = partition.leader;
+      to.err = partition.err;
+      to.first_replica =
+          addBrokerIds(partition.replicas, partition.replica_cnt);
+      to.replica_cnt = partition.replica_cnt;
+      to.first_isr = addBrokerIds(partition.isrs, partition.isr_cnt);
+      to.isr_cnt = partition.isr_cnt;
+    }
+  }
+
+  void addTopic(const MetadataSnapshot& base, const TopicInfo& topic) {
+    auto& info = newTopic(topic.name, topic.err, topic.partition_cnt);
+    for (const auto& partition : base.partitions(topic)) {
+      auto& to = partitions_[info.first_partition + partition.id];
+      to = partition;
+      auto replicas = base.replicas(partition);
+      to.first_replica = addBrokerIds(replicas.data(), partition.replica_cnt);
+      auto isrs = base.isrs(partition);
+      to.first_isr = addBrokerIds(isrs.data(), partition.isr_cnt);
+    }
+  }
+
+  void finish() {
+    for (size_t i = 0; i < topics_.size(); i++)
+      topics_[i].name = strings_.data() + topic_names_[i];
+    for (size_t i = 0; i < brokers_.size(); i++)
+      brokers_[i].host = strings_.data() + broker_hosts_[i];
+
+    // at most half full, so probes stay short
+    size_t num_slots = 4;
+    while (num_slots < 2 * topics_.size()) num_slots *= 2;
+    slots_.assign(num_slots, 0);
+    for (size_t i = 0; i < topics_.size(); i++) {
+      size_t slot = topics_[i].hash & (num_slots - 1);
+      while (slots_[slot] != 0) slot = (slot + 1) & (num_slots - 1);
+      slots_[slot] = static_cast<uint32_t>(i + 1);
+    }
+  }
+};
+
+struct MetadataCacheOptions {
+  // how often the background thread refreshes, see MetadataCache::start()
+  std::chrono::milliseconds refresh_interval{30000};
+  int timeout_ms = 10000;
+  // all topics of the cluster, or only those the client knows (subscribed,
+  // produced to or refreshed with refreshTopic())
+  bool all_topics = true;
+};
+
+class MetadataCache final {
+ public:
+  // Pins the current snapshot, which is nullptr until the first refresh
+  // succeeded. Lock-free, see the NOTE above.
+  class Reader {
+   public:
+    explicit Reader(const MetadataCache& cache) noexcept
+        : counter_(cache.enterReader()),
+          snapshot_(cache.current_.load()) {}
+
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+
+    ~Reader() { counter_->fetch_sub(1); }
+
+    const MetadataSnapshot* get() const noexcept { return snapshot_; }
+
+    const MetadataSnapshot* operator->() const noexcept { return snapshot_; }
+
+    explicit operator bool() const noexcept { return snapshot_ != nullptr; }
+
+   private:
+    std::atomic<long>* counter_;
+    const MetadataSnapshot* snapshot_;
+  };
+
+  // client is used to send requests, it's not owned
+  explicit MetadataCache(const KafkaBase& client,
+                         MetadataCacheOptions options = MetadataCacheOptions())
+      : client_(client),
+        options_(options),
+        shards_(new ReaderShard[kNumShards]) {}
+
+  MetadataCache(const MetadataCache&) = delete;
+  MetadataCache& operator=(const MetadataCache&) = delete;
+
+  // no Reader may be alive
+  ~MetadataCache() {
+    stop();
+    delete current_.load();
+  }
+
+  // Fetch the metadata and publish it if it changed.
+  ErrorCode refresh() {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    const rd_kafka_metadata_t* metadata;
+    auto err = rd_kafka_metadata(client_.get(), options_.all_topics ? 1 : 0,
+                                 nullptr, &metadata, options_.timeout_ms);
+    ++num_requests_;
+    last_error_ = err;
+    if (err != RD_KAFKA_RESP_ERR_NO_ERROR) return err;
+    std::unique_ptr<MetadataSnapshot> snapshot(
+        new MetadataSnapshot(*metadata, version_.load() + 1));
+    rd_kafka_metadata_destroy(metadata);
+    publish(std::move(snapshot));
+    return RD_KAFKA_RESP_ERR_NO_ERROR;
+  }
+
+  // Fetch the metadata of topic only and merge it into a copy of the current
+  // snapshot, e.g. after a lookup of a topic that isn't there yet.
+  ErrorCode refreshTopic(const std::string& topic) {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    Topic rkt(client_.get(), topic.data());
+    if (rkt.isNull()) return rd_kafka_last_error();
+    const rd_kafka_metadata_t* metadata;
+    auto err = rd_kafka_metadata(client_.get(), 0, rkt.get(), &metadata,
+                                 options_.timeout_ms);
+    ++num_requests_;
+    last_error_ = err;
+    if (err != RD_KAFKA_RESP_ERR_NO_ERROR) return err;
+    // the writer mutex is held, so current_ can't change meanwhile
+    std::unique_ptr<MetadataSnapshot> snapshot(
+        new MetadataSnapshot(current_.load(), *metadata,
+                             version_.load() + 1));
+    rd_kafka_metadata_destroy(metadata);
+    publish(std::move(snapshot));
+    return RD_KAFKA_RESP_ERR_NO_ERROR;
+  }
+
+  // Refresh every refresh_interval on a background thread, or at once after
+  // requestRefresh(). The first refresh happens right away.
+  void start() {
+    std::lock_guard<std::mutex> lock(thread_mutex_);
+    if (thread_.joinable()) return;
+    running_ = true;
+    refresh_requested_ = true;
+    thread_ = std::thread(&MetadataCache::run, this);
+  }
+
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(thread_mutex_);
+      running_ = false;
+    }
+    cond_.notify_all();
+    if (thread_.joinable()) thread_.join();
+  }
+
+  // wake the background thread, e.g. when a topic wasn't found
+  void requestRefresh() {
+    {
+      std::lock_guard<std::mutex> lock(thread_mutex_);
+      refresh_requested_ = true;
+    }
+    cond_.notify_all();
+  }
+
+  // of the last refresh, the current snapshot is kept when it fails
+  ErrorCode lastError() const noexcept { return last_error_.load(); }
+
+  // metadata requests sent
+  long numRequests() const noexcept { return num_requests_.load(); }
+
+  // snapshots published, a refresh that changed nothing isn't counted.
+  // Lock-free, so it doesn't wait for a refresh in flight.
+  uint64_t version() const noexcept { return version_.load(); }
+
+ private:
+  static constexpr int kNumShards = 16;
+
+  struct ReaderShard {
+    // readers of even and odd epochs
+    std::atomic<long> counts[2];
+    // new doesn't align to cache lines in C++11, pad instead
+    char padding[64];
+
+    ReaderShard() {
+      counts[0] = 0;
+      counts[1] = 0;
+    }
+  };
+
+  const KafkaBase& client_;
+  const MetadataCacheOptions options_;
+  std::unique_ptr<ReaderShard[]> shards_;
+  std::atomic<const MetadataSnapshot*> current_{nullptr};
+  std::atomic<unsigned> epoch_{0};
+
+  std::mutex writer_mutex_;
+  std::atomic<uint64_t> version_{0};  // written with writer_mutex_ held
+  std::atomic<ErrorCode> last_error_{RD_KAFKA_RESP_ERR_NO_ERROR};
+  std::atomic<long> num_requests_{0};
+
+  std::mutex thread_mutex_;
+  std::condition_variable cond_;
+  std::thread thread_;
+  bool running_ = false;
+  bool refresh_requested_ = false;
+
+  std::atomic<long>* enterReader() const noexcept {
+    static std::atomic<unsigned> next_index{0};
+    static thread_local unsigned index = next_index++ % kNumShards;
+    auto counter = &shards_[index].counts[epoch_.load() & 1];
+    counter->fetch_add(1);
+    return counter;
+  }
+
+  // Swap snapshot in and wait for the readers of the old one. Readers count
+  // themselves before loading current_, so after the exchange every reader
+  // of the old snapshot is counted in one of the two epochs. Each epoch is
+  // flipped first so that new readers count in the other one, then drained.
+  // writer_mutex_ must be held.
+  void publish(std::unique_ptr<MetadataSnapshot> snapshot) {
+    auto old = current_.load();
+    if (old && old->sameAs(*snapshot)) return;
+    ++version_;
+    current_.exchange(snapshot.release());
+    if (!old) return;
+    for (int round = 0; round < 2; round++) {
+      unsigned parity = epoch_.fetch_add(1) & 1;
+      for (int i = 0; i < kNumShards; i++) {
+        while (shards_[i].counts[parity].load() != 0)
+          std::this_thread::yield();
+      }
+    }
+    delete old;
+  }
+
+  void run() {
+    std::unique_lock<std::mutex> lock(thread_mutex_);
+    while (running_) {
+      if (!refresh_requested_) {
+        cond_.wait_for(lock, options_.refresh_interval);
+        if (!running_) break;
+      }
+      refresh_requested_ = false;
+      lock.unlock();
+      refresh();
+      lock.lock();
+    }
+  }
+};
+
+}  // namespace rdkafka
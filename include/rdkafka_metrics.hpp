@@ -0,0 +1,332 @@
+// rdkafka_metrics.hpp: counters and histograms the wrapper records about itself
+//
+// Every client (see KafkaBase::metrics()) records its produce calls,
+// QUEUE_FULL backpressure, delivery latency, consume batch sizes and time
+// blocked in poll. Writers only touch the shard of their thread, each shard
+// on its own cache lines, so recording is a relaxed atomic add without
+// contention. Shards are merged when snapshot() is called.
+//
+// Nothing is allocated until the first record: then the shards' counters
+// (about 2.5 KB), and a histogram (about 4 KB) the first time a thread's
+// shard records into it. A client nobody records into costs a pointer. If an
+// allocation fails, the value isn't recorded.
+//
+// Histograms have fixed memory: values are bucketed by their highest bit
+// and the 3 bits below it (HDR histogram style), so a percentile is exact
+// up to 12.5%.
+#pragma once
+
+#include "rdkafka.h"
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <new>
+
+namespace rdkafka {
+
+class Histogram {
+ public:
+  // 8 linear sub-buckets per power of 2, from 0 to UINT64_MAX
+  static constexpr int kSubBucketBits = 3;
+  static constexpr int kSubBuckets = 1 << kSubBucketBits;
+  static constexpr int kNumBuckets = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+  static int bucketOf(uint64_t value) noexcept {
+    if (value < kSubBuckets) return static_cast<int>(value);
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - kSubBucketBits;
+    return (shift + 1) * kSubBuckets +
+           static_cast<int>((value >> shift) & (kSubBuckets - 1));
+  }
+
+  // smallest value of bucket
+  static uint64_t lowerBound(int bucket) noexcept {
+    if (bucket < kSubBuckets) return static_cast<uint64_t>(bucket);
+    int shift = bucket / kSubBuckets - 1;
+    uint64_t sub = static_cast<uint64_t>(bucket % kSubBuckets);
+    return (kSubBuckets + sub) << shift;
+  }
+
+  // largest value of bucket
+  static uint64_t upperBound(int bucket) noexcept {
+    return (bucket + 1 < kNumBuckets) ? lowerBound(bucket + 1) - 1
+                                      : UINT64_MAX;
+  }
+
+  Histogram() noexcept {
+    for (auto& count : counts_) count = 0;
+  }
+
+  void record(uint64_t value, uint64_t count = 1) noexcept {
+    counts_[bucketOf(value)] += count;
+    count_ += count;
+    sum_ += value * count;
+  }
+
+  // add count values of bucket, whose sum is added separately by addSum()
+  void addBucket(int bucket, uint64_t count) noexcept {
+    counts_[bucket] += count;
+    count_ += count;
+  }
+
+  void addSum(uint64_t sum) noexcept { sum_ += sum; }
+
+  void merge(const Histogram& rhs) noexcept {
+    for (int i = 0; i < kNumBuckets; i++) counts_[i] += rhs.counts_[i];
+    count_ += rhs.count_;
+    sum_ += rhs.sum_;
+  }
+
+  uint64_t count() const noexcept { return count_; }
+
+  uint64_t sum() const noexcept { return sum_; }
+
+  double mean() const noexcept {
+    return count_ ? static_cast<double>(sum_) / count_ : 0;
+  }
+
+  // upper bound of the bucket holding the p-th (0 to 1) value, 0 if empty
+  uint64_t percentile(double p) const noexcept {
+    if (count_ == 0) return 0;
+    auto rank = static_cast<uint64_t>(p * (count_ - 1)) + 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < kNumBuckets; i++) {
+      seen += counts_[i];
+      if (seen >= rank) return upperBound(i);
+    }
+    return upperBound(kNumBuckets - 1);
+  }
+
+  uint64_t max() const noexcept { return percentile(1); }
+
+  uint64_t bucketCount(int bucket) const noexcept { return counts_[bucket]; }
+
+ private:
+  uint64_t counts_[kNumBuckets];
+  uint64_t count_ = 0;
+  uint64_t sum_ = 0;
+};
+
+class ClientMetrics {
+ public:
+  enum class Counter {
+    kProduceCalls,      // produce(), produceWithHeaders(), produceBatch()
+    kProducedMessages,  // messages enqueued
+    kQueueFull,         // messages rejected with QUEUE_FULL
+    kProduceErrors,     // messages rejected with other errors
+    kDelivered,         // delivery reports without error
+    kDeliveryErrors,    // delivery reports with error
+    kConsumedMessages,  // messages and errors returned by consume calls
+    kRecreations,       // handles replaced after a fatal error
+    kCount
+  };
+
+  enum class HistogramType {
+    kDeliveryLatencyUs,   // produce() to delivery report, see recordDelivery()
+    kConsumeBatchSize,    // messages per consumeBatch()
+    kPollWaitUs,          // time blocked in poll(), consume(), consumeBatch()
+    kBackpressureWaitUs,  // produce() stalled on QUEUE_FULL, see Backpressure
+    kCount
+  };
+
+  static constexpr int kNumCounters = static_cast<int>(Counter::kCount);
+  static constexpr int kNumHistograms =
+      static_cast<int>(HistogramType::kCount);
+  // threads beyond this share shards, which is still correct, just slower
+  static constexpr int kNumShards = 16;
+
+  static const char* name(Counter counter) noexcept {
+    static const char* kNames[] = {
+        "produce_calls", "produced_messages", "queue_full",   "produce_errors",
+        "delivered",     "delivery_errors",   "consumed_messages",
+        "recreations"};
+    static_assert(sizeof(kNames) / sizeof(kNames[0]) == kNumCounters,
+                  "a Counter has no name");
+    return kNames[static_cast<int>(counter)];
+  }
+
+  static const char* name(HistogramType type) noexcept {
+    static const char* kNames[] = {"delivery_latency_us", "consume_batch_size",
+                                   "poll_wait_us", "backpressure_wait_us"};
+    static_assert(sizeof(kNames) / sizeof(kNames[0]) == kNumHistograms,
+                  "a HistogramType has no name");
+    return kNames[static_cast<int>(type)];
+  }
+
+  // merged shards, a consistent view of each value but not of all values
+  struct Snapshot {
+    uint64_t counters[kNumCounters] = {};
+    Histogram histograms[kNumHistograms];
+
+    uint64_t get(Counter counter) const noexcept {
+      return counters[static_cast<int>(counter)];
+    }
+
+    const Histogram& get(HistogramType type) const noexcept {
+      return histograms[static_cast<int>(type)];
+    }
+  };
+
+  ClientMetrics() noexcept {}
+
+  // not thread safe, nothing may record into rhs meanwhile
+  ClientMetrics(ClientMetrics&& rhs) noexcept
+      : shards_(rhs.shards_.exchange(nullptr)) {}
+
+  ClientMetrics& operator=(ClientMetrics&& rhs) noexcept {
+    if (this != &rhs) {
+      destroy();
+      shards_ = rhs.shards_.exchange(nullptr);
+    }
+    return *this;
+  }
+
+  ~ClientMetrics() { destroy(); }
+
+  void add(Counter counter, uint64_t n = 1) noexcept {
+    auto shard = this->shard();
+    if (!shard) return;
+    shard->counters[static_cast<int>(counter)].fetch_add(
+        n, std::memory_order_relaxed);
+  }
+
+  void record(HistogramType type, uint64_t value) noexcept {
+    auto shard = this->shard();
+    if (!shard) return;
+    auto histogram = shard->histogram(static_cast<int>(type));
+    if (!histogram) return;
+    histogram->counts[Histogram::bucketOf(value)].fetch_add(
+        1, std::memory_order_relaxed);
+    histogram->sum.fetch_add(value, std::memory_order_relaxed);
+  }
+
+  // call from the delivery report callback, the latency is measured by
+  // librdkafka from produce() to the delivery report
+  void recordDelivery(const rd_kafka_message_t* rkmessage) noexcept {
+    if (rkmessage->err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+      add(Counter::kDeliveryErrors);
+      return;
+    }
+    add(Counter::kDelivered);
+    int64_t latency_us = rd_kafka_message_latency(rkmessage);
+    if (latency_us >= 0)
+      record(HistogramType::kDeliveryLatencyUs,
+             static_cast<uint64_t>(latency_us));
+  }
+
+  // record the result of enqueuing one message
+  void recordProduce(rd_kafka_resp_err_t err) noexcept {
+    if (err == RD_KAFKA_RESP_ERR_NO_ERROR) {
+      add(Counter::kProducedMessages);
+    } else if (err == RD_KAFKA_RESP_ERR__QUEUE_FULL) {
+      add(Counter::kQueueFull);
+    } else {
+      add(Counter::kProduceErrors);
+    }
+  }
+
+  void recordPollWait(std::chrono::steady_clock::time_point start) noexcept {
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    record(HistogramType::kPollWaitUs,
+           std::chrono::duration_cast<std::chrono::microseconds>(elapsed)
+               .count());
+  }
+
+  // one counter merged, cheaper than snapshot()
+  uint64_t count(Counter counter) const noexcept {
+    const Shard* shards = shards_.load(std::memory_order_acquire);
+    if (!shards) return 0;
+    uint64_t n = 0;
+    for (int i = 0; i < kNumShards; i++) {
+      n += shards[i].counters[static_cast<int>(counter)].load(
+          std::memory_order_relaxed);
+    }
+    return n;
+  }
+
+  Snapshot snapshot() const noexcept {
+    Snapshot snapshot;
+    const Shard* shards = shards_.load(std::memory_order_acquire);
+    if (!shards) return snapshot;
+    for (int i = 0; i < kNumShards; i++) {
+      const Shard& shard = shards[i];
+      for (int j = 0; j < kNumCounters; j++)
+        snapshot.counters[j] +=
+            shard.counters[j].load(std::memory_order_relaxed);
+
+      for (int j = 0; j < kNumHistograms; j++) {
+        const AtomicHistogram* from =
+            shard.histograms[j].load(std::memory_order_acquire);
+        if (!from) continue;
+        Histogram& to = snapshot.histograms[j];
+        for (int k = 0; k < Histogram::kNumBuckets; k++) {
+          uint64_t count = from->counts[k].load(std::memory_order_relaxed);
+          if (count > 0) to.addBucket(k, count);
+        }
+        to.addSum(from->sum.load(std::memory_order_relaxed));
+      }
+    }
+    return snapshot;
+  }
+
+ private:
+  struct AtomicHistogram {
+    std::atomic<uint64_t> counts[Histogram::kNumBuckets];
+    std::atomic<uint64_t> sum;
+  };
+
+  struct Shard {
+    std::atomic<uint64_t> counters[kNumCounters];
+    std::atomic<AtomicHistogram*> histograms[kNumHistograms];
+    // new doesn't align to cache lines in C++11, pad instead, so the hot
+    // counters of two shards never share a line
+    char padding[64];
+
+    // allocated by the first record, null if out of memory
+    AtomicHistogram* histogram(int type) noexcept {
+      return installOnce(histograms[type],
+                         [] { return new (std::nothrow) AtomicHistogram(); },
+                         [](AtomicHistogram* h) { delete h; });
+    }
+  };
+
+  std::atomic<Shard*> shards_{nullptr};
+
+  // allocated by the first record, null if out of memory
+  Shard* shard() noexcept {
+    static std::atomic<unsigned> next_index{0};
+    static thread_local unsigned index = next_index++ % kNumShards;
+    Shard* shards = installOnce(
+        shards_,
+        [] { return new (std::nothrow) Shard[kNumShards](); },  // zeroed
+        [](Shard* s) { delete[] s; });
+    return shards ? shards + index : nullptr;
+  }
+
+  // the pointer in slot, or the one allocated and installed by this call
+  template <typename T, typename New, typename Delete>
+  static T* installOnce(std::atomic<T*>& slot, New allocate,
+                        Delete destroy) noexcept {
+    T* ptr = slot.load(std::memory_order_acquire);
+    if (ptr) return ptr;
+    T* fresh = allocate();
+    if (!fresh) return nullptr;
+    if (slot.compare_exchange_strong(ptr, fresh, std::memory_order_acq_rel))
+      return fresh;
+    destroy(fresh);  // another thread installed ptr first
+    return ptr;
+  }
+
+  void destroy() noexcept {
+    Shard* shards = shards_.exchange(nullptr);
+    if (!shards) return;
+    for (int i = 0; i < kNumShards; i++) {
+      for (auto& histogram : shards[i].histograms) delete histogram.load();
+    }
+    delete[] shards;
+  }
+};
+
+}  // namespace rdkafka
@@ -0,0 +1,393 @@
+// rdkafka_offset_tracker.hpp: at-least-once commits of out-of-order completions
+//
+// Messages handed to worker threads complete in any order, but a committed
+// offset means that every message of the partition before it is done.
+// OffsetTracker keeps each partition's tracked (handed out) but not completed
+// offsets in a bitmap starting at the lowest of them, so the offset to commit
+// is the first set bit, or the offset after the last tracked message if none
+// is pending. Offsets that are never consumed (compacted records, transaction
+// markers) are never set, so gaps don't hold the commit back.
+//
+// poll() commits asynchronously every partition whose committable offset
+// moved since its last commit, once commit_interval has passed or
+// commit_threshold messages have completed, with at most one commit request
+// in flight. Thousands of completions become one request instead of one each.
+// revoke() commits the revoked partitions synchronously and forgets them, so
+// their next owner starts right after the completed messages.
+//
+// NOTE: enable.auto.commit must be false, otherwise librdkafka also commits
+//       the consumed offsets, which may not be completed yet.
+#pragma once
+
+#include "rdkafka.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "rdkafka_classes.hpp"
+
+namespace rdkafka {
+
+// Tracked but not completed offsets of a partition, one bit per offset from
+// the lowest pending one, kept in a ring of 64-bit words.
+class PendingOffsets {
+ public:
+  // Offsets must be added in increasing order. A smaller offset (the consumer
+  // seeked back) forgets the pending ones, they will be consumed again.
+  void add(int64_t offset) {
+    if (num_pending_ == 0 || offset < next_) {
+      // all words are zero now, rebase on offset's word
+      for (size_t i = 0; i < num_words_; i++) word(i) = 0;
+      head_ = 0;
+      num_words_ = 0;
+      num_pending_ = 0;
+      base_ = offset - offset % kWordBits;
+    }
+    auto index = static_cast<size_t>((offset - base_) / kWordBits);
+    while (num_words_ <= index) pushWord();
+    word(index) |= bit(offset);
+    ++num_pending_;
+    next_ = offset + 1;
+  }
+
+  // false if offset isn't pending
+  bool remove(int64_t offset) noexcept {
+    if (offset < base_ || offset >= next_) return false;
+    auto index = static_cast<size_t>((offset - base_) / kWordBits);
+    if (index >= num_words_ || !(word(index) & bit(offset))) return false;
+    word(index) &= ~bit(offset);
+    --num_pending_;
+    // words before the last one only hold offsets that were already added
+    while (num_words_ > 1 && word(0) == 0) {
+      head_ = (head_ + 1) & (words_.size() - 1);
+      --num_words_;
+      base_ += kWordBits;
+    }
+    return true;
+  }
+
+  // the lowest pending offset, or the offset after the last added one,
+  // RD_KAFKA_OFFSET_INVALID if nothing was added
+  int64_t committable() const noexcept {
+    if (num_pending_ == 0) return next_;
+    for (size_t i = 0; i < num_words_; i++) {
+      uint64_t w = word(i);
+      if (w != 0)
+        return base_ + static_cast<int64_t>(i) * kWordBits +
+               __builtin_ctzll(w);
+    }
+    return next_;  // not reached
+  }
+
+  size_t size() const noexcept { return num_pending_; }
+
+  // bytes of the bitmap, it grows with the distance between the lowest
+  // pending offset and the last added one
+  size_t capacity() const noexcept { return words_.size() * sizeof(uint64_t); }
+
+ private:
+  static constexpr int64_t kWordBits = 64;
+
+  std::vector<uint64_t> words_;  // ring, the size is a power of 2 or 0
+  size_t head_ = 0;              // index of the word of base_
+  size_t num_words_ = 0;
+  int64_t base_ = 0;  // offset of the lowest bit of the head word
+  int64_t next_ = RD_KAFKA_OFFSET_INVALID;
+  size_t num_pending_ = 0;
+
+  uint64_t& word(size_t i) noexcept {
+    return words_[(head_ + i) & (words_.size() - 1)];
+  }
+
+  uint64_t word(size_t i) const noexcept {
+    return words_[(head_ + i) & (words_.size() - 1)];
+  }
+
+  uint64_t bit(int64_t offset) const noexcept {
+    return uint64_t(1) << ((offset - base_) % kWordBits);
+  }
+
+  void pushWord() {
+    if (num_words_ == words_.size()) {
+      // unroll the ring into a twice larger one
+      std::vector<uint64_t> words(words_.empty() ? 4 : 2 * words_.size(), 0);
+      for (size_t i = 0; i < num_words_; i++) words[i] = word(i);
+      words_.swap(words);
+      head_ = 0;
+    }
+    word(num_words_++) = 0;
+  }
+};
+
+struct OffsetTrackerOptions {
+  // commit at least this often while messages complete
+  std::chrono::milliseconds commit_interval{5000};
+  // or once this many messages have completed since the last commit
+  long commit_threshold = 10000;
+};
+
+class OffsetTracker final {
+ public:
+  struct Counts {
+    long tracked = 0;
+    long completed = 0;
+    long commits = 0;   // commit requests, async and sync
+    long failed = 0;    // commit requests that failed
+    long offsets = 0;   // partition offsets committed successfully
+  };
+
+  // rk is the consumer, it must outlive the tracker. Results of a commit
+  // still in flight when the tracker is destroyed are dropped.
+  explicit OffsetTracker(rd_kafka_t* rk,
+                         OffsetTrackerOptions options = OffsetTrackerOptions())
+      : rk_(rk),
+        options_(options),
+        queue_(rd_kafka_queue_new(rk)),
+        last_commit_(Clock::now()) {}
+
+  OffsetTracker(const OffsetTracker&) = delete;
+  OffsetTracker& operator=(const OffsetTracker&) = delete;
+
+  // Called with the assigned partitions, e.g. in ParallelConsumer's assign
+  // handler. Whatever was tracked for them before is forgotten.
+  void assign(const rd_kafka_topic_partition_list_t* partitions) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int i = 0; i < partitions->cnt; i++) {
+      const auto& elem = partitions->elems[i];
+      getPartition(elem.topic, elem.partition) = Partition();
+    }
+  }
+
+  // Called with the revoked partitions after their messages completed, e.g. in
+  // ParallelConsumer's revoke handler. Commits their offsets synchronously
+  // and forgets them.
+  ErrorCode revoke(const rd_kafka_topic_partition_list_t* partitions) {
+    PointerHolder<rd_kafka_topic_partition_list_t> offsets(
+        rd_kafka_topic_partition_list_new(partitions->cnt));
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (int i = 0; i < partitions->cnt; i++) {
+        const auto& elem = partitions->elems[i];
+        auto partition = findPartition(elem.topic, elem.partition);
+        if (!partition || !partition->assigned) continue;
+        addIfMoved(offsets.get(), elem.topic, elem.partition, *partition);
+        partition->assigned = false;
+      }
+    }
+    return commitSync(offsets.get());
+  }
+
+  // Message was handed out to be processed. Thread-safe, but the messages of a
+  // partition must be tracked in offset order.
+  template <typename T>
+  void track(const MessageAccessor<T>& message) {
+    track(message.topicName(), message.partition(), message.offset());
+  }
+
+  void track(const char* topic, int32_t partition, int64_t offset) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& state = getPartition(topic, partition);
+    state.assigned = true;
+    state.pending.add(offset);
+    ++counts_.tracked;
+  }
+
+  // Message was processed, in any order. Thread-safe. Messages of partitions
+  // that are no longer tracked are ignored.
+  template <typename T>
+  void complete(const MessageAccessor<T>& message) {
+    complete(message.topicName(), message.partition(), message.offset());
+  }
+
+  void complete(const char* topic, int32_t partition, int64_t offset) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto state = findPartition(topic, partition);
+    if (!state || !state->assigned || !state->pending.remove(offset)) return;
+    ++counts_.completed;
+    ++num_completed_since_commit_;
+  }
+
+  // Serve the results of previous commits and commit if it's due. Must be
+  // called periodically, e.g. after ParallelConsumer::poll().
+  ErrorCode poll() {
+    rd_kafka_queue_poll_callback(queue_.get(), 0);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (commit_in_flight_) return RD_KAFKA_RESP_ERR_NO_ERROR;
+    if (num_completed_since_commit_ < options_.commit_threshold &&
+        Clock::now() - last_commit_ < options_.commit_interval)
+      return RD_KAFKA_RESP_ERR_NO_ERROR;
+    return commitAsync();
+  }
+
+  // Commit every partition's offset and wait, e.g. before closing the
+  // consumer.
+  ErrorCode commit() {
+    PointerHolder<rd_kafka_topic_partition_list_t> offsets(
+        rd_kafka_topic_partition_list_new(0));
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      collectMoved(offsets.get());
+    }
+    return commitSync(offsets.get());
+  }
+
+  // the offset that would be committed for the partition,
+  // RD_KAFKA_OFFSET_INVALID if nothing was tracked
+  int64_t committable(const char* topic, int32_t partition) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto state = findPartition(topic, partition);
+    if (!state || !state->assigned) return RD_KAFKA_OFFSET_INVALID;
+    return state->pending.committable();
+  }
+
+  Counts counts() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return counts_;
+  }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Partition {
+    PendingOffsets pending;
+    int64_t committed = RD_KAFKA_OFFSET_INVALID;  // last committed offset
+    bool assigned = false;
+  };
+
+  // a consumer subscribes to a few topics, so they're searched linearly,
+  // which doesn't allocate like a std::string key would
+  struct TopicState {
+    std::string name;
+    std::vector<Partition> partitions;
+  };
+
+  rd_kafka_t* const rk_;
+  const OffsetTrackerOptions options_;
+  // commit results are served here by poll()
+  PointerHolder<rd_kafka_queue_t> queue_;
+
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<TopicState>> topics_;
+  Counts counts_;
+  long num_completed_since_commit_ = 0;
+  Clock::time_point last_commit_;
+  bool commit_in_flight_ = false;
+
+  const Partition* findPartition(const char* topic, int32_t partition) const {
+    for (const auto& t : topics_) {
+      if (t->name == topic) {
+        if (partition < 0 ||
+            static_cast<size_t>(partition) >= t->partitions.size())
+          return nullptr;
+        return &t->partitions[partition];
+      }
+    }
+    return nullptr;
+  }
+
+  Partition* findPartition(const char* topic, int32_t partition) {
+    return const_cast<Partition*>(
+        static_cast<const OffsetTracker*>(this)->findPartition(topic,
+                                                               partition));
+  }
+
+  Partition& getPartition(const char* topic, int32_t partition) {
+    TopicState* found = nullptr;
+    for (const auto& t : topics_) {
+      if (t->name == topic) {
+        found = t.get();
+        break;
+      }
+    }
+    if (!found) {
+      topics_.emplace_back(new TopicState);
+      found = topics_.back().get();
+      found->name = topic;
+    }
+    if (static_cast<size_t>(partition) >= found->partitions.size())
+      found->partitions.resize(partition + 1);
+    return found->partitions[partition];
+  }
+
+  static void addIfMoved(rd_kafka_topic_partition_list_t* offsets,
+                         const char* topic, int32_t partition,
+                         const Partition& state) {
+    auto offset = state.pending.committable();
+    if (offset == RD_KAFKA_OFFSET_INVALID || offset == state.committed) return;
+    rd_kafka_topic_partition_list_add(offsets, topic, partition)->offset =
+        offset;
+  }
+
+  void collectMoved(rd_kafka_topic_partition_list_t* offsets) const {
+    for (const auto& t : topics_) {
+      for (size_t i = 0; i < t->partitions.size(); i++) {
+        const auto& state = t->partitions[i];
+        if (state.assigned)
+          addIfMoved(offsets, t->name.data(), static_cast<int32_t>(i), state);
+      }
+    }
+  }
+
+  // mutex_ must be held
+  ErrorCode commitAsync() {
+    PointerHolder<rd_kafka_topic_partition_list_t> offsets(
+        rd_kafka_topic_partition_list_new(0));
+    collectMoved(offsets.get());
+    last_commit_ = Clock::now();
+    num_completed_since_commit_ = 0;
+    if (offsets.get()->cnt == 0) return RD_KAFKA_RESP_ERR_NO_ERROR;
+
+    ++counts_.commits;
+    auto error_code = rd_kafka_commit_queue(rk_, offsets.get(), queue_.get(),
+                                            commitCallback, this);
+    if (error_code == RD_KAFKA_RESP_ERR_NO_ERROR)
+      commit_in_flight_ = true;
+    else
+      ++counts_.failed;
+    return error_code;
+  }
+
+  ErrorCode commitSync(rd_kafka_topic_partition_list_t* offsets) {
+    if (offsets->cnt == 0) return RD_KAFKA_RESP_ERR_NO_ERROR;
+    auto error_code = rd_kafka_commit(rk_, offsets, 0);
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++counts_.commits;
+    onCommitted(error_code, offsets);
+    return error_code;
+  }
+
+  // mutex_ must be held
+  void onCommitted(ErrorCode error_code,
+                   const rd_kafka_topic_partition_list_t* offsets) {
+    if (error_code != RD_KAFKA_RESP_ERR_NO_ERROR) ++counts_.failed;
+    for (int i = 0; offsets && i < offsets->cnt; i++) {
+      const auto& elem = offsets->elems[i];
+      // a failed partition is committed again by the next commit
+      if (error_code != RD_KAFKA_RESP_ERR_NO_ERROR ||
+          elem.err != RD_KAFKA_RESP_ERR_NO_ERROR)
+        continue;
+      ++counts_.offsets;
+      // as is, after a seek back it's lower than the previous one
+      auto state = findPartition(elem.topic, elem.partition);
+      if (state) state->committed = elem.offset;
+    }
+  }
+
+  static void commitCallback(rd_kafka_t*, rd_kafka_resp_err_t err,
+                             rd_kafka_topic_partition_list_t* offsets,
+                             void* opaque) {
+    auto self = static_cast<OffsetTracker*>(opaque);
+    std::lock_guard<std::mutex> lock(self->mutex_);
+    self->commit_in_flight_ = false;
+    self->onCommitted(err, offsets);
+  }
+};
+
+}  // namespace rdkafka
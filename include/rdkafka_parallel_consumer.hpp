@@ -0,0 +1,222 @@
+// rdkafka_parallel_consumer.hpp: consume partitions on a fixed worker pool
+//
+// On assignment each partition's queue is forwarded to the queue of one
+// worker thread, so a partition is always handled by a single worker and its
+// messages keep their order, while different partitions are processed in
+// parallel. On revoke the workers are paused and their in-hand batches are
+// drained before the partitions are unassigned.
+//
+// NOTE: the eager rebalance protocol is assumed (rd_kafka_assign()).
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "rdkafka_classes.hpp"
+#include "rdkafka_error.hpp"
+
+namespace rdkafka {
+
+class ParallelConsumer final {
+ public:
+  // called on worker threads, messages of one partition are handled in order
+  using MessageHandler = std::function<void(const MessageView&)>;
+  // called on the thread of poll() or close() during a rebalance
+  using RebalanceHandler =
+      std::function<void(rd_kafka_t*, rd_kafka_topic_partition_list_t*)>;
+
+  template <size_t N>
+  ParallelConsumer(GlobalConf conf, size_t num_workers, MessageHandler handler,
+                   char (&errstr)[N])
+      : handler_(std::move(handler)),
+        consumer_(prepareConf(std::move(conf), this), errstr) {
+    if (consumer_.isNull()) return;
+
+    if (num_workers == 0) num_workers = 1;
+    for (size_t i = 0; i < num_workers; i++) {
+      workers_.emplace_back(new Worker(rd_kafka_queue_new(consumer_.get())));
+    }
+    for (auto& worker : workers_) {
+      worker->thread = std::thread(&ParallelConsumer::run, this, worker.get());
+    }
+  }
+
+  ParallelConsumer(const ParallelConsumer&) = delete;
+  ParallelConsumer& operator=(const ParallelConsumer&) = delete;
+
+  ~ParallelConsumer() { close(); }
+
+  bool isNull() const noexcept { return consumer_.isNull(); }
+
+  rd_kafka_t* get() const noexcept { return consumer_.get(); }
+
+  ClientMetrics& metrics() const noexcept { return consumer_.metrics(); }
+
+  size_t numWorkers() const noexcept { return workers_.size(); }
+
+  // called with the assigned partitions before rd_kafka_assign(), the offsets
+  // can be modified to choose where to start
+  void setAssignHandler(RebalanceHandler handler) {
+    assign_handler_ = std::move(handler);
+  }
+
+  // called with the revoked partitions after all workers drained, before
+  // rd_kafka_assign(rk, nullptr), it's the place to commit offsets
+  void setRevokeHandler(RebalanceHandler handler) {
+    revoke_handler_ = std::move(handler);
+  }
+
+  ErrorCode subscribe(const std::vector<std::string>& topics) const noexcept {
+    return consumer_.subscribe(topics);
+  }
+
+  // Serve rebalance and error events, must be called periodically like
+  // Consumer::consume(). Messages never arrive here because all partitions
+  // are forwarded to workers, the returned Message is a consumer error or null.
+  Message poll(int timeout_ms) const noexcept {
+    return consumer_.consume(timeout_ms);
+  }
+
+  // Leave the group (the final revoke is drained), then stop the workers.
+  ErrorCode close() {
+    if (consumer_.isNull() || closed_) return RD_KAFKA_RESP_ERR_NO_ERROR;
+    closed_ = true;
+
+    auto error_code = consumer_.waitUntilRebalanceRevoke();
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      running_ = false;
+    }
+    cond_.notify_all();
+    for (auto& worker : workers_) {
+      rd_kafka_queue_yield(worker->queue.get());
+      if (worker->thread.joinable()) worker->thread.join();
+    }
+    // worker queues must be destroyed before rd_kafka_t
+    workers_.clear();
+    return error_code;
+  }
+
+ private:
+  struct Worker {
+    explicit Worker(rd_kafka_queue_t* rkqu)
+        : queue(rkqu) {}
+
+    PointerHolder<rd_kafka_queue_t> queue;
+    std::thread thread;
+  };
+
+  static constexpr size_t kBatchSize = 1000;
+  static constexpr int kConsumeTimeoutMs = 100;
+
+  MessageHandler handler_;
+  RebalanceHandler assign_handler_;
+  RebalanceHandler revoke_handler_;
+  Consumer consumer_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  bool running_ = true;
+  bool paused_ = true;  // no partitions before the first assignment
+  size_t num_busy_ = 0;
+  bool closed_ = false;
+
+  static GlobalConf prepareConf(GlobalConf conf, ParallelConsumer* self) {
+    conf.setOpaque(self);
+    conf.setRebalanceCallback(rebalanceCallback);
+    return conf;
+  }
+
+  static void rebalanceCallback(rd_kafka_t* rk, rd_kafka_resp_err_t err,
+                                rd_kafka_topic_partition_list_t* partitions,
+                                void* opaque) {
+    auto self = static_cast<ParallelConsumer*>(opaque);
+    switch (err) {
+      case RD_KAFKA_RESP_ERR__ASSIGN_PARTITIONS:
+        self->assign(rk, partitions);
+        break;
+
+      case RD_KAFKA_RESP_ERR__REVOKE_PARTITIONS:
+        self->revoke(rk, partitions);
+        break;
+
+      default:
+        error::Print("[ERROR] Group rebalance failed: %s\n",
+                     rd_kafka_err2str(err));
+        self->revoke(rk, nullptr);
+        break;
+    }
+  }
+
+  void assign(rd_kafka_t* rk, rd_kafka_topic_partition_list_t* partitions) {
+    if (assign_handler_) assign_handler_(rk, partitions);
+
+    // round-robin, each partition is forwarded to exactly one worker
+    for (int i = 0; i < partitions->cnt; i++) {
+      auto& elem = partitions->elems[i];
+      auto rkqu = rd_kafka_queue_get_partition(rk, elem.topic, elem.partition);
+      if (!rkqu) continue;
+      auto& worker = workers_[i % workers_.size()];
+      rd_kafka_queue_forward(rkqu, worker->queue.get());
+      rd_kafka_queue_destroy(rkqu);
+    }
+
+    auto error_code = rd_kafka_assign(rk, partitions);
+    if (error_code != RD_KAFKA_RESP_ERR_NO_ERROR) {
+      error::Print("[ERROR] rd_kafka_assign() failed: %s\n",
+                   rd_kafka_err2str(error_code));
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      paused_ = false;
+    }
+    cond_.notify_all();
+  }
+
+  void revoke(rd_kafka_t* rk, rd_kafka_topic_partition_list_t* partitions) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      paused_ = true;
+      for (auto& worker : workers_) rd_kafka_queue_yield(worker->queue.get());
+      cond_.wait(lock, [this] { return num_busy_ == 0; });
+    }
+
+    if (partitions && revoke_handler_) revoke_handler_(rk, partitions);
+    // messages still queued for the revoked partitions become outdated and
+    // are dropped by librdkafka
+    rd_kafka_assign(rk, nullptr);
+  }
+
+  void run(Worker* worker) {
+    MessageBatch batch(kBatchSize);
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this] { return !running_ || !paused_; });
+        if (!running_) break;
+        ++num_busy_;
+      }
+
+      batch.consume(worker->queue.get(), kBatchSize, kConsumeTimeoutMs);
+      consumer_.metrics().record(
+          ClientMetrics::HistogramType::kConsumeBatchSize, batch.size());
+      consumer_.metrics().add(ClientMetrics::Counter::kConsumedMessages,
+                              batch.size());
+      for (size_t i = 0; i < batch.size(); i++) handler_(batch[i]);
+      batch.clear();
+
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--num_busy_ == 0) cond_.notify_all();
+      }
+    }
+  }
+};
+
+}  // namespace rdkafka
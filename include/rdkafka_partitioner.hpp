@@ -0,0 +1,239 @@
+// rdkafka_partitioner.hpp: partitioners implemented in C++
+//
+// A partitioner is any type with a method
+//
+//   int32_t partition(const rd_kafka_topic_t* rkt, const void* key,
+//                     size_t keylen, int32_t partition_cnt);
+//
+// which is passed to TopicConf::setPartitioner(). It's called once per message
+// produced without an explicit partition, from any thread calling produce()
+// and from librdkafka's thread when the topic's metadata arrives, so it must
+// be thread safe. key is nullptr for messages without a key.
+//
+// NOTE: librdkafka only calls a custom partitioner for keyless messages if
+// "sticky.partitioning.linger.ms" is 0 in the global config, otherwise it
+// assigns them a partition itself.
+#pragma once
+
+#include "rdkafka.h"
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <vector>
+
+#include "rdkafka_hash.hpp"
+
+namespace rdkafka {
+
+// Keyed messages go to murmur2(key) % partition_cnt like librdkafka's
+// "murmur2_random" and the Java client, keyless messages to a random
+// available partition.
+class Murmur2Partitioner {
+ public:
+  int32_t partition(const rd_kafka_topic_t* rkt, const void* key,
+                    size_t keylen, int32_t partition_cnt) const noexcept {
+    if (!key)
+      return rd_kafka_msg_partitioner_random(rkt, key, keylen, partition_cnt,
+                                             nullptr, nullptr);
+    return static_cast<int32_t>((murmur2(key, keylen) & 0x7fffffff) %
+                                static_cast<uint32_t>(partition_cnt));
+  }
+};
+
+// Keyed messages are placed on a hash ring with points_per_partition points
+// for each partition, so adding partitions only moves the keys of the ring's
+// arcs taken by the new partitions instead of nearly all keys like modulo
+// does. Keyless messages go to a random available partition.
+//
+// The ring of a partition count is built once, at the first message that
+// sees it, and looked up through a table indexed by the hash's top bits.
+class ConsistentHashPartitioner {
+ public:
+  explicit ConsistentHashPartitioner(int points_per_partition = 128) noexcept
+      : points_per_partition_(std::max(points_per_partition, 1)) {}
+
+  int32_t partition(const rd_kafka_topic_t* rkt, const void* key,
+                    size_t keylen, int32_t partition_cnt) noexcept {
+    if (!key)
+      return rd_kafka_msg_partitioner_random(rkt, key, keylen, partition_cnt,
+                                             nullptr, nullptr);
+    const Ring* current = ring(partition_cnt);
+    // the ring couldn't be built, modulo instead
+    if (!current)
+      return Murmur2Partitioner().partition(rkt, key, keylen, partition_cnt);
+    return current->find(murmur2(key, keylen));
+  }
+
+  // sorted points of partition_cnt partitions
+  struct Ring {
+    int32_t partition_cnt;
+    int shift;                      // hash >> shift is an index of buckets
+    std::vector<uint32_t> buckets;  // first point of each bucket, and the end
+    std::vector<uint32_t> hashes;
+    std::vector<int32_t> partitions;
+
+    // owner of the first point at or after hash, wrapping around the ring
+    int32_t find(uint32_t hash) const noexcept {
+      size_t bucket = hash >> shift;
+      auto first = hashes.begin() + buckets[bucket];
+      auto last = hashes.begin() + buckets[bucket + 1];
+      auto it = std::lower_bound(first, last, hash);
+      size_t i = static_cast<size_t>(it - hashes.begin());
+      return partitions[i < hashes.size() ? i : 0];
+    }
+  };
+
+  // Null if it can't be built: it's called by librdkafka's C partitioner
+  // callback, which an exception mustn't unwind through.
+  const Ring* ring(int32_t partition_cnt) noexcept {
+    const Ring* current = ring_.load(std::memory_order_acquire);
+    if (current && current->partition_cnt == partition_cnt) return current;
+
+    try {
+      std::lock_guard<std::mutex> lock(mutex_);
+      current = nullptr;
+      for (auto& built : rings_) {
+        if (built->partition_cnt == partition_cnt) current = built.get();
+      }
+      if (!current) {
+        // kept until destruction, other threads may still read the old one
+        rings_.emplace_back(buildRing(partition_cnt));
+        current = rings_.back().get();
+      }
+    } catch (const std::exception&) {
+      return nullptr;
+    }
+    ring_.store(current, std::memory_order_release);
+    return current;
+  }
+
+ private:
+  const int points_per_partition_;
+  std::atomic<const Ring*> ring_{nullptr};
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<Ring>> rings_;
+
+  // position of a partition's point on the ring (64-bit finalizer of murmur3)
+  static uint32_t pointHash(int32_t partition, int point) noexcept {
+    uint64_t x = static_cast<uint64_t>(partition) << 32 |
+                 static_cast<uint32_t>(point);
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return static_cast<uint32_t>(x);
+  }
+
+  std::unique_ptr<Ring> buildRing(int32_t partition_cnt) const {
+    std::vector<std::pair<uint32_t, int32_t>> points;
+    points.reserve(static_cast<size_t>(partition_cnt) * points_per_partition_);
+    for (int32_t partition = 0; partition < partition_cnt; partition++) {
+      for (int point = 0; point < points_per_partition_; point++)
+        points.emplace_back(pointHash(partition, point), partition);
+    }
+    std::sort(points.begin(), points.end());
+
+    std::unique_ptr<Ring> ring(new Ring);
+    ring->partition_cnt = partition_cnt;
+    ring->hashes.reserve(points.size());
+    ring->partitions.reserve(points.size());
+    for (auto& point : points) {
+      ring->hashes.push_back(point.first);
+      ring->partitions.push_back(point.second);
+    }
+
+    // about one point per bucket
+    int bits = 1;
+    while (bits < 24 && (size_t(1) << bits) < points.size()) bits++;
+    ring->shift = 32 - bits;
+    size_t num_buckets = size_t(1) << bits;
+    ring->buckets.resize(num_buckets + 1);
+    size_t i = 0;
+    for (size_t bucket = 0; bucket < num_buckets; bucket++) {
+      while (i < points.size() && (points[i].first >> ring->shift) < bucket)
+        i++;
+      ring->buckets[bucket] = static_cast<uint32_t>(i);
+    }
+    ring->buckets[num_buckets] = static_cast<uint32_t>(points.size());
+    return ring;
+  }
+};
+
+// Keyless messages go to one partition until batch_messages of them were
+// sent there, then to the next available partition, so they form a few big
+// batches, which compress better, instead of a small batch per partition.
+// Keyed messages are passed to KeyedPartitioner.
+//
+// Unlike librdkafka's sticky partitioning, which switches every
+// sticky.partitioning.linger.ms, the switch is decided by a single atomic
+// increment and doesn't read the clock.
+template <typename KeyedPartitioner = Murmur2Partitioner>
+class StickyPartitioner {
+ public:
+  explicit StickyPartitioner(int batch_messages = 1000)
+      : batch_messages_(static_cast<uint64_t>(std::max(batch_messages, 1))),
+        seed_(std::random_device()()) {}
+
+  int32_t partition(const rd_kafka_topic_t* rkt, const void* key,
+                    size_t keylen, int32_t partition_cnt) {
+    if (key) return keyed_.partition(rkt, key, keylen, partition_cnt);
+
+    uint64_t n = count_.fetch_add(1, std::memory_order_relaxed);
+    auto batch = static_cast<uint32_t>(n / batch_messages_);
+    uint64_t state = state_.load(std::memory_order_relaxed);
+    if (static_cast<uint32_t>(state >> 32) == batch) {
+      auto partition = static_cast<int32_t>(state & 0xffffffff);
+      if (partition < partition_cnt) return partition;
+    }
+
+    int32_t partition = choose(rkt, batch, partition_cnt);
+    state_.store(static_cast<uint64_t>(batch) << 32 |
+                     static_cast<uint32_t>(partition),
+                 std::memory_order_relaxed);
+    return partition;
+  }
+
+  KeyedPartitioner& keyed() noexcept { return keyed_; }
+
+ private:
+  const uint64_t batch_messages_;
+  const uint32_t seed_;  // producers don't start on the same partition
+  KeyedPartitioner keyed_;
+  std::atomic<uint64_t> count_{0};
+  // batch number << 32 | its partition, no partition matches at first
+  std::atomic<uint64_t> state_{static_cast<uint64_t>(UINT32_MAX) << 32 |
+                               INT32_MAX};
+
+  // partitions are visited in turn, skipping those without a leader
+  int32_t choose(const rd_kafka_topic_t* rkt, uint32_t batch,
+                 int32_t partition_cnt) const noexcept {
+    auto start = static_cast<int32_t>((static_cast<uint64_t>(seed_) + batch) %
+                                      static_cast<uint32_t>(partition_cnt));
+    for (int32_t i = 0; i < partition_cnt; i++) {
+      int32_t partition = (start + i) % partition_cnt;
+      if (rd_kafka_topic_partition_available(rkt, partition)) return partition;
+    }
+    return start;
+  }
+};
+
+namespace detail {
+
+template <typename Partitioner>
+int32_t partitionerCallback(const rd_kafka_topic_t* rkt, const void* key,
+                            size_t keylen, int32_t partition_cnt,
+                            void* rkt_opaque, void*) noexcept {
+  return static_cast<Partitioner*>(rkt_opaque)->partition(rkt, key, keylen,
+                                                          partition_cnt);
+}
+
+}  // namespace detail
+
+}  // namespace rdkafka
@@ -0,0 +1,253 @@
+// rdkafka_prefetch.hpp: per-partition prefetch limits, tunable at runtime
+//
+// librdkafka forwards every partition's fetch queue to the consumer queue and
+// stops fetching once that shared queue holds queued.max.messages.kbytes, so
+// one hot partition can fill it and the memory isn't bounded per partition.
+// PartitionPrefetcher stops the forwarding of the assigned partitions, then
+// librdkafka applies queued.max.messages.kbytes (and queued.min.messages) to
+// each partition's own queue. Fetching a partition forwards it again, so it's
+// stopped again whenever the partition's messages reach the consumer queue.
+// On top of it, setLimit() gives a partition a read-ahead buffer, e.g. to
+// replay it quickly: messages are moved from its queue to the buffer until
+// the buffer holds that many bytes, which makes librdkafka fetch more. A
+// partition prefetches at most about queued.max.messages.kbytes plus its
+// limit.
+//
+// consume() serves the consumer queue (rebalance callbacks, errors) and
+// returns the assigned partitions' messages in round-robin order.
+//
+// NOTE: the offsets of buffered messages are stored when they're buffered, set
+// enable.auto.offset.store=false and store the offsets of processed messages
+// if partitions have a limit. The eager rebalance protocol is assumed.
+#pragma once
+
+#include "rdkafka.h"
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "rdkafka_classes.hpp"
+
+namespace rdkafka {
+
+// Not thread safe except setLimit(), setDefaultLimit() and limit().
+class PartitionPrefetcher final {
+ public:
+  // consumer isn't owned, it must outlive the PartitionPrefetcher
+  explicit PartitionPrefetcher(const Consumer& consumer,
+                               size_t default_limit_bytes = 0)
+      : consumer_(consumer),
+        consumer_queue_(rd_kafka_queue_get_consumer(consumer.get())),
+        default_limit_(default_limit_bytes) {
+    rd_kafka_queue_cb_event_enable(consumer_queue_.get(), wakeUp, this);
+  }
+
+  PartitionPrefetcher(const PartitionPrefetcher&) = delete;
+  PartitionPrefetcher& operator=(const PartitionPrefetcher&) = delete;
+
+  ~PartitionPrefetcher() {
+    revoke();
+    rd_kafka_queue_cb_event_enable(consumer_queue_.get(), nullptr, nullptr);
+  }
+
+  // Call with the assigned partitions before rd_kafka_assign(), e.g. in the
+  // rebalance callback.
+  void assign(const rd_kafka_topic_partition_list_t* partitions) {
+    revoke();
+    for (int i = 0; i < partitions->cnt; i++) {
+      const auto& elem = partitions->elems[i];
+      auto rkqu = rd_kafka_queue_get_partition(consumer_.get(), elem.topic,
+                                               elem.partition);
+      if (!rkqu) continue;
+      std::unique_ptr<Partition> partition(new Partition);
+      partition->topic = elem.topic;
+      partition->partition = elem.partition;
+      partition->queue.reset(rkqu);
+      rd_kafka_queue_forward(rkqu, nullptr);
+      rd_kafka_queue_cb_event_enable(rkqu, wakeUp, this);
+      partitions_.emplace_back(std::move(partition));
+    }
+    limits_version_seen_ = 0;  // read the limits of the new partitions
+    next_ = 0;
+  }
+
+  // Drop the buffered messages and forward the partitions to the consumer
+  // queue again. Call it before rd_kafka_assign(rk, nullptr).
+  void revoke() {
+    for (auto& partition : partitions_) {
+      for (auto rkmessage : partition->buffer)
+        rd_kafka_message_destroy(rkmessage);
+      auto rkqu = partition->queue.get();
+      rd_kafka_queue_cb_event_enable(rkqu, nullptr, nullptr);
+      rd_kafka_queue_forward(rkqu, consumer_queue_.get());
+    }
+    partitions_.clear();
+  }
+
+  // Read-ahead bytes of partitions without their own limit, 0 by default.
+  // Applied from the next consume().
+  void setDefaultLimit(size_t bytes) {
+    std::lock_guard<std::mutex> lock(limits_mutex_);
+    default_limit_ = bytes;
+    ++limits_version_;
+  }
+
+  void setLimit(const std::string& topic, int32_t partition, size_t bytes) {
+    std::lock_guard<std::mutex> lock(limits_mutex_);
+    auto key = std::make_pair(topic, partition);
+    limits_.erase(key);
+    limits_.emplace(key, bytes);
+    ++limits_version_;
+  }
+
+  size_t limit(const std::string& topic, int32_t partition) const {
+    std::lock_guard<std::mutex> lock(limits_mutex_);
+    return limitLocked(topic, partition);
+  }
+
+  // The next message of the assigned partitions or a consumer error, null if
+  // there's none in timeout_ms.
+  Message consume(int timeout_ms) {
+    auto start = std::chrono::steady_clock::now();
+    Message message(poll(start + std::chrono::milliseconds(timeout_ms)));
+    consumer_.metrics().recordPollWait(start);
+    if (!message.isNull())
+      consumer_.metrics().add(ClientMetrics::Counter::kConsumedMessages);
+    return message;
+  }
+
+  size_t numPartitions() const noexcept { return partitions_.size(); }
+
+  // bytes in the read-ahead buffer of an assigned partition
+  size_t bufferedBytes(const std::string& topic, int32_t partition) const {
+    auto p = find(topic.data(), partition);
+    return p ? p->buffered_bytes : 0;
+  }
+
+ private:
+  struct Partition {
+    std::string topic;
+    int32_t partition;
+    PointerHolder<rd_kafka_queue_t> queue;
+    std::deque<rd_kafka_message_t*> buffer;
+    size_t buffered_bytes = 0;
+    size_t limit = 0;
+  };
+
+  const Consumer& consumer_;
+  PointerHolder<rd_kafka_queue_t> consumer_queue_;
+  std::vector<std::unique_ptr<Partition>> partitions_;
+  size_t next_ = 0;  // round-robin
+
+  mutable std::mutex limits_mutex_;
+  size_t default_limit_;
+  std::map<std::pair<std::string, int32_t>, size_t> limits_;
+  std::atomic<uint64_t> limits_version_{1};
+  uint64_t limits_version_seen_ = 0;
+
+  std::mutex wake_mutex_;
+  std::condition_variable wake_cond_;
+  bool woken_ = false;
+
+  // called by librdkafka when a queue becomes non-empty
+  static void wakeUp(rd_kafka_t*, void* opaque) {
+    auto self = static_cast<PartitionPrefetcher*>(opaque);
+    {
+      std::lock_guard<std::mutex> lock(self->wake_mutex_);
+      self->woken_ = true;
+    }
+    self->wake_cond_.notify_one();
+  }
+
+  Partition* find(const char* topic, int32_t partition) const {
+    for (const auto& p : partitions_) {
+      if (p->partition == partition && p->topic == topic) return p.get();
+    }
+    return nullptr;
+  }
+
+  static size_t messageBytes(const rd_kafka_message_t* rkmessage) noexcept {
+    return rkmessage->len + rkmessage->key_len;
+  }
+
+  size_t limitLocked(const std::string& topic, int32_t partition) const {
+    auto it = limits_.find(std::make_pair(topic, partition));
+    return (it != limits_.end()) ? it->second : default_limit_;
+  }
+
+  void refreshLimits() {
+    auto version = limits_version_.load();
+    if (version == limits_version_seen_) return;
+    std::lock_guard<std::mutex> lock(limits_mutex_);
+    for (auto& partition : partitions_)
+      partition->limit = limitLocked(partition->topic, partition->partition);
+    limits_version_seen_ = version;
+  }
+
+  // move messages from the partition's queue to its buffer up to its limit
+  static void fill(Partition& partition) {
+    while (partition.buffered_bytes < partition.limit) {
+      auto rkmessage = rd_kafka_consume_queue(partition.queue.get(), 0);
+      if (!rkmessage) break;
+      partition.buffered_bytes += messageBytes(rkmessage);
+      partition.buffer.push_back(rkmessage);
+    }
+  }
+
+  rd_kafka_message_t* poll(std::chrono::steady_clock::time_point deadline) {
+    while (true) {
+      {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        woken_ = false;
+      }
+      // the rebalance callback runs here, it may call assign() and revoke()
+      auto rkmessage = rd_kafka_consumer_poll(consumer_.get(), 0);
+      if (rkmessage) {
+        if (rkmessage->rkt) {
+          auto p = find(rd_kafka_topic_name(rkmessage->rkt),
+                        rkmessage->partition);
+          if (p) rd_kafka_queue_forward(p->queue.get(), nullptr);
+        }
+        return rkmessage;
+      }
+
+      refreshLimits();
+      rkmessage = next();
+      if (rkmessage) return rkmessage;
+
+      std::unique_lock<std::mutex> lock(wake_mutex_);
+      if (!wake_cond_.wait_until(lock, deadline, [this] { return woken_; }))
+        return nullptr;
+    }
+  }
+
+  // one message of the next partition that has one
+  rd_kafka_message_t* next() {
+    for (size_t i = 0; i < partitions_.size(); i++) {
+      auto& partition = *partitions_[next_];
+      next_ = (next_ + 1) % partitions_.size();
+      fill(partition);
+      if (!partition.buffer.empty()) {
+        auto rkmessage = partition.buffer.front();
+        partition.buffer.pop_front();
+        partition.buffered_bytes -= messageBytes(rkmessage);
+        return rkmessage;
+      }
+      if (auto rkmessage = rd_kafka_consume_queue(partition.queue.get(), 0))
+        return rkmessage;
+    }
+    return nullptr;
+  }
+};
+
+}  // namespace rdkafka
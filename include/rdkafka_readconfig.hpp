@@ -9,102 +9,297 @@
 // key1=value1
 // key2=value2
 // key3=value3
+//
+// [topic:orders]  # overrides [topic] for topic "orders"
+// key1=value4
 // ---------------------config ends---------------------------
-// NOTE: the header must be [topic] or [global], other lines must
-//       be "key=value" format or empty line.
+// NOTE: the header must be [topic], [topic:<name>] or [global], other lines
+//       must be "key=value" format or empty line. A line starting with '#'
+//       is a comment, otherwise the last '#' of a line starts a comment.
+//
+// ConfigSet maps the file and parses it in a single pass, names and values
+// are slices of the mapping. Loading another file into the same ConfigSet
+// reuses its storage, so building the configs of many clients doesn't
+// allocate per line. Errors are returned with their line number instead of
+// exiting, readConfig() is the exiting shortcut used by the examples.
 #pragma once
 
-#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <algorithm>
-#include <fstream>
 #include <string>
-#include <unordered_set>
 #include <utility>
+#include <vector>
 
 #include "rdkafka_classes.hpp"
 #include "rdkafka_error.hpp"
+#include "rdkafka_hash.hpp"
+#include "rdkafka_slice.hpp"
 
 namespace rdkafka {
 
-// User shouldn't call it
-inline std::string __strip(const std::string& s) {
-  // TODO: use std::reverse_iterator and std::find_if()
-  size_t pos_begin = 0;
-  while (pos_begin < s.size() && isblank(s[pos_begin])) ++pos_begin;
-  if (pos_begin == s.size() || s[pos_begin] == '#') return "";
+struct ConfigError {
+  int line = 0;  // 0 if the error isn't about a line, e.g. open failed
+  std::string message;
+
+  std::string toString() const {
+    return (line > 0) ? "line " + std::to_string(line) + ": " + message
+                      : message;
+  }
+};
+
+class ConfigSet {
+ public:
+  // sections of entries, [topic:<name>] sections follow from kFirstTopic
+  static constexpr int kGlobal = 0;
+  static constexpr int kTopic = 1;
+  static constexpr int kFirstTopic = 2;
+
+  struct Entry {
+    int section;
+    int line;
+    Slice name;
+    Slice value;
+  };
 
-  size_t pos_end = s.size();
-  while (pos_end > pos_begin && isblank(s[pos_end - 1])) --pos_end;
-  // s[pos_begin, pos_end)
+  ConfigSet() = default;
+  ~ConfigSet() { unmap(); }
 
-  size_t pos_comment = s.rfind('#', pos_end - 1);
-  if (pos_comment != std::string::npos) {
-    pos_end = pos_comment;  // NOTE: pos_comment >= pos_begin
+  ConfigSet(const ConfigSet&) = delete;
+  ConfigSet& operator=(const ConfigSet&) = delete;
+
+  // the previous file's entries are dropped
+  bool load(const std::string& filename, ConfigError& error) {
+    unmap();
+    entries_.clear();
+    topic_names_.clear();
+
+    int fd = open(filename.data(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+      return fail(error, 0, "open file \"" + filename +
+                                "\" failed: " + strerror(errno));
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+      int err = errno;
+      close(fd);
+      return fail(error, 0, "stat \"" + filename + "\" failed: " +
+                                strerror(err));
+    }
+
+    // mmap() fails on empty files, which have no entries anyway
+    if (st.st_size > 0) {
+      void* addr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                        MAP_PRIVATE, fd, 0);
+      int err = errno;
+      close(fd);
+      if (addr == MAP_FAILED)
+        return fail(error, 0, "mmap \"" + filename + "\" failed: " +
+                                  strerror(err));
+      map_ = addr;
+      map_size_ = static_cast<size_t>(st.st_size);
+      madvise(map_, map_size_, MADV_SEQUENTIAL);
+    } else {
+      close(fd);
+    }
+    return parse(Slice(map_, map_size_), error);
   }
 
-  return s.substr(pos_begin, pos_end - pos_begin);
-}
+  // text must outlive the ConfigSet, or the next load() or parse()
+  bool parse(Slice text, ConfigError& error) {
+    entries_.clear();
+    topic_names_.clear();
+    std::fill(topic_slots_.begin(), topic_slots_.end(), 0);
 
-inline std::pair<GlobalConf, TopicConf> readConfig(
-    const std::string& filename) {
-  std::ifstream fin(filename);
-  error::ExitIf(!fin, "open file \"%s\" failed!\n", filename.data());
+    int section = -1;  // no header yet
+    const char* p = text.begin();
+    const char* end = text.end();
+    for (int line = 1; p < end; line++) {
+      auto eol = static_cast<const char*>(memchr(p, '\n', end - p));
+      if (!eol) eol = end;
+      Slice s = strip(p, commentStart(p, eol));
+      p = eol + 1;
+      if (s.empty()) continue;
 
-  std::string line;
-  int num_line = 0;
+      // read header "[global]", "[topic]" or "[topic:<name>]"
+      if (s[0] == '[') {
+        if (s.size() < 2 || s[s.size() - 1] != ']')
+          return fail(error, line,
+                      "\"" + s.toString() + "\" is invalid header");
+        Slice header = strip(s.begin() + 1, s.end() - 1);
+        constexpr size_t kPrefixSize = 6;  // "topic:"
+        if (header == "global") {
+          section = kGlobal;
+        } else if (header == "topic") {
+          section = kTopic;
+        } else if (header.size() > kPrefixSize &&
+                   memcmp(header.data(), "topic:", kPrefixSize) == 0) {
+          Slice topic_name = strip(header.begin() + kPrefixSize, header.end());
+          if (topic_name.empty()) return fail(error, line, "empty topic name");
+          section = topicSection(topic_name);
+        } else {
+          return fail(error, line,
+                      "header \"" + header.toString() +
+                          "\" is not \"global\", \"topic\" or "
+                          "\"topic:<name>\"");
+        }
+        continue;
+      }
 
-  std::pair<GlobalConf, TopicConf> configs;
-  enum { GLOBAL, TOPIC, NONE } type = NONE;
-
-  while (std::getline(fin, line)) {
-    std::string old_line = line;
-    line = __strip(line);
-    ++num_line;
-
-    if (line.empty()) continue;
-
-    // read header "[global]" or "[topic]"
-    if (line[0] == '[') {
-      if (line.back() != ']' || line.length() < 2)
-        error::Exit("[file: %s] line %d (\"%s\") is invalid header\n",
-                    filename.data(), num_line, old_line.data());
-
-      auto header = line.substr(1, line.length() - 2);
-      if (header == "topic")
-        type = TOPIC;
-      else if (header == "global")
-        type = GLOBAL;
-      else
-        error::Exit("header \"%s\" is not \"topic\" or \"global\"\n",
-                    header.data());
-
-      continue;
+      if (section == -1)
+        return fail(error, line,
+                    "doesn't have a header like \"[topic]\" or \"[global]\"");
+
+      auto equal = static_cast<const char*>(memchr(s.data(), '=', s.size()));
+      if (!equal)
+        return fail(error, line, "\"" + s.toString() + "\": can't find '='");
+      Slice name = strip(s.begin(), equal);
+      if (name.empty()) return fail(error, line, "empty name");
+      entries_.push_back(Entry{section, line, name, strip(equal + 1, s.end())});
     }
+    return true;
+  }
 
-    if (type == NONE) {
-      error::Exit(
-          "[file: %s] line %d doesn't have a header like "
-          "\"[topic]\" or \"[global]\"\n",
-          filename.data(), num_line);
+  bool toGlobalConf(GlobalConf& conf, ConfigError& error) const {
+    std::string buffer;
+    return apply(conf.get(), kGlobal, buffer, error);
+  }
+
+  // [topic] entries, then those of [topic:<topic_name>] if it's not empty
+  bool toTopicConf(TopicConf& conf, Slice topic_name,
+                   ConfigError& error) const {
+    std::string buffer;
+    if (!apply(conf.get(), kTopic, buffer, error)) return false;
+    if (topic_name.empty() || topic_names_.empty()) return true;
+    uint32_t index = topic_slots_[findSlot(topic_name)];
+    if (index == 0) return true;
+    return apply(conf.get(), kFirstTopic + static_cast<int>(index - 1), buffer,
+                 error);
+  }
+
+  // in file order
+  const std::vector<Entry>& entries() const noexcept { return entries_; }
+
+  // names of [topic:<name>] sections, section kFirstTopic + i is names[i]
+  const std::vector<Slice>& topicNames() const noexcept {
+    return topic_names_;
+  }
+
+ private:
+  void* map_ = nullptr;
+  size_t map_size_ = 0;
+  std::vector<Entry> entries_;
+  std::vector<Slice> topic_names_;
+  // open addressing index of topic_names_, a slot holds index + 1 or 0
+  std::vector<uint32_t> topic_slots_;
+
+  void unmap() noexcept {
+    if (map_) munmap(map_, map_size_);
+    map_ = nullptr;
+    map_size_ = 0;
+  }
+
+  static bool fail(ConfigError& error, int line, std::string message) {
+    error.line = line;
+    error.message = std::move(message);
+    return false;
+  }
+
+  // isspace() of the "C" locale, without a call per character
+  static bool isSpace(char c) noexcept {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+  }
+
+  static Slice strip(const char* begin, const char* end) noexcept {
+    while (begin < end && isSpace(*begin)) ++begin;
+    while (end > begin && isSpace(end[-1])) --end;
+    return Slice(begin, static_cast<size_t>(end - begin));
+  }
+
+  // A line starting with '#' is a comment, otherwise the comment starts at
+  // the last '#' like the old line reader, so "k=a#b  # note" has value a#b
+  // but "k=a#b" has value a. Returns end if there's no comment.
+  static const char* commentStart(const char* begin, const char* end) noexcept {
+    const char* first = begin;
+    while (first < end && isSpace(*first)) ++first;
+    if (first < end && *first == '#') return first;
+    for (const char* p = end; p > first; --p) {
+      if (p[-1] == '#') return p - 1;
     }
+    return end;
+  }
 
-    size_t pos = line.find('=');
-    if (pos == std::string::npos) {
-      error::Exit("[file: %s] line %d (\"%s\"): can't find '='\n",
-                  filename.data(), num_line, old_line.data());
+  // a section that appears twice keeps one index
+  int topicSection(Slice topic_name) {
+    if (topic_slots_.size() < 2 * (topic_names_.size() + 1)) {
+      topic_slots_.assign(std::max<size_t>(16, 2 * topic_slots_.size()), 0);
+      for (size_t i = 0; i < topic_names_.size(); i++)
+        topic_slots_[findSlot(topic_names_[i])] = static_cast<uint32_t>(i + 1);
     }
+    size_t slot = findSlot(topic_name);
+    if (topic_slots_[slot] == 0) {
+      topic_names_.push_back(topic_name);
+      topic_slots_[slot] = static_cast<uint32_t>(topic_names_.size());
+    }
+    return kFirstTopic + static_cast<int>(topic_slots_[slot] - 1);
+  }
+
+  // slot of topic_name, or the empty slot where it belongs
+  size_t findSlot(Slice topic_name) const noexcept {
+    size_t mask = topic_slots_.size() - 1;
+    size_t slot = murmur2(topic_name.data(), topic_name.size()) & mask;
+    while (topic_slots_[slot] != 0 &&
+           topic_names_[topic_slots_[slot] - 1] != topic_name)
+      slot = (slot + 1) & mask;
+    return slot;
+  }
+
+  // librdkafka needs null-terminated strings, buffer holds "name\0value\0"
+  template <typename T>
+  bool apply(T* conf, int section, std::string& buffer,
+             ConfigError& error) const {
+    char errstr[512];
+    for (auto& entry : entries_) {
+      if (entry.section != section) continue;
+      buffer.assign(entry.name.data(), entry.name.size());
+      buffer.push_back('\0');
+      buffer.append(entry.value.data(), entry.value.size());
+      const char* name = buffer.data();
+      const char* value = buffer.data() + entry.name.size() + 1;
+      if (util::getConfSetFunc(conf)(conf, name, value, errstr,
+                                     sizeof(errstr)) != RD_KAFKA_CONF_OK) {
+        return fail(error, entry.line,
+                    std::string(util::getConfStr(conf)) + " [" + name + "=" +
+                        value + "] error: " + errstr);
+      }
+    }
+    return true;
+  }
+};
 
-    line[pos] = '\0';
-    error::Print("--CONFIG [%s=%s]\n", line.data(), line.data() + pos + 1);
-    if (type == GLOBAL)
-      configs.first.put(line.data(), line.data() + pos + 1);
-    else if (type == TOPIC)
-      configs.second.put(line.data(), line.data() + pos + 1);
-    else
-      error::Exit("Unknown error in line %d\n", num_line);
+// Exits if the file is invalid. If topic_name isn't nullptr, the
+// [topic:<topic_name>] section overrides [topic].
+inline std::pair<GlobalConf, TopicConf> readConfig(
+    const std::string& filename, const char* topic_name = nullptr) {
+  ConfigSet config_set;
+  ConfigError error;
+  if (!config_set.load(filename, error))
+    error::Exit("[file: %s] %s\n", filename.data(), error.toString().data());
+
+  for (auto& entry : config_set.entries()) {
+    error::Print("--CONFIG [%.*s=%.*s]\n", static_cast<int>(entry.name.size()),
+                 entry.name.data(), static_cast<int>(entry.value.size()),
+                 entry.value.data());
   }
 
+  std::pair<GlobalConf, TopicConf> configs;
+  if (!config_set.toGlobalConf(configs.first, error) ||
+      !config_set.toTopicConf(configs.second, topic_name, error))
+    error::Exit("[file: %s] %s\n", filename.data(), error.toString().data());
   return configs;
 }
 
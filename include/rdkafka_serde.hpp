@@ -0,0 +1,287 @@
+// rdkafka_serde.hpp: typed keys and values of produced and consumed messages
+//
+// A serde (serializer/deserializer) is any type with
+//
+//   using Type = ...;                          // what's encoded
+//   static size_t maxSize(const Type& value);  // arena bytes encode() needs
+//   static Slice encode(const Type& value, char* out);
+//   template <typename T>
+//   static bool decode(Slice bytes, T* value);
+//
+// encode() writes at most maxSize(value) bytes to out and returns the encoded
+// bytes, which may be value's own memory if it's already in wire format (a
+// zero-copy codec, maxSize() is 0 then). A codec that copies returns a null
+// Slice if value can't be encoded, e.g. it's too long for its length prefix;
+// a zero-copy codec can't fail, its null Slice is a null key or value.
+// decode() reads a message's key or payload and returns false if it's
+// malformed. A decoded Slice points into the message, so it's valid as long
+// as the message is.
+#pragma once
+
+#include "rdkafka.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "rdkafka_classes.hpp"
+#include "rdkafka_slice.hpp"
+#include "rdkafka_wire.hpp"
+
+namespace rdkafka {
+
+// Fixed-width integer in big-endian (network) byte order, like the INT8 to
+// INT64 types of Kafka's protocol.
+template <typename T>
+struct BigEndianSerde {
+  static_assert(std::is_integral<T>::value, "T must be an integer");
+  using Type = T;
+
+  static constexpr size_t maxSize(T) noexcept { return sizeof(T); }
+
+  static Slice encode(T value, char* out) noexcept {
+    storeBigEndian(value, out);
+    return Slice(out, sizeof(T));
+  }
+
+  static bool decode(Slice bytes, T* value) noexcept {
+    if (bytes.size() != sizeof(T)) return false;
+    *value = loadBigEndian<T>(bytes.data());
+    return true;
+  }
+};
+
+// Bytes as they are, like the Java client's StringSerializer and
+// ByteArraySerializer. Encoding doesn't copy, decoding to Slice doesn't copy
+// either, decoding to std::string does.
+struct RawSerde {
+  using Type = Slice;
+
+  static constexpr size_t maxSize(const Slice&) noexcept { return 0; }
+
+  static Slice encode(const Slice& value, char*) noexcept { return value; }
+
+  template <typename T>
+  static bool decode(Slice bytes, T* value) {
+    *value = T(bytes.data(), bytes.size());
+    return true;
+  }
+};
+
+// Bytes prefixed with their length as a big-endian LengthT, like the STRING
+// (int16_t) and BYTES (int32_t) types of Kafka's protocol. A null Slice is
+// encoded as length -1.
+template <typename LengthT = int32_t>
+struct LengthPrefixedSerde {
+  static_assert(std::is_signed<LengthT>::value, "LengthT must be signed");
+  using Type = Slice;
+  using LengthSerde = BigEndianSerde<LengthT>;
+
+  static size_t maxSize(const Slice& value) noexcept {
+    return sizeof(LengthT) + value.size();
+  }
+
+  // a null Slice if value is longer than LengthT's max
+  static Slice encode(const Slice& value, char* out) noexcept {
+    if (!value.data()) {
+      LengthSerde::encode(-1, out);
+      return Slice(out, sizeof(LengthT));
+    }
+    constexpr auto kMaxLength =
+        static_cast<size_t>(std::numeric_limits<LengthT>::max());
+    if (value.size() > kMaxLength) return Slice();
+    LengthSerde::encode(static_cast<LengthT>(value.size()), out);
+    memcpy(out + sizeof(LengthT), value.data(), value.size());
+    return Slice(out, sizeof(LengthT) + value.size());
+  }
+
+  template <typename T>
+  static bool decode(Slice bytes, T* value) {
+    LengthT length;
+    if (bytes.size() < sizeof(LengthT) ||
+        !LengthSerde::decode(Slice(bytes.data(), sizeof(LengthT)), &length))
+      return false;
+    size_t left = bytes.size() - sizeof(LengthT);
+    if (length == -1 && left == 0) {
+      *value = T();
+      return true;
+    }
+    if (length < 0 || static_cast<size_t>(length) != left) return false;
+    *value = T(bytes.data() + sizeof(LengthT), left);
+    return true;
+  }
+};
+
+namespace detail {
+
+template <typename T, typename Enable = void>
+struct DefaultSerdeOf {
+  using type = RawSerde;  // Slice, std::string and const char*
+};
+
+template <typename T>
+struct DefaultSerdeOf<
+    T, typename std::enable_if<std::is_integral<T>::value>::type> {
+  using type = BigEndianSerde<T>;
+};
+
+}  // namespace detail
+
+// integers are big-endian, strings raw bytes
+template <typename T>
+using DefaultSerde = typename detail::DefaultSerdeOf<T>::type;
+
+// Grow-only buffer that keys and values are encoded into. Each thread has its
+// own, so encoding stops allocating once it has grown to the largest message.
+class SerdeArena {
+ public:
+  char* reserve(size_t size) {
+    if (buffer_.size() < size)
+      buffer_.resize(std::max(size, 2 * buffer_.size()));
+    return buffer_.data();
+  }
+
+  size_t capacity() const noexcept { return buffer_.size(); }
+
+  static SerdeArena& local() {
+    static thread_local SerdeArena arena;
+    return arena;
+  }
+
+ private:
+  std::vector<char> buffer_;
+};
+
+// Produces K and V through producer, e.g.
+//
+//   TypedProducer<int64_t, std::string> typed_producer(producer);
+//   typed_producer.produce(topic, user_id, json);
+//
+// The encoded key and value are copied by librdkafka, whatever
+// Producer::setMsgflags() set. produce() returns MSG_SIZE_TOO_LARGE without
+// producing if the key or value can't be encoded, else produceCopy()'s error.
+template <typename K, typename V, typename KeySerde = DefaultSerde<K>,
+          typename ValueSerde = DefaultSerde<V>>
+class TypedProducer {
+ public:
+  static_assert(std::is_convertible<const K&, typename KeySerde::Type>::value,
+                "KeySerde can't encode K");
+  static_assert(
+      std::is_convertible<const V&, typename ValueSerde::Type>::value,
+      "ValueSerde can't encode V");
+
+  explicit TypedProducer(const Producer& producer) noexcept
+      : producer_(producer) {}
+
+  ErrorCode produce(const Topic& topic, const K& key, const V& value,
+                    void* msg_opaque = nullptr) const {
+    const typename KeySerde::Type& key_ref = key;
+    const typename ValueSerde::Type& value_ref = value;
+    size_t key_size = KeySerde::maxSize(key_ref);
+    size_t value_size = ValueSerde::maxSize(value_ref);
+    char* out = SerdeArena::local().reserve(key_size + value_size);
+    Slice key_bytes = KeySerde::encode(key_ref, out);
+    Slice value_bytes = ValueSerde::encode(value_ref, out + key_size);
+    if (failed(key_bytes, key_size) || failed(value_bytes, value_size))
+      return RD_KAFKA_RESP_ERR_MSG_SIZE_TOO_LARGE;
+    return produceCopy(topic, value_bytes, key_bytes, msg_opaque);
+  }
+
+  // a message without key
+  ErrorCode produce(const Topic& topic, const V& value,
+                    void* msg_opaque = nullptr) const {
+    const typename ValueSerde::Type& value_ref = value;
+    size_t value_size = ValueSerde::maxSize(value_ref);
+    char* out = SerdeArena::local().reserve(value_size);
+    Slice value_bytes = ValueSerde::encode(value_ref, out);
+    if (failed(value_bytes, value_size))
+      return RD_KAFKA_RESP_ERR_MSG_SIZE_TOO_LARGE;
+    return produceCopy(topic, value_bytes, Slice(), msg_opaque);
+  }
+
+  const Producer& producer() const noexcept { return producer_; }
+
+ private:
+  const Producer& producer_;
+
+  // only codecs that copy into the arena can fail
+  static bool failed(const Slice& bytes, size_t max_size) noexcept {
+    return max_size > 0 && !bytes.data();
+  }
+
+  ErrorCode produceCopy(const Topic& topic, Slice value, Slice key,
+                        void* msg_opaque) const noexcept {
+    return producer_.produceCopy(topic, value, key, msg_opaque)
+               ? RD_KAFKA_RESP_ERR_NO_ERROR
+               : rd_kafka_last_error();
+  }
+};
+
+// A consumed message whose key and value are decoded when they're read.
+// MessageT is Message (owning) or MessageView (of a MessageBatch).
+template <typename K, typename V, typename KeySerde, typename ValueSerde,
+          typename MessageT>
+class TypedMessage {
+ public:
+  explicit TypedMessage(MessageT message) noexcept
+      : message_(std::move(message)) {}
+
+  const MessageT& message() const noexcept { return message_; }
+
+  // false if the message has no key or it's malformed
+  bool key(K* key) const {
+    if (!message_.key()) return false;
+    return KeySerde::decode(Slice(message_.key(), message_.keyLen()), key);
+  }
+
+  // false if the value is malformed
+  bool value(V* value) const {
+    return ValueSerde::decode(
+        Slice(message_.payload(), message_.payloadLen()), value);
+  }
+
+ private:
+  MessageT message_;
+};
+
+// Consumes messages of K and V through consumer, e.g.
+//
+//   TypedConsumer<int64_t, Slice> typed_consumer(consumer);
+//   auto message = typed_consumer.consume(1000);
+//   int64_t user_id;
+//   Slice json;  // points into message
+//   if (!message.message().isNull() && !message.message().hasError() &&
+//       message.key(&user_id) && message.value(&json)) { ... }
+template <typename K, typename V, typename KeySerde = DefaultSerde<K>,
+          typename ValueSerde = DefaultSerde<V>>
+class TypedConsumer {
+ public:
+  using MessageType = TypedMessage<K, V, KeySerde, ValueSerde, Message>;
+  using MessageViewType =
+      TypedMessage<K, V, KeySerde, ValueSerde, MessageView>;
+
+  explicit TypedConsumer(const Consumer& consumer) noexcept
+      : consumer_(consumer) {}
+
+  MessageType consume(int timeout_ms) const noexcept {
+    return MessageType(consumer_.consume(timeout_ms));
+  }
+
+  // the i-th message of a batch filled by Consumer::consumeBatch()
+  static MessageViewType at(const MessageBatch& batch, size_t i) noexcept {
+    return MessageViewType(batch[i]);
+  }
+
+  const Consumer& consumer() const noexcept { return consumer_; }
+
+ private:
+  const Consumer& consumer_;
+};
+
+}  // namespace rdkafka
@@ -0,0 +1,51 @@
+// rdkafka_slice.hpp: non-owning view of bytes, like C++17's std::string_view
+#pragma once
+
+#include <string.h>
+
+#include <string>
+
+namespace rdkafka {
+
+class Slice {
+ public:
+  constexpr Slice() noexcept : data_(nullptr), size_(0) {}
+
+  constexpr Slice(const char* data, size_t size) noexcept
+      : data_(data), size_(size) {}
+
+  Slice(const void* data, size_t size) noexcept
+      : data_(static_cast<const char*>(data)), size_(size) {}
+
+  // implicit, so a string literal or std::string can be passed as a Slice
+  Slice(const char* s) noexcept : data_(s), size_(s ? strlen(s) : 0) {}
+
+  Slice(const std::string& s) noexcept : data_(s.data()), size_(s.size()) {}
+
+  const char* data() const noexcept { return data_; }
+
+  size_t size() const noexcept { return size_; }
+
+  bool empty() const noexcept { return size_ == 0; }
+
+  char operator[](size_t i) const noexcept { return data_[i]; }
+
+  const char* begin() const noexcept { return data_; }
+
+  const char* end() const noexcept { return data_ + size_; }
+
+  std::string toString() const { return std::string(data_, size_); }
+
+  bool operator==(const Slice& rhs) const noexcept {
+    return size_ == rhs.size_ &&
+           (size_ == 0 || memcmp(data_, rhs.data_, size_) == 0);
+  }
+
+  bool operator!=(const Slice& rhs) const noexcept { return !(*this == rhs); }
+
+ private:
+  const char* data_;
+  size_t size_;
+};
+
+}  // namespace rdkafka
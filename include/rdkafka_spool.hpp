@@ -0,0 +1,599 @@
+// rdkafka_spool.hpp: spill messages to disk while librdkafka's queue is full
+//
+// When brokers are unreachable, messages pile up in librdkafka's queue until
+// queue.buffering.max.messages (or .kbytes) is reached, then produce() fails
+// with QUEUE_FULL. SpoolingProducer appends such a message to a DiskSpool
+// instead, and every following one until the spool is drained, so the order
+// is kept. poll() replays spooled records in order with produceBatch() calls
+// of as many records as fit in the queue, once delivery reports make room.
+//
+// DiskSpool writes records to segment files whose blocks are allocated when
+// they're created (posix_fallocate()) and mmap()ed, so appending is a
+// memcpy() into the page cache and a full disk fails a segment's creation
+// instead of the memcpy(). A record has a CRC-32C of its content, a record
+// torn by a crash ends its segment when the directory is opened again.
+// Replayed records are flagged in place and a segment is deleted once all of
+// its records are replayed, so a restarted producer only replays what it
+// hadn't enqueued yet. As for any message, enqueued isn't delivered: the
+// delivery report tells.
+#pragma once
+
+#include "rdkafka.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "rdkafka_classes.hpp"
+#include "rdkafka_error.hpp"
+#include "rdkafka_slice.hpp"
+
+namespace rdkafka {
+
+namespace detail {
+
+// CRC-32C (Castagnoli), crc of a previous call continues it
+inline uint32_t crc32c(const char* data, size_t size, uint32_t crc = 0) {
+  using Table = std::array<uint32_t, 256>;
+  static const Table kTable = []() -> Table {
+    Table table;
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++) c = (c & 1) ? 0x82F63B78 ^ (c >> 1) : c >> 1;
+      table[i] = c;
+    }
+    return table;
+  }();
+  crc = ~crc;
+  for (size_t i = 0; i < size; i++)
+    crc = kTable[(crc ^ static_cast<uint8_t>(data[i])) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+}  // namespace detail
+
+struct SpoolOptions {
+  // segment files are created with this size, a record can't be larger
+  size_t segment_bytes = 64 * 1024 * 1024;
+  // of all segment files, appends fail with QUEUE_FULL beyond, 0: no limit
+  size_t max_bytes = size_t(1) << 30;
+  // at most this many records per produceBatch() call when replaying
+  int replay_batch = 1000;
+};
+
+// key or payload with null data is a null key or payload
+struct SpoolRecord {
+  Slice topic;
+  int32_t partition;
+  Slice key;
+  Slice payload;
+};
+
+// Records in append order in the segment files of a directory, not thread
+// safe. A record is a header {content size, CRC-32C of content, flags}, then
+// the content {partition, topic size, key size, payload size, topic, key,
+// payload}, all in host byte order. A zero content size ends a segment.
+class DiskSpool {
+ public:
+  explicit DiskSpool(const SpoolOptions& options = SpoolOptions()) noexcept
+      : options_(options) {}
+
+  ~DiskSpool() { close(); }
+
+  DiskSpool(const DiskSpool&) = delete;
+  DiskSpool& operator=(const DiskSpool&) = delete;
+
+  // Open directory, which must exist, and recover the records a previous
+  // DiskSpool left there. Returns false with error on failure.
+  bool open(const std::string& directory, std::string& error) {
+    close();
+    directory_ = directory;
+    DIR* dir = opendir(directory.data());
+    if (!dir) {
+      error = "opendir \"" + directory + "\" failed: " + strerror(errno);
+      return false;
+    }
+    std::vector<uint64_t> ids;
+    while (auto entry = readdir(dir)) {
+      char* end;
+      uint64_t id = strtoull(entry->d_name, &end, 10);
+      if (end != entry->d_name && strcmp(end, kSuffix) == 0) ids.push_back(id);
+    }
+    closedir(dir);
+    std::sort(ids.begin(), ids.end());
+
+    for (uint64_t id : ids) {
+      next_id_ = id + 1;
+      Segment segment;
+      segment.id = id;
+      if (!map(segment, 0, error)) {
+        close();
+        return false;
+      }
+      recover(segment);
+      if (segment.begin == segment.end) {
+        unmap(segment, true);  // all replayed
+        continue;
+      }
+      if (segments_.empty()) read_offset_ = segment.begin;
+      segments_.push_back(segment);
+    }
+    return true;
+  }
+
+  // unmap the segments, their files are kept for the next open() unless all
+  // records are replayed
+  void close() noexcept {
+    for (auto& segment : segments_) unmap(segment, num_records_ == 0);
+    segments_.clear();
+    read_offset_ = 0;
+    num_records_ = 0;
+  }
+
+  // Returns RD_KAFKA_RESP_ERR__QUEUE_FULL if max_bytes is reached,
+  // RD_KAFKA_RESP_ERR_MSG_SIZE_TOO_LARGE if the record can't fit in a
+  // segment, RD_KAFKA_RESP_ERR__FS if a segment can't be created (see
+  // lastError()).
+  ErrorCode append(const SpoolRecord& record) {
+    size_t content_size = kFixedContentSize + record.topic.size() +
+                          record.key.size() + record.payload.size();
+    size_t record_size = kHeaderSize + content_size;
+    if (record.topic.size() > UINT16_MAX ||
+        record_size > options_.segment_bytes)
+      return RD_KAFKA_RESP_ERR_MSG_SIZE_TOO_LARGE;
+
+    if (segments_.empty() || segments_.back().sealed ||
+        segments_.back().end + record_size > segments_.back().size) {
+      auto error_code = addSegment();
+      if (error_code != RD_KAFKA_RESP_ERR_NO_ERROR) return error_code;
+    }
+
+    auto& segment = segments_.back();
+    char* content = segment.data + segment.end + kHeaderSize;
+    char* p = content;
+    p = put(p, record.partition);
+    p = put(p, static_cast<uint16_t>(record.topic.size()));
+    p = put(p, sizeOf(record.key));
+    p = put(p, sizeOf(record.payload));
+    p = put(p, record.topic);
+    p = put(p, record.key);
+    put(p, record.payload);
+
+    // the size goes last, a record without it isn't there
+    char* header = segment.data + segment.end;
+    put(header + 4, detail::crc32c(content, content_size));
+    put(header + 8, uint32_t(0));
+    put(header, static_cast<uint32_t>(content_size));
+    segment.end += record_size;
+    ++num_records_;
+    return RD_KAFKA_RESP_ERR_NO_ERROR;
+  }
+
+  // Fill records with up to max of the oldest records, fewer at the end of a
+  // segment. Their slices are valid until pop() removes them.
+  size_t peek(SpoolRecord* records, size_t max) const {
+    if (segments_.empty()) return 0;
+    const auto& segment = segments_.front();
+    size_t offset = read_offset_;
+    size_t n = 0;
+    for (; n < max && offset < segment.end; n++) {
+      uint32_t content_size;
+      get(segment.data + offset, content_size);
+      parse(segment.data + offset + kHeaderSize, records[n]);
+      offset += kHeaderSize + content_size;
+    }
+    return n;
+  }
+
+  // remove the n oldest records, at most the count of the last peek()
+  void pop(size_t n) {
+    for (size_t i = 0; i < n && !segments_.empty(); i++) {
+      auto& segment = segments_.front();
+      if (read_offset_ >= segment.end) break;
+      char* header = segment.data + read_offset_;
+      uint32_t content_size;
+      get(header, content_size);
+      put(header + 8, kReplayed);
+      read_offset_ += kHeaderSize + content_size;
+      --num_records_;
+      dropReplayed();
+    }
+  }
+
+  bool empty() const noexcept { return num_records_ == 0; }
+
+  // records not replayed
+  size_t size() const noexcept { return num_records_; }
+
+  size_t numSegments() const noexcept { return segments_.size(); }
+
+  // why the last append() failed with RD_KAFKA_RESP_ERR__FS
+  const std::string& lastError() const noexcept { return last_error_; }
+
+ private:
+  static constexpr const char* kSuffix = ".spool";
+  static constexpr size_t kHeaderSize = 12;
+  static constexpr size_t kFixedContentSize = 14;
+  static constexpr uint32_t kReplayed = 1;
+
+  struct Segment {
+    uint64_t id = 0;
+    char* data = nullptr;
+    size_t size = 0;
+    size_t begin = 0;  // first record not replayed when recovered
+    size_t end = 0;    // after the last record
+    bool sealed = true;
+  };
+
+  const SpoolOptions options_;
+  std::string directory_;
+  std::deque<Segment> segments_;  // oldest first, appended to the last one
+  size_t read_offset_ = 0;        // in the first segment
+  size_t num_records_ = 0;
+  uint64_t next_id_ = 0;
+  std::string last_error_;
+
+  std::string path(uint64_t id) const {
+    char name[32];
+    snprintf(name, sizeof(name), "%020llu%s",
+             static_cast<unsigned long long>(id), kSuffix);
+    return directory_ + "/" + name;
+  }
+
+  // map an existing segment file, or create one of size if size > 0
+  bool map(Segment& segment, size_t size, std::string& error) {
+    auto filename = path(segment.id);
+    int flags = O_RDWR | O_CLOEXEC | (size > 0 ? O_CREAT | O_TRUNC : 0);
+    int fd = ::open(filename.data(), flags, 0644);
+    if (fd == -1) {
+      error = "open \"" + filename + "\" failed: " + strerror(errno);
+      return false;
+    }
+    if (size > 0) {
+      // blocks are reserved, a sparse file would make a full disk SIGBUS the
+      // memcpy() of append() instead of failing here
+      int err = posix_fallocate(fd, 0, static_cast<off_t>(size));
+      if (err != 0) {
+        error = "fallocate \"" + filename + "\" failed: " + strerror(err);
+        ::close(fd);
+        unlink(filename.data());
+        return false;
+      }
+    } else {
+      struct stat st;
+      if (fstat(fd, &st) == -1) {
+        error = "stat \"" + filename + "\" failed: " + strerror(errno);
+        ::close(fd);
+        return false;
+      }
+      size = static_cast<size_t>(st.st_size);
+    }
+
+    void* addr = (size > 0) ? mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                                   MAP_SHARED, fd, 0)
+                            : nullptr;
+    int err = errno;
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+      error = "mmap \"" + filename + "\" failed: " + strerror(err);
+      return false;
+    }
+    segment.data = static_cast<char*>(addr);
+    segment.size = size;
+    return true;
+  }
+
+  void unmap(Segment& segment, bool remove) noexcept {
+    if (segment.data) munmap(segment.data, segment.size);
+    segment.data = nullptr;
+    if (remove) unlink(path(segment.id).data());
+  }
+
+  // find the end of the valid records and the first one not replayed
+  void recover(Segment& segment) {
+    size_t offset = 0;
+    bool replayed_prefix = true;
+    while (offset + kHeaderSize <= segment.size) {
+      const char* header = segment.data + offset;
+      uint32_t content_size, crc, flags;
+      get(header, content_size);
+      get(header + 4, crc);
+      get(header + 8, flags);
+      if (content_size < kFixedContentSize ||
+          offset + kHeaderSize + content_size > segment.size ||
+          detail::crc32c(header + kHeaderSize, content_size) != crc ||
+          !valid(header + kHeaderSize, content_size))
+        break;
+      offset += kHeaderSize + content_size;
+      if (replayed_prefix && flags == kReplayed) {
+        segment.begin = offset;
+      } else {
+        replayed_prefix = false;
+        ++num_records_;
+      }
+    }
+    segment.end = offset;
+  }
+
+  ErrorCode addSegment() {
+    if (options_.max_bytes > 0 &&
+        (segments_.size() + 1) * options_.segment_bytes > options_.max_bytes)
+      return RD_KAFKA_RESP_ERR__QUEUE_FULL;
+    if (!segments_.empty()) {
+      auto& last = segments_.back();
+      last.sealed = true;
+      msync(last.data, last.size, MS_ASYNC);  // start writing it back
+    }
+
+    Segment segment;
+    segment.id = next_id_++;
+    segment.sealed = false;
+    if (!map(segment, options_.segment_bytes, last_error_))
+      return RD_KAFKA_RESP_ERR__FS;
+    if (segments_.empty()) read_offset_ = 0;
+    segments_.push_back(segment);
+    dropReplayed();
+    return RD_KAFKA_RESP_ERR_NO_ERROR;
+  }
+
+  // delete the first segments once sealed and replayed
+  void dropReplayed() {
+    while (!segments_.empty() && segments_.front().sealed &&
+           read_offset_ >= segments_.front().end) {
+      unmap(segments_.front(), true);
+      segments_.pop_front();
+      read_offset_ = segments_.empty() ? 0 : segments_.front().begin;
+    }
+  }
+
+  static int32_t sizeOf(Slice s) noexcept {
+    return s.data() ? static_cast<int32_t>(s.size()) : -1;
+  }
+
+  template <typename T>
+  static char* put(char* p, T value) noexcept {
+    memcpy(p, &value, sizeof(value));
+    return p + sizeof(value);
+  }
+
+  static char* put(char* p, Slice s) noexcept {
+    if (s.size() > 0) memcpy(p, s.data(), s.size());
+    return p + s.size();
+  }
+
+  template <typename T>
+  static const char* get(const char* p, T& value) noexcept {
+    memcpy(&value, p, sizeof(value));
+    return p + sizeof(value);
+  }
+
+  static const char* get(const char* p, int32_t size, Slice& s) noexcept {
+    s = (size < 0) ? Slice() : Slice(p, static_cast<size_t>(size));
+    return p + s.size();
+  }
+
+  // the sizes of a content whose CRC matched add up
+  static bool valid(const char* content, size_t content_size) noexcept {
+    uint16_t topic_size;
+    int32_t key_size, payload_size;
+    get(content + 4, topic_size);
+    get(content + 6, key_size);
+    get(content + 10, payload_size);
+    return key_size >= -1 && payload_size >= -1 &&
+           kFixedContentSize + topic_size + std::max(key_size, 0) +
+                   std::max(payload_size, 0) ==
+               content_size;
+  }
+
+  static void parse(const char* content, SpoolRecord& record) noexcept {
+    uint16_t topic_size;
+    int32_t key_size, payload_size;
+    const char* p = get(content, record.partition);
+    p = get(p, topic_size);
+    p = get(p, key_size);
+    p = get(p, payload_size);
+    record.topic = Slice(p, topic_size);
+    p = get(p + topic_size, key_size, record.key);
+    get(p, payload_size, record.payload);
+  }
+};
+
+// Producer front end spilling to a DiskSpool on QUEUE_FULL, thread safe.
+// While nothing is spooled, produce() costs an atomic load more than
+// Producer::produceCopy(). The producer's backpressure policy isn't applied.
+class SpoolingProducer {
+ public:
+  struct Counts {
+    long spooled = 0;   // records appended to the spool
+    long replayed = 0;  // records enqueued from the spool
+    long dropped = 0;   // records rejected by librdkafka (e.g. too large)
+  };
+
+  // producer isn't owned, it must outlive the SpoolingProducer
+  SpoolingProducer(const Producer& producer,
+                   const SpoolOptions& options = SpoolOptions())
+      : producer_(producer),
+        spool_(options),
+        records_(std::max(options.replay_batch, 1)),
+        messages_(records_.size()) {}
+
+  SpoolingProducer(const SpoolingProducer&) = delete;
+  SpoolingProducer& operator=(const SpoolingProducer&) = delete;
+
+  // Open the spool's directory, the records left there are replayed first.
+  bool open(const std::string& directory, std::string& error) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!spool_.open(directory, error)) return false;
+    spooling_ = !spool_.empty();
+    return true;
+  }
+
+  // Enqueue a copy of the message, or append it to the spool if librdkafka's
+  // queue is full or records are spooled already. The spool's errors are
+  // returned, see DiskSpool::append().
+  ErrorCode produce(const Topic& topic, Slice payload, Slice key = Slice(),
+                    int32_t partition = RD_KAFKA_PARTITION_UA) {
+    if (!spooling_.load(std::memory_order_acquire)) {
+      auto error_code = enqueue(topic, payload, key, partition);
+      if (error_code != RD_KAFKA_RESP_ERR__QUEUE_FULL) return error_code;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto error_code = spool_.append(
+        {Slice(rd_kafka_topic_name(topic.get())), partition, key, payload});
+    if (error_code == RD_KAFKA_RESP_ERR_NO_ERROR) {
+      ++counts_.spooled;
+      spooling_ = true;
+    }
+    return error_code;
+  }
+
+  // Serve delivery reports, then replay spooled records that fit.
+  int poll(int timeout_ms) {
+    int num_events = producer_.poll(timeout_ms);
+    replay();
+    return num_events;
+  }
+
+  // Replay spooled records in order while they fit in librdkafka's queue,
+  // with produceBatch() calls of up to replay_batch records of a topic.
+  // Returns the number of records replayed.
+  size_t replay() {
+    if (!spooling_.load(std::memory_order_acquire)) return 0;
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t num_replayed = 0;
+    bool queue_full = false;
+    while (!queue_full && !spool_.empty()) {
+      size_t n = spool_.peek(records_.data(), records_.size());
+      if (n == 0) break;
+
+      // records are consumed up to the first one rejected with QUEUE_FULL,
+      // rd_kafka_produce_batch() rejects all of the following ones too
+      size_t num_consumed = 0;
+      while (num_consumed < n && !queue_full) {
+        size_t first = num_consumed;
+        size_t last = first + 1;
+        while (last < n && records_[last].topic == records_[first].topic)
+          ++last;
+        int count = produceRun(first, last);
+        for (int i = 0; i < count && !queue_full; i++) {
+          auto error_code = messages_[i].err;
+          if (error_code == RD_KAFKA_RESP_ERR__QUEUE_FULL) {
+            queue_full = true;
+          } else {
+            ++num_consumed;
+            if (error_code == RD_KAFKA_RESP_ERR_NO_ERROR)
+              ++counts_.replayed;
+            else
+              ++counts_.dropped;
+          }
+        }
+      }
+      spool_.pop(num_consumed);
+      num_replayed += num_consumed;
+    }
+    if (spool_.empty()) spooling_ = false;
+    return num_replayed;
+  }
+
+  // Poll and replay until the spool is empty, then flush the producer.
+  // Returns false on timeout.
+  bool flush(int timeout_ms) {
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(timeout_ms);
+    while (true) {
+      replay();
+      auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                           deadline - std::chrono::steady_clock::now())
+                           .count();
+      if (!spooling_) return producer_.flush(static_cast<int>(
+                                 std::max<int64_t>(remaining, 0)));
+      if (remaining <= 0) return false;
+      producer_.poll(static_cast<int>(std::min<int64_t>(remaining, 100)));
+    }
+  }
+
+  bool spooling() const noexcept { return spooling_; }
+
+  // records waiting in the spool
+  size_t numSpooled() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return spool_.size();
+  }
+
+  Counts counts() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return counts_;
+  }
+
+  const Producer& producer() const noexcept { return producer_; }
+
+ private:
+  const Producer& producer_;
+
+  mutable std::mutex mutex_;
+  DiskSpool spool_;
+  std::atomic<bool> spooling_{false};
+  Counts counts_;
+  // replay buffers, reused
+  std::vector<SpoolRecord> records_;
+  std::vector<rd_kafka_message_t> messages_;
+  std::unordered_map<std::string, Topic> topics_;
+
+  ErrorCode enqueue(const Topic& topic, Slice payload, Slice key,
+                    int32_t partition) const noexcept {
+    auto error_code = rd_kafka_producev(
+        producer_.get(), RD_KAFKA_V_RKT(topic.get()),
+        RD_KAFKA_V_PARTITION(partition),
+        RD_KAFKA_V_MSGFLAGS(RD_KAFKA_MSG_F_COPY),
+        RD_KAFKA_V_VALUE(const_cast<char*>(payload.data()), payload.size()),
+        RD_KAFKA_V_KEY(key.data(), key.size()), RD_KAFKA_V_END);
+    producer_.metrics().add(ClientMetrics::Counter::kProduceCalls);
+    producer_.metrics().recordProduce(error_code);
+    return error_code;
+  }
+
+  // enqueue records_[first, last) of one topic, messages_ has their errors
+  int produceRun(size_t first, size_t last) {
+    std::string name = records_[first].topic.toString();
+    auto it = topics_.find(name);
+    if (it == topics_.end()) {
+      Topic topic(producer_.get(), name.data());
+      it = topics_.emplace(name, std::move(topic)).first;
+    }
+
+    int count = static_cast<int>(last - first);
+    for (int i = 0; i < count; i++) {
+      const auto& record = records_[first + i];
+      auto& message = messages_[i];
+      memset(&message, 0, sizeof(message));
+      message.partition = record.partition;
+      message.payload = const_cast<char*>(record.payload.data());
+      message.len = record.payload.size();
+      message.key = const_cast<char*>(record.key.data());
+      message.key_len = record.key.size();
+    }
+    producer_.produceBatch(it->second, messages_.data(), count,
+                           PayloadOwnership::kCopy, true);
+    return count;
+  }
+};
+
+}  // namespace rdkafka
@@ -0,0 +1,146 @@
+// rdkafka_start_offset.hpp: where assigned partitions start consuming
+//
+// StartOffsetPolicy::apply() sets the offsets of the partitions passed to the
+// rebalance callback (or ParallelConsumer::setAssignHandler()) before
+// rd_kafka_assign(), so fetching starts at the chosen offsets instead of
+// starting at the committed ones and seeking afterwards. A partition starts
+// from the committed offset (the default), an offset, the first message at or
+// after a timestamp, or n messages before the end. Timestamps of all
+// partitions are looked up with one rd_kafka_offsets_for_times() call.
+#pragma once
+
+#include "rdkafka.h"
+
+#include <stdint.h>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "rdkafka_classes.hpp"
+
+namespace rdkafka {
+
+class StartOffset {
+ public:
+  enum class Kind { kCommitted, kOffset, kTimestamp, kLatest };
+
+  // the committed offset, or auto.offset.reset if there's none
+  static StartOffset committed() noexcept {
+    return StartOffset(Kind::kCommitted, RD_KAFKA_OFFSET_INVALID);
+  }
+
+  // an offset or a logical one like RD_KAFKA_OFFSET_BEGINNING
+  static StartOffset offset(int64_t offset) noexcept {
+    return StartOffset(Kind::kOffset, offset);
+  }
+
+  // the first message whose timestamp is at or after timestamp_ms, the end if
+  // there's none
+  static StartOffset timestamp(int64_t timestamp_ms) noexcept {
+    return StartOffset(Kind::kTimestamp, timestamp_ms);
+  }
+
+  // n messages before the end, the beginning if there are fewer
+  static StartOffset latest(int64_t n) noexcept {
+    return StartOffset(Kind::kLatest, n);
+  }
+
+  Kind kind() const noexcept { return kind_; }
+  int64_t value() const noexcept { return value_; }
+
+ private:
+  Kind kind_;
+  int64_t value_;
+
+  StartOffset(Kind kind, int64_t value) noexcept : kind_(kind), value_(value) {}
+};
+
+// Not thread safe, configure it before the consumer subscribes.
+class StartOffsetPolicy {
+ public:
+  // decides for partitions without a per-partition or per-topic offset
+  using Rule = std::function<StartOffset(const char* topic, int32_t partition)>;
+
+  explicit StartOffsetPolicy(StartOffset offset = StartOffset::committed())
+      : default_(offset) {}
+
+  explicit StartOffsetPolicy(Rule rule)
+      : default_(StartOffset::committed()), rule_(std::move(rule)) {}
+
+  void set(const std::string& topic, StartOffset offset) {
+    topics_.erase(topic);
+    topics_.emplace(topic, offset);
+  }
+
+  void set(const std::string& topic, int32_t partition, StartOffset offset) {
+    auto key = std::make_pair(topic, partition);
+    partitions_.erase(key);
+    partitions_.emplace(key, offset);
+  }
+
+  StartOffset get(const char* topic, int32_t partition) const {
+    auto it = partitions_.find(std::make_pair(std::string(topic), partition));
+    if (it != partitions_.end()) return it->second;
+    auto topic_it = topics_.find(topic);
+    if (topic_it != topics_.end()) return topic_it->second;
+    return rule_ ? rule_(topic, partition) : default_;
+  }
+
+  // Set the offsets of partitions, waiting at most timeout_ms for timestamp
+  // lookups. Partitions whose lookup failed start from the committed offset
+  // and the first error is returned.
+  ErrorCode apply(rd_kafka_t* rk, rd_kafka_topic_partition_list_t* partitions,
+                  int timeout_ms) const {
+    PointerHolder<rd_kafka_topic_partition_list_t> timestamps(
+        rd_kafka_topic_partition_list_new(0));
+    std::vector<int> indexes;  // of partitions in timestamps
+    for (int i = 0; i < partitions->cnt; i++) {
+      auto& elem = partitions->elems[i];
+      auto start = get(elem.topic, elem.partition);
+      switch (start.kind()) {
+        case StartOffset::Kind::kCommitted:
+        case StartOffset::Kind::kOffset:
+          elem.offset = start.value();
+          break;
+        case StartOffset::Kind::kLatest:
+          elem.offset = start.value() > 0 ? RD_KAFKA_OFFSET_TAIL(start.value())
+                                          : RD_KAFKA_OFFSET_END;
+          break;
+        case StartOffset::Kind::kTimestamp:
+          elem.offset = RD_KAFKA_OFFSET_INVALID;
+          rd_kafka_topic_partition_list_add(timestamps.get(), elem.topic,
+                                            elem.partition)
+              ->offset = start.value();
+          indexes.push_back(i);
+          break;
+      }
+    }
+    if (indexes.empty()) return RD_KAFKA_RESP_ERR_NO_ERROR;
+
+    auto error_code =
+        rd_kafka_offsets_for_times(rk, timestamps.get(), timeout_ms);
+    if (error_code != RD_KAFKA_RESP_ERR_NO_ERROR) return error_code;
+    for (size_t i = 0; i < indexes.size(); i++) {
+      const auto& found = timestamps.get()->elems[i];
+      auto& elem = partitions->elems[indexes[i]];
+      if (found.err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+        if (error_code == RD_KAFKA_RESP_ERR_NO_ERROR) error_code = found.err;
+        continue;
+      }
+      // -1: every message is older
+      elem.offset = found.offset >= 0 ? found.offset : RD_KAFKA_OFFSET_END;
+    }
+    return error_code;
+  }
+
+ private:
+  StartOffset default_;
+  Rule rule_;
+  std::map<std::string, StartOffset> topics_;
+  std::map<std::pair<std::string, int32_t>, StartOffset> partitions_;
+};
+
+}  // namespace rdkafka
@@ -0,0 +1,637 @@
+// rdkafka_stats.hpp: typed snapshots of librdkafka's statistics JSON
+//
+// Set "statistics.interval.ms" and GlobalConf::setStatsCallback(), then call
+// StatsSnapshot::parse() on the JSON passed to the callback. The parser reads
+// fields in place and parse() reuses the snapshot's storage, so a snapshot
+// kept between callbacks only allocates when a broker, topic or partition
+// shows up for the first time. StatsRates turns two snapshots into rates.
+//
+// See https://github.com/edenhill/librdkafka/blob/master/STATISTICS.md for
+// the meaning of each field. Counters are cumulative since the client started.
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "rdkafka_slice.hpp"
+
+namespace rdkafka {
+
+// rolling window of latencies (microseconds) or sizes, e.g. a broker's rtt
+struct WindowStats {
+  int64_t min = 0;
+  int64_t max = 0;
+  int64_t avg = 0;
+  int64_t sum = 0;
+  int64_t stddev = 0;
+  int64_t p50 = 0;
+  int64_t p75 = 0;
+  int64_t p90 = 0;
+  int64_t p95 = 0;
+  int64_t p99 = 0;
+  int64_t p99_99 = 0;
+  int64_t outofrange = 0;
+  int64_t cnt = 0;
+};
+
+struct PartitionStats {
+  int64_t partition = -1;  // -1 is the internal unassigned partition
+  int64_t leader = -1;
+  int64_t msgq_cnt = 0;
+  int64_t msgq_bytes = 0;
+  int64_t xmit_msgq_cnt = 0;
+  int64_t xmit_msgq_bytes = 0;
+  int64_t fetchq_cnt = 0;
+  int64_t fetchq_size = 0;
+  int64_t app_offset = -1;
+  int64_t committed_offset = -1;
+  int64_t lo_offset = -1;
+  int64_t hi_offset = -1;
+  int64_t ls_offset = -1;
+  int64_t consumer_lag = -1;
+  int64_t txmsgs = 0;
+  int64_t txbytes = 0;
+  int64_t rxmsgs = 0;
+  int64_t rxbytes = 0;
+  int64_t msgs = 0;
+  int64_t rx_ver_drops = 0;
+  int64_t msgs_inflight = 0;
+};
+
+struct TopicStats {
+  std::string name;
+  int64_t metadata_age = 0;
+  WindowStats batchsize;
+  WindowStats batchcnt;
+  std::vector<PartitionStats> partitions;
+};
+
+struct BrokerStats {
+  std::string name;  // "host:port/nodeid", or a logical name
+  std::string state;
+  int64_t nodeid = -1;
+  int64_t stateage = 0;
+  int64_t outbuf_cnt = 0;
+  int64_t outbuf_msg_cnt = 0;
+  int64_t waitresp_cnt = 0;
+  int64_t waitresp_msg_cnt = 0;
+  int64_t tx = 0;
+  int64_t txbytes = 0;
+  int64_t txerrs = 0;
+  int64_t txretries = 0;
+  int64_t req_timeouts = 0;
+  int64_t rx = 0;
+  int64_t rxbytes = 0;
+  int64_t rxerrs = 0;
+  int64_t connects = 0;
+  int64_t disconnects = 0;
+  WindowStats int_latency;
+  WindowStats outbuf_latency;
+  WindowStats rtt;
+  WindowStats throttle;
+};
+
+namespace detail {
+
+// reads a JSON document in place, strings are returned as raw slices (escape
+// sequences are kept) and numbers are truncated to integers
+class JsonReader {
+ public:
+  JsonReader(const char* data, size_t size) noexcept
+      : p_(data), end_(data + size) {}
+
+  bool ok() const noexcept { return ok_; }
+
+  bool beginObject() noexcept { return expect('{'); }
+
+  // read the next key of the current object and the ':' after it,
+  // returns false at the end of the object or on error
+  bool nextKey(Slice& key) noexcept {
+    skipSpace();
+    if (p_ < end_ && *p_ == '}') {
+      ++p_;
+      return false;
+    }
+    if (p_ < end_ && *p_ == ',') {
+      ++p_;
+      skipSpace();
+    }
+    return readString(key) && expect(':');
+  }
+
+  bool readString(Slice& value) noexcept {
+    if (!expect('"')) return false;
+    const char* begin = p_;
+    while (p_ < end_ && *p_ != '"') p_ += (*p_ == '\\') ? 2 : 1;
+    if (p_ >= end_) return fail();
+    value = Slice(begin, p_ - begin);
+    ++p_;
+    return true;
+  }
+
+  bool readInt(int64_t& value) noexcept {
+    skipSpace();
+    bool negative = (p_ < end_ && *p_ == '-');
+    if (negative) ++p_;
+    if (p_ >= end_ || *p_ < '0' || *p_ > '9') return skipValue();
+
+    value = 0;
+    while (p_ < end_ && *p_ >= '0' && *p_ <= '9')
+      value = value * 10 + (*p_++ - '0');
+    if (negative) value = -value;
+    // fraction and exponent
+    while (p_ < end_ && (*p_ == '.' || *p_ == 'e' || *p_ == 'E' ||
+                         *p_ == '+' || *p_ == '-' ||
+                         (*p_ >= '0' && *p_ <= '9')))
+      ++p_;
+    return true;
+  }
+
+  bool skipValue() noexcept {
+    skipSpace();
+    if (p_ >= end_) return fail();
+    if (*p_ == '"') {
+      Slice ignored;
+      return readString(ignored);
+    }
+    if (*p_ != '{' && *p_ != '[') {
+      // number, true, false or null
+      while (p_ < end_ && *p_ != ',' && *p_ != '}' && *p_ != ']' &&
+             !isSpace(*p_))
+        ++p_;
+      return true;
+    }
+
+    int depth = 0;
+    while (p_ < end_) {
+      char c = *p_;
+      if (c == '"') {
+        Slice ignored;
+        if (!readString(ignored)) return false;
+        continue;
+      }
+      ++p_;
+      if (c == '{' || c == '[') {
+        ++depth;
+      } else if ((c == '}' || c == ']') && --depth == 0) {
+        return true;
+      }
+    }
+    return fail();
+  }
+
+ private:
+  const char* p_;
+  const char* end_;
+  bool ok_ = true;
+
+  static bool isSpace(char c) noexcept {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+  }
+
+  void skipSpace() noexcept {
+    while (p_ < end_ && isSpace(*p_)) ++p_;
+  }
+
+  bool expect(char c) noexcept {
+    skipSpace();
+    if (p_ >= end_ || *p_ != c) return fail();
+    ++p_;
+    return true;
+  }
+
+  bool fail() noexcept {
+    ok_ = false;
+    p_ = end_;  // following reads fail too
+    return false;
+  }
+};
+
+template <typename T>
+struct IntField {
+  const char* name;
+  int64_t T::*member;
+};
+
+// read value into the field named key, returns false if there's no such field
+template <typename T, size_t N>
+inline bool readIntField(JsonReader& reader, const IntField<T> (&fields)[N],
+                         Slice key, T& object) noexcept {
+  for (const auto& field : fields) {
+    if (key == field.name) {
+      reader.readInt(object.*field.member);
+      return true;
+    }
+  }
+  return false;
+}
+
+inline void parseWindow(JsonReader& reader, WindowStats& window) noexcept {
+  static const IntField<WindowStats> kFields[] = {
+      {"min", &WindowStats::min},
+      {"max", &WindowStats::max},
+      {"avg", &WindowStats::avg},
+      {"sum", &WindowStats::sum},
+      {"stddev", &WindowStats::stddev},
+      {"p50", &WindowStats::p50},
+      {"p75", &WindowStats::p75},
+      {"p90", &WindowStats::p90},
+      {"p95", &WindowStats::p95},
+      {"p99", &WindowStats::p99},
+      {"p99_99", &WindowStats::p99_99},
+      {"outofrange", &WindowStats::outofrange},
+      {"cnt", &WindowStats::cnt},
+  };
+  if (!reader.beginObject()) return;
+  Slice key;
+  while (reader.nextKey(key)) {
+    if (!readIntField(reader, kFields, key, window)) reader.skipValue();
+  }
+}
+
+// move the members that own storage, emptied: a key missing from the next
+// document must not keep its previous value
+inline void takeStorage(PartitionStats&, PartitionStats&) noexcept {}
+
+inline void takeStorage(TopicStats& from, TopicStats& to) noexcept {
+  to.name.swap(from.name);
+  to.name.clear();
+  to.partitions.swap(from.partitions);
+  to.partitions.clear();
+}
+
+inline void takeStorage(BrokerStats& from, BrokerStats& to) noexcept {
+  to.name.swap(from.name);
+  to.name.clear();
+  to.state.swap(from.state);
+  to.state.clear();
+}
+
+// Returns the n-th element of entries with its fields reset, appended if
+// entries is too short. Strings and vectors keep their storage for reuse.
+template <typename T>
+inline T& recycle(std::vector<T>& entries, size_t n) {
+  if (n == entries.size()) {
+    entries.emplace_back();
+  } else {
+    T& entry = entries[n];
+    T fresh;
+    takeStorage(entry, fresh);
+    entry = std::move(fresh);
+  }
+  return entries[n];
+}
+
+inline void assign(std::string& s, Slice value) {
+  s.assign(value.data(), value.size());
+}
+
+// find the entry named name, entries usually keep their order between
+// snapshots so the hint index is tried first
+template <typename T>
+inline const T* findByName(const std::vector<T>& entries,
+                           const std::string& name, size_t hint) noexcept {
+  if (hint < entries.size() && entries[hint].name == name)
+    return &entries[hint];
+  for (const auto& entry : entries) {
+    if (entry.name == name) return &entry;
+  }
+  return nullptr;
+}
+
+}  // namespace detail
+
+struct StatsSnapshot {
+  std::string name;  // client instance name, e.g. "rdkafka#producer-1"
+  std::string type;  // "producer" or "consumer"
+  int64_t ts = 0;    // monotonic clock in microseconds
+  int64_t time = 0;  // wall clock in seconds
+  int64_t age = 0;
+  int64_t replyq = 0;
+  int64_t msg_cnt = 0;
+  int64_t msg_size = 0;
+  int64_t msg_max = 0;
+  int64_t msg_size_max = 0;
+  int64_t tx = 0;
+  int64_t tx_bytes = 0;
+  int64_t rx = 0;
+  int64_t rx_bytes = 0;
+  int64_t txmsgs = 0;
+  int64_t txmsg_bytes = 0;
+  int64_t rxmsgs = 0;
+  int64_t rxmsg_bytes = 0;
+  std::vector<BrokerStats> brokers;
+  std::vector<TopicStats> topics;
+
+  // Parse the JSON passed to the stats callback, overwriting this snapshot.
+  // Returns false if json is malformed, the snapshot is then incomplete.
+  bool parse(const char* json, size_t len) {
+    static const detail::IntField<StatsSnapshot> kFields[] = {
+        {"ts", &StatsSnapshot::ts},
+        {"time", &StatsSnapshot::time},
+        {"age", &StatsSnapshot::age},
+        {"replyq", &StatsSnapshot::replyq},
+        {"msg_cnt", &StatsSnapshot::msg_cnt},
+        {"msg_size", &StatsSnapshot::msg_size},
+        {"msg_max", &StatsSnapshot::msg_max},
+        {"msg_size_max", &StatsSnapshot::msg_size_max},
+        {"tx", &StatsSnapshot::tx},
+        {"tx_bytes", &StatsSnapshot::tx_bytes},
+        {"rx", &StatsSnapshot::rx},
+        {"rx_bytes", &StatsSnapshot::rx_bytes},
+        {"txmsgs", &StatsSnapshot::txmsgs},
+        {"txmsg_bytes", &StatsSnapshot::txmsg_bytes},
+        {"rxmsgs", &StatsSnapshot::rxmsgs},
+        {"rxmsg_bytes", &StatsSnapshot::rxmsg_bytes},
+    };
+
+    // reset the fields but keep the storage
+    StatsSnapshot fresh;
+    fresh.name.swap(name);
+    fresh.type.swap(type);
+    fresh.brokers.swap(brokers);
+    fresh.topics.swap(topics);
+    *this = std::move(fresh);
+
+    detail::JsonReader reader(json, len);
+    size_t num_brokers = 0;
+    size_t num_topics = 0;
+    if (reader.beginObject()) {
+      Slice key;
+      Slice value;
+      while (reader.nextKey(key)) {
+        if (key == "brokers") {
+          num_brokers = parseBrokers(reader);
+        } else if (key == "topics") {
+          num_topics = parseTopics(reader);
+        } else if (key == "name" && reader.readString(value)) {
+          detail::assign(name, value);
+        } else if (key == "type" && reader.readString(value)) {
+          detail::assign(type, value);
+        } else if (!detail::readIntField(reader, kFields, key, *this)) {
+          reader.skipValue();
+        }
+      }
+    }
+    brokers.resize(num_brokers);
+    topics.resize(num_topics);
+    return reader.ok();
+  }
+
+  const BrokerStats* findBroker(const std::string& broker_name) const
+      noexcept {
+    return detail::findByName(brokers, broker_name, 0);
+  }
+
+  const TopicStats* findTopic(const std::string& topic_name) const noexcept {
+    return detail::findByName(topics, topic_name, 0);
+  }
+
+ private:
+  size_t parseBrokers(detail::JsonReader& reader) {
+    static const detail::IntField<BrokerStats> kFields[] = {
+        {"nodeid", &BrokerStats::nodeid},
+        {"stateage", &BrokerStats::stateage},
+        {"outbuf_cnt", &BrokerStats::outbuf_cnt},
+        {"outbuf_msg_cnt", &BrokerStats::outbuf_msg_cnt},
+        {"waitresp_cnt", &BrokerStats::waitresp_cnt},
+        {"waitresp_msg_cnt", &BrokerStats::waitresp_msg_cnt},
+        {"tx", &BrokerStats::tx},
+        {"txbytes", &BrokerStats::txbytes},
+        {"txerrs", &BrokerStats::txerrs},
+        {"txretries", &BrokerStats::txretries},
+        {"req_timeouts", &BrokerStats::req_timeouts},
+        {"rx", &BrokerStats::rx},
+        {"rxbytes", &BrokerStats::rxbytes},
+        {"rxerrs", &BrokerStats::rxerrs},
+        {"connects", &BrokerStats::connects},
+        {"disconnects", &BrokerStats::disconnects},
+    };
+
+    size_t n = 0;
+    if (!reader.beginObject()) return n;
+    Slice broker_name;
+    while (reader.nextKey(broker_name)) {
+      BrokerStats& broker = detail::recycle(brokers, n++);
+      detail::assign(broker.name, broker_name);
+      if (!reader.beginObject()) break;
+
+      Slice key;
+      Slice value;
+      while (reader.nextKey(key)) {
+        if (key == "state" && reader.readString(value)) {
+          detail::assign(broker.state, value);
+        } else if (key == "int_latency") {
+          detail::parseWindow(reader, broker.int_latency);
+        } else if (key == "outbuf_latency") {
+          detail::parseWindow(reader, broker.outbuf_latency);
+        } else if (key == "rtt") {
+          detail::parseWindow(reader, broker.rtt);
+        } else if (key == "throttle") {
+          detail::parseWindow(reader, broker.throttle);
+        } else if (!detail::readIntField(reader, kFields, key, broker)) {
+          reader.skipValue();
+        }
+      }
+    }
+    return n;
+  }
+
+  size_t parseTopics(detail::JsonReader& reader) {
+    size_t n = 0;
+    if (!reader.beginObject()) return n;
+    Slice topic_name;
+    while (reader.nextKey(topic_name)) {
+      TopicStats& topic = detail::recycle(topics, n++);
+      detail::assign(topic.name, topic_name);
+      if (!reader.beginObject()) break;
+
+      Slice key;
+      while (reader.nextKey(key)) {
+        if (key == "metadata_age") {
+          reader.readInt(topic.metadata_age);
+        } else if (key == "batchsize") {
+          detail::parseWindow(reader, topic.batchsize);
+        } else if (key == "batchcnt") {
+          detail::parseWindow(reader, topic.batchcnt);
+        } else if (key == "partitions") {
+          topic.partitions.resize(parsePartitions(reader, topic.partitions));
+        } else {
+          reader.skipValue();
+        }
+      }
+    }
+    return n;
+  }
+
+  static size_t parsePartitions(detail::JsonReader& reader,
+                                std::vector<PartitionStats>& partitions) {
+    static const detail::IntField<PartitionStats> kFields[] = {
+        {"partition", &PartitionStats::partition},
+        {"leader", &PartitionStats::leader},
+        {"msgq_cnt", &PartitionStats::msgq_cnt},
+        {"msgq_bytes", &PartitionStats::msgq_bytes},
+        {"xmit_msgq_cnt", &PartitionStats::xmit_msgq_cnt},
+        {"xmit_msgq_bytes", &PartitionStats::xmit_msgq_bytes},
+        {"fetchq_cnt", &PartitionStats::fetchq_cnt},
+        {"fetchq_size", &PartitionStats::fetchq_size},
+        {"app_offset", &PartitionStats::app_offset},
+        {"committed_offset", &PartitionStats::committed_offset},
+        {"lo_offset", &PartitionStats::lo_offset},
+        {"hi_offset", &PartitionStats::hi_offset},
+        {"ls_offset", &PartitionStats::ls_offset},
+        {"consumer_lag", &PartitionStats::consumer_lag},
+        {"txmsgs", &PartitionStats::txmsgs},
+        {"txbytes", &PartitionStats::txbytes},
+        {"rxmsgs", &PartitionStats::rxmsgs},
+        {"rxbytes", &PartitionStats::rxbytes},
+        {"msgs", &PartitionStats::msgs},
+        {"rx_ver_drops", &PartitionStats::rx_ver_drops},
+        {"msgs_inflight", &PartitionStats::msgs_inflight},
+    };
+
+    size_t n = 0;
+    if (!reader.beginObject()) return n;
+    Slice partition_id;
+    while (reader.nextKey(partition_id)) {
+      PartitionStats& partition = detail::recycle(partitions, n++);
+      if (!reader.beginObject()) break;
+
+      Slice key;
+      while (reader.nextKey(key)) {
+        if (!detail::readIntField(reader, kFields, key, partition))
+          reader.skipValue();
+      }
+    }
+    return n;
+  }
+};
+
+// Per second rates of the counters between two snapshots of the same client,
+// e.g. to export to a metrics system. Brokers and partitions that are missing
+// from the older snapshot are compared to zero.
+struct StatsRates {
+  struct Broker {
+    std::string name;
+    double tx = 0;
+    double txbytes = 0;
+    double txerrs = 0;
+    double txretries = 0;
+    double req_timeouts = 0;
+    double rx = 0;
+    double rxbytes = 0;
+    double rxerrs = 0;
+    double connects = 0;
+    double disconnects = 0;
+  };
+
+  struct Partition {
+    std::string topic;
+    int64_t partition = -1;
+    double txmsgs = 0;
+    double txbytes = 0;
+    double rxmsgs = 0;
+    double rxbytes = 0;
+  };
+
+  double seconds = 0;  // time between the snapshots
+  double tx = 0;
+  double tx_bytes = 0;
+  double rx = 0;
+  double rx_bytes = 0;
+  double txmsgs = 0;
+  double txmsg_bytes = 0;
+  double rxmsgs = 0;
+  double rxmsg_bytes = 0;
+  std::vector<Broker> brokers;
+  std::vector<Partition> partitions;
+
+  // Returns false if prev isn't older than cur, the rates are then left empty.
+  // Like StatsSnapshot::parse(), reusing a StatsRates doesn't allocate.
+  bool compute(const StatsSnapshot& prev, const StatsSnapshot& cur) {
+    seconds = (cur.ts - prev.ts) / 1e6;
+    if (cur.ts <= prev.ts) {
+      brokers.clear();
+      partitions.clear();
+      return false;
+    }
+
+    tx = rate(prev.tx, cur.tx);
+    tx_bytes = rate(prev.tx_bytes, cur.tx_bytes);
+    rx = rate(prev.rx, cur.rx);
+    rx_bytes = rate(prev.rx_bytes, cur.rx_bytes);
+    txmsgs = rate(prev.txmsgs, cur.txmsgs);
+    txmsg_bytes = rate(prev.txmsg_bytes, cur.txmsg_bytes);
+    rxmsgs = rate(prev.rxmsgs, cur.rxmsgs);
+    rxmsg_bytes = rate(prev.rxmsg_bytes, cur.rxmsg_bytes);
+
+    const BrokerStats kNoBroker;
+    brokers.resize(cur.brokers.size());
+    for (size_t i = 0; i < cur.brokers.size(); i++) {
+      const BrokerStats& to = cur.brokers[i];
+      const BrokerStats* from = detail::findByName(prev.brokers, to.name, i);
+      if (!from) from = &kNoBroker;
+
+      Broker& broker = brokers[i];
+      broker.name = to.name;
+      broker.tx = rate(from->tx, to.tx);
+      broker.txbytes = rate(from->txbytes, to.txbytes);
+      broker.txerrs = rate(from->txerrs, to.txerrs);
+      broker.txretries = rate(from->txretries, to.txretries);
+      broker.req_timeouts = rate(from->req_timeouts, to.req_timeouts);
+      broker.rx = rate(from->rx, to.rx);
+      broker.rxbytes = rate(from->rxbytes, to.rxbytes);
+      broker.rxerrs = rate(from->rxerrs, to.rxerrs);
+      broker.connects = rate(from->connects, to.connects);
+      broker.disconnects = rate(from->disconnects, to.disconnects);
+    }
+
+    const PartitionStats kNoPartition;
+    size_t num_partitions = 0;
+    for (size_t i = 0; i < cur.topics.size(); i++) {
+      const TopicStats& topic = cur.topics[i];
+      const TopicStats* prev_topic =
+          detail::findByName(prev.topics, topic.name, i);
+
+      for (size_t j = 0; j < topic.partitions.size(); j++) {
+        const PartitionStats& to = topic.partitions[j];
+        const PartitionStats* from =
+            prev_topic ? findPartition(*prev_topic, to.partition, j) : nullptr;
+        if (!from) from = &kNoPartition;
+
+        if (num_partitions == partitions.size()) partitions.emplace_back();
+        Partition& partition = partitions[num_partitions++];
+        partition.topic = topic.name;
+        partition.partition = to.partition;
+        partition.txmsgs = rate(from->txmsgs, to.txmsgs);
+        partition.txbytes = rate(from->txbytes, to.txbytes);
+        partition.rxmsgs = rate(from->rxmsgs, to.rxmsgs);
+        partition.rxbytes = rate(from->rxbytes, to.rxbytes);
+      }
+    }
+    partitions.resize(num_partitions);
+    return true;
+  }
+
+ private:
+  // a counter that went backwards was reset, e.g. the broker was recreated
+  double rate(int64_t from, int64_t to) const noexcept {
+    return (to >= from) ? (to - from) / seconds : to / seconds;
+  }
+
+  static const PartitionStats* findPartition(const TopicStats& topic,
+                                             int64_t partition,
+                                             size_t hint) noexcept {
+    if (hint < topic.partitions.size() &&
+        topic.partitions[hint].partition == partition)
+      return &topic.partitions[hint];
+    for (const auto& entry : topic.partitions) {
+      if (entry.partition == partition) return &entry;
+    }
+    return nullptr;
+  }
+};
+
+}  // namespace rdkafka
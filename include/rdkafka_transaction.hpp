@@ -0,0 +1,259 @@
+// rdkafka_transaction.hpp: exactly-once consume-transform-produce
+//
+// TransactionalProducer produces the output of many input messages in one
+// transaction, together with the input offsets (send_offsets_to_transaction),
+// so the outputs and the consumer group's progress are committed atomically.
+// A transaction costs a few round trips to the transaction coordinator
+// (AddPartitionsToTxn, AddOffsetsToTxn, TxnOffsetCommit, EndTxn) plus the
+// flush of its messages, so committing every max_records records, max_bytes
+// bytes or max_duration, whichever comes first, amortizes that cost. A due
+// transaction is only committed between inputs, by consumed() and poll(), so
+// the outputs of one input are never split between two transactions.
+//
+// On an abortable error the transaction is aborted and the consumer is
+// rewound to the first input offset of each partition of the transaction,
+// so the inputs are processed again. A fatal error (e.g. the producer was
+// fenced by another instance with the same transactional.id) means the
+// producer must be recreated.
+//
+// NOTE: the producer's config must set transactional.id, the consumer's
+//       config should set isolation.level=read_committed (the default) and
+//       enable.auto.commit=false.
+#pragma once
+
+#include "rdkafka.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "rdkafka_classes.hpp"
+
+namespace rdkafka {
+
+struct TransactionOptions {
+  // commit once a transaction has this many records
+  long max_records = 10000;
+  // or this many bytes of keys and payloads
+  size_t max_bytes = 16 * 1024 * 1024;
+  // or has been open this long, checked by consumed() and poll()
+  std::chrono::milliseconds max_duration{100};
+  // of init(), commit() and abort(), they block
+  int timeout_ms = 60000;
+};
+
+class TransactionalProducer final {
+ public:
+  struct Counts {
+    long committed = 0;  // transactions
+    long aborted = 0;
+    long records = 0;  // records of committed transactions
+  };
+
+  // producer and consumer (the input of the transformation, may be null) are
+  // not owned. producer must not be used to produce directly.
+  TransactionalProducer(const Producer& producer, rd_kafka_t* consumer,
+                        TransactionOptions options = TransactionOptions())
+      : producer_(producer), consumer_(consumer), options_(options) {}
+
+  TransactionalProducer(const TransactionalProducer&) = delete;
+  TransactionalProducer& operator=(const TransactionalProducer&) = delete;
+
+  // Register the transactional.id, fencing older instances with the same id,
+  // and wait until their transactions are done. Must be called first.
+  KafkaError init() {
+    return KafkaError(
+        rd_kafka_init_transactions(producer_.get(), options_.timeout_ms));
+  }
+
+  // Produce a record in the current transaction, which is begun if none is
+  // open. The payload and key are copied. Returns the error of beginning the
+  // transaction or of enqueuing the record, errors of delivery fail the
+  // commit. Never commits, even if the transaction is due.
+  ErrorCode produce(const Topic& topic, Slice payload, Slice key = Slice()) {
+    KafkaError error = begin();
+    if (!error.isNull()) return error.code();
+    if (!producer_.produceCopy(topic, payload, key))
+      return rd_kafka_last_error();
+    ++num_records_;
+    num_bytes_ += payload.size() + key.size();
+    return RD_KAFKA_RESP_ERR_NO_ERROR;
+  }
+
+  // The input message was transformed, its offset is committed with the
+  // transaction. Must be called after the outputs of message are produced.
+  // Commits if the transaction is due and returns commit()'s error.
+  template <typename T>
+  KafkaError consumed(const MessageAccessor<T>& message) {
+    return consumed(message.topicName(), message.partition(),
+                    message.offset());
+  }
+
+  KafkaError consumed(const char* topic, int32_t partition, int64_t offset) {
+    KafkaError error = begin();
+    if (!error.isNull()) return error;
+    auto input = findInput(topic, partition);
+    if (!input) {
+      inputs_.push_back({topic, partition, offset, offset + 1});
+    } else {
+      if (input->first < 0) input->first = offset;
+      input->next = offset + 1;
+    }
+    if (isDue()) return commit();
+    return KafkaError();
+  }
+
+  // Serve delivery reports and commit if the open transaction is due. Call
+  // it between inputs, not between the outputs of one input.
+  KafkaError poll() {
+    producer_.poll(0);
+    if (in_transaction_ && isDue()) return commit();
+    return KafkaError();
+  }
+
+  // Commit the open transaction, if any. A retriable error is retried, an
+  // abortable one aborts the transaction (and rewinds the consumer), the
+  // error is returned in both cases.
+  KafkaError commit() {
+    if (!in_transaction_) return KafkaError();
+    KafkaError error = sendOffsets();
+    for (int retry = 0; error.isRetriable() && retry < kMaxRetries; retry++)
+      error = sendOffsets();
+    if (error.isNull()) {
+      error.reset(
+          rd_kafka_commit_transaction(producer_.get(), options_.timeout_ms));
+      for (int retry = 0; error.isRetriable() && retry < kMaxRetries;
+           retry++) {
+        error.reset(
+            rd_kafka_commit_transaction(producer_.get(), options_.timeout_ms));
+      }
+    }
+
+    if (error.isNull()) {
+      ++counts_.committed;
+      counts_.records += num_records_;
+      endTransaction();
+    } else if (error.txnRequiresAbort()) {
+      abort();
+    }
+    return error;
+  }
+
+  // Abort the open transaction, if any, and rewind the consumer to the first
+  // input offset of every partition of the transaction.
+  KafkaError abort() {
+    if (!in_transaction_) return KafkaError();
+    KafkaError error(
+        rd_kafka_abort_transaction(producer_.get(), options_.timeout_ms));
+    if (!error.isNull()) return error;
+    ++counts_.aborted;
+    error = rewind();
+    endTransaction();
+    return error;
+  }
+
+  bool inTransaction() const noexcept { return in_transaction_; }
+
+  // records and bytes of the open transaction
+  long numRecords() const noexcept { return num_records_; }
+  size_t numBytes() const noexcept { return num_bytes_; }
+
+  const Counts& counts() const noexcept { return counts_; }
+
+  const Producer& producer() const noexcept { return producer_; }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr int kMaxRetries = 3;
+
+  // the next offset to consume of a partition, first is the offset of the
+  // first input of the transaction
+  struct Input {
+    std::string topic;
+    int32_t partition;
+    int64_t first;
+    int64_t next;
+  };
+
+  const Producer& producer_;
+  rd_kafka_t* const consumer_;
+  const TransactionOptions options_;
+
+  bool in_transaction_ = false;
+  Clock::time_point begun_at_;
+  long num_records_ = 0;
+  size_t num_bytes_ = 0;
+  // inputs of all transactions so far, few partitions, so a vector
+  std::vector<Input> inputs_;
+  Counts counts_;
+
+  bool isDue() const noexcept {
+    return num_records_ >= options_.max_records ||
+           num_bytes_ >= options_.max_bytes ||
+           Clock::now() - begun_at_ >= options_.max_duration;
+  }
+
+  KafkaError begin() {
+    if (in_transaction_) return KafkaError();
+    KafkaError error(rd_kafka_begin_transaction(producer_.get()));
+    if (!error.isNull()) return error;
+    in_transaction_ = true;
+    begun_at_ = Clock::now();
+    return error;
+  }
+
+  void endTransaction() noexcept {
+    in_transaction_ = false;
+    num_records_ = 0;
+    num_bytes_ = 0;
+    for (auto& input : inputs_) input.first = -1;
+  }
+
+  Input* findInput(const char* topic, int32_t partition) {
+    for (auto& input : inputs_) {
+      if (input.partition == partition && input.topic == topic) return &input;
+    }
+    return nullptr;
+  }
+
+  KafkaError sendOffsets() {
+    if (!consumer_) return KafkaError();
+    PointerHolder<rd_kafka_topic_partition_list_t> offsets(
+        rd_kafka_topic_partition_list_new(static_cast<int>(inputs_.size())));
+    for (const auto& input : inputs_) {
+      if (input.first < 0) continue;  // not in this transaction
+      rd_kafka_topic_partition_list_add(offsets.get(), input.topic.data(),
+                                        input.partition)
+          ->offset = input.next;
+    }
+    if (offsets.get()->cnt == 0) return KafkaError();
+
+    // of the current generation, so a zombie member's offsets are rejected
+    PointerHolder<rd_kafka_consumer_group_metadata_t> group_metadata(
+        rd_kafka_consumer_group_metadata(consumer_));
+    return KafkaError(rd_kafka_send_offsets_to_transaction(
+        producer_.get(), offsets.get(), group_metadata.get(),
+        options_.timeout_ms));
+  }
+
+  KafkaError rewind() {
+    if (!consumer_) return KafkaError();
+    PointerHolder<rd_kafka_topic_partition_list_t> offsets(
+        rd_kafka_topic_partition_list_new(static_cast<int>(inputs_.size())));
+    for (const auto& input : inputs_) {
+      if (input.first < 0) continue;
+      rd_kafka_topic_partition_list_add(offsets.get(), input.topic.data(),
+                                        input.partition)
+          ->offset = input.first;
+    }
+    if (offsets.get()->cnt == 0) return KafkaError();
+    return KafkaError(rd_kafka_seek_partitions(consumer_, offsets.get(),
+                                               options_.timeout_ms));
+  }
+};
+
+}  // namespace rdkafka
@@ -6,6 +6,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <string>
+
 namespace rdkafka {
 
 namespace util {
@@ -36,6 +38,24 @@ inline void putNameValue(T* conf, const char* name, const char* value) {
   }
 }
 
+inline decltype(rd_kafka_conf_get)* getConfGetFunc(const rd_kafka_conf_t*) {
+  return rd_kafka_conf_get;
+}
+inline decltype(rd_kafka_topic_conf_get)* getConfGetFunc(
+    const rd_kafka_topic_conf_t*) {
+  return rd_kafka_topic_conf_get;
+}
+
+// empty if name is unknown or unset
+template <typename T>
+inline std::string getValue(const T* conf, const char* name) {
+  char value[512];
+  size_t size = sizeof(value);
+  if (getConfGetFunc(conf)(conf, name, value, &size) != RD_KAFKA_CONF_OK)
+    return std::string();
+  return value;
+}
+
 inline void printPartitionList(
     const rd_kafka_topic_partition_list_t* partitions, FILE* fp = stdout) {
   for (int i = 0; i < partitions->cnt; ++i) {
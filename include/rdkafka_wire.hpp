@@ -0,0 +1,476 @@
+// rdkafka_wire.hpp: Kafka's wire format and the consumer protocol
+//
+// WireReader and WireWriter read and write the primitive types of Kafka's
+// protocol guide: big-endian integers, varints, (compact) strings, bytes and
+// arrays. WireReader never aborts or throws on malformed input, the first
+// out-of-range read marks it failed, further reads return zero values and
+// ok() tells whether the input was well-formed. Strings and bytes are read as
+// Slices into the input and arrays are allocated from a WireArena, so decoding
+// doesn't copy and a reused arena stops allocating.
+//
+// decodeSubscription() and decodeAssignment() decode the member metadata and
+// member assignment of the "consumer" protocol type, as returned by
+// rd_kafka_list_groups(), see examples/group_metadata.cc.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "rdkafka_slice.hpp"
+
+namespace rdkafka {
+
+template <typename T>
+inline void storeBigEndian(T value, char* out) noexcept {
+  static_assert(std::is_integral<T>::value, "T must be an integer");
+  auto u = static_cast<typename std::make_unsigned<T>::type>(value);
+  for (size_t i = sizeof(T); i > 0; i--) {
+    out[i - 1] = static_cast<char>(u & 0xff);
+    u = static_cast<decltype(u)>(u >> 8);
+  }
+}
+
+template <typename T>
+inline T loadBigEndian(const char* in) noexcept {
+  static_assert(std::is_integral<T>::value, "T must be an integer");
+  typename std::make_unsigned<T>::type u = 0;
+  for (size_t i = 0; i < sizeof(T); i++)
+    u = static_cast<decltype(u)>((u << 8) | static_cast<uint8_t>(in[i]));
+  return static_cast<T>(u);
+}
+
+// Non-owning array decoded into a WireArena, a null array has data nullptr.
+template <typename T>
+class ArrayView {
+ public:
+  ArrayView() noexcept : data_(nullptr), size_(0) {}
+
+  ArrayView(const T* data, size_t size) noexcept : data_(data), size_(size) {}
+
+  const T* data() const noexcept { return data_; }
+
+  size_t size() const noexcept { return size_; }
+
+  bool empty() const noexcept { return size_ == 0; }
+
+  bool isNull() const noexcept { return data_ == nullptr; }
+
+  const T& operator[](size_t i) const noexcept { return data_[i]; }
+
+  const T* begin() const noexcept { return data_; }
+
+  const T* end() const noexcept { return data_ + size_; }
+
+ private:
+  const T* data_;
+  size_t size_;
+};
+
+// Bump allocator of trivially destructible objects. reset() frees everything
+// at once and keeps the memory, so decoding many groups with one arena only
+// allocates until its chunks fit the largest one.
+class WireArena {
+ public:
+  explicit WireArena(size_t chunk_size = 4096) : chunk_size_(chunk_size) {}
+
+  WireArena(const WireArena&) = delete;
+  WireArena& operator=(const WireArena&) = delete;
+
+  template <typename T>
+  T* allocate(size_t n) {
+    static_assert(std::is_trivially_destructible<T>::value,
+                  "arena objects are never destroyed");
+    if (n == 0) return nullptr;
+    size_t bytes = n * sizeof(T);
+    while (current_ < chunks_.size()) {
+      size_t offset = (offset_ + alignof(T) - 1) & ~(alignof(T) - 1);
+      if (offset + bytes <= chunks_[current_].size) {
+        offset_ = offset + bytes;
+        return reinterpret_cast<T*>(chunks_[current_].data.get() + offset);
+      }
+      ++current_;
+      offset_ = 0;
+    }
+    // new char[] is aligned for any fundamental type
+    Chunk chunk{std::unique_ptr<char[]>(new char[std::max(bytes, chunk_size_)]),
+                std::max(bytes, chunk_size_)};
+    chunks_.emplace_back(std::move(chunk));
+    offset_ = bytes;
+    return reinterpret_cast<T*>(chunks_.back().data.get());
+  }
+
+  void reset() noexcept {
+    current_ = 0;
+    offset_ = 0;
+  }
+
+  size_t numChunks() const noexcept { return chunks_.size(); }
+
+ private:
+  struct Chunk {
+    std::unique_ptr<char[]> data;
+    size_t size;
+  };
+
+  const size_t chunk_size_;
+  std::vector<Chunk> chunks_;
+  size_t current_ = 0;
+  size_t offset_ = 0;
+};
+
+class WireReader {
+ public:
+  explicit WireReader(Slice data) noexcept : data_(data) {}
+
+  // false once a read went out of range or met a malformed length
+  bool ok() const noexcept { return ok_; }
+
+  size_t position() const noexcept { return pos_; }
+
+  size_t remaining() const noexcept { return data_.size() - pos_; }
+
+  int8_t readInt8() noexcept { return readFixed<int8_t>(); }
+
+  int16_t readInt16() noexcept { return readFixed<int16_t>(); }
+
+  int32_t readInt32() noexcept { return readFixed<int32_t>(); }
+
+  int64_t readInt64() noexcept { return readFixed<int64_t>(); }
+
+  uint32_t readUnsignedVarint() noexcept {
+    return static_cast<uint32_t>(readVarintBits(5));
+  }
+
+  // zigzag encoded
+  int32_t readVarint() noexcept {
+    uint32_t u = readUnsignedVarint();
+    return static_cast<int32_t>((u >> 1) ^ (0u - (u & 1)));
+  }
+
+  int64_t readVarlong() noexcept {
+    uint64_t u = readVarintBits(10);
+    return static_cast<int64_t>((u >> 1) ^ (0ull - (u & 1)));
+  }
+
+  // STRING and NULLABLE_STRING, null is Slice()
+  Slice readString() noexcept { return readSlice(readInt16()); }
+
+  // COMPACT_STRING and COMPACT_NULLABLE_STRING
+  Slice readCompactString() noexcept {
+    return readSlice(static_cast<int64_t>(readUnsignedVarint()) - 1);
+  }
+
+  // BYTES and NULLABLE_BYTES
+  Slice readBytes() noexcept { return readSlice(readInt32()); }
+
+  Slice readCompactBytes() noexcept { return readCompactString(); }
+
+  // -1 for a null array
+  int32_t readArrayLength() noexcept {
+    return checkArrayLength(readInt32());
+  }
+
+  int32_t readCompactArrayLength() noexcept {
+    return checkArrayLength(static_cast<int64_t>(readUnsignedVarint()) - 1);
+  }
+
+  // Array of length elements, each read by read_element(*this, T*), it's
+  // null if length is -1.
+  template <typename T, typename ReadElement>
+  ArrayView<T> readArray(int32_t length, WireArena& arena,
+                         ReadElement read_element) {
+    if (!ok_ || length < 0) return ArrayView<T>();
+    // an empty array isn't null, so it takes an element too
+    T* elements = arena.allocate<T>(std::max<size_t>(length, 1));
+    for (int32_t i = 0; i < length; i++) {
+      elements[i] = T();
+      read_element(*this, &elements[i]);
+      if (!ok_) return ArrayView<T>();
+    }
+    return ArrayView<T>(elements, static_cast<size_t>(length));
+  }
+
+  // Array of length integers, range-checked once instead of per element.
+  template <typename T>
+  ArrayView<T> readFixedArray(int32_t length, WireArena& arena) {
+    if (!ok_ || length < 0) return ArrayView<T>();
+    const char* p = take(static_cast<size_t>(length) * sizeof(T));
+    if (!p) return ArrayView<T>();
+    T* elements = arena.allocate<T>(std::max<size_t>(length, 1));
+    for (int32_t i = 0; i < length; i++)
+      elements[i] = loadBigEndian<T>(p + i * sizeof(T));
+    return ArrayView<T>(elements, static_cast<size_t>(length));
+  }
+
+  // tagged fields of flexible versions aren't interpreted
+  void skipTaggedFields() noexcept {
+    uint32_t num_fields = readUnsignedVarint();
+    for (uint32_t i = 0; ok_ && i < num_fields; i++) {
+      readUnsignedVarint();  // tag
+      readSlice(readUnsignedVarint());
+    }
+  }
+
+ private:
+  Slice data_;
+  size_t pos_ = 0;
+  bool ok_ = true;
+
+  const char* take(size_t n) noexcept {
+    if (!ok_ || remaining() < n) {
+      ok_ = false;
+      return nullptr;
+    }
+    const char* p = data_.data() + pos_;
+    pos_ += n;
+    return p;
+  }
+
+  template <typename T>
+  T readFixed() noexcept {
+    const char* p = take(sizeof(T));
+    return p ? loadBigEndian<T>(p) : 0;
+  }
+
+  uint64_t readVarintBits(int max_bytes) noexcept {
+    uint64_t value = 0;
+    for (int i = 0; i < max_bytes; i++) {
+      const char* p = take(1);
+      if (!p) return 0;
+      auto byte = static_cast<uint8_t>(*p);
+      value |= static_cast<uint64_t>(byte & 0x7f) << (7 * i);
+      if ((byte & 0x80) == 0) return value;
+    }
+    ok_ = false;  // too long
+    return 0;
+  }
+
+  Slice readSlice(int64_t length) noexcept {
+    if (!ok_ || length == -1) return Slice();
+    if (length < 0) {
+      ok_ = false;
+      return Slice();
+    }
+    const char* p = take(static_cast<size_t>(length));
+    return p ? Slice(p, static_cast<size_t>(length)) : Slice();
+  }
+
+  // every element takes at least a byte, so a longer array is malformed and
+  // mustn't make the arena allocate it
+  int32_t checkArrayLength(int64_t length) noexcept {
+    if (!ok_) return -1;
+    if (length < -1 || length > static_cast<int64_t>(remaining())) {
+      ok_ = false;
+      return -1;
+    }
+    return static_cast<int32_t>(length);
+  }
+};
+
+// Appends to a caller's string, which is reused to stop allocating.
+class WireWriter {
+ public:
+  explicit WireWriter(std::string& out) noexcept : out_(out) {}
+
+  // false once a string or array was too long for its length type
+  bool ok() const noexcept { return ok_; }
+
+  void writeInt8(int8_t value) { writeFixed(value); }
+
+  void writeInt16(int16_t value) { writeFixed(value); }
+
+  void writeInt32(int32_t value) { writeFixed(value); }
+
+  void writeInt64(int64_t value) { writeFixed(value); }
+
+  void writeUnsignedVarint(uint32_t value) { writeVarintBits(value); }
+
+  void writeVarint(int32_t value) {
+    auto u = static_cast<uint32_t>(value);
+    writeVarintBits((u << 1) ^ (0u - (u >> 31)));
+  }
+
+  void writeVarlong(int64_t value) {
+    auto u = static_cast<uint64_t>(value);
+    writeVarintBits((u << 1) ^ (0ull - (u >> 63)));
+  }
+
+  // a Slice with data nullptr is written as null
+  void writeString(Slice value) {
+    if (!value.data()) return writeInt16(-1);
+    if (!checkLength(value.size(), std::numeric_limits<int16_t>::max()))
+      return;
+    writeInt16(static_cast<int16_t>(value.size()));
+    out_.append(value.data(), value.size());
+  }
+
+  void writeCompactString(Slice value) {
+    if (!value.data()) return writeUnsignedVarint(0);
+    if (!checkLength(value.size(), std::numeric_limits<int32_t>::max() - 1))
+      return;
+    writeUnsignedVarint(static_cast<uint32_t>(value.size() + 1));
+    out_.append(value.data(), value.size());
+  }
+
+  void writeBytes(Slice value) {
+    if (!value.data()) return writeInt32(-1);
+    if (!checkLength(value.size(), std::numeric_limits<int32_t>::max()))
+      return;
+    writeInt32(static_cast<int32_t>(value.size()));
+    out_.append(value.data(), value.size());
+  }
+
+  void writeCompactBytes(Slice value) { writeCompactString(value); }
+
+  // -1 for a null array
+  void writeArrayLength(int32_t length) { writeInt32(length); }
+
+  void writeCompactArrayLength(int32_t length) {
+    writeUnsignedVarint(static_cast<uint32_t>(length + 1));
+  }
+
+  void writeEmptyTaggedFields() { writeUnsignedVarint(0); }
+
+ private:
+  std::string& out_;
+  bool ok_ = true;
+
+  template <typename T>
+  void writeFixed(T value) {
+    char buf[sizeof(T)];
+    storeBigEndian(value, buf);
+    out_.append(buf, sizeof(T));
+  }
+
+  void writeVarintBits(uint64_t value) {
+    char buf[10];
+    size_t n = 0;
+    while (value >= 0x80) {
+      buf[n++] = static_cast<char>((value & 0x7f) | 0x80);
+      value >>= 7;
+    }
+    buf[n++] = static_cast<char>(value);
+    out_.append(buf, n);
+  }
+
+  bool checkLength(size_t length, size_t max_length) noexcept {
+    if (length > max_length) ok_ = false;
+    return ok_;
+  }
+};
+
+// Consumer protocol, see ConsumerProtocolSubscription.json and
+// ConsumerProtocolAssignment.json of Kafka. Slices and arrays point into the
+// decoded data and the arena.
+struct TopicPartitions {
+  Slice topic;
+  ArrayView<int32_t> partitions;
+};
+
+struct ConsumerProtocolSubscription {
+  int16_t version = 0;
+  ArrayView<Slice> topics;
+  Slice user_data;
+  ArrayView<TopicPartitions> owned_partitions;  // version 1+
+  int32_t generation_id = -1;                   // version 2+
+  Slice rack_id;                                // version 3+
+};
+
+struct ConsumerProtocolAssignment {
+  int16_t version = 0;
+  ArrayView<TopicPartitions> assigned_partitions;
+  Slice user_data;
+};
+
+namespace detail {
+
+// -1 for a null array, like readArray() reads it
+template <typename T>
+int32_t arrayLength(ArrayView<T> array) noexcept {
+  return array.isNull() ? -1 : static_cast<int32_t>(array.size());
+}
+
+inline ArrayView<TopicPartitions> readTopicPartitions(WireReader& reader,
+                                                      WireArena& arena) {
+  return reader.readArray<TopicPartitions>(
+      reader.readArrayLength(), arena,
+      [&arena](WireReader& r, TopicPartitions* element) {
+        element->topic = r.readString();
+        element->partitions =
+            r.readFixedArray<int32_t>(r.readArrayLength(), arena);
+      });
+}
+
+inline void writeTopicPartitions(WireWriter& writer,
+                                 ArrayView<TopicPartitions> topics) {
+  writer.writeArrayLength(arrayLength(topics));
+  for (const auto& topic : topics) {
+    writer.writeString(topic.topic);
+    writer.writeArrayLength(arrayLength(topic.partitions));
+    for (int32_t partition : topic.partitions) writer.writeInt32(partition);
+  }
+}
+
+}  // namespace detail
+
+// Fields of versions above 3 are ignored like the Java client does.
+// Returns false if data is malformed.
+inline bool decodeSubscription(Slice data, WireArena& arena,
+                               ConsumerProtocolSubscription* subscription) {
+  WireReader reader(data);
+  *subscription = ConsumerProtocolSubscription();
+  subscription->version = reader.readInt16();
+  if (subscription->version < 0) return false;
+  subscription->topics = reader.readArray<Slice>(
+      reader.readArrayLength(), arena,
+      [](WireReader& r, Slice* topic) { *topic = r.readString(); });
+  subscription->user_data = reader.readBytes();
+  if (subscription->version >= 1)
+    subscription->owned_partitions =
+        detail::readTopicPartitions(reader, arena);
+  if (subscription->version >= 2)
+    subscription->generation_id = reader.readInt32();
+  if (subscription->version >= 3) subscription->rack_id = reader.readString();
+  return reader.ok();
+}
+
+inline bool decodeAssignment(Slice data, WireArena& arena,
+                             ConsumerProtocolAssignment* assignment) {
+  WireReader reader(data);
+  *assignment = ConsumerProtocolAssignment();
+  assignment->version = reader.readInt16();
+  if (assignment->version < 0) return false;
+  assignment->assigned_partitions = detail::readTopicPartitions(reader, arena);
+  assignment->user_data = reader.readBytes();
+  return reader.ok();
+}
+
+// fields above subscription.version aren't written
+inline void encodeSubscription(const ConsumerProtocolSubscription& subscription,
+                               WireWriter& writer) {
+  writer.writeInt16(subscription.version);
+  writer.writeArrayLength(detail::arrayLength(subscription.topics));
+  for (Slice topic : subscription.topics) writer.writeString(topic);
+  writer.writeBytes(subscription.user_data);
+  if (subscription.version >= 1)
+    detail::writeTopicPartitions(writer, subscription.owned_partitions);
+  if (subscription.version >= 2) writer.writeInt32(subscription.generation_id);
+  if (subscription.version >= 3) writer.writeString(subscription.rack_id);
+}
+
+inline void encodeAssignment(const ConsumerProtocolAssignment& assignment,
+                             WireWriter& writer) {
+  writer.writeInt16(assignment.version);
+  detail::writeTopicPartitions(writer, assignment.assigned_partitions);
+  writer.writeBytes(assignment.user_data);
+}
+
+}  // namespace rdkafka
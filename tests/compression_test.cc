@@ -0,0 +1,196 @@
+#include "rdkafka_compression.hpp"
+#include "rdkafka_error.hpp"
+#include "test_util.hpp"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+using namespace rdkafka;
+using namespace test;
+
+static const string kDictionary = "{\"id\": , \"name\": \"user-\", \"tags\": ";
+
+// i % 3: 0 small, 1 large and compressible, 2 large and random
+static string payload(int i) {
+  string s;
+  if (i % 3 == 0) return "small-" + to_string(i);
+  if (i % 3 == 1) {
+    while (s.size() < 4096)
+      s += "{\"id\": " + to_string(i) + ", \"name\": \"user-" + to_string(i) +
+           "\", \"tags\": []}";
+    return s;
+  }
+  srand(i);
+  for (int j = 0; j < 4096; j++) s += static_cast<char>(rand());
+  return s;
+}
+
+// msg_opaque of the i-th message is i + 1
+static long num_wrong_opaques = 0;
+
+static void dr_msg_cb(rd_kafka_t*, const rd_kafka_message_t* rkmessage,
+                      void*) {
+  if (!rkmessage->_private) return;
+  auto i = reinterpret_cast<intptr_t>(rkmessage->_private) - 1;
+  if (string(static_cast<const char*>(rkmessage->key), rkmessage->key_len) !=
+      to_string(i))
+    ++num_wrong_opaques;
+}
+
+// delivery reports served by the fast path's poll() call back into it
+static CompressingProducer* reentered = nullptr;
+static long num_reentered = 0;
+
+static void reentrant_dr_msg_cb(rd_kafka_t*, const rd_kafka_message_t*,
+                                void*) {
+  if (!reentered) return;
+  reentered->counts();
+  ++num_reentered;
+}
+
+static void assign(const Consumer& consumer, const char* topic) {
+  PointerHolder<rd_kafka_topic_partition_list_t> partitions(
+      rd_kafka_topic_partition_list_new(1));
+  rd_kafka_topic_partition_list_add(partitions.get(), topic, 0)->offset =
+      RD_KAFKA_OFFSET_BEGINNING;
+  error::checkRespError(rd_kafka_assign(consumer.get(), partitions.get()),
+                        "rd_kafka_assign");
+}
+
+int main(int argc, char* argv[]) {
+  MockCluster cluster;
+  cluster.createTopic("compression", 1);
+  cluster.createTopic("dictionary", 1);
+  cluster.createTopic("small-queue", 1);
+  const char* bootstraps = cluster.bootstraps();
+  char errstr[512];
+
+  // in produce() order whichever worker finishes first
+  const int kNumMessages = 300;
+  GlobalConf conf;
+  conf.put("bootstrap.servers", bootstraps);
+  conf.setDeliveryReportCallback(dr_msg_cb);
+  Producer producer(std::move(conf), errstr);
+  if (producer.isNull())
+    error::Exit("[ERROR] Create producer failed: %s\n", errstr);
+  {
+    CompressionOptions options;
+    options.num_workers = 4;
+    options.max_pending = 16;
+    CompressingProducer compressing(producer, options);
+    Topic topic(producer.get(), "compression");
+    int num_failed = 0;
+    for (int i = 0; i < kNumMessages; i++) {
+      string key = to_string(i);
+      auto opaque = reinterpret_cast<void*>(static_cast<intptr_t>(i + 1));
+      if (compressing.produce(topic, payload(i), key, RD_KAFKA_PARTITION_UA,
+                              opaque) != RD_KAFKA_RESP_ERR_NO_ERROR)
+        ++num_failed;
+    }
+    compressing.drain();
+    check("flush", producer.flush(10 * 1000), true);
+    check("produce failed", num_failed, 0);
+    check("msg_opaque", num_wrong_opaques, 0L);
+    auto counts = compressing.counts();
+    check("compressed", counts.compressed, long(kNumMessages / 3));
+    check("uncompressed", counts.uncompressed, long(kNumMessages / 3 * 2));
+    check("errors", counts.errors, 0L);
+    check("last error", compressing.lastError(), RD_KAFKA_RESP_ERR_NO_ERROR);
+
+    // a small message is enqueued at once, so its error is returned
+    check("unknown partition",
+          compressing.produce(topic, "small", "0", 5),
+          RD_KAFKA_RESP_ERR__UNKNOWN_PARTITION);
+    check("counted error", compressing.counts().errors, 1L);
+    check("smaller", counts.bytes_out < counts.bytes_in / 4, true);
+  }
+  {
+    CompressionOptions options;
+    options.dictionary = kDictionary;
+    options.min_bytes = 16;
+    CompressingProducer compressing(producer, options);
+    Topic topic(producer.get(), "dictionary");
+    compressing.produce(topic,
+                        "{\"id\": 1, \"name\": \"user-1\", \"tags\": []}");
+    compressing.drain();
+    check("flush dictionary", producer.flush(10 * 1000), true);
+    check("compressed with dictionary", compressing.counts().compressed, 1L);
+  }
+  {
+    // QUEUE_FULL is waited out in poll() without the lock
+    GlobalConf small_conf;
+    small_conf.put("bootstrap.servers", bootstraps);
+    small_conf.put("queue.buffering.max.messages", "5");
+    small_conf.setDeliveryReportCallback(reentrant_dr_msg_cb);
+    Producer small_producer(std::move(small_conf), errstr);
+    if (small_producer.isNull())
+      error::Exit("[ERROR] Create producer failed: %s\n", errstr);
+    CompressingProducer compressing(small_producer);
+    reentered = &compressing;
+    Topic topic(small_producer.get(), "small-queue");
+    for (int i = 0; i < 50; i++) compressing.produce(topic, "small");
+    compressing.drain();
+    check("flush small queue", small_producer.flush(10 * 1000), true);
+    reentered = nullptr;
+    check("small queue", compressing.counts().uncompressed, 50L);
+    check("reentered", num_reentered, 50L);
+  }
+
+  GlobalConf consumer_conf;
+  consumer_conf.put("bootstrap.servers", bootstraps);
+  consumer_conf.put("group.id", "compression-test");
+  consumer_conf.put("enable.auto.commit", "false");
+  Consumer consumer(std::move(consumer_conf), errstr);
+  if (consumer.isNull())
+    error::Exit("[ERROR] Create consumer failed: %s\n", errstr);
+  assign(consumer, "compression");
+  PayloadDecompressor decompressor;
+  int next = 0;
+  bool in_order = true;
+  bool tagged = true;
+  while (next < kNumMessages) {
+    auto message = consumer.consume(5000);
+    if (message.isNull()) break;
+    if (message.hasError()) continue;
+    Slice value;
+    if (decompressor.payload(message, value) != RD_KAFKA_RESP_ERR_NO_ERROR)
+      in_order = false;
+    in_order = in_order && value == payload(next) &&
+               string(message.key(), message.keyLen()) == to_string(next);
+    Slice codec;
+    tagged = tagged && message.headers().get("x-payload-codec", codec) ==
+                           (next % 3 == 1);
+    ++next;
+  }
+  check("consumed", next, kNumMessages);
+  check("in order", in_order, true);
+  check("tagged", tagged, true);
+
+  // the dictionary is needed to inflate
+  assign(consumer, "dictionary");
+  auto message = consumer.consume(5000);
+  check("consumed dictionary", message.isNull() || message.hasError(), false);
+  Slice value;
+  check("no dictionary", decompressor.payload(message, value),
+        RD_KAFKA_RESP_ERR__BAD_COMPRESSION);
+  CompressionOptions options;
+  options.dictionary = kDictionary;
+  PayloadDecompressor with_dictionary(options);
+  check("with dictionary", with_dictionary.payload(message, value),
+        RD_KAFKA_RESP_ERR_NO_ERROR);
+  check("inflated", value.toString(),
+        string("{\"id\": 1, \"name\": \"user-1\", \"tags\": []}"));
+
+  // corrupted payloads are rejected
+  string corrupted("\x00\x00\x10\x00garbage", 11);
+  Slice slice(corrupted);
+  check("corrupted", decompressor.inflate(slice),
+        RD_KAFKA_RESP_ERR__BAD_COMPRESSION);
+
+  consumer.waitUntilRebalanceRevoke();
+  return test::exitCode();
+}
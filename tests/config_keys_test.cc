@@ -0,0 +1,103 @@
+#include "kafka_client/config.h"
+#include "test_util.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+using namespace kafka_client;
+using namespace test;
+
+static string join(const vector<string>& values) {
+  string s;
+  for (const auto& value : values) s += (s.empty() ? "" : "|") + value;
+  return s;
+}
+
+int main(int argc, char* argv[]) {
+  GlobalConfig config;
+  config.Set(keys::bootstrap_servers, {"host1:9092", "host2:9092"});
+  config.Set(keys::client_id, "typed-client");
+  config.Set(keys::linger_ms, 5);
+  config.Set(keys::message_max_bytes, 1000000000);
+  config.Set(keys::enable_idempotence, true);
+  config.Set(keys::compression_codec, CompressionCodec::kZstd);
+  config.Set(keys::security_protocol, SecurityProtocol::kSaslSsl);
+
+  // typed values are the strings librdkafka reads back
+  check("bootstrap.servers", config.Get("bootstrap.servers"),
+        "host1:9092,host2:9092");
+  check("linger.ms", config.Get("linger.ms"), "5");
+  check("message.max.bytes", config.Get("message.max.bytes"), "1000000000");
+  check("enable.idempotence", config.Get("enable.idempotence"), "true");
+  check("compression.codec", config.Get("compression.codec"), "zstd");
+  check("security.protocol", config.Get("security.protocol"), "sasl_ssl");
+
+  check("Get bootstrap_servers", join(config.Get(keys::bootstrap_servers)),
+        "host1:9092|host2:9092");
+  check("Get client_id", config.Get(keys::client_id), "typed-client");
+  check("Get linger_ms", to_string(config.Get(keys::linger_ms)), "5.000000");
+  check("Get message_max_bytes", to_string(config.Get<keys::MessageMaxBytes>()),
+        "1000000000");
+  check("Get enable_idempotence",
+        config.Get(keys::enable_idempotence) ? "true" : "false", "true");
+  check("Get compression_codec",
+        config.Get(keys::compression_codec) == CompressionCodec::kZstd
+            ? "kZstd"
+            : "other",
+        "kZstd");
+  check("Get security_protocol",
+        config.Get(keys::security_protocol) == SecurityProtocol::kSaslSsl
+            ? "kSaslSsl"
+            : "other",
+        "kSaslSsl");
+
+  // errors are reported like Put()
+  bool ok = config.Set<keys::BatchNumMessages>(-1);
+  check("Set batch_num_messages=-1", ok ? "true" : "false", "false");
+  cout << "[OK] Error: " << config.Error() << endl;
+  ok = config.Set(keys::client_id, nullptr);
+  check("Set client_id=null", ok ? "true" : "false", "false");
+  cout << "[OK] Error: " << config.Error() << endl;
+
+  // values longer than Get()'s stack buffer
+  string long_id(1000, 'x');
+  config.Set(keys::client_id, long_id.data());
+  check("Get long client_id", to_string(config.Get(keys::client_id).size()),
+        "1000");
+
+  TopicConfig topic_config;
+  topic_config.Set(topic_keys::acks, -1);
+  topic_config.Set(topic_keys::partitioner, Partitioner::kMurmur2Random);
+  topic_config.Set(topic_keys::compression_codec, CompressionCodec::kInherit);
+  topic_config.Set(topic_keys::auto_offset_reset, AutoOffsetReset::kEarliest);
+  check("acks", topic_config.Get("acks"), "-1");
+  check("Get acks", to_string(topic_config.Get(topic_keys::acks)), "-1");
+  check("Get partitioner",
+        topic_config.Get(topic_keys::partitioner) ==
+                Partitioner::kMurmur2Random
+            ? "kMurmur2Random"
+            : "other",
+        "kMurmur2Random");
+  check("Get compression_codec",
+        topic_config.Get(topic_keys::compression_codec) ==
+                CompressionCodec::kInherit
+            ? "kInherit"
+            : "other",
+        "kInherit");
+
+  // "earliest" is an alias of "smallest"
+  topic_config.Put("auto.offset.reset", "earliest");
+  check("Get auto_offset_reset",
+        topic_config.Get(topic_keys::auto_offset_reset) ==
+                AutoOffsetReset::kEarliest
+            ? "kEarliest"
+            : "other",
+        "kEarliest");
+
+  // a topic key doesn't compile with GlobalConfig and vice versa:
+  //   config.Set(topic_keys::acks, 1);
+  //   topic_config.Set(keys::linger_ms, 5);
+
+  return test::exitCode();
+}
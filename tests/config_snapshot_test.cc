@@ -0,0 +1,64 @@
+#include "kafka_client/config.h"
+#include "test_util.hpp"
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+using namespace std;
+using namespace kafka_client;
+using namespace test;
+
+int main(int argc, char* argv[]) {
+  GlobalConfig config;
+  config.Put("bootstrap.servers", "localhost:9092");
+  config.Put("linger.ms", "5");
+  ConfigSnapshot<GlobalConfig> snapshot(config);
+
+  // the snapshot doesn't see later changes
+  config.Put("linger.ms", "100");
+
+  GlobalConfig clone;
+  bool ok = snapshot.Clone(&clone, {{"client.id", "clone-1"}});
+  check("Clone", ok ? "true" : clone.Error(), "true");
+  check("bootstrap.servers", clone.Get("bootstrap.servers"), "localhost:9092");
+  check("linger.ms", clone.Get("linger.ms"), "5");
+  check("client.id", clone.Get("client.id"), "clone-1");
+
+  // overrides of one clone don't leak into the next
+  GlobalConfig other = snapshot.Clone();
+  check("other client.id", other.Get("client.id"), "rdkafka");
+
+  ok = snapshot.Clone(&other, {{"linger.ms", "NOT_A_NUMBER"}});
+  check("invalid override", ok ? "true" : "false", "false");
+  cout << "[OK] Error: " << other.Error() << endl;
+
+  TopicConfig topic_config;
+  topic_config.Put("acks", "1");
+  ConfigSnapshot<TopicConfig> topic_snapshot(topic_config);
+  TopicConfig topic_clone;
+  topic_snapshot.Clone(&topic_clone, {{"message.timeout.ms", "1000"}});
+  check("acks", topic_clone.Get("acks"), "1");
+  check("message.timeout.ms", topic_clone.Get("message.timeout.ms"), "1000");
+
+  // one snapshot shared by many threads
+  atomic<int> num_wrong{0};
+  vector<thread> threads;
+  for (int i = 0; i < 4; i++) {
+    threads.emplace_back([&snapshot, &num_wrong, i] {
+      string client_id = "thread-" + to_string(i);
+      for (int j = 0; j < 100; j++) {
+        GlobalConfig thread_config;
+        bool ok =
+            snapshot.Clone(&thread_config, {{"client.id", client_id.data()}});
+        if (!ok || thread_config.Get("client.id") != client_id ||
+            thread_config.Get("linger.ms") != "5")
+          ++num_wrong;
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+  check("wrong clones of threads", to_string(num_wrong.load()), "0");
+
+  return test::exitCode();
+}
@@ -0,0 +1,44 @@
+#include "rdkafka_event_loop.hpp"
+#include "test_util.hpp"
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <vector>
+using namespace std;
+using namespace rdkafka;
+using namespace test;
+
+int main(int argc, char* argv[]) {
+  {
+    EventLoop loop;
+    check("loop", loop.isNull(), false);
+    loop.start();
+    loop.stop();
+  }
+
+  // one free fd: epoll_create1() gets it, the wakeup eventfd() fails
+  struct rlimit saved;
+  getrlimit(RLIMIT_NOFILE, &saved);
+  struct rlimit limited = saved;
+  limited.rlim_cur = 64;
+  setrlimit(RLIMIT_NOFILE, &limited);
+  vector<int> fds;
+  for (int fd = dup(0); fd != -1; fd = dup(0)) fds.push_back(fd);
+  close(fds.back());
+  fds.pop_back();
+  {
+    EventLoop loop;
+    check("no wakeup fd", loop.isNull(), true);
+    check("no epoll fd", loop.fd(), -1);
+  }
+  // the epoll fd was closed, not leaked
+  int fd = dup(0);
+  check("epoll fd closed", fd != -1, true);
+  if (fd != -1) close(fd);
+  for (int fd : fds) close(fd);
+  setrlimit(RLIMIT_NOFILE, &saved);
+
+  return test::exitCode();
+}
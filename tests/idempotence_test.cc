@@ -0,0 +1,184 @@
+#include "rdkafka_classes.hpp"
+#include "rdkafka_error.hpp"
+#include "test_util.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+using namespace rdkafka;
+using namespace test;
+
+static long num_delivered = 0;
+static long num_failed_deliveries = 0;
+
+static void dr_msg_cb(rd_kafka_t*, const rd_kafka_message_t* rkmessage,
+                      void*) {
+  if (rkmessage->err)
+    ++num_failed_deliveries;
+  else
+    ++num_delivered;
+}
+
+static long num_purged_queued = 0;
+static long num_purged_inflight = 0;
+
+static void purge_dr_msg_cb(rd_kafka_t*, const rd_kafka_message_t* rkmessage,
+                            void*) {
+  if (rkmessage->err == RD_KAFKA_RESP_ERR__PURGE_QUEUE) ++num_purged_queued;
+  if (rkmessage->err == RD_KAFKA_RESP_ERR__PURGE_INFLIGHT)
+    ++num_purged_inflight;
+}
+
+static void produce(const Producer& producer, int first, int count) {
+  Topic topic(producer.get(), "idempotence");
+  for (int i = first; i < first + count; i++) {
+    string payload = to_string(i);
+    producer.produceCopy(topic, Slice(payload.data(), payload.size()));
+  }
+}
+
+int main(int argc, char* argv[]) {
+  // config checks
+  {
+    GlobalConf conf;
+    check("not enabled", conf.checkIdempotence(),
+          string("enable.idempotence is not true"));
+    conf.enableIdempotence();
+    check("enabled", conf.checkIdempotence(), string());
+    check("max.in.flight", conf.value("max.in.flight"), string("5"));
+    conf.put("max.in.flight", "6");
+    check("too many in flight", conf.checkIdempotence(),
+          string("max.in.flight must be 1 to 5, not 6"));
+    conf.put("max.in.flight", "5");
+    conf.put("acks", "1");
+    check("acks", conf.checkIdempotence(), string("acks must be all, not 1"));
+    conf.put("acks", "all");
+    conf.put("retries", "0");
+    check("retries", conf.checkIdempotence(),
+          string("retries must be at least 1"));
+    conf.put("retries", "3");
+    conf.put("api.version.request", "false");
+    conf.put("broker.version.fallback", "0.9.0.1");
+    check("old broker", conf.checkIdempotence(),
+          string("broker.version.fallback 0.9.0.1 has no idempotence, "
+                 "which requires 0.11+"));
+    conf.put("broker.version.fallback", "2.8.0");
+    check("new broker", conf.checkIdempotence(), string());
+
+    GlobalConf transactional;
+    transactional.put("transactional.id", "idempotence-test");
+    check("transactional", transactional.checkIdempotence(), string());
+  }
+
+  char errstr[512];
+  MockCluster cluster(3);
+  check("plain producer", cluster.producer().isIdempotent(), false);
+  check("plain recreate", cluster.producer().recreate(errstr), false);
+  cluster.createTopic("idempotence", 1, 3);
+  const char* bootstraps = cluster.bootstraps();
+
+  GlobalConf conf;
+  conf.put("bootstrap.servers", bootstraps);
+  conf.enableIdempotence();
+  conf.setDeliveryReportCallback(dr_msg_cb);
+  Producer producer(std::move(conf), errstr);
+  if (producer.isNull())
+    error::Exit("[ERROR] Create producer failed: %s\n", errstr);
+  check("idempotent", producer.isIdempotent(), true);
+
+  produce(producer, 0, 100);
+  check("flush", producer.flush(10 * 1000), true);
+  check("delivered", num_delivered, 100L);
+  check("no fatal error", producer.fatalError(), RD_KAFKA_RESP_ERR_NO_ERROR);
+
+  // e.g. the partition leader lost messages, the sequence can't continue
+  rd_kafka_test_fatal_error(producer.get(),
+                            RD_KAFKA_RESP_ERR_OUT_OF_ORDER_SEQUENCE_NUMBER,
+                            "test fatal error");
+  string reason;
+  check("fatal error", producer.fatalError(&reason),
+        RD_KAFKA_RESP_ERR_OUT_OF_ORDER_SEQUENCE_NUMBER);
+  check("fatal reason", reason.find("test fatal error") != string::npos,
+        true);
+  {
+    Topic topic(producer.get(), "idempotence");
+    check("produce after fatal", producer.produceCopy(topic, Slice("x", 1)),
+          false);
+    check("produce error", rd_kafka_last_error(), RD_KAFKA_RESP_ERR__FATAL);
+  }
+
+  check("recreate", producer.recreate(errstr), true);
+  check("recreations",
+        producer.metrics().snapshot().get(
+            ClientMetrics::Counter::kRecreations),
+        uint64_t(1));
+  check("fatal error cleared", producer.fatalError(),
+        RD_KAFKA_RESP_ERR_NO_ERROR);
+  produce(producer, 100, 100);
+  check("flush after recreate", producer.flush(10 * 1000), true);
+  check("delivered after recreate", num_delivered, 200L);
+  check("failed deliveries", num_failed_deliveries, 0L);
+
+  // everything is written once and in order
+  GlobalConf consumer_conf;
+  consumer_conf.put("bootstrap.servers", bootstraps);
+  consumer_conf.put("group.id", "idempotence-test");
+  consumer_conf.put("enable.auto.commit", "false");
+  Consumer consumer(std::move(consumer_conf), errstr);
+  if (consumer.isNull())
+    error::Exit("[ERROR] Create consumer failed: %s\n", errstr);
+  PointerHolder<rd_kafka_topic_partition_list_t> partitions(
+      rd_kafka_topic_partition_list_new(1));
+  rd_kafka_topic_partition_list_add(partitions.get(), "idempotence", 0)
+      ->offset = RD_KAFKA_OFFSET_BEGINNING;
+  error::checkRespError(rd_kafka_assign(consumer.get(), partitions.get()),
+                        "rd_kafka_assign");
+  int next = 0;
+  bool in_order = true;
+  while (next < 200) {
+    auto message = consumer.consume(5000);
+    if (message.isNull()) break;
+    if (message.hasError()) continue;
+    in_order = in_order && string(message.payload(), message.payloadLen()) ==
+                               to_string(next);
+    ++next;
+  }
+  check("consumed", next, 200);
+  check("in order", in_order, true);
+  check("no duplicates", consumer.consume(1000).isNull(), true);
+  consumer.waitUntilRebalanceRevoke();
+
+  // recreate() tells queued messages from in-flight ones, which may have
+  // been written already: one request in flight, the others queued
+  cluster.createTopic("idempotence-purge", 1, 3);
+  GlobalConf purge_conf;
+  purge_conf.put("bootstrap.servers", bootstraps);
+  purge_conf.enableIdempotence();
+  purge_conf.put("max.in.flight", "1");
+  purge_conf.put("batch.num.messages", "1");
+  purge_conf.put("linger.ms", "0");
+  purge_conf.setDeliveryReportCallback(purge_dr_msg_cb);
+  Producer purge_producer(std::move(purge_conf), errstr);
+  if (purge_producer.isNull())
+    error::Exit("[ERROR] Create producer failed: %s\n", errstr);
+  {
+    Topic topic(purge_producer.get(), "idempotence-purge");
+    purge_producer.produceCopy(topic, Slice("first", 5));
+    check("purge flush", purge_producer.flush(10 * 1000), true);
+    for (int32_t broker_id = 1; broker_id <= 3; broker_id++)
+      rd_kafka_mock_broker_set_rtt(cluster.get(), broker_id, 3000);
+    for (int i = 0; i < 5; i++)
+      purge_producer.produceCopy(topic, Slice("queued", 6));
+    this_thread::sleep_for(chrono::milliseconds(500));
+  }
+  check("recreate with in-flight", purge_producer.recreate(errstr), true);
+  for (int32_t broker_id = 1; broker_id <= 3; broker_id++)
+    rd_kafka_mock_broker_set_rtt(cluster.get(), broker_id, 0);
+  check("purged in flight", num_purged_inflight, 1L);
+  check("purged queued", num_purged_queued, 4L);
+
+  return test::exitCode();
+}
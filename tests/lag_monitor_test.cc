@@ -0,0 +1,130 @@
+#include "rdkafka_lag.hpp"
+#include "test_util.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+using namespace rdkafka;
+using namespace test;
+
+static void commit(const char* bootstraps, const char* group,
+                   const char* topic,
+                   const vector<pair<int32_t, int64_t>>& offsets) {
+  GlobalConf conf;
+  conf.put("bootstrap.servers", bootstraps);
+  conf.put("group.id", group);
+  char errstr[512];
+  Consumer consumer(std::move(conf), errstr);
+  if (consumer.isNull())
+    error::Exit("[ERROR] Create consumer failed: %s\n", errstr);
+
+  PointerHolder<rd_kafka_topic_partition_list_t> list(
+      rd_kafka_topic_partition_list_new(0));
+  for (const auto& offset : offsets) {
+    rd_kafka_topic_partition_list_add(list.get(), topic, offset.first)
+        ->offset = offset.second;
+  }
+  error::checkRespError(rd_kafka_commit(consumer.get(), list.get(), 0),
+                        "rd_kafka_commit");
+}
+
+static const PartitionLag* find(const vector<PartitionLag>& lags,
+                                const string& group, const string& topic,
+                                int32_t partition) {
+  for (const auto& lag : lags) {
+    if (lag.group == group && lag.topic == topic &&
+        lag.partition == partition)
+      return &lag;
+  }
+  return nullptr;
+}
+
+int main(int argc, char* argv[]) {
+  MockCluster cluster(2);
+  auto& producer = cluster.producer();
+  cluster.createTopic("lag-a", 4);
+  cluster.createTopic("lag-b", 2);
+  const char* bootstraps = cluster.bootstraps();
+
+  // 10 messages in every partition
+  char payload[] = "lag";
+  for (const char* topic_name : {"lag-a", "lag-b"}) {
+    Topic topic(producer.get(), topic_name);
+    for (int32_t partition = 0; partition < 4; partition++) {
+      producer.setPartition(partition);
+      for (int i = 0; i < 10; i++)
+        producer.produce(topic, payload, sizeof(payload));
+    }
+  }
+  producer.flush(10 * 1000);
+
+  commit(bootstraps, "group-1", "lag-a", {{0, 3}, {1, 10}});
+  commit(bootstraps, "group-2", "lag-b", {{0, 5}});
+
+  LagMonitor monitor(producer);
+  monitor.watch("group-1", {"lag-a"});
+  monitor.watch("group-2", {"lag-a", "lag-b"});
+
+  vector<PartitionLag> lags;
+  auto err = monitor.poll(lags);
+  check("poll", string(rd_kafka_err2str(err)), string("Success"));
+  check("lags", lags.size(), static_cast<size_t>(4 + 4 + 2));
+
+  auto lag = find(lags, "group-1", "lag-a", 0);
+  check("group-1 lag-a[0] lag", lag ? lag->lag : -2, static_cast<int64_t>(7));
+  check("group-1 lag-a[0] low", lag ? lag->low : -2, static_cast<int64_t>(0));
+  lag = find(lags, "group-1", "lag-a", 1);
+  check("group-1 lag-a[1] lag", lag ? lag->lag : -2, static_cast<int64_t>(0));
+  lag = find(lags, "group-1", "lag-a", 2);
+  check("group-1 lag-a[2] committed", lag ? lag->committed : -2,
+        static_cast<int64_t>(RD_KAFKA_OFFSET_INVALID));
+  check("group-1 lag-a[2] lag", lag ? lag->lag : -2, static_cast<int64_t>(-1));
+  check("group-1 lag-a[2] high", lag ? lag->high : -2,
+        static_cast<int64_t>(10));
+  lag = find(lags, "group-2", "lag-b", 0);
+  check("group-2 lag-b[0] lag", lag ? lag->lag : -2, static_cast<int64_t>(5));
+
+  auto counts = monitor.requestCounts();
+  check("metadata requests", counts.metadata, 1L);
+  check("committed requests", counts.committed, 2L);
+  check("watermarks requests", counts.watermarks, 2L);
+
+  // watermarks are cached, committed offsets are always fetched
+  commit(bootstraps, "group-1", "lag-a", {{0, 8}});
+  err = monitor.poll(lags);
+  check("second poll", string(rd_kafka_err2str(err)), string("Success"));
+  lag = find(lags, "group-1", "lag-a", 0);
+  check("group-1 lag-a[0] lag after commit", lag ? lag->lag : -2,
+        static_cast<int64_t>(2));
+  counts = monitor.requestCounts();
+  check("metadata requests", counts.metadata, 1L);
+  check("committed requests", counts.committed, 4L);
+  check("watermarks requests", counts.watermarks, 2L);
+
+  // a group of an unknown topic fails alone
+  monitor.watch("group-3", {"no-such-topic"});
+  err = monitor.poll(lags);
+  check("unknown topic", string(rd_kafka_err2str(err)),
+        string(rd_kafka_err2str(RD_KAFKA_RESP_ERR_UNKNOWN_TOPIC_OR_PART)));
+  check("lags", lags.size(), static_cast<size_t>(4 + 4 + 2));
+  monitor.unwatch("group-3");
+
+  // partition counts from a shared cache instead of own requests
+  MetadataCache metadata(producer);
+  LagMonitorOptions options;
+  options.metadata = &metadata;
+  LagMonitor shared_monitor(producer, options);
+  shared_monitor.watch("group-1", {"lag-a"});
+  err = shared_monitor.poll(lags);
+  check("shared poll", string(rd_kafka_err2str(err)), string("Success"));
+  lag = find(lags, "group-1", "lag-a", 0);
+  check("shared group-1 lag-a[0] lag", lag ? lag->lag : -2,
+        static_cast<int64_t>(2));
+  shared_monitor.poll(lags);
+  check("shared metadata requests", shared_monitor.requestCounts().metadata,
+        0L);
+  check("cache metadata requests", metadata.numRequests(), 1L);
+
+  return test::exitCode();
+}
@@ -0,0 +1,126 @@
+#include "rdkafka_metadata.hpp"
+#include "rdkafka_error.hpp"
+#include "test_util.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+using namespace rdkafka;
+using namespace test;
+
+int main(int argc, char* argv[]) {
+  MockCluster cluster(3);
+  auto& producer = cluster.producer();
+  cluster.createTopic("meta-a", 6, 3);
+  cluster.createTopic("meta-b", 2);
+
+  MetadataCache cache(producer);
+  check("empty", MetadataCache::Reader(cache).get() == nullptr, true);
+  check("refresh", cache.refresh(), RD_KAFKA_RESP_ERR_NO_ERROR);
+  check("version", cache.version(), uint64_t(1));
+  {
+    MetadataCache::Reader reader(cache);
+    check("brokers", reader->brokers().size(), size_t(3));
+    check("partitions a", reader->partitionCount("meta-a"), 6);
+    check("partitions b", reader->partitionCount("meta-b"), 2);
+    check("unknown topic", reader->partitionCount("meta-c"), -1);
+    check("unknown partition", reader->findPartition("meta-a", 6) == nullptr,
+          true);
+
+    auto topic = reader->findTopic("meta-a");
+    bool consistent = topic != nullptr;
+    for (const auto& partition : reader->partitions(*topic)) {
+      // partitions are indexed by id, the leader is a replica and in the ISR
+      consistent = consistent &&
+                   &partition == reader->findPartition("meta-a", partition.id);
+      consistent = consistent && reader->replicas(partition).size() == 3 &&
+                   reader->isrs(partition).size() == 3;
+      bool leader_in_isr = false;
+      for (int32_t id : reader->isrs(partition))
+        leader_in_isr = leader_in_isr || id == partition.leader;
+      consistent = consistent && leader_in_isr &&
+                   reader->findBroker(partition.leader) != nullptr;
+    }
+    check("topic a consistent", consistent, true);
+    auto leader = reader->leader("meta-b", 1);
+    auto broker = reader->findBroker(leader);
+    check("leader b", broker != nullptr && broker->port > 0, true);
+  }
+
+  // nothing changed, nothing published
+  check("refresh again", cache.refresh(), RD_KAFKA_RESP_ERR_NO_ERROR);
+  check("unchanged version", cache.version(), uint64_t(1));
+  check("requests", cache.numRequests(), 2L);
+
+  // a single topic is merged into the snapshot
+  cluster.createTopic("meta-c", 4);
+  check("refresh topic", cache.refreshTopic("meta-c"),
+        RD_KAFKA_RESP_ERR_NO_ERROR);
+  check("merged version", cache.version(), uint64_t(2));
+  {
+    MetadataCache::Reader reader(cache);
+    check("merged c", reader->partitionCount("meta-c"), 4);
+    check("kept a", reader->partitionCount("meta-a"), 6);
+    check("kept b", reader->partitionCount("meta-b"), 2);
+  }
+
+  // readers on other threads while snapshots are swapped, each of them
+  // sees a whole snapshot
+  std::atomic<bool> running(true);
+  std::atomic<long> num_reads(0);
+  std::atomic<long> num_torn(0);
+  vector<thread> readers;
+  for (int i = 0; i < 4; i++) {
+    readers.emplace_back([&] {
+      while (running) {
+        MetadataCache::Reader reader(cache);
+        int32_t count = reader->partitionCount("meta-a");
+        int32_t total = 0;
+        for (const auto& topic : reader->topics()) {
+          total += static_cast<int32_t>(reader->partitions(topic).size());
+        }
+        if (count != 6 || total < 12) ++num_torn;
+        ++num_reads;
+      }
+    });
+  }
+  for (int i = 0; i < 20; i++) {
+    cluster.createTopic(("meta-new-" + to_string(i)).data(), 1);
+    cache.refresh();
+  }
+  running = false;
+  for (auto& reader : readers) reader.join();
+  check("swapped", cache.version() > uint64_t(10), true);
+  check("reads", num_reads.load() > 0, true);
+  check("torn reads", num_torn.load(), 0L);
+
+  // version() doesn't wait for a slow refresh
+  for (int32_t broker_id = 1; broker_id <= 3; broker_id++)
+    rd_kafka_mock_broker_set_rtt(cluster.get(), broker_id, 500);
+  thread slow_refresh([&cache]() { cache.refresh(); });
+  this_thread::sleep_for(chrono::milliseconds(100));
+  auto start = chrono::steady_clock::now();
+  cache.version();
+  auto waited = chrono::steady_clock::now() - start;
+  check("version during refresh", waited < chrono::milliseconds(100), true);
+  slow_refresh.join();
+  for (int32_t broker_id = 1; broker_id <= 3; broker_id++)
+    rd_kafka_mock_broker_set_rtt(cluster.get(), broker_id, 0);
+
+  // background refresh
+  MetadataCacheOptions options;
+  options.refresh_interval = std::chrono::milliseconds(50);
+  MetadataCache background(producer, options);
+  background.start();
+  for (int i = 0; i < 100 && background.numRequests() < 3; i++)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  background.stop();
+  check("background refreshes", background.numRequests() >= 3, true);
+  check("background version", background.version(), uint64_t(1));
+
+  return test::exitCode();
+}
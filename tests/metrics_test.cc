@@ -0,0 +1,88 @@
+#include "rdkafka_metrics.hpp"
+#include "test_util.hpp"
+
+#include <iostream>
+#include <thread>
+#include <vector>
+using namespace std;
+using rdkafka::ClientMetrics;
+using rdkafka::Histogram;
+using namespace test;
+
+int main(int argc, char* argv[]) {
+  // every value is within its bucket, buckets are contiguous
+  bool bounds_ok = true;
+  for (int bucket = 0; bucket < Histogram::kNumBuckets; bucket++) {
+    uint64_t lower = Histogram::lowerBound(bucket);
+    uint64_t upper = Histogram::upperBound(bucket);
+    if (Histogram::bucketOf(lower) != bucket ||
+        Histogram::bucketOf(upper) != bucket ||
+        (bucket > 0 && Histogram::upperBound(bucket - 1) + 1 != lower)) {
+      cerr << "[FAILED] bucket " << bucket << " [" << lower << ", " << upper
+           << "]" << endl;
+      bounds_ok = false;
+    }
+  }
+  check("bucket bounds", bounds_ok, true);
+  check("bucketOf(UINT64_MAX)", Histogram::bucketOf(UINT64_MAX),
+        Histogram::kNumBuckets - 1);
+
+  Histogram histogram;
+  for (uint64_t i = 1; i <= 1000; i++) histogram.record(i);
+  check("count", histogram.count(), uint64_t(1000));
+  check("sum", histogram.sum(), uint64_t(500500));
+  // 12.5% precision
+  check("p50", histogram.percentile(0.5), uint64_t(511));
+  check("p99", histogram.percentile(0.99), uint64_t(1023));
+  check("max", histogram.max(), uint64_t(1023));
+  check("empty percentile", Histogram().percentile(0.5), uint64_t(0));
+
+  // threads record into their own shards, snapshot() merges them
+  ClientMetrics metrics;
+  constexpr int kNumThreads = ClientMetrics::kNumShards + 4;
+  constexpr int kNumRecords = 10000;
+  vector<thread> threads;
+  for (int i = 0; i < kNumThreads; i++) {
+    threads.emplace_back([&metrics, i] {
+      for (int j = 0; j < kNumRecords; j++) {
+        metrics.add(ClientMetrics::Counter::kProduceCalls);
+        metrics.record(ClientMetrics::HistogramType::kConsumeBatchSize, i);
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+
+  metrics.recordProduce(RD_KAFKA_RESP_ERR__QUEUE_FULL);
+  metrics.recordProduce(RD_KAFKA_RESP_ERR_NO_ERROR);
+
+  auto snapshot = metrics.snapshot();
+  check("produce_calls",
+        snapshot.get(ClientMetrics::Counter::kProduceCalls),
+        uint64_t(kNumThreads * kNumRecords));
+  check("queue_full", snapshot.get(ClientMetrics::Counter::kQueueFull),
+        uint64_t(1));
+  check("produced_messages",
+        snapshot.get(ClientMetrics::Counter::kProducedMessages), uint64_t(1));
+  auto const& batch_size =
+      snapshot.get(ClientMetrics::HistogramType::kConsumeBatchSize);
+  check("batch_size.count", batch_size.count(),
+        uint64_t(kNumThreads * kNumRecords));
+  check("batch_size.sum", batch_size.sum(),
+        uint64_t(kNumRecords * kNumThreads * (kNumThreads - 1) / 2));
+  check("counter name",
+        string(ClientMetrics::name(ClientMetrics::Counter::kQueueFull)),
+        string("queue_full"));
+
+  // nothing is allocated until the first record, moves keep the values
+  ClientMetrics idle;
+  check("idle size", sizeof(idle), sizeof(void*));
+  check("idle count", idle.count(ClientMetrics::Counter::kProduceCalls),
+        uint64_t(0));
+  ClientMetrics moved(std::move(metrics));
+  check("moved count", moved.count(ClientMetrics::Counter::kProduceCalls),
+        uint64_t(kNumRecords * kNumThreads));
+  check("moved from count",
+        metrics.count(ClientMetrics::Counter::kProduceCalls), uint64_t(0));
+
+  return test::exitCode();
+}
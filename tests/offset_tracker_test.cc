@@ -0,0 +1,178 @@
+#include "rdkafka_offset_tracker.hpp"
+#include "rdkafka_error.hpp"
+#include "test_util.hpp"
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+using namespace rdkafka;
+using namespace test;
+
+static void testPendingOffsets() {
+  PendingOffsets pending;
+  check("empty", pending.committable(), int64_t(RD_KAFKA_OFFSET_INVALID));
+
+  // 60..139 across word boundaries, completed from the back
+  for (int64_t offset = 60; offset < 140; offset++) pending.add(offset);
+  check("size", pending.size(), size_t(80));
+  check("all pending", pending.committable(), int64_t(60));
+  for (int64_t offset = 139; offset > 60; offset--) pending.remove(offset);
+  check("first pending", pending.committable(), int64_t(60));
+  check("remove again", pending.remove(100), false);
+  check("remove first", pending.remove(60), true);
+  check("all done", pending.committable(), int64_t(140));
+  check("none pending", pending.size(), size_t(0));
+
+  // gaps of compacted offsets don't hold the commit back
+  for (int64_t offset : {200, 205, 300, 1000}) pending.add(offset);
+  pending.remove(200);
+  check("gap", pending.committable(), int64_t(205));
+  pending.remove(205);
+  check("gap across words", pending.committable(), int64_t(300));
+  pending.remove(1000);
+  check("hole", pending.committable(), int64_t(300));
+  pending.remove(300);
+  check("gaps done", pending.committable(), int64_t(1001));
+
+  // a sliding window of 1000 pending offsets wraps the ring many times
+  // without growing it
+  for (int64_t offset = 2000; offset < 3000; offset++) pending.add(offset);
+  size_t capacity = 0;
+  for (int64_t offset = 3000; offset < 100000; offset++) {
+    pending.add(offset);
+    pending.remove(offset - 1000);
+    if (offset == 4000) capacity = pending.capacity();
+  }
+  check("window", pending.committable(), int64_t(99000));
+  check("window capacity", pending.capacity(), capacity);
+
+  // seeking back forgets the pending offsets
+  pending.add(50);
+  check("seek", pending.committable(), int64_t(50));
+  check("seek size", pending.size(), size_t(1));
+  check("stale", pending.remove(99500), false);
+}
+
+static int64_t committed(rd_kafka_t* rk, const char* topic, int32_t partition) {
+  PointerHolder<rd_kafka_topic_partition_list_t> list(
+      rd_kafka_topic_partition_list_new(1));
+  auto elem = rd_kafka_topic_partition_list_add(list.get(), topic, partition);
+  error::checkRespError(rd_kafka_committed(rk, list.get(), 5000),
+                        "rd_kafka_committed");
+  return elem->offset;
+}
+
+static void testCommits() {
+  MockCluster cluster;
+  auto& producer = cluster.producer();
+  cluster.createTopic("tracked", 2);
+  char errstr[512];
+  {
+    Topic topic(producer.get(), "tracked");
+    char payload[] = "tracked";
+    for (int32_t partition = 0; partition < 2; partition++) {
+      producer.setPartition(partition);
+      for (int i = 0; i < 100; i++)
+        producer.produce(topic, payload, sizeof(payload));
+    }
+    producer.flush(10 * 1000);
+  }
+
+  GlobalConf consumer_conf;
+  consumer_conf.put("bootstrap.servers",
+                    cluster.bootstraps());
+  consumer_conf.put("group.id", "tracker");
+  consumer_conf.put("enable.auto.commit", "false");
+  Consumer consumer(std::move(consumer_conf), errstr);
+  if (consumer.isNull())
+    error::Exit("[ERROR] Create consumer failed: %s\n", errstr);
+
+  PointerHolder<rd_kafka_topic_partition_list_t> partitions(
+      rd_kafka_topic_partition_list_new(2));
+  for (int32_t partition = 0; partition < 2; partition++) {
+    rd_kafka_topic_partition_list_add(partitions.get(), "tracked", partition)
+        ->offset = RD_KAFKA_OFFSET_BEGINNING;
+  }
+
+  OffsetTrackerOptions options;
+  options.commit_interval = std::chrono::milliseconds(60 * 1000);
+  options.commit_threshold = 150;
+  OffsetTracker tracker(consumer.get(), options);
+  tracker.assign(partitions.get());
+  error::checkRespError(rd_kafka_assign(consumer.get(), partitions.get()),
+                        "rd_kafka_assign");
+
+  vector<Message> messages;
+  while (messages.size() < 200) {
+    auto message = consumer.consume(1000);
+    if (message.isNull() || message.hasError()) continue;
+    tracker.track(message);
+    messages.push_back(std::move(message));
+  }
+
+  // complete in reverse order, except partition 0's offset 40
+  for (auto it = messages.rbegin(); it != messages.rend(); ++it) {
+    if (it->partition() == 0 && it->offset() == 40) continue;
+    tracker.complete(*it);
+  }
+  check("committable 0", tracker.committable("tracked", 0), int64_t(40));
+  check("committable 1", tracker.committable("tracked", 1), int64_t(100));
+
+  // 199 completions reached the threshold, a single request commits both
+  error::checkRespError(tracker.poll(), "poll");
+  for (int i = 0; i < 100 && tracker.counts().offsets < 2; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    tracker.poll();
+  }
+  check("commits", tracker.counts().commits, 1L);
+  check("offsets", tracker.counts().offsets, 2L);
+  check("committed 0", committed(consumer.get(), "tracked", 0), int64_t(40));
+  check("committed 1", committed(consumer.get(), "tracked", 1), int64_t(100));
+
+  // nothing moved, nothing to commit
+  check("commit unchanged", tracker.commit(),
+        RD_KAFKA_RESP_ERR_NO_ERROR);
+  check("no request", tracker.counts().commits, 1L);
+
+  // the consumer seeked back: the lower offset is committed once, not again
+  // by every commit until the partition passes the old one
+  tracker.track("tracked", 1, 50);
+  check("committable after seek", tracker.committable("tracked", 1),
+        int64_t(50));
+  check("commit after seek", tracker.commit(), RD_KAFKA_RESP_ERR_NO_ERROR);
+  check("committed after seek", committed(consumer.get(), "tracked", 1),
+        int64_t(50));
+  check("commit after seek again", tracker.commit(),
+        RD_KAFKA_RESP_ERR_NO_ERROR);
+  check("seek requests", tracker.counts().commits, 2L);
+
+  // revoke commits the last completion synchronously
+  for (const auto& message : messages) {
+    if (message.partition() == 0 && message.offset() == 40)
+      tracker.complete(message);
+  }
+  check("revoke", tracker.revoke(partitions.get()),
+        RD_KAFKA_RESP_ERR_NO_ERROR);
+  check("revoke request", tracker.counts().commits, 3L);
+  check("committed after revoke", committed(consumer.get(), "tracked", 0),
+        int64_t(100));
+  check("revoked", tracker.committable("tracked", 0),
+        int64_t(RD_KAFKA_OFFSET_INVALID));
+
+  // completions of revoked partitions are ignored
+  long completed = tracker.counts().completed;
+  tracker.complete(messages[0]);
+  check("ignored", tracker.counts().completed, completed);
+
+  messages.clear();
+  rd_kafka_assign(consumer.get(), nullptr);
+  consumer.waitUntilRebalanceRevoke();
+}
+
+int main(int argc, char* argv[]) {
+  testPendingOffsets();
+  testCommits();
+  return test::exitCode();
+}
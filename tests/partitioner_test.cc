@@ -0,0 +1,124 @@
+#include "rdkafka_classes.hpp"
+#include "test_util.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+using namespace rdkafka;
+using namespace test;
+
+static vector<int32_t> delivered_partitions;
+
+static void dr_msg_cb(rd_kafka_t*, const rd_kafka_message_t* rkmessage,
+                      void*) {
+  auto index = reinterpret_cast<size_t>(rkmessage->_private);
+  delivered_partitions[index] = rkmessage->partition;
+}
+
+// keyless messages must switch partition every batch_messages messages
+static void testStickyPartitioner() {
+  constexpr int kNumPartitions = 8;
+  constexpr int kBatchMessages = 100;
+  constexpr int kNumMessages = 1000;
+
+  GlobalConf conf;
+  conf.put("sticky.partitioning.linger.ms", "0");
+  conf.setDeliveryReportCallback(dr_msg_cb);
+  MockCluster cluster(1, std::move(conf));
+  auto& producer = cluster.producer();
+  cluster.createTopic("partitioner_test", kNumPartitions);
+
+  StickyPartitioner<> partitioner(kBatchMessages);
+  TopicConf topic_conf;
+  topic_conf.setPartitioner(&partitioner);
+  Topic topic(producer.get(), "partitioner_test", std::move(topic_conf));
+
+  // Wait for the leaders. Without them, batches skip unavailable partitions
+  // and several in a row may land on the same one.
+  const rd_kafka_metadata_t* metadata = nullptr;
+  error::checkRespError(
+      rd_kafka_metadata(producer.get(), 0, topic.get(), &metadata, 5000),
+      "rd_kafka_metadata");
+  rd_kafka_metadata_destroy(metadata);
+
+  delivered_partitions.assign(kNumMessages + 1, -1);
+  char payload[] = "sticky";
+  for (size_t i = 0; i < kNumMessages; i++) {
+    producer.produce(topic, payload, sizeof(payload), nullptr, 0,
+                     reinterpret_cast<void*>(i));
+  }
+  char key[] = "key";
+  producer.produce(topic, payload, sizeof(payload), key, sizeof(key) - 1,
+                   reinterpret_cast<void*>(size_t(kNumMessages)));
+  producer.flush(10 * 1000);
+
+  int num_switches = 0;
+  bool sticky = true;
+  for (int i = 1; i < kNumMessages; i++) {
+    if (delivered_partitions[i] == delivered_partitions[i - 1]) continue;
+    ++num_switches;
+    if (i % kBatchMessages != 0) sticky = false;
+  }
+  check("sticky", sticky, true);
+  check("switches", num_switches, kNumMessages / kBatchMessages - 1);
+  check("keyed partition", delivered_partitions[kNumMessages],
+        static_cast<int32_t>((murmur2(key, 3) & 0x7fffffff) % kNumPartitions));
+}
+
+int main(int argc, char* argv[]) {
+  // test vectors of the Java client's Utils.murmur2()
+  check("murmur2(21)", static_cast<int32_t>(murmur2("21", 2)), -973932308);
+  check("murmur2(foobar)", static_cast<int32_t>(murmur2("foobar", 6)),
+        -790332482);
+  const char* long_key = "lkjh234lh9fiuh90y23oiuhsafujhadof229phr9h19h89h8";
+  check("murmur2(long)",
+        static_cast<int32_t>(murmur2(long_key, strlen(long_key))), -58897971);
+
+  // same partitions as librdkafka's murmur2 partitioner, for every tail size
+  Murmur2Partitioner murmur2_partitioner;
+  bool same_as_librdkafka = true;
+  string key;
+  for (int i = 0; i < 1000; i++) {
+    key += static_cast<char>('a' + i % 26);
+    if (key.size() > 40) key.clear();
+    int32_t expected = rd_kafka_msg_partitioner_murmur2(
+        nullptr, key.data(), key.size(), 37, nullptr, nullptr);
+    if (murmur2_partitioner.partition(nullptr, key.data(), key.size(), 37) !=
+        expected)
+      same_as_librdkafka = false;
+  }
+  check("same as librdkafka", same_as_librdkafka, true);
+
+  // adding a partition only moves the keys taken by the new one
+  ConsistentHashPartitioner consistent;
+  constexpr int kNumKeys = 10000;
+  int num_moved = 0;
+  int num_to_new = 0;
+  vector<int> keys_per_partition(16);
+  for (int i = 0; i < kNumKeys; i++) {
+    key = "key-" + to_string(i);
+    int32_t before = consistent.partition(nullptr, key.data(), key.size(), 16);
+    int32_t after = consistent.partition(nullptr, key.data(), key.size(), 17);
+    keys_per_partition[before]++;
+    if (before != after) {
+      ++num_moved;
+      if (after == 16) ++num_to_new;
+    }
+  }
+  check("moved keys go to the new partition", num_to_new, num_moved);
+  check("moved about 1/17 keys", num_moved > 0 && num_moved < kNumKeys / 10,
+        true);
+  check("every partition has keys",
+        *min_element(keys_per_partition.begin(), keys_per_partition.end()) > 0,
+        true);
+  check("same partition",
+        consistent.partition(nullptr, "key-1", 5, 16) ==
+            consistent.partition(nullptr, "key-1", 5, 16),
+        true);
+
+  testStickyPartitioner();
+
+  return test::exitCode();
+}
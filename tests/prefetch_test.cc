@@ -0,0 +1,127 @@
+#include "rdkafka_prefetch.hpp"
+#include "rdkafka_error.hpp"
+#include "test_util.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+using namespace rdkafka;
+using namespace test;
+
+static const char* kTopic = "prefetch";
+static const int kNumPartitions = 3;
+static const int kNumMessages = 300;  // per partition
+static const size_t kPayloadSize = 1000;
+
+int main(int argc, char* argv[]) {
+  MockCluster cluster;
+  auto& producer = cluster.producer();
+  cluster.createTopic(kTopic, kNumPartitions);
+  const char* bootstraps = cluster.bootstraps();
+  char errstr[512];
+
+  string payload(kPayloadSize, 'x');
+  for (int32_t partition = 0; partition < kNumPartitions; partition++) {
+    for (int i = 0; i < kNumMessages; i++) {
+      error::checkRespError(
+          rd_kafka_producev(producer.get(), RD_KAFKA_V_TOPIC(kTopic),
+                            RD_KAFKA_V_PARTITION(partition),
+                            RD_KAFKA_V_MSGFLAGS(RD_KAFKA_MSG_F_COPY),
+                            RD_KAFKA_V_VALUE(&payload[0], payload.size()),
+                            RD_KAFKA_V_END),
+          "rd_kafka_producev");
+    }
+  }
+  check("flush", producer.flush(10 * 1000), true);
+
+  GlobalConf conf;
+  conf.put("bootstrap.servers", bootstraps);
+  conf.put("group.id", "prefetch-test");
+  conf.put("enable.auto.commit", "false");
+  conf.put("queued.max.messages.kbytes", "64");
+  conf.put("max.partition.fetch.bytes", "16384");
+  Consumer consumer(std::move(conf), errstr);
+  if (consumer.isNull())
+    error::Exit("[ERROR] Create consumer failed: %s\n", errstr);
+
+  PartitionPrefetcher prefetcher(consumer, 20 * kPayloadSize);
+  prefetcher.setLimit(kTopic, 1, 50 * kPayloadSize);
+  check("default limit", prefetcher.limit(kTopic, 0), 20 * kPayloadSize);
+  check("partition limit", prefetcher.limit(kTopic, 1), 50 * kPayloadSize);
+
+  PointerHolder<rd_kafka_topic_partition_list_t> partitions(
+      rd_kafka_topic_partition_list_new(kNumPartitions));
+  for (int32_t p = 0; p < kNumPartitions; p++)
+    rd_kafka_topic_partition_list_add(partitions.get(), kTopic, p)->offset =
+        RD_KAFKA_OFFSET_BEGINNING;
+  prefetcher.assign(partitions.get());
+  error::checkRespError(rd_kafka_assign(consumer.get(), partitions.get()),
+                        "rd_kafka_assign");
+  check("partitions", prefetcher.numPartitions(), size_t(kNumPartitions));
+
+  vector<int64_t> last(kNumPartitions, -1);
+  int num_consumed = 0;
+  bool in_order = true;
+  auto consumeOne = [&]() -> int32_t {
+    auto message = prefetcher.consume(5000);
+    if (message.isNull()) return -1;
+    if (message.hasError()) return -2;
+    auto partition = message.partition();
+    if (message.offset() <= last[partition]) in_order = false;
+    last[partition] = message.offset();
+    ++num_consumed;
+    return partition;
+  };
+
+  // let librdkafka fill the partitions' queues, the first round fills the
+  // buffers from them
+  this_thread::sleep_for(chrono::seconds(2));
+  for (int i = 0; i < kNumPartitions; i++) consumeOne();
+  // filled up to the limit, then one message was consumed
+  check("buffered default", prefetcher.bufferedBytes(kTopic, 0),
+        19 * kPayloadSize);
+  check("buffered partition limit", prefetcher.bufferedBytes(kTopic, 1),
+        49 * kPayloadSize);
+
+  // partitions with buffered messages take turns
+  bool round_robin = true;
+  for (int round = 0; round < 10; round++) {
+    vector<bool> seen(kNumPartitions, false);
+    for (int i = 0; i < kNumPartitions; i++) {
+      auto partition = consumeOne();
+      if (partition < 0 || seen[partition]) round_robin = false;
+      if (partition >= 0) seen[partition] = true;
+    }
+  }
+  check("round robin", round_robin, true);
+
+  // without limits the buffers drain and aren't refilled
+  prefetcher.setDefaultLimit(0);
+  prefetcher.setLimit(kTopic, 1, 0);
+  for (int i = 0; i < 300; i++) consumeOne();
+  size_t buffered = 0;
+  for (int32_t p = 0; p < kNumPartitions; p++)
+    buffered += prefetcher.bufferedBytes(kTopic, p);
+  check("drained", buffered, size_t(0));
+
+  while (num_consumed < kNumPartitions * kNumMessages) {
+    if (consumeOne() == -1) break;
+  }
+  check("consumed", num_consumed, kNumPartitions * kNumMessages);
+  check("in order", in_order, true);
+  check("metrics",
+        consumer.metrics().snapshot().get(
+            ClientMetrics::Counter::kConsumedMessages) >=
+            static_cast<uint64_t>(num_consumed),
+        true);
+
+  prefetcher.revoke();
+  check("revoked", prefetcher.numPartitions(), size_t(0));
+  error::checkRespError(rd_kafka_assign(consumer.get(), nullptr),
+                        "rd_kafka_assign");
+  consumer.waitUntilRebalanceRevoke();
+  return test::exitCode();
+}
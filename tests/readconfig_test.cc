@@ -0,0 +1,120 @@
+#include "rdkafka_readconfig.hpp"
+#include "test_util.hpp"
+
+#include <stdlib.h>
+
+#include <iostream>
+#include <string>
+using namespace std;
+using namespace rdkafka;
+using namespace test;
+
+static string get(const TopicConf& conf, const char* name) {
+  char value[512];
+  size_t size = sizeof(value);
+  if (rd_kafka_topic_conf_get(conf.get(), name, value, &size) !=
+      RD_KAFKA_CONF_OK)
+    return "<unknown>";
+  return value;
+}
+
+static string get(const GlobalConf& conf, const char* name) {
+  char value[512];
+  size_t size = sizeof(value);
+  if (rd_kafka_conf_get(conf.get(), name, value, &size) != RD_KAFKA_CONF_OK)
+    return "<unknown>";
+  return value;
+}
+
+// error line of an invalid config, 0 if it's valid
+static int errorLine(const char* text) {
+  ConfigSet config_set;
+  ConfigError error;
+  if (config_set.parse(text, error)) {
+    GlobalConf global_conf;
+    TopicConf topic_conf;
+    if (config_set.toGlobalConf(global_conf, error) &&
+        config_set.toTopicConf(topic_conf, "", error))
+      return 0;
+  }
+  cout << "error: " << error.toString() << endl;
+  return error.line;
+}
+
+int main(int argc, char* argv[]) {
+  char filename[] = "/tmp/readconfig_test_XXXXXX";
+  int fd = mkstemp(filename);
+  if (fd == -1) error::Exit("[ERROR] mkstemp failed\n");
+  const char text[] =
+      "# comment\n"
+      "[global]\n"
+      "  client.id = readconfig_test  # comment\r\n"
+      "\n"
+      "[topic]\n"
+      "acks=all\n"
+      "message.timeout.ms=1000\n"
+      "[ topic:orders ]\n"
+      "message.timeout.ms=2000\n"
+      "[topic:payments]\n"
+      "acks=1\n"
+      "[topic:orders]\n"
+      "request.timeout.ms=3000";
+  if (write(fd, text, sizeof(text) - 1) != sizeof(text) - 1)
+    error::Exit("[ERROR] write failed\n");
+  close(fd);
+
+  ConfigSet config_set;
+  ConfigError error;
+  check("load", config_set.load(filename, error), true);
+  unlink(filename);
+  check("entries", config_set.entries().size(), size_t(6));
+  check("topics", config_set.topicNames().size(), size_t(2));
+  check("last entry line", config_set.entries().back().line, 13);
+
+  GlobalConf global_conf;
+  check("toGlobalConf", config_set.toGlobalConf(global_conf, error), true);
+  check("client.id", get(global_conf, "client.id"), string("readconfig_test"));
+
+  TopicConf default_conf;
+  check("toTopicConf", config_set.toTopicConf(default_conf, "", error), true);
+  check("default message.timeout.ms", get(default_conf, "message.timeout.ms"),
+        string("1000"));
+
+  // both [topic:orders] sections override [topic]
+  TopicConf orders_conf;
+  check("toTopicConf(orders)",
+        config_set.toTopicConf(orders_conf, "orders", error), true);
+  check("orders acks", get(orders_conf, "acks"), string("-1"));
+  check("orders message.timeout.ms", get(orders_conf, "message.timeout.ms"),
+        string("2000"));
+  check("orders request.timeout.ms", get(orders_conf, "request.timeout.ms"),
+        string("3000"));
+
+  // the last '#' of a line starts a comment, like the old line reader
+  ConfigSet hashes;
+  check("parse '#'",
+        hashes.parse("[global]\nk=a#b  # note\nj=c#d\n  # x=1\n", error),
+        true);
+  check("'#' entries", hashes.entries().size(), size_t(2));
+  check("'#' before a comment", hashes.entries()[0].value.toString(),
+        string("a#b"));
+  check("'#' without a comment", hashes.entries()[1].value.toString(),
+        string("c"));
+
+  check("open failed", config_set.load("/nonexistent.conf", error), false);
+  check("open failed line", error.line, 0);
+
+  check("valid", errorLine("[global]\nclient.id=a\n"), 0);
+  check("no header", errorLine("\nclient.id=a\n"), 2);
+  check("invalid header", errorLine("[global]\n[global\n"), 2);
+  check("unknown header", errorLine("[global]\n\n[consumer]\n"), 3);
+  check("empty topic name", errorLine("[topic: ]\n"), 1);
+  check("no '='", errorLine("[global]\nclient.id\n"), 2);
+  check("empty name", errorLine("[topic]\n=1\n"), 2);
+  check("unknown property",
+        errorLine("[global]\nclient.id=a\n[topic]\nno.such.property=1\n"), 4);
+  check("invalid value", errorLine("[global]\n\napi.version.request=maybe\n"),
+        3);
+
+  return test::exitCode();
+}
@@ -0,0 +1,135 @@
+#include "rdkafka_serde.hpp"
+#include "test_util.hpp"
+
+#include <stdint.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+using namespace rdkafka;
+using namespace test;
+
+static string hex(Slice bytes) {
+  static const char kDigits[] = "0123456789abcdef";
+  string s;
+  for (char c : bytes) {
+    s += kDigits[static_cast<uint8_t>(c) >> 4];
+    s += kDigits[static_cast<uint8_t>(c) & 0xf];
+  }
+  return s;
+}
+
+static void testCodecs() {
+  char out[64];
+  check("int32 encode", hex(BigEndianSerde<int32_t>::encode(0x01020304, out)),
+        string("01020304"));
+  check("int16 -2 encode", hex(BigEndianSerde<int16_t>::encode(-2, out)),
+        string("fffe"));
+
+  int64_t i64 = 0;
+  BigEndianSerde<int64_t>::encode(-1234567890123LL, out);
+  bool ok = BigEndianSerde<int64_t>::decode(Slice(out, 8), &i64);
+  check("int64 decode", ok ? i64 : 0, static_cast<int64_t>(-1234567890123LL));
+  ok = BigEndianSerde<int64_t>::decode(Slice(out, 7), &i64);
+  check("int64 decode 7 bytes", ok, false);
+
+  using StringSerde = LengthPrefixedSerde<int16_t>;
+  Slice encoded = StringSerde::encode("kafka", out);
+  check("string encode", hex(encoded), string("00056b61666b61"));
+  Slice s;
+  ok = StringSerde::decode(encoded, &s);
+  check("string decode", ok ? s.toString() : "", string("kafka"));
+  check("string decode zero-copy", s.data() == out + 2, true);
+  ok = StringSerde::decode(Slice(out, encoded.size() - 1), &s);
+  check("string decode truncated", ok, false);
+
+  encoded = StringSerde::encode(Slice(), out);
+  check("null string encode", hex(encoded), string("ffff"));
+  s = "not null";
+  ok = StringSerde::decode(encoded, &s);
+  check("null string decode", ok && s.data() == nullptr, true);
+
+  string too_long(40000, 'x');
+  vector<char> big_out(StringSerde::maxSize(too_long));
+  check("too long string encode",
+        StringSerde::encode(too_long, big_out.data()).data() == nullptr, true);
+
+  char raw[] = "raw bytes";
+  check("raw encode zero-copy", RawSerde::encode(raw, out).data() == raw,
+        true);
+  string str;
+  RawSerde::decode(Slice(raw), &str);
+  check("raw decode to string", str, string("raw bytes"));
+}
+
+static void testProduceConsume() {
+  MockCluster cluster;
+  auto& producer = cluster.producer();
+  cluster.createTopic("serde_test", 1);
+  char errstr[512];
+
+  // librdkafka must copy the arena even if the producer doesn't copy
+  producer.setMsgflags(0);
+  Topic topic(producer.get(), "serde_test");
+  TypedProducer<int64_t, string, BigEndianSerde<int64_t>,
+                LengthPrefixedSerde<>>
+      typed_producer(producer);
+  int num_failed = 0;
+  for (int64_t i = 0; i < 10; i++) {
+    if (typed_producer.produce(topic, i, "value-" + to_string(i)) !=
+        RD_KAFKA_RESP_ERR_NO_ERROR)
+      ++num_failed;
+  }
+  check("produce failed", num_failed, 0);
+  typed_producer.produce(topic, string("keyless"));
+
+  // too long for an int16_t length, nothing is produced
+  TypedProducer<int64_t, string, BigEndianSerde<int64_t>,
+                LengthPrefixedSerde<int16_t>>
+      short_producer(producer);
+  check("produce too long",
+        short_producer.produce(topic, 11, string(40000, 'x')),
+        RD_KAFKA_RESP_ERR_MSG_SIZE_TOO_LARGE);
+  producer.flush(10 * 1000);
+
+  GlobalConf consumer_conf;
+  consumer_conf.put("bootstrap.servers",
+                    cluster.bootstraps());
+  consumer_conf.put("group.id", "serde_test");
+  consumer_conf.put("auto.offset.reset", "earliest");
+  Consumer consumer(std::move(consumer_conf), errstr);
+  if (consumer.isNull())
+    error::Exit("[ERROR] Create consumer failed: %s\n", errstr);
+  consumer.subscribe({"serde_test"});
+
+  TypedConsumer<int64_t, Slice, BigEndianSerde<int64_t>, LengthPrefixedSerde<>>
+      typed_consumer(consumer);
+  int num_consumed = 0;
+  int num_wrong = 0;
+  int num_keyless = 0;
+  for (int i = 0; i < 30 && num_consumed < 11; i++) {
+    auto message = typed_consumer.consume(1000);
+    if (message.message().isNull() || message.message().hasError()) continue;
+    ++num_consumed;
+    int64_t key;
+    Slice value;
+    if (!message.value(&value)) {
+      ++num_wrong;
+    } else if (!message.key(&key)) {
+      if (value == "keyless") ++num_keyless;
+    } else if (value != "value-" + to_string(key)) {
+      ++num_wrong;
+    }
+  }
+  consumer.waitUntilRebalanceRevoke();
+  check("consumed", num_consumed, 11);
+  check("wrong", num_wrong, 0);
+  check("keyless", num_keyless, 1);
+}
+
+int main(int argc, char* argv[]) {
+  testCodecs();
+  testProduceConsume();
+  return test::exitCode();
+}
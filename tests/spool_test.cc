@@ -0,0 +1,233 @@
+#include "rdkafka_spool.hpp"
+#include "rdkafka_error.hpp"
+#include "test_util.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+using namespace rdkafka;
+using namespace test;
+
+static vector<string> listFiles(const string& directory) {
+  vector<string> files;
+  DIR* dir = opendir(directory.data());
+  while (auto entry = readdir(dir)) {
+    if (entry->d_name[0] != '.') files.push_back(entry->d_name);
+  }
+  closedir(dir);
+  sort(files.begin(), files.end());
+  return files;
+}
+
+static void removeAll(const string& directory) {
+  for (const auto& file : listFiles(directory))
+    unlink((directory + "/" + file).data());
+  rmdir(directory.data());
+}
+
+static SpoolRecord record(const string& payload) {
+  return {"spool", 0, "key", payload};
+}
+
+// payloads of up to max oldest records
+static vector<string> peek(const DiskSpool& spool, size_t max) {
+  vector<SpoolRecord> records(max);
+  size_t n = spool.peek(records.data(), max);
+  vector<string> payloads;
+  for (size_t i = 0; i < n; i++)
+    payloads.push_back(records[i].payload.toString());
+  return payloads;
+}
+
+int main(int argc, char* argv[]) {
+  char dir_template[] = "/tmp/spool_test.XXXXXX";
+  const string directory = mkdtemp(dir_template);
+  string error;
+
+  SpoolOptions options;
+  options.segment_bytes = 4096;
+  options.max_bytes = 64 * 4096;
+  {
+    DiskSpool spool(options);
+    check("open", spool.open(directory, error), true);
+    check("empty", spool.empty(), true);
+    for (int i = 0; i < 1000; i++)
+      spool.append(record("message-" + to_string(i)));
+    check("size", spool.size(), size_t(1000));
+    check("segments", spool.numSegments() > size_t(1), true);
+
+    SpoolRecord first;
+    check("peek", spool.peek(&first, 1), size_t(1));
+    check("topic", first.topic.toString(), string("spool"));
+    check("key", first.key.toString(), string("key"));
+    check("payload", first.payload.toString(), string("message-0"));
+
+    // all records in order, replayed segments are deleted
+    bool in_order = true;
+    size_t num_files = listFiles(directory).size();
+    int next = 0;
+    while (!spool.empty()) {
+      auto payloads = peek(spool, 64);
+      for (const auto& payload : payloads)
+        in_order = in_order && payload == "message-" + to_string(next++);
+      spool.pop(payloads.size());
+    }
+    check("in order", in_order, true);
+    check("replayed", next, 1000);
+    check("deleted", listFiles(directory).size() < num_files, true);
+
+    // null key and payload are kept apart from empty ones
+    spool.append({"spool", 3, Slice(), ""});
+    SpoolRecord null_key;
+    spool.peek(&null_key, 1);
+    check("partition", null_key.partition, 3);
+    check("null key", null_key.key.data() == nullptr, true);
+    check("empty payload", null_key.payload.data() != nullptr, true);
+    spool.pop(1);
+
+    check("too large", spool.append(record(string(4096, 'x'))),
+          RD_KAFKA_RESP_ERR_MSG_SIZE_TOO_LARGE);
+    ErrorCode error_code = RD_KAFKA_RESP_ERR_NO_ERROR;
+    int num_appended = 0;
+    while (error_code == RD_KAFKA_RESP_ERR_NO_ERROR && num_appended < 100000) {
+      error_code = spool.append(record(string(1000, 'x')));
+      if (error_code == RD_KAFKA_RESP_ERR_NO_ERROR) ++num_appended;
+    }
+    check("full", error_code, RD_KAFKA_RESP_ERR__QUEUE_FULL);
+    check("segments when full", spool.numSegments(), size_t(64));
+    while (!spool.empty()) spool.pop(peek(spool, 64).size());
+  }
+  removeAll(directory);
+  mkdir(directory.data(), 0755);
+
+  // recovery: replayed records aren't replayed again, a torn record ends
+  // its segment
+  {
+    DiskSpool spool(options);
+    spool.open(directory, error);
+    for (int i = 0; i < 10; i++)
+      spool.append(record("message-" + to_string(i)));
+    spool.pop(3);
+  }
+  {
+    DiskSpool spool(options);
+    check("reopen", spool.open(directory, error), true);
+    check("recovered", spool.size(), size_t(7));
+    auto payloads = peek(spool, 1);
+    check("first recovered", payloads.empty() ? string() : payloads[0],
+          string("message-3"));
+    spool.append(record("message-10"));
+    check("appended after recovery", spool.size(), size_t(8));
+  }
+  {
+    auto files = listFiles(directory);
+    int fd = open((directory + "/" + files[0]).data(), O_RDWR);
+    // the last byte of "message-9", the 10th record of the first segment:
+    // header, partition and sizes, "spool", "key", "message-9"
+    size_t record_size = 12 + 14 + 5 + 3 + 9;
+    pwrite(fd, "X", 1, static_cast<off_t>(10 * record_size - 1));
+    close(fd);
+
+    DiskSpool spool(options);
+    check("reopen torn", spool.open(directory, error), true);
+    check("recovered torn", spool.size(), size_t(6 + 1));
+  }
+  removeAll(directory);
+  mkdir(directory.data(), 0755);
+
+  // a disk without room for a segment fails append(), here a file size limit
+  // below segment_bytes
+  {
+    struct rlimit saved;
+    getrlimit(RLIMIT_FSIZE, &saved);
+    struct rlimit limited = saved;
+    limited.rlim_cur = 1024;
+    signal(SIGXFSZ, SIG_IGN);
+    setrlimit(RLIMIT_FSIZE, &limited);
+    DiskSpool spool(options);
+    spool.open(directory, error);
+    check("no room", spool.append(record("message")),
+          RD_KAFKA_RESP_ERR__FS);
+    check("no room error",
+          spool.lastError().find("fallocate") != string::npos, true);
+    check("no room file removed", listFiles(directory).size(), size_t(0));
+    setrlimit(RLIMIT_FSIZE, &saved);
+    signal(SIGXFSZ, SIG_DFL);
+  }
+
+  // spill while the broker is down, replay in order once it's up
+  MockCluster cluster;
+  cluster.createTopic("spool", 1);
+  const char* bootstraps = cluster.bootstraps();
+  char errstr[512];
+  rd_kafka_mock_broker_set_down(cluster.get(), 1);
+
+  GlobalConf conf;
+  conf.put("bootstrap.servers", bootstraps);
+  conf.put("queue.buffering.max.messages", "10");
+  Producer producer(std::move(conf), errstr);
+  if (producer.isNull())
+    error::Exit("[ERROR] Create producer failed: %s\n", errstr);
+  {
+    options.replay_batch = 4;
+    SpoolingProducer spooling(producer, options);
+    check("open spooling", spooling.open(directory, error), true);
+    Topic topic(producer.get(), "spool");
+    int num_accepted = 0;
+    for (int i = 0; i < 100; i++) {
+      string payload = to_string(i);
+      if (spooling.produce(topic, payload) == RD_KAFKA_RESP_ERR_NO_ERROR)
+        ++num_accepted;
+    }
+    check("accepted", num_accepted, 100);
+    check("spooled", spooling.counts().spooled, 90L);
+    check("spooling", spooling.spooling(), true);
+    spooling.poll(0);
+    check("nothing replayed while full", spooling.counts().replayed, 0L);
+
+    rd_kafka_mock_broker_set_up(cluster.get(), 1);
+    check("flush", spooling.flush(30 * 1000), true);
+    check("replayed", spooling.counts().replayed, 90L);
+    check("drained", spooling.numSpooled(), size_t(0));
+    check("not spooling", spooling.spooling(), false);
+  }
+
+  GlobalConf consumer_conf;
+  consumer_conf.put("bootstrap.servers", bootstraps);
+  consumer_conf.put("group.id", "spool-test");
+  consumer_conf.put("enable.auto.commit", "false");
+  Consumer consumer(std::move(consumer_conf), errstr);
+  if (consumer.isNull())
+    error::Exit("[ERROR] Create consumer failed: %s\n", errstr);
+  PointerHolder<rd_kafka_topic_partition_list_t> partitions(
+      rd_kafka_topic_partition_list_new(1));
+  rd_kafka_topic_partition_list_add(partitions.get(), "spool", 0)->offset =
+      RD_KAFKA_OFFSET_BEGINNING;
+  error::checkRespError(rd_kafka_assign(consumer.get(), partitions.get()),
+                        "rd_kafka_assign");
+  int next = 0;
+  bool in_order = true;
+  while (next < 100) {
+    auto message = consumer.consume(5000);
+    if (message.isNull()) break;
+    if (message.hasError()) continue;
+    in_order = in_order && string(message.payload(), message.payloadLen()) ==
+                               to_string(next);
+    ++next;
+  }
+  check("consumed", next, 100);
+  check("consumed in order", in_order, true);
+  consumer.waitUntilRebalanceRevoke();
+
+  removeAll(directory);
+  return test::exitCode();
+}
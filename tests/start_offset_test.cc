@@ -0,0 +1,167 @@
+#include "rdkafka_start_offset.hpp"
+#include "rdkafka_error.hpp"
+#include "test_util.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+using namespace rdkafka;
+using namespace test;
+
+static const char* kTopic = "start-offset";
+static const int kNumPartitions = 4;
+static const int kNumMessages = 100;  // per partition
+static const int64_t kBaseTimestamp = 1600000000000;  // message i at +i s
+
+static StartOffsetPolicy policy;
+static ErrorCode apply_error = RD_KAFKA_RESP_ERR_NO_ERROR;
+
+static void rebalance_cb(rd_kafka_t* rk, rd_kafka_resp_err_t err,
+                         rd_kafka_topic_partition_list_t* partitions, void*) {
+  if (err == RD_KAFKA_RESP_ERR__ASSIGN_PARTITIONS) {
+    apply_error = policy.apply(rk, partitions, 5000);
+    rd_kafka_assign(rk, partitions);
+  } else {
+    rd_kafka_assign(rk, nullptr);
+  }
+}
+
+static PointerHolder<rd_kafka_topic_partition_list_t> partitionList(
+    int32_t partition, int64_t offset) {
+  PointerHolder<rd_kafka_topic_partition_list_t> partitions(
+      rd_kafka_topic_partition_list_new(1));
+  rd_kafka_topic_partition_list_add(partitions.get(), kTopic, partition)
+      ->offset = offset;
+  return partitions;
+}
+
+// the next message of partition, skipping others, -1 if none
+static int64_t nextOffset(const Consumer& consumer, int32_t partition) {
+  for (int i = 0; i < 10 * kNumMessages; i++) {
+    auto message = consumer.consume(2000);
+    if (message.isNull()) return -1;
+    if (!message.hasError() && message.partition() == partition)
+      return message.offset();
+  }
+  return -1;
+}
+
+int main(int argc, char* argv[]) {
+  MockCluster cluster;
+  auto& producer = cluster.producer();
+  cluster.createTopic(kTopic, kNumPartitions);
+  const char* bootstraps = cluster.bootstraps();
+  char errstr[512];
+
+  for (int32_t partition = 0; partition < kNumPartitions; partition++) {
+    for (int i = 0; i < kNumMessages; i++) {
+      string payload = to_string(i);
+      error::checkRespError(
+          rd_kafka_producev(
+              producer.get(), RD_KAFKA_V_TOPIC(kTopic),
+              RD_KAFKA_V_PARTITION(partition),
+              RD_KAFKA_V_MSGFLAGS(RD_KAFKA_MSG_F_COPY),
+              RD_KAFKA_V_VALUE(&payload[0], payload.size()),
+              RD_KAFKA_V_TIMESTAMP(kBaseTimestamp + i * 1000), RD_KAFKA_V_END),
+          "rd_kafka_producev");
+    }
+  }
+  check("flush", producer.flush(10 * 1000), true);
+
+  // partition 0 starts from the committed offset
+  {
+    GlobalConf conf;
+    conf.put("bootstrap.servers", bootstraps);
+    conf.put("group.id", "start-offset-test");
+    Consumer consumer(std::move(conf), errstr);
+    if (consumer.isNull())
+      error::Exit("[ERROR] Create consumer failed: %s\n", errstr);
+    auto committed = partitionList(0, 40);
+    check("commit", rd_kafka_commit(consumer.get(), committed.get(), 0),
+          RD_KAFKA_RESP_ERR_NO_ERROR);
+    consumer.waitUntilRebalanceRevoke();
+  }
+
+  policy = StartOffsetPolicy([](const char*, int32_t partition) {
+    return partition == 3 ? StartOffset::offset(RD_KAFKA_OFFSET_BEGINNING)
+                          : StartOffset::committed();
+  });
+  policy.set(kTopic, StartOffset::latest(10));
+  policy.set(kTopic, 0, StartOffset::committed());
+  policy.set(kTopic, 1, StartOffset::timestamp(kBaseTimestamp + 70 * 1000));
+  policy.set(kTopic, 3, StartOffset::offset(25));
+  check("per partition", static_cast<int>(policy.get(kTopic, 1).kind()),
+        static_cast<int>(StartOffset::Kind::kTimestamp));
+  check("per topic", policy.get(kTopic, 2).value(), int64_t(10));
+  check("rule", static_cast<int>(policy.get("other", 3).kind()),
+        static_cast<int>(StartOffset::Kind::kOffset));
+  check("default", static_cast<int>(policy.get("other", 0).kind()),
+        static_cast<int>(StartOffset::Kind::kCommitted));
+
+  GlobalConf conf;
+  conf.put("bootstrap.servers", bootstraps);
+  conf.put("group.id", "start-offset-test");
+  conf.put("enable.auto.commit", "false");
+  conf.setRebalanceCallback(rebalance_cb);
+  Consumer consumer(std::move(conf), errstr);
+  if (consumer.isNull())
+    error::Exit("[ERROR] Create consumer failed: %s\n", errstr);
+  error::checkRespError(consumer.subscribe({kTopic}), "subscribe");
+
+  // librdkafka's mock cluster finds no message for any timestamp, so
+  // partition 1 starts from the end: wait for the others, then produce to it
+  vector<int64_t> first(kNumPartitions, -1);
+  int num_found = 0;
+  while (num_found < kNumPartitions - 1) {
+    auto message = consumer.consume(5000);
+    if (message.isNull()) break;
+    if (message.hasError()) continue;
+    auto& offset = first[message.partition()];
+    if (offset < 0) {
+      offset = message.offset();
+      ++num_found;
+    }
+  }
+  Topic topic(producer.get(), kTopic);
+  rd_kafka_produce(topic.get(), 1, RD_KAFKA_MSG_F_COPY,
+                   const_cast<char*>("new"), 3, nullptr, 0, nullptr);
+  check("flush new", producer.flush(10 * 1000), true);
+  check("apply", apply_error, RD_KAFKA_RESP_ERR_NO_ERROR);
+  check("committed", first[0], int64_t(40));
+  check("timestamp", nextOffset(consumer, 1), int64_t(kNumMessages));
+  check("latest", first[2], int64_t(90));
+  check("offset", first[3], int64_t(25));
+
+  // a timestamp after every message starts from the end
+  {
+    auto partitions = partitionList(1, RD_KAFKA_OFFSET_INVALID);
+    StartOffsetPolicy after_end(StartOffset::timestamp(kBaseTimestamp * 2));
+    check("apply list", after_end.apply(consumer.get(), partitions.get(), 5000),
+          RD_KAFKA_RESP_ERR_NO_ERROR);
+    check("after end", partitions.get()->elems[0].offset,
+          int64_t(RD_KAFKA_OFFSET_END));
+  }
+
+  // nothing from a paused partition until it's resumed
+  auto paused = partitionList(3, RD_KAFKA_OFFSET_INVALID);
+  check("pause", consumer.pause(paused.get()), RD_KAFKA_RESP_ERR_NO_ERROR);
+  rd_kafka_produce(topic.get(), 3, RD_KAFKA_MSG_F_COPY,
+                   const_cast<char*>("new"), 3, nullptr, 0, nullptr);
+  check("flush while paused", producer.flush(10 * 1000), true);
+
+  // seek partition 0 back, the messages fetched before are dropped
+  check("seek", consumer.seek(kTopic, 0, 10, 5000),
+        RD_KAFKA_RESP_ERR_NO_ERROR);
+  check("after seek", nextOffset(consumer, 0), int64_t(10));
+  check("seek unassigned", consumer.seek("unknown", 0, 10, 5000) ==
+                               RD_KAFKA_RESP_ERR_NO_ERROR,
+        false);
+
+  check("paused", nextOffset(consumer, 3), int64_t(-1));
+  check("resume", consumer.resume(paused.get()), RD_KAFKA_RESP_ERR_NO_ERROR);
+  check("resumed", nextOffset(consumer, 3) > 25, true);
+
+  consumer.waitUntilRebalanceRevoke();
+  return test::exitCode();
+}
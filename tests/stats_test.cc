@@ -0,0 +1,128 @@
+#include "rdkafka_stats.hpp"
+#include "test_util.hpp"
+
+#include <string.h>
+
+#include <iostream>
+using namespace std;
+using namespace test;
+
+// trimmed output of a producer's stats callback
+static const char* kStats1 = R"({
+  "name": "rdkafka#producer-1", "client_id": "rdkafka", "type": "producer",
+  "ts": 1000000, "time": 1700000000, "age": 500000, "replyq": 0,
+  "msg_cnt": 3, "msg_size": 300, "msg_max": 100000, "msg_size_max": 1073741824,
+  "brokers": {
+    "localhost:9092/1": {
+      "name": "localhost:9092/1", "nodeid": 1, "state": "UP",
+      "outbuf_cnt": 0, "waitresp_cnt": 1, "tx": 10, "txbytes": 1000,
+      "rx": 10, "rxbytes": 500, "connects": 1,
+      "rtt": {"min": 100, "max": 900, "avg": 300, "p50": 250, "p99": 850,
+              "cnt": 10},
+      "req": {"Produce": 8, "Metadata": 2},
+      "toppars": {"test-0": {"topic": "test", "partition": 0}}
+    }
+  },
+  "topics": {
+    "test": {
+      "topic": "test", "age": 400, "metadata_age": 300,
+      "batchsize": {"min": 99, "max": 5000, "avg": 1000.5, "cnt": 4},
+      "partitions": {
+        "0": {"partition": 0, "leader": 1, "desired": false,
+              "fetch_state": "none", "msgq_cnt": 3, "txmsgs": 40,
+              "txbytes": 4000, "consumer_lag": -1},
+        "-1": {"partition": -1, "leader": -1, "msgq_cnt": 0, "txmsgs": 0}
+      }
+    }
+  },
+  "tx": 10, "tx_bytes": 1000, "rx": 10, "rx_bytes": 500,
+  "txmsgs": 40, "txmsg_bytes": 4000, "rxmsgs": 0, "rxmsg_bytes": 0
+})";
+
+// one second later
+static const char* kStats2 = R"({
+  "name": "rdkafka#producer-1", "type": "producer", "ts": 2000000,
+  "brokers": {
+    "localhost:9092/1": {"name": "localhost:9092/1", "nodeid": 1,
+                         "state": "UP", "tx": 30, "txbytes": 3000}
+  },
+  "topics": {
+    "test": {"topic": "test", "partitions": {
+      "0": {"partition": 0, "txmsgs": 140, "txbytes": 14000},
+      "-1": {"partition": -1}
+    }}
+  },
+  "tx": 30, "tx_bytes": 3000, "txmsgs": 140, "txmsg_bytes": 14000
+})";
+
+int main(int argc, char* argv[]) {
+  rdkafka::StatsSnapshot prev;
+  check("parse", prev.parse(kStats1, strlen(kStats1)), true);
+  check("name", prev.name, string("rdkafka#producer-1"));
+  check("type", prev.type, string("producer"));
+  check("ts", prev.ts, int64_t(1000000));
+  check("msg_cnt", prev.msg_cnt, int64_t(3));
+  check("msg_size_max", prev.msg_size_max, int64_t(1073741824));
+  check("txmsgs", prev.txmsgs, int64_t(40));
+
+  check("brokers.size", prev.brokers.size(), size_t(1));
+  auto broker = prev.findBroker("localhost:9092/1");
+  check("findBroker", broker != nullptr, true);
+  if (broker) {
+    check("broker.state", broker->state, string("UP"));
+    check("broker.nodeid", broker->nodeid, int64_t(1));
+    check("broker.waitresp_cnt", broker->waitresp_cnt, int64_t(1));
+    check("broker.rtt.p99", broker->rtt.p99, int64_t(850));
+    check("broker.rtt.cnt", broker->rtt.cnt, int64_t(10));
+  }
+
+  check("topics.size", prev.topics.size(), size_t(1));
+  auto topic = prev.findTopic("test");
+  check("findTopic", topic != nullptr, true);
+  if (topic) {
+    check("topic.metadata_age", topic->metadata_age, int64_t(300));
+    check("topic.batchsize.avg", topic->batchsize.avg, int64_t(1000));
+    check("topic.partitions.size", topic->partitions.size(), size_t(2));
+    check("partition[0].msgq_cnt", topic->partitions[0].msgq_cnt, int64_t(3));
+    check("partition[0].consumer_lag", topic->partitions[0].consumer_lag,
+          int64_t(-1));
+    check("partition[1].partition", topic->partitions[1].partition,
+          int64_t(-1));
+  }
+
+  // parse into a used snapshot, fields missing from kStats2 are reset
+  rdkafka::StatsSnapshot cur = prev;
+  check("reparse", cur.parse(kStats2, strlen(kStats2)), true);
+  check("reparse msg_cnt", cur.msg_cnt, int64_t(0));
+  check("reparse broker.waitresp_cnt", cur.brokers[0].waitresp_cnt,
+        int64_t(0));
+  check("reparse broker.rtt.p99", cur.brokers[0].rtt.p99, int64_t(0));
+  check("reparse partition[0].txmsgs", cur.topics[0].partitions[0].txmsgs,
+        int64_t(140));
+
+  // rates are whole numbers here
+  rdkafka::StatsRates rates;
+  check("compute", rates.compute(prev, cur), true);
+  check("rates.seconds", int64_t(rates.seconds), int64_t(1));
+  check("rates.txmsgs", int64_t(rates.txmsgs), int64_t(100));
+  check("rates.brokers[0].tx", int64_t(rates.brokers[0].tx), int64_t(20));
+  check("rates.partitions.size", rates.partitions.size(), size_t(2));
+  check("rates.partitions[0].txbytes", int64_t(rates.partitions[0].txbytes),
+        int64_t(10000));
+  check("compute backwards", rates.compute(cur, prev), false);
+
+  // a recycled entry doesn't keep the values of keys missing from the update
+  const char* sparse = R"({"brokers": {"localhost:9092/1": {"nodeid": 1}},
+                           "topics": {"test": {"topic": "test"}}})";
+  check("sparse", cur.parse(sparse, strlen(sparse)), true);
+  check("sparse broker.state", cur.brokers[0].state, string());
+  check("sparse topic.partitions.size", cur.topics[0].partitions.size(),
+        size_t(0));
+
+  const char* malformed = R"({"name": "x", "brokers": {"b": {"tx": 1)";
+  check("parse malformed", cur.parse(malformed, strlen(malformed)), false);
+  check("empty object", cur.parse("{}", 2), true);
+  check("empty object brokers.size", cur.brokers.size(), size_t(0));
+
+  return test::exitCode();
+}
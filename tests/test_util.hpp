@@ -0,0 +1,87 @@
+// test_util.hpp: shared helpers of tests
+#pragma once
+
+#include "rdkafka_classes.hpp"
+#include "rdkafka_error.hpp"
+#include "rdkafka_mock.h"
+
+#include <iostream>
+#include <string>
+
+namespace test {
+
+inline int& numFailed() noexcept {
+  static int num_failed = 0;
+  return num_failed;
+}
+
+// return it from main()
+inline int exitCode() noexcept { return numFailed() == 0 ? 0 : 1; }
+
+template <typename T>
+void check(const char* name, const T& actual, const T& expected) {
+  if (actual == expected) {
+    std::cout << "[OK] " << name << "=" << actual << std::endl;
+  } else {
+    std::cerr << "[FAILED] " << name << "=" << actual << ", expected "
+              << expected << std::endl;
+    ++numFailed();
+  }
+}
+
+// strings compared with literals
+inline void check(const char* name, const std::string& actual,
+                  const std::string& expected) {
+  check<std::string>(name, actual, expected);
+}
+
+// literals are compared as strings, not as addresses
+inline void check(const char* name, const char* actual, const char* expected) {
+  check<std::string>(name, actual ? actual : "(null)",
+                     expected ? expected : "(null)");
+}
+
+// Producer with its own mock cluster, conf may set other producer properties.
+// Consumers join the cluster with bootstraps().
+class MockCluster {
+ public:
+  explicit MockCluster(int num_brokers = 1,
+                       rdkafka::GlobalConf conf = rdkafka::GlobalConf())
+      : producer_(mockConf(std::move(conf), num_brokers), errstr_) {
+    if (producer_.isNull())
+      rdkafka::error::Exit("[ERROR] Create producer failed: %s\n", errstr_);
+    mcluster_ = rd_kafka_handle_mock_cluster(producer_.get());
+  }
+
+  MockCluster(const MockCluster&) = delete;
+  MockCluster& operator=(const MockCluster&) = delete;
+
+  rdkafka::Producer& producer() noexcept { return producer_; }
+
+  rd_kafka_mock_cluster_t* get() const noexcept { return mcluster_; }
+
+  const char* bootstraps() const noexcept {
+    return rd_kafka_mock_cluster_bootstraps(mcluster_);
+  }
+
+  void createTopic(const char* topic_name, int partition_count,
+                   int replication_factor = 1) const {
+    rdkafka::error::checkRespError(
+        rd_kafka_mock_topic_create(mcluster_, topic_name, partition_count,
+                                   replication_factor),
+        "rd_kafka_mock_topic_create");
+  }
+
+ private:
+  char errstr_[512];
+  rdkafka::Producer producer_;
+  rd_kafka_mock_cluster_t* mcluster_;
+
+  static rdkafka::GlobalConf mockConf(rdkafka::GlobalConf conf,
+                                      int num_brokers) {
+    conf.put("test.mock.num.brokers", std::to_string(num_brokers).data());
+    return conf;
+  }
+};
+
+}  // namespace test
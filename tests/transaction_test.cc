@@ -0,0 +1,166 @@
+#include "rdkafka_transaction.hpp"
+#include "rdkafka_error.hpp"
+#include "test_util.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+using namespace rdkafka;
+using namespace test;
+
+static Consumer* newConsumer(const char* bootstraps, const char* group) {
+  GlobalConf conf;
+  conf.put("bootstrap.servers", bootstraps);
+  conf.put("group.id", group);
+  conf.put("auto.offset.reset", "earliest");
+  conf.put("enable.auto.commit", "false");
+  conf.put("isolation.level", "read_committed");
+  char errstr[512];
+  auto consumer = new Consumer(std::move(conf), errstr);
+  if (consumer->isNull())
+    error::Exit("[ERROR] Create consumer failed: %s\n", errstr);
+  return consumer;
+}
+
+static void assign(const Consumer& consumer, const char* topic,
+                   int64_t offset) {
+  PointerHolder<rd_kafka_topic_partition_list_t> partitions(
+      rd_kafka_topic_partition_list_new(1));
+  rd_kafka_topic_partition_list_add(partitions.get(), topic, 0)->offset =
+      offset;
+  error::checkRespError(rd_kafka_assign(consumer.get(), partitions.get()),
+                        "rd_kafka_assign");
+}
+
+// committed messages of topic's partition 0
+static vector<string> readCommitted(const char* bootstraps,
+                                    const char* topic) {
+  unique_ptr<Consumer> consumer(newConsumer(bootstraps, "reader"));
+  assign(*consumer, topic, RD_KAFKA_OFFSET_BEGINNING);
+  vector<string> payloads;
+  while (true) {
+    auto message = consumer->consume(2000);
+    if (message.isNull()) break;  // nothing more within 2s
+    if (message.hasError()) continue;
+    payloads.emplace_back(message.payload(), message.payloadLen());
+  }
+  return payloads;
+}
+
+int main(int argc, char* argv[]) {
+  GlobalConf conf;
+  conf.put("transactional.id", "transaction-test");
+  MockCluster cluster(3, std::move(conf));
+  auto& producer = cluster.producer();
+  check("transactional is idempotent", producer.isIdempotent(), true);
+  cluster.createTopic("txn-in", 1, 3);
+  cluster.createTopic("txn-out", 1, 3);
+  cluster.createTopic("txn-multi-out", 1, 3);
+  const char* bootstraps = cluster.bootstraps();
+  char errstr[512];
+
+  // 10 inputs, written by a plain producer
+  {
+    GlobalConf input_conf;
+    input_conf.put("bootstrap.servers", bootstraps);
+    Producer input_producer(std::move(input_conf), errstr);
+    Topic topic(input_producer.get(), "txn-in");
+    for (int i = 0; i < 10; i++) {
+      string payload = "input-" + to_string(i);
+      input_producer.produceCopy(topic, Slice(payload.data(), payload.size()));
+    }
+    input_producer.flush(10 * 1000);
+  }
+
+  unique_ptr<Consumer> consumer(newConsumer(bootstraps, "transformer"));
+  assign(*consumer, "txn-in", RD_KAFKA_OFFSET_BEGINNING);
+
+  TransactionOptions options;
+  options.max_records = 4;
+  options.max_duration = std::chrono::milliseconds(60 * 1000);
+  options.timeout_ms = 10000;
+  TransactionalProducer txn(producer, consumer->get(), options);
+  check("init", string(txn.init().str()), string("Success"));
+
+  // transform: upper case, committed every 4 records
+  Topic output(producer.get(), "txn-out");
+  int num_inputs = 0;
+  while (num_inputs < 10) {
+    auto message = consumer->consume(1000);
+    if (message.isNull() || message.hasError()) continue;
+    string payload(message.payload(), message.payloadLen());
+    for (auto& c : payload) c = static_cast<char>(toupper(c));
+    check("produce", txn.produce(output, Slice(payload.data(), payload.size())),
+          RD_KAFKA_RESP_ERR_NO_ERROR);
+    check("consumed", string(txn.consumed(message).str()), string("Success"));
+    ++num_inputs;
+  }
+  check("commit", string(txn.commit().str()), string("Success"));
+  // 2 due after the 4th and 8th inputs, plus the final one
+  check("transactions", txn.counts().committed, 3L);
+  check("records", txn.counts().records, 10L);
+  // the mock cluster accepts TxnOffsetCommit but doesn't store the offsets,
+  // so the committed input offsets can't be checked here
+
+  auto outputs = readCommitted(bootstraps, "txn-out");
+  check("outputs", outputs.size(), size_t(10));
+  check("first output", outputs.empty() ? string() : outputs[0],
+        string("INPUT-0"));
+
+  // an aborted transaction is never read and its inputs are consumed again
+  assign(*consumer, "txn-in", 7);
+  int64_t first_offset = -1;
+  for (int i = 0; i < 3;) {
+    auto message = consumer->consume(1000);
+    if (message.isNull() || message.hasError()) continue;
+    if (first_offset < 0) first_offset = message.offset();
+    txn.produce(output, Slice("aborted", 7));
+    txn.consumed(message);
+    i++;
+  }
+  check("first aborted input", first_offset, int64_t(7));
+  check("abort", string(txn.abort().str()), string("Success"));
+  check("aborted", txn.counts().aborted, 1L);
+  check("in transaction", txn.inTransaction(), false);
+  check("outputs after abort", readCommitted(bootstraps, "txn-out").size(),
+        size_t(10));
+  auto message = consumer->consume(5000);
+  check("rewound", message.isNull() ? int64_t(-1) : message.offset(),
+        int64_t(7));
+
+
+  // inputs of two outputs with max_records=1: the transaction is due after
+  // the first output but only committed after the input, with both outputs
+  TransactionOptions multi_options = options;
+  multi_options.max_records = 1;
+  TransactionalProducer multi_txn(producer, consumer->get(), multi_options);
+  Topic multi_output(producer.get(), "txn-multi-out");
+  assign(*consumer, "txn-in", 0);
+  bool split = false;
+  for (int i = 0; i < 3;) {
+    auto message = consumer->consume(1000);
+    if (message.isNull() || message.hasError()) continue;
+    string payload(message.payload(), message.payloadLen());
+    for (int j = 0; j < 2; j++) {
+      multi_txn.produce(multi_output,
+                        Slice(payload.data(), payload.size()));
+      if (multi_txn.numRecords() != j + 1) split = true;
+    }
+    check("multi consumed", string(multi_txn.consumed(message).str()),
+          string("Success"));
+    i++;
+  }
+  check("multi split", split, false);
+  check("multi transactions", multi_txn.counts().committed, 3L);
+  check("multi records", multi_txn.counts().records, 6L);
+  auto multi_outputs = readCommitted(bootstraps, "txn-multi-out");
+  check("multi outputs", multi_outputs.size(), size_t(6));
+  bool paired = multi_outputs.size() == 6;
+  for (size_t i = 0; paired && i < multi_outputs.size(); i += 2)
+    paired = multi_outputs[i] == multi_outputs[i + 1];
+  check("multi paired", paired, true);
+
+  consumer->waitUntilRebalanceRevoke();
+  return test::exitCode();
+}
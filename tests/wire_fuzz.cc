@@ -0,0 +1,137 @@
+// wire_fuzz.cc: fuzz target of rdkafka_wire.hpp's consumer protocol decoders.
+//
+// Decoding must never crash, read out of range or take more than an element
+// per input byte from the arena, and what's decoded must encode back to data
+// that decodes to the same encoding.
+//
+// `make fuzz` builds it with clang's libFuzzer. Without libFuzzer main()
+// mutates valid encodings with a fixed seed, so it runs with the other tests:
+//   ./wire_fuzz.out [iterations]
+#include "rdkafka_wire.hpp"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <random>
+#include <string>
+#include <vector>
+using namespace rdkafka;
+
+static void fail(const char* what, const uint8_t* data, size_t size) {
+  fprintf(stderr, "[FAILED] %s, input of %zu bytes:", what, size);
+  for (size_t i = 0; i < size; i++) fprintf(stderr, " %02x", data[i]);
+  fprintf(stderr, "\n");
+  abort();
+}
+
+template <typename T, typename Decode, typename Encode>
+static void roundTrip(const uint8_t* data, size_t size, Decode decode,
+                      Encode encode) {
+  Slice input(data, size);
+  WireArena arena(256);
+  T decoded;
+  if (!decode(input, arena, &decoded)) return;
+
+  // every element takes at least a byte of input, chunks may be half empty
+  if (arena.numChunks() > 1 + 2 * size * sizeof(TopicPartitions) / 256)
+    fail("arena grew beyond the input", data, size);
+
+  std::string encoded;
+  WireWriter writer(encoded);
+  encode(decoded, writer);
+  T decoded_again;
+  if (!decode(encoded, arena, &decoded_again))
+    fail("re-encoded data doesn't decode", data, size);
+  std::string encoded_again;
+  WireWriter writer_again(encoded_again);
+  encode(decoded_again, writer_again);
+  if (encoded != encoded_again) fail("round trip changed data", data, size);
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  roundTrip<ConsumerProtocolSubscription>(
+      data, size, decodeSubscription,
+      [](const ConsumerProtocolSubscription& s, WireWriter& w) {
+        encodeSubscription(s, w);
+      });
+  roundTrip<ConsumerProtocolAssignment>(
+      data, size, decodeAssignment,
+      [](const ConsumerProtocolAssignment& a, WireWriter& w) {
+        encodeAssignment(a, w);
+      });
+  return 0;
+}
+
+#ifndef RDKAFKA_LIBFUZZER
+
+static std::vector<std::string> seeds() {
+  const int32_t partitions[] = {0, 1, 2, 3};
+  const TopicPartitions topic_partitions[] = {
+      {"topic-a", ArrayView<int32_t>(partitions, 4)},
+      {"topic-b", ArrayView<int32_t>(partitions, 1)}};
+  const Slice topics[] = {"topic-a", "topic-b"};
+
+  std::vector<std::string> result;
+  for (int16_t version = 0; version <= 3; version++) {
+    ConsumerProtocolSubscription subscription;
+    subscription.version = version;
+    subscription.topics = ArrayView<Slice>(topics, 2);
+    subscription.user_data = "user-data";
+    subscription.owned_partitions =
+        ArrayView<TopicPartitions>(topic_partitions, 2);
+    subscription.generation_id = 42;
+    subscription.rack_id = "rack";
+    result.emplace_back();
+    WireWriter writer(result.back());
+    encodeSubscription(subscription, writer);
+
+    ConsumerProtocolAssignment assignment;
+    assignment.version = version;
+    assignment.assigned_partitions =
+        ArrayView<TopicPartitions>(topic_partitions, 2);
+    result.emplace_back();
+    WireWriter assignment_writer(result.back());
+    encodeAssignment(assignment, assignment_writer);
+  }
+  return result;
+}
+
+int main(int argc, char* argv[]) {
+  long iterations = (argc > 1) ? atol(argv[1]) : 200000;
+  auto inputs = seeds();
+  std::mt19937 rng(20240601);
+  std::string input;
+  for (long i = 0; i < iterations; i++) {
+    input = inputs[rng() % inputs.size()];
+    int num_mutations = 1 + rng() % 4;
+    for (int j = 0; j < num_mutations && !input.empty(); j++) {
+      size_t pos = rng() % input.size();
+      switch (rng() % 5) {
+        case 0:  // flip a bit
+          input[pos] = static_cast<char>(input[pos] ^ (1 << (rng() % 8)));
+          break;
+        case 1:  // length fields become huge or negative
+          input[pos] = static_cast<char>(0xff);
+          break;
+        case 2:
+          input.resize(pos);
+          break;
+        case 3:
+          input.insert(pos, 1, static_cast<char>(rng()));
+          break;
+        case 4:
+          input.erase(pos, 1);
+          break;
+      }
+    }
+    // a copy of exactly the input's size, so out-of-range reads are caught
+    // by sanitizers
+    std::vector<uint8_t> data(input.begin(), input.end());
+    LLVMFuzzerTestOneInput(data.data(), data.size());
+  }
+  printf("[OK] %ld mutated inputs\n", iterations);
+  return 0;
+}
+
+#endif  // RDKAFKA_LIBFUZZER
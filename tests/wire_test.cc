@@ -0,0 +1,180 @@
+#include "rdkafka_wire.hpp"
+#include "test_util.hpp"
+
+#include <stdint.h>
+
+#include <iostream>
+#include <string>
+using namespace std;
+using namespace rdkafka;
+using namespace test;
+
+static string hex(const string& bytes) {
+  static const char kDigits[] = "0123456789abcdef";
+  string s;
+  for (char c : bytes) {
+    s += kDigits[static_cast<uint8_t>(c) >> 4];
+    s += kDigits[static_cast<uint8_t>(c) & 0xf];
+  }
+  return s;
+}
+
+static void testPrimitives() {
+  string buf;
+  WireWriter writer(buf);
+  writer.writeInt8(-1);
+  writer.writeInt16(0x0102);
+  writer.writeInt32(-2);
+  writer.writeInt64(0x0102030405060708LL);
+  writer.writeUnsignedVarint(300);
+  writer.writeVarint(-1);
+  writer.writeVarlong(INT64_MIN);
+  writer.writeString("abc");
+  writer.writeString(Slice());
+  writer.writeCompactString("de");
+  writer.writeCompactString(Slice());
+  writer.writeBytes("");
+  writer.writeCompactArrayLength(1);
+  writer.writeEmptyTaggedFields();
+  check("writer ok", writer.ok(), true);
+  check("hex", hex(buf),
+        string("ff0102fffffffe0102030405060708ac0201ffffffffffffffffff01"
+               "0003616263ffff03646500000000000200"));
+
+  WireReader reader(buf);
+  check("int8", static_cast<int>(reader.readInt8()), -1);
+  check("int16", reader.readInt16(), static_cast<int16_t>(0x0102));
+  check("int32", reader.readInt32(), -2);
+  check("int64", reader.readInt64(),
+        static_cast<int64_t>(0x0102030405060708LL));
+  check("unsigned varint", reader.readUnsignedVarint(), 300u);
+  check("varint", reader.readVarint(), -1);
+  check("varlong", reader.readVarlong(), static_cast<int64_t>(INT64_MIN));
+  check("string", reader.readString().toString(), string("abc"));
+  check("null string", reader.readString().data() == nullptr, true);
+  check("compact string", reader.readCompactString().toString(),
+        string("de"));
+  check("null compact string", reader.readCompactString().data() == nullptr,
+        true);
+  Slice empty = reader.readBytes();
+  check("empty bytes", empty.data() != nullptr && empty.empty(), true);
+  check("compact array length", reader.readCompactArrayLength(), 1);
+  reader.skipTaggedFields();
+  check("reader ok", reader.ok(), true);
+  check("remaining", reader.remaining(), static_cast<size_t>(0));
+
+  // out of range reads fail without aborting, later reads return zeros
+  reader.readInt32();
+  check("read past end", reader.ok(), false);
+  check("read after failure", reader.readInt16(), static_cast<int16_t>(0));
+
+  // an array longer than its data must not be allocated
+  string huge_array;
+  WireWriter(huge_array).writeArrayLength(INT32_MAX);
+  WireReader huge_reader(huge_array);
+  check("huge array length", huge_reader.readArrayLength(), -1);
+  check("huge array", huge_reader.ok(), false);
+
+  string long_varint(6, '\xff');
+  WireReader varint_reader(long_varint);
+  varint_reader.readUnsignedVarint();
+  check("too long varint", varint_reader.ok(), false);
+}
+
+static void testConsumerProtocol() {
+  WireArena arena;
+  const int32_t partitions[] = {0, 2, 5};
+  const TopicPartitions owned[] = {
+      {"topic-a", ArrayView<int32_t>(partitions, 3)},
+      {"topic-b", ArrayView<int32_t>(partitions, 0)}};
+  const Slice topics[] = {"topic-a", "topic-b"};
+
+  ConsumerProtocolSubscription subscription;
+  subscription.version = 3;
+  subscription.topics = ArrayView<Slice>(topics, 2);
+  subscription.user_data = "user";
+  subscription.owned_partitions = ArrayView<TopicPartitions>(owned, 2);
+  subscription.generation_id = 7;
+  subscription.rack_id = "rack-1";
+
+  string buf;
+  WireWriter writer(buf);
+  encodeSubscription(subscription, writer);
+
+  ConsumerProtocolSubscription decoded;
+  bool ok = decodeSubscription(buf, arena, &decoded);
+  check("decodeSubscription", ok, true);
+  check("version", decoded.version, static_cast<int16_t>(3));
+  check("topics", decoded.topics.size(), static_cast<size_t>(2));
+  check("topics[1]", decoded.topics[1].toString(), string("topic-b"));
+  check("user_data", decoded.user_data.toString(), string("user"));
+  check("owned topic", decoded.owned_partitions[0].topic.toString(),
+        string("topic-a"));
+  check("owned partitions[2]", decoded.owned_partitions[0].partitions[2], 5);
+  check("empty owned partitions",
+        decoded.owned_partitions[1].partitions.empty() &&
+            !decoded.owned_partitions[1].partitions.isNull(),
+        true);
+  check("generation_id", decoded.generation_id, 7);
+  check("rack_id", decoded.rack_id.toString(), string("rack-1"));
+  check("zero-copy topic", decoded.topics[0].data() > buf.data(), true);
+
+  // every truncation of valid data is rejected
+  int num_accepted = 0;
+  for (size_t n = 0; n < buf.size(); n++) {
+    arena.reset();
+    if (decodeSubscription(Slice(buf.data(), n), arena, &decoded))
+      ++num_accepted;
+  }
+  check("truncated subscriptions accepted", num_accepted, 0);
+
+  ConsumerProtocolAssignment assignment;
+  assignment.version = 1;
+  assignment.assigned_partitions = ArrayView<TopicPartitions>(owned, 1);
+  buf.clear();
+  encodeAssignment(assignment, writer);
+  // a newer version with more fields is decoded as the known ones
+  buf.append("extra");
+
+  arena.reset();
+  ConsumerProtocolAssignment decoded_assignment;
+  ok = decodeAssignment(buf, arena, &decoded_assignment);
+  check("decodeAssignment", ok, true);
+  check("assigned topic",
+        decoded_assignment.assigned_partitions[0].topic.toString(),
+        string("topic-a"));
+  check("assigned partitions",
+        decoded_assignment.assigned_partitions[0].partitions.size(),
+        static_cast<size_t>(3));
+  check("null user_data", decoded_assignment.user_data.data() == nullptr,
+        true);
+
+  // null arrays stay null, empty ones empty
+  const TopicPartitions null_partitions[] = {{"topic-c", ArrayView<int32_t>()}};
+  ConsumerProtocolSubscription null_subscription;
+  null_subscription.version = 1;
+  null_subscription.owned_partitions =
+      ArrayView<TopicPartitions>(null_partitions, 1);
+  buf.clear();
+  encodeSubscription(null_subscription, writer);
+  arena.reset();
+  ok = decodeSubscription(buf, arena, &decoded);
+  check("decode null arrays", ok, true);
+  check("null topics", decoded.topics.isNull(), true);
+  check("null owned partitions",
+        ok && decoded.owned_partitions[0].partitions.isNull(), true);
+
+  assignment.assigned_partitions = ArrayView<TopicPartitions>();
+  buf.clear();
+  encodeAssignment(assignment, writer);
+  arena.reset();
+  ok = decodeAssignment(buf, arena, &decoded_assignment);
+  check("null assigned partitions",
+        ok && decoded_assignment.assigned_partitions.isNull(), true);
+}
+
+int main(int argc, char* argv[]) {
+  testPrimitives();
+  testConsumerProtocol();
+  return test::exitCode();
+}